@@ -35,6 +35,7 @@
 
 #include <esp8266_device_framework.h>       // Required by the ESP compiler framework.
 
+#include <grmcdorman/device/BootSequence.h>
 #include <grmcdorman/device/ConfigFile.h>
 
 #include <grmcdorman/device/MqttPublisher.h>
@@ -114,10 +115,11 @@ void setup() {
     Serial.print("WiFi SSID is ");
     Serial.println(wifi_setup.get("ssid"));
 
+    // Set up the devices in boot phase order: WiFi first, so that it associates
+    // while the sensors take their first readings.
+    ::grmcdorman::device::BootSequence::setup_devices(devices);
     for (auto &device : devices)
     {
-        device->setup();
-        device->set_devices(devices);
         webServer.add_setting_set(device->name(), device->identifier(), device->get_settings());
     }
 
@@ -44,10 +44,13 @@
 
 #include <esp8266_device_framework.h>       // Required by the ESP compiler framework.
 
+#include <grmcdorman/device/BootSequence.h>
 #include <grmcdorman/device/ConfigFile.h>
 
 #include <grmcdorman/device/MqttPublisher.h>
+#include <grmcdorman/device/DerivedSensor.h>
 #include <grmcdorman/device/DhtSensor.h>
+#include <grmcdorman/device/ReadingBus.h>
 #include <grmcdorman/device/WifiSetup.h>
 
 // Global constant strings.
@@ -83,6 +86,25 @@ static ::grmcdorman::device::DhtSensor dht_sensor;
 // This uses the default WiFiClient for communications.
 static ::grmcdorman::device::MqttPublisher mqtt_publisher(FPSTR(manufacturer), FPSTR(model), FPSTR(software_version));
 
+// A dew point computed from the DHT readings; it is published like any other sensor.
+static const char dew_point_name_suffix[] PROGMEM = " Dew Point";
+static const char dew_point_unique_id_suffix[] PROGMEM = "_dew_point";
+static const char celsius_units[] PROGMEM = "°C";
+static const char dew_point_icon[] PROGMEM = "mdi:water";
+static const char dew_point_field[] PROGMEM = "dew_point";
+static const char dew_point_name[] PROGMEM = "Dew Point";
+static const char dew_point_identifier[] PROGMEM = "dew_point";
+constexpr ::grmcdorman::device::Device::Definition dew_point_definition PROGMEM
+{
+    dew_point_name_suffix, dew_point_unique_id_suffix, celsius_units, dew_point_icon,
+    dew_point_field, ::grmcdorman::device::Device::Definition::Layout::VALUE, nullptr, 0.1f
+};
+static ::grmcdorman::device::DerivedSensor dew_point(FPSTR(dew_point_name), FPSTR(dew_point_identifier), &dew_point_definition, {&dht_sensor}, [] (float &value)
+{
+    value = ::grmcdorman::device::DerivedSensor::dew_point(dht_sensor.get_temperature(), dht_sensor.get_humidity());
+    return true;
+});
+
 // This should be adjusted as per your LCD, or you can create configurable settings.
 static LiquidCrystal_I2C lcd(0x27, 16, 2);
 
@@ -92,6 +114,7 @@ static Ticker lcd_update_ticker;
 static std::vector<grmcdorman::device::Device *> devices
 {
     &dht_sensor,
+    &dew_point,
     &wifi_setup,
     &mqtt_publisher
 };
@@ -155,21 +178,31 @@ void setup() {
     lcd.setCursor(0, 0);
     lcd.print("WiFi Connecting");
 
-    // At the moment there is no 'read' callback for the device; instead this will simply use a
-    // Ticker to update the LCD every so often.
-    lcd_update_ticker.attach_scheduled(5, [] {
+    // The readings are shown when there are new ones: the dew point is derived from each
+    // new DHT reading, so the line is redrawn when the dew point changes.
+    ::grmcdorman::device::ReadingBus::subscribe([] (const ::grmcdorman::device::Device &device) {
+        if (&device != &dew_point)
+        {
+            return;
+        }
         lcd.setCursor(0, 1);
         size_t col = 0;
-        col += lcd.print(dht_sensor.get_temperature());
+        col += lcd.print(dht_sensor.get_temperature(), 1);
         col += lcd.print('\01');
         col += lcd.print(' ');
-        col += lcd.print(dht_sensor.get_humidity());
+        col += lcd.print(dht_sensor.get_humidity(), 0);
         col += lcd.print('%');
+        col += lcd.print(' ');
+        col += lcd.print(dew_point.get_value(), 1);
+        col += lcd.print('\01');
         // Fill with spaces to the end of the 16 columns.
         while (col < 16)
         {
             col += lcd.print(' ');
         }
+    });
+    // The WiFi state is not a reading; it is checked every so often.
+    lcd_update_ticker.attach_scheduled(5, [] {
         lcd_report_wifi();
     });
 
@@ -199,10 +232,11 @@ void setup() {
     Serial.print("WiFi SSID is ");
     Serial.println(wifi_setup.get("ssid"));
 
+    // Set up the devices in boot phase order: WiFi first, so that it associates
+    // while the sensors take their first readings.
+    ::grmcdorman::device::BootSequence::setup_devices(devices);
     for (auto &device : devices)
     {
-        device->setup();
-        device->set_devices(devices);
         webServer.add_setting_set(device->name(), device->identifier(), device->get_settings());
     }
 
@@ -35,6 +35,9 @@
  * and the WiFi setup response will be like:
  * `{"wifi_setup":{"enabled":true,"ssid":"myap","ip":"192.168.213.48","rssi":-46}}`.
  *
+ * New DHT readings are also pushed to http://_your device ip_/rest/events, as server-sent events like:
+ * `{"dht_temperature":23.6,"dht_humidity":41.2}`
+ *
  * The DHT can be configured as a DHT11 or DTH22; the default is a DHT11.
  */
 
@@ -47,6 +50,7 @@
 
 #include <esp8266_device_framework.h>       // Required by the ESP compiler framework.
 
+#include <grmcdorman/device/BootSequence.h>
 #include <grmcdorman/device/ConfigFile.h>
 
 #include <grmcdorman/device/SystemDetailsDisplay.h>
@@ -129,14 +133,16 @@ void setup() {
     Serial.print("WiFi SSID is ");
     Serial.println(wifi_setup.get("ssid"));
 
+    // Set up the devices in boot phase order: WiFi first, so that it associates
+    // while the sensors take their first readings.
+    ::grmcdorman::device::BootSequence::setup_devices(devices);
     for (auto &device : devices)
     {
-        device->setup();
-        device->set_devices(devices);
         webServer.add_setting_set(device->name(), device->identifier(), device->get_settings());
     }
 
     rest_api.setup(webServer.get_server(), devices);
+    rest_api.setup_events(webServer.get_server(), devices);
 
     webServer.setup(on_save, on_restart, on_factory_reset);
 
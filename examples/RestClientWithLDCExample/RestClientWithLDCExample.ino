@@ -34,8 +34,11 @@
  * for entering a WiFi access point name and password, and the IP address
  * (or host name) of your ESP8266-modified Vindriktning.
  *
- * If the target does not have a Vindriktning, or does not have a SHT31-D, the
- * associated entries will show F:404 (i.e. not found).
+ * The readings are mirrored with a `RemoteDevice`, which keeps one connection to
+ * the server's event stream; the server must call `rest_api.setup_events`. If the
+ * server does not have the event stream, the entries show F:404 (i.e. not found);
+ * if it does not have a Vindriktning, or does not have a SHT31-D, the associated
+ * entries show "--".
  *
  * Additional libraries required:
  *  - LiquidCrystal_I2C
@@ -45,14 +48,15 @@
 #include <LiquidCrystal_I2C.h>
 #include <ArduinoJson.h>
 #include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
-#include <WiFiClient.h>
 #include <Ticker.h>
 #include <DNSServer.h>
 #include <LittleFS.h>
 
 #include <esp8266_web_settings.h>
 
+#include <esp8266_device_framework.h>       // Required by the ESP compiler framework.
+#include <grmcdorman/device/RemoteDevice.h>
+
 // Forward declarations
 static void wifi_setup();
 static std::optional<DynamicJsonDocument> LoadConfig();
@@ -79,10 +83,10 @@ static ::grmcdorman::SettingInterface::settings_list_t
 static const char config_path[] PROGMEM = "/config.json";
 
 static LiquidCrystal_I2C lcd(0x27, 16, 2);
-static WiFiClient wifi_client;
-static HTTPClient http_client;
-static Ticker update_pm25_timer;
-static Ticker update_temperature_timer;
+static ::grmcdorman::device::RemoteDevice remote;
+static size_t temperature_index;
+static size_t humidity_index;
+static size_t pm25_index;
 static Ticker update_time_timer;
 static Ticker backlight_timer;
 static std::unique_ptr<DNSServer> dns_server;   //!< The DNS server for SoftAP mode.
@@ -124,6 +128,7 @@ static byte degree[] = {
 
 static void update_pm25();
 static void update_temperature();
+static void print_status(size_t col, size_t end_col);
 static void update_time();
 static void backlight_off();
 
@@ -165,11 +170,13 @@ void setup()
     web_settings.setup(on_save, nullptr, nullptr);
 
 
-    update_pm25_timer.attach_scheduled(23, update_pm25);
-    update_temperature_timer.attach_scheduled(11, update_temperature);
+    temperature_index = remote.add_sensor(F("sht31d_temperature"));
+    humidity_index = remote.add_sensor(F("sht31d_humidity"));
+    pm25_index = remote.add_sensor(F("pm25"));
+    remote.set_server(server_address.get());
+
     update_time_timer.attach_scheduled(30, update_time);
     backlight_timer.attach_scheduled(30, backlight_off);
-    http_client.setTimeout(5000);   // Timeout is in milliseconds.
 }
 
 void loop()
@@ -183,6 +190,19 @@ void loop()
     // Not presently essential; might be needed in future.
     web_settings.loop();
 
+    // Reads whatever has arrived; never waits for the server.
+    remote.loop();
+    static uint32_t shown_generation = 0;
+    static int shown_status = 0;
+    if (WiFi.status() == WL_CONNECTED &&
+        (shown_generation != remote.get_update_generation() || shown_status != remote.get_http_status()))
+    {
+        shown_generation = remote.get_update_generation();
+        shown_status = remote.get_http_status();
+        update_temperature();
+        update_pm25();
+    }
+
 
     if (digitalRead(5) == HIGH)
     {
@@ -244,99 +264,69 @@ static void update_time()
     }
 }
 
+// Show why there are no values: the connection failed, or the server is missing the event stream.
+static void print_status(size_t col, size_t end_col)
+{
+    int status = remote.get_http_status();
+    if (status != 0 && status != 200)
+    {
+        col += lcd.print("F: ");
+        col += lcd.print(status);
+    }
+    else
+    {
+        col += lcd.print("--");
+    }
+    while (col < end_col)
+    {
+        col += lcd.print(' ');
+    }
+}
+
 static void update_temperature()
 {
-    if (WiFi.status() == WL_CONNECTED)
+    constexpr int startCol = 0;
+    constexpr int row = 1;
+    constexpr size_t endCol = expectedTemperaturePrintLength + 1;
+    lcd.setCursor(startCol, row);
+    float temperature;
+    float humidity;
+    if (!remote.get_value(temperature_index, temperature) || !remote.get_value(humidity_index, humidity))
     {
-        if (http_client.begin(wifi_client, "http://" + server_address.get() + "/rest/device/sht31_d/get"))
-        {
-            constexpr int startCol = 0;
-            constexpr int row = 1;
-            lcd.setCursor(startCol, row);
-            lcd.print("Get T");
-            auto status = http_client.GET();
-            lcd.setCursor(startCol, row);
-            size_t col = startCol;
-            if (status == 200)
-            {
-                DynamicJsonDocument doc(1024);
-                deserializeJson(doc, http_client.getStream());
-                auto temperature = doc["sht31_d"]["temperature"]["average"].as<float>();
-                auto humidity = doc["sht31_d"]["humidity"]["average"].as<float>();
-                col = lcd.print(static_cast<int>(temperature + 0.5));
-                col += lcd.print('\03');
-                col += lcd.print(' ');
-                col += lcd.print(static_cast<int>(humidity + 0.5));
-                col += lcd.print('%');
-            }
-            else if (status == HTTPC_ERROR_READ_TIMEOUT)
-            {
-                col = lcd.print("T/O");
-            }
-            else
-            {
-                col = lcd.print("F: ");
-                col += lcd.print(status);
-            }
-            http_client.end();
-            while (col < expectedTemperaturePrintLength + 1)
-            {
-                col += lcd.print(' ');
-            }
-        }
-        else
-        {
-            Serial.println("http_client begin failed");
-        }
+        print_status(startCol, endCol);
+        return;
+    }
+
+    size_t col = startCol + lcd.print(static_cast<int>(temperature + 0.5));
+    col += lcd.print('\03');
+    col += lcd.print(' ');
+    col += lcd.print(static_cast<int>(humidity + 0.5));
+    col += lcd.print('%');
+    while (col < endCol)
+    {
+        col += lcd.print(' ');
     }
 }
 
 
 static void update_pm25()
 {
-    if (WiFi.status() == WL_CONNECTED)
+    // Leave space for an actual time.
+    constexpr auto startCol = expectedTemperaturePrintLength + 1;
+    constexpr int row = 1;
+    lcd.setCursor(startCol, row);
+    float pm25;
+    if (!remote.get_value(pm25_index, pm25))
     {
-        // Leave space for an actual time.
-        constexpr auto startCol = expectedTemperaturePrintLength + 1;
-        constexpr int row = 1;
-        if (http_client.begin(wifi_client, "http://" + server_address.get() + "/rest/device/vindriktning/get"))
-        {
-            lcd.setCursor(startCol, row);
-            size_t col = startCol;
-            lcd.print("PM25");
-            lcd.setCursor(startCol, row);
-            auto status = http_client.GET();
-            if (status == 200)
-            {
-                DynamicJsonDocument doc(1024);
-                deserializeJson(doc, http_client.getStream());
-                auto pm25 = doc["vindriktning"]["pm25"]["average"].as<float>();
-                col = startCol + lcd.print(static_cast<int>(pm25 + 0.5));
-                col += lcd.print("\02g/m\01");
-                while (col < 16)
-                {
-                    col += lcd.print(' ');
-                }
-            }
-            else if (status == HTTPC_ERROR_READ_TIMEOUT)
-            {
-                col = lcd.print("T/O");
-            }
-            else
-            {
-                col = lcd.print("F: ");
-                col += lcd.print(status);
-            }
-            http_client.end();
-            while (col < 16)
-            {
-                col += lcd.print(' ');
-            }
-        }
-        else
-        {
-            Serial.println("pm25 http_client begin failed");
-        }
+        print_status(startCol, 16);
+        return;
+    }
+
+    size_t col = startCol + lcd.print(static_cast<int>(pm25 + 0.5));
+    col += lcd.print("\02g/m\01");
+    while (col < 16)
+    {
+        col += lcd.print(' ');
     }
 }
 
@@ -448,6 +438,7 @@ static void on_save(::grmcdorman::WebSettings &)
     configFile.close();
 
     schedule_function([] {
+        remote.set_server(server_address.get());
         if (!WiFi.isConnected())
         {
             WiFi.softAPdisconnect();
@@ -40,6 +40,7 @@
 
 #include <esp8266_device_framework.h>       // Required by the ESP compiler framework.
 
+#include <grmcdorman/device/BootSequence.h>
 #include <grmcdorman/device/ConfigFile.h>
 
 #include <grmcdorman/device/InfoDisplay.h>
@@ -143,10 +144,11 @@ void setup() {
     Serial.print("SHT31-D SDA is on pin ");
     Serial.println(devices[4]->get("sda"));
 
+    // Set up the devices in boot phase order: WiFi first, so that it associates
+    // while the sensors take their first readings.
+    ::grmcdorman::device::BootSequence::setup_devices(devices);
     for (auto &device : devices)
     {
-        device->setup();
-        device->set_devices(devices);
         webServer.add_setting_set(device->name(), device->identifier(), device->get_settings());
     }
 
@@ -216,13 +218,7 @@ void loop()
     ArduinoOTA.handle();
     webServer.loop();
 
-    for (auto &device : devices)
-    {
-        if (device->is_enabled())
-        {
-            device->loop();
-        }
-    }
+    ::grmcdorman::device::Device::loop_devices(devices);
 
     if (factory_reset_next_loop && millis() - restart_reset_when > restart_reset_delay)
     {
@@ -23,6 +23,8 @@
 #include "grmcdorman/device/AbstractAnalog.h"
 #include "grmcdorman/Setting.h"
 
+#include <algorithm>
+
 namespace grmcdorman::device
 {
 
@@ -32,13 +34,15 @@ namespace grmcdorman::device
         scale(F("Scaling"), F("scale")),
         offset(F("Offset"), F("offset")),
         invertReading(F("Invert reading before transform"), F("invert_reading")),
-        readInterval(F("Polling interval (seconds)"), F("poll_interval"))
+        readInterval(F("Polling interval (seconds)"), F("poll_interval")),
+        oversampling(F("Samples per reading (1 to 32)"), F("oversampling"))
     {
         // Superclass will initialize.
         scale.set(defaultScale);
         offset.set(defaultOffset);
         invertReading.set(invert);
         readInterval.set(statusReadInterval / 1000);
+        oversampling.set(8);
     }
 
     void AbstractAnalog::setup()
@@ -48,6 +52,15 @@ namespace grmcdorman::device
             return;
         }
 
+        if (use_transform_table())
+        {
+            transform_table.resize(TABLE_SIZE);
+            for (size_t index = 0; index < TABLE_SIZE; ++index)
+            {
+                transform_table[index] = transform_raw_reading(index * TABLE_STEP);
+            }
+        }
+
         set_timer();
     }
 
@@ -58,7 +71,7 @@ namespace grmcdorman::device
             return;
         }
 
-        if (current_polling_seconds != readInterval.get() || !ticker.active())
+        if (current_polling_seconds != readInterval.get() || !read_task.active())
         {
             set_timer();
         }
@@ -71,41 +84,88 @@ namespace grmcdorman::device
             return false;
         }
 
-        json[identifier()] = as_json();
+        return serialize_into(json.createNestedObject(get_publish_key()));
+    }
 
+    bool AbstractAnalog::get_definition_value(size_t index, float &value) const
+    {
+        if (index != 0 || !sensor_reading.has_accumulation())
+        {
+            return false;
+        }
+
+        value = sensor_reading.get_current_average();
         return true;
     }
 
-    DynamicJsonDocument AbstractAnalog::as_json() const
+    bool AbstractAnalog::serialize_into(JsonObject json) const
     {
-        DynamicJsonDocument json(512);
         static const char enabled_string[] PROGMEM = "enabled";
         json[FPSTR(enabled_string)] = is_enabled();
-        json[identifier()] = sensor_reading.as_json();
+        sensor_reading.serialize_into(json.createNestedObject(identifier()));
 
-        return json;
+        return true;
     }
 
-    void AbstractAnalog::set_timer()
+    void AbstractAnalog::request_reading()
     {
-        current_polling_seconds = readInterval.get();
-        ticker.attach(current_polling_seconds, [this]
+        if (is_enabled())
         {
-            if (is_enabled())
+            last_read_millis = millis();
+            last_raw_value = sample();
+            if (invertReading.get())
             {
-                last_read_millis = millis();
-                last_raw_value = analogRead(A0);
-                if (invertReading.get())
-                {
-                    sensor_reading.new_reading(scale.get() / transform_raw_reading(last_raw_value) + offset.get());
-                }
-                else
-                {
-                    sensor_reading.new_reading(scale.get() * transform_raw_reading(last_raw_value) + offset.get());
-                }
-                clear_is_published();
+                sensor_reading.new_reading(scale.get() / transform(last_raw_value) + offset.get());
             }
+            else
+            {
+                sensor_reading.new_reading(scale.get() * transform(last_raw_value) + offset.get());
+            }
+            clear_is_published();
+        }
+    }
 
+    float AbstractAnalog::sample()
+    {
+        uint16_t samples[MAX_OVERSAMPLING];
+        size_t count = std::min<uint32_t>(std::max<uint32_t>(oversampling.get(), 1), MAX_OVERSAMPLING);
+        for (size_t index = 0; index < count; ++index)
+        {
+            samples[index] = analogRead(A0);
+        }
+
+        // Discard the lowest and highest quarter.
+        std::sort(samples, samples + count);
+        size_t discard = count / 4;
+        uint32_t sum = 0;
+        for (size_t index = discard; index < count - discard; ++index)
+        {
+            sum += samples[index];
+        }
+
+        return static_cast<float>(sum) / (count - 2 * discard);
+    }
+
+    float AbstractAnalog::transform(float reading)
+    {
+        reading = std::min(std::max(reading, 0.0f), 1023.0f);
+        size_t index = static_cast<size_t>(reading) / TABLE_STEP;
+        // The steps near the ends are computed; transforms such as the thermistor's curve sharply there.
+        if (transform_table.empty() || index < TABLE_EXACT_STEPS || index >= TABLE_SIZE - 1 - TABLE_EXACT_STEPS)
+        {
+            return transform_raw_reading(reading);
+        }
+
+        float fraction = (reading - index * TABLE_STEP) / TABLE_STEP;
+        return transform_table[index] + fraction * (transform_table[index + 1] - transform_table[index]);
+    }
+
+    void AbstractAnalog::set_timer()
+    {
+        current_polling_seconds = readInterval.get();
+        read_task.attach(current_polling_seconds, [this]
+        {
+            request_reading();
         });
     }
 }
\ No newline at end of file
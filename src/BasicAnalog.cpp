@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <StreamString.h>
+
 #include "grmcdorman/device/BasicAnalog.h"
 #include "grmcdorman/Setting.h"
 
@@ -30,41 +32,9 @@ namespace grmcdorman::device
         const char basic_analog_name[] PROGMEM = "Basic Analog Reading";
         const char basic_analog_identifier[] PROGMEM = "basic_analog";
 
-        class BasicAnalog_Definition: public Device::Definition
-        {
-            public:
-                BasicAnalog_Definition(const __FlashStringHelper *units): units(units)
-                {
-                }
-
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" Analog Reading");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.basic_analog.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_basic_analog");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return units;
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.basic_analog.last}}\", \"age\": \"{{value_json.basic_analog.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:alpha-s-circle");
-                }
-
-            private:
-                const __FlashStringHelper *units;
-        };
+        const char basic_analog_name_suffix[] PROGMEM = " Analog Reading";
+        const char basic_analog_unique_id_suffix[] PROGMEM = "_basic_analog";
+        const char basic_analog_icon[] PROGMEM = "mdi:alpha-s-circle";
     }
 
     BasicAnalog::BasicAnalog(const __FlashStringHelper *units, bool allowUserAdjust, float defaultScale, float defaultOffset, bool invert):
@@ -72,17 +42,22 @@ namespace grmcdorman::device
         title(F("<h2>Analog Data Line Reading (A0 input)</h2>")),
         device_status(F("Sensor status<script>periodicUpdateList.push(\"basic_analog&setting=device_status\");</script>"), F("device_status"))
     {
-        static const BasicAnalog_Definition definition(units);
+        // In RAM, as the units are only known here. The reading is nested under the identifier.
+        static const Definition definition
+        {
+            basic_analog_name_suffix, basic_analog_unique_id_suffix, reinterpret_cast<const char *>(units), basic_analog_icon,
+            basic_analog_identifier, Definition::Layout::ACCUMULATOR, nullptr, 0.0f
+        };
 
         if (allowUserAdjust)
         {
             initialize({&definition}, {&title, &scale, &offset, &invertReading,
-                &readInterval, &device_status, &enabled});
+                &readInterval, &oversampling, &device_status, &enabled});
         }
         else
         {
             initialize({&definition}, {&title,
-                &readInterval, &device_status, &enabled});
+                &readInterval, &oversampling, &device_status, &enabled});
         }
 
         set_enabled(false);
@@ -100,23 +75,24 @@ namespace grmcdorman::device
 
 
     String BasicAnalog::get_status() const
+    {
+        StreamString message;
+        message.reserve(150);
+        print_status(message);
+        return message;
+    }
+
+    void BasicAnalog::print_status(Print &output) const
     {
         if (!is_enabled())
         {
-            return String();
+            return;
         }
 
-        String message;
-        message.reserve(150);
-        char float_str[64];
-        dtostrf(get_last_reading(), 1, 1, float_str);
-        message = float_str;
-        message += ';';
-        message += ' ';
+        output.print(get_last_reading(), 1);
+        output.print(F("; "));
         auto since = millis() - last_read_millis;
-        message += since / 1000;
-        message += F(" seconds since last reading.");
-
-        return message;
+        output.print(since / 1000);
+        output.print(F(" seconds since last reading."));
     }
 }
\ No newline at end of file
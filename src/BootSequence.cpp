@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "grmcdorman/device/BootSequence.h"
+#include "grmcdorman/device/ConfigFile.h"
+#include "grmcdorman/device/ReadingBus.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char network_start_name[] PROGMEM = "network_start";
+        const char hardware_name[] PROGMEM = "hardware";
+        const char filesystem_name[] PROGMEM = "filesystem";
+        const char network_name[] PROGMEM = "network";
+        const char *const phase_names[] = { network_start_name, hardware_name, filesystem_name, network_name };
+
+        const char filesystem_mounted_name[] PROGMEM = "filesystem_mounted";
+        const char network_connected_name[] PROGMEM = "network_connected";
+        const char mqtt_connected_name[] PROGMEM = "mqtt_connected";
+        const char first_reading_published_name[] PROGMEM = "first_reading_published";
+        const char *const milestone_names[] = { filesystem_mounted_name, network_connected_name, mqtt_connected_name, first_reading_published_name };
+
+        static_assert(sizeof(phase_names) / sizeof(phase_names[0]) == static_cast<size_t>(Device::BootPhase::COUNT), "Missing phase name");
+        static_assert(sizeof(milestone_names) / sizeof(milestone_names[0]) == static_cast<size_t>(BootSequence::Milestone::COUNT), "Missing milestone name");
+    }
+
+    std::vector<BootSequence::Entry> BootSequence::entries;
+    uint32_t BootSequence::milestones[static_cast<size_t>(Milestone::COUNT)] = {};
+    uint32_t BootSequence::setup_complete_ms = 0;
+    size_t BootSequence::awaiting_first_reading = 0;
+    bool BootSequence::subscribed = false;
+
+    void BootSequence::setup_devices(const std::vector<Device *> &devices)
+    {
+        entries.clear();
+        entries.reserve(devices.size());
+        awaiting_first_reading = 0;
+        for (auto &device : devices)
+        {
+            device->set_devices(devices);
+            entries.push_back(Entry{device, device->get_boot_phase(), 0, 0, 0});
+        }
+        // Stable, so that devices within a phase are set up in list order.
+        std::stable_sort(entries.begin(), entries.end(), [] (const Entry &first, const Entry &second)
+        {
+            return first.phase < second.phase;
+        });
+
+        if (!subscribed)
+        {
+            subscribed = true;
+            ReadingBus::subscribe(on_reading);
+        }
+
+        bool mounted = false;
+        for (auto &entry : entries)
+        {
+            if (entry.phase >= Device::BootPhase::FILESYSTEM && !mounted)
+            {
+                ConfigFile::mount();
+                mounted = true;
+            }
+
+            entry.setup_start_ms = millis();
+            uint32_t start_us = micros();
+            entry.device->setup();
+            if (entry.phase == Device::BootPhase::HARDWARE && entry.device->is_enabled())
+            {
+                entry.device->request_reading();
+            }
+            entry.setup_us = micros() - start_us;
+
+            // Readings made during `setup` are only delivered by the bus after the loop starts.
+            if (entry.device->get_reading_generation() != 0)
+            {
+                entry.first_reading_ms = millis();
+            }
+            else if (entry.device->is_enabled() && entry.device->has_reading_generation())
+            {
+                ++awaiting_first_reading;
+            }
+
+            // Let the WiFi stack run between devices.
+            yield();
+        }
+
+        setup_complete_ms = millis();
+    }
+
+    void BootSequence::on_reading(const Device &device)
+    {
+        if (awaiting_first_reading == 0)
+        {
+            return;
+        }
+
+        auto entry = std::find_if(entries.begin(), entries.end(), [&device] (const Entry &entry)
+        {
+            return entry.device == &device;
+        });
+        if (entry != entries.end() && entry->first_reading_ms == 0)
+        {
+            entry->first_reading_ms = millis();
+            --awaiting_first_reading;
+        }
+    }
+
+    const __FlashStringHelper *BootSequence::get_phase_name(Device::BootPhase phase)
+    {
+        return FPSTR(phase_names[std::min(static_cast<size_t>(phase), static_cast<size_t>(Device::BootPhase::COUNT) - 1)]);
+    }
+
+    const __FlashStringHelper *BootSequence::get_milestone_name(Milestone milestone)
+    {
+        return FPSTR(milestone_names[std::min(static_cast<size_t>(milestone), static_cast<size_t>(Milestone::COUNT) - 1)]);
+    }
+
+    void BootSequence::to_json(JsonObject json)
+    {
+        json[F("setup_complete_ms")] = setup_complete_ms;
+        JsonObject milestones_json = json.createNestedObject(F("milestones"));
+        for (size_t index = 0; index < static_cast<size_t>(Milestone::COUNT); ++index)
+        {
+            if (milestones[index] != 0)
+            {
+                milestones_json[FPSTR(milestone_names[index])] = milestones[index];
+            }
+        }
+
+        JsonObject devices_json = json.createNestedObject(F("devices"));
+        for (const auto &entry : entries)
+        {
+            JsonObject device_json = devices_json.createNestedObject(entry.device->identifier());
+            device_json[F("phase")] = get_phase_name(entry.phase);
+            device_json[F("setup_start_ms")] = entry.setup_start_ms;
+            device_json[F("setup_us")] = entry.setup_us;
+            if (entry.first_reading_ms != 0)
+            {
+                device_json[F("first_reading_ms")] = entry.first_reading_ms;
+            }
+        }
+    }
+}
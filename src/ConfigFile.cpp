@@ -23,44 +23,280 @@
 #include <ArduinoJson.h>
 #include <LittleFS.h>
 
+#include "grmcdorman/device/BootSequence.h"
 #include "grmcdorman/device/ConfigFile.h"
 #include "grmcdorman/device/Device.h"
 
+#include <algorithm>
+#include <utility>
+
 namespace grmcdorman::device
 {
-    void ConfigFile::save(const std::vector<Device *> &devices)
+    namespace
     {
-        DynamicJsonDocument json(4096);
-        bool set_a_device = false;
-        for (auto &device: devices)
+        constexpr uint32_t FNV_OFFSET = 2166136261u;    //!< FNV-1a initial value.
+        constexpr uint32_t FNV_PRIME = 16777619u;       //!< FNV-1a multiplier.
+
+        /**
+         * @brief Add a PROGMEM string to an FNV-1a hash.
+         *
+         * @param hash      The hash so far.
+         * @param text      The string.
+         * @return The new hash.
+         */
+        uint32_t hash_progmem(uint32_t hash, const __FlashStringHelper *text)
         {
-            if (strlen_P(reinterpret_cast<const char *>(device->identifier())) != 0 && !device->get_settings().empty())
+            for (const char *character = reinterpret_cast<const char *>(text); pgm_read_byte(character) != '\0'; ++character)
             {
-                DynamicJsonDocument deviceJson(2048);
-                bool set_setting = false;
-                for (auto &setting: device->get_settings())
+                hash = (hash ^ pgm_read_byte(character)) * FNV_PRIME;
+            }
+            return hash;
+        }
+
+        /**
+         * @brief Get the record key for a device setting.
+         *
+         * @param device    The device.
+         * @param setting   The setting.
+         * @return The key.
+         */
+        uint32_t get_key(const Device *device, const ::grmcdorman::SettingInterface *setting)
+        {
+            uint32_t hash = hash_progmem(FNV_OFFSET, device->identifier());
+            hash = (hash ^ '/') * FNV_PRIME;
+            return hash_progmem(hash, setting->name());
+        }
+
+        /**
+         * @brief A Print that hashes what is written, optionally forwarding it.
+         *
+         */
+        class HashPrint: public Print
+        {
+            public:
+                /**
+                 * @brief Construct a new HashPrint object.
+                 *
+                 * @param output    If not `nullptr`, receives the output.
+                 */
+                explicit HashPrint(Print *output): output(output)
+                {
+                }
+
+                size_t write(uint8_t character) override
                 {
-                    if (strlen_P(reinterpret_cast<const char *>(setting->name())) != 0 && setting->is_persistable())
+                    return write(&character, 1);
+                }
+
+                size_t write(const uint8_t *data, size_t size) override
+                {
+                    for (size_t index = 0; index < size; ++index)
                     {
-                        deviceJson[setting->name()] = setting->as_string();
-                        set_a_device = true;
-                        set_setting = true;
+                        hash = (hash ^ data[index]) * FNV_PRIME;
                     }
+                    if (output != nullptr && output->write(data, size) != size)
+                    {
+                        failed = true;
+                    }
+                    return size;
                 }
-                if (set_setting)
+
+                /**
+                 * @brief Write an integer, little-endian.
+                 *
+                 * @tparam T        The integer type.
+                 * @param value     The value.
+                 */
+                template<typename T>
+                void write_integer(T value)
                 {
-                    json[device->identifier()] = deviceJson;
+                    uint8_t bytes[sizeof(T)];
+                    for (size_t index = 0; index < sizeof(T); ++index)
+                    {
+                        bytes[index] = static_cast<uint8_t>(value >> (index * 8));
+                    }
+                    write(bytes, sizeof(T));
                 }
+
+                uint32_t hash = FNV_OFFSET;     //!< The hash of the output.
+                bool failed = false;            //!< Set if forwarding the output failed.
+
+            private:
+                Print *output;                  //!< Receives the output, if not `nullptr`.
+        };
+
+        /**
+         * @brief Read a little-endian integer.
+         *
+         * @param bytes     The bytes.
+         * @param size      The integer size.
+         * @return The value.
+         */
+        uint32_t get_integer(const uint8_t *bytes, size_t size)
+        {
+            uint32_t value = 0;
+            for (size_t index = size; index > 0; --index)
+            {
+                value = (value << 8) | bytes[index - 1];
             }
+            return value;
         }
-        if (set_a_device)
+    }
+
+    uint32_t ConfigFile::write_records(const std::vector<Device *> &devices, Print *output, size_t &record_count)
+    {
+        HashPrint records(output);
+        record_count = 0;
+        for (auto &device: devices)
         {
-            save(json);
+            if (strlen_P(reinterpret_cast<const char *>(device->identifier())) == 0)
+            {
+                continue;
+            }
+            for (auto &setting: device->get_settings())
+            {
+                if (strlen_P(reinterpret_cast<const char *>(setting->name())) != 0 && setting->is_persistable())
+                {
+                    String value(setting->as_string());
+                    uint16_t length = std::min<size_t>(value.length(), UINT16_MAX);
+                    records.write_integer(get_key(device, setting));
+                    records.write_integer(length);
+                    records.write(reinterpret_cast<const uint8_t *>(value.c_str()), length);
+                    ++record_count;
+                }
+            }
         }
+        return records.failed ? ~records.hash : records.hash;
+    }
+
+    void ConfigFile::save(const std::vector<Device *> &devices)
+    {
+        size_t record_count;
+        uint32_t hash = write_records(devices, nullptr, record_count);
+        if (record_count == 0 || (saved_hash_valid && hash == saved_hash))
+        {
+            return;
+        }
+
+        String temporary_path(binary_path);
+        temporary_path += F(".tmp");
+        File configFile = LittleFS.open(temporary_path, "w");
+        if (!configFile) {
+            return;
+        }
+
+        bool written = configFile.write(MAGIC, sizeof(MAGIC)) == sizeof(MAGIC) && configFile.write(VERSION) == 1;
+        written = written && write_records(devices, &configFile, record_count) == hash;
+        configFile.close();
+
+        if (!written)
+        {
+            LittleFS.remove(temporary_path);
+            return;
+        }
+
+        // LittleFS replaces an existing file on rename; the remove is a fallback.
+        if (!LittleFS.rename(temporary_path, binary_path))
+        {
+            LittleFS.remove(binary_path);
+            if (!LittleFS.rename(temporary_path, binary_path))
+            {
+                return;
+            }
+        }
+        saved_hash = hash;
+        saved_hash_valid = true;
+    }
+
+    bool ConfigFile::load_binary(const std::vector<Device *> &devices)
+    {
+        if (!LittleFS.exists(binary_path)) {
+            return false;
+        }
+
+        File configFile = LittleFS.open(binary_path, "r");
+        if (!configFile) {
+            return false;
+        }
+
+        uint8_t header[sizeof(MAGIC) + 1];
+        if (configFile.read(header, sizeof(header)) != sizeof(header) ||
+            memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[sizeof(MAGIC)] != VERSION)
+        {
+            Serial.println(F("Unrecognized binary configuration file"));
+            return false;
+        }
+
+        std::vector<std::pair<uint32_t, ::grmcdorman::SettingInterface *>> keys;
+        for (auto &device: devices)
+        {
+            for (auto &setting: device->get_settings())
+            {
+                keys.emplace_back(get_key(device, setting), setting);
+            }
+        }
+        std::sort(keys.begin(), keys.end(), [] (const auto &first, const auto &second)
+        {
+            return first.first < second.first;
+        });
+
+        // Records are applied as they are read; a truncated final record is ignored.
+        std::vector<char> value;
+        uint8_t record_header[sizeof(uint32_t) + sizeof(uint16_t)];
+        while (configFile.read(record_header, sizeof(record_header)) == sizeof(record_header))
+        {
+            uint32_t key = get_integer(record_header, sizeof(uint32_t));
+            size_t length = get_integer(record_header + sizeof(uint32_t), sizeof(uint16_t));
+            value.resize(length + 1);
+            if (configFile.read(reinterpret_cast<uint8_t *>(value.data()), length) != length)
+            {
+                break;
+            }
+            value[length] = '\0';
+
+            auto entry = std::lower_bound(keys.begin(), keys.end(), key, [] (const auto &entry, uint32_t key)
+            {
+                return entry.first < key;
+            });
+            if (entry != keys.end() && entry->first == key)
+            {
+                entry->second->set_from_string(String(value.data()));
+            }
+        }
+        configFile.close();
+
+        size_t record_count;
+        saved_hash = write_records(devices, nullptr, record_count);
+        saved_hash_valid = true;
+        return true;
+    }
+
+    bool ConfigFile::mounted = false;
+
+    bool ConfigFile::mount()
+    {
+        if (!mounted)
+        {
+            mounted = LittleFS.begin();
+            if (mounted)
+            {
+                BootSequence::mark(BootSequence::Milestone::FILESYSTEM_MOUNTED);
+            }
+        }
+        return mounted;
     }
 
     bool ConfigFile::load(const std::vector<Device *> &devices)
     {
+        if (!mount()) {
+            return false;
+        }
+
+        if (load_binary(devices))
+        {
+            return true;
+        }
+
         auto json = load();
         if (json)
         {
@@ -71,14 +307,11 @@ namespace grmcdorman::device
                 {
                     deviceJson = (*json)[device->name()];
                 }
-                for (auto &setting: device->get_settings())
-                {
-                    if (!deviceJson[setting->name()].isNull())
-                    {
-                        setting->set_from_string(deviceJson[setting->name()]);
-                    }
-                }
+                device->set_many(deviceJson.as<JsonObjectConst>());
             }
+
+            // Migrate to the binary file.
+            save(devices);
         }
 
         return json.has_value();
@@ -97,7 +330,7 @@ namespace grmcdorman::device
 
     std::optional<DynamicJsonDocument> ConfigFile::load()
     {
-        if (!LittleFS.begin()) {
+        if (!mount()) {
             return std::nullopt;
         }
 
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include <StreamString.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "grmcdorman/device/DerivedSensor.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        /**
+         * @brief Write the status label for a device.
+         *
+         * @param label         Receives the label; 96 characters.
+         * @param identifier    The device identifier.
+         * @return The label.
+         */
+        const char *make_status_label(char *label, const __FlashStringHelper *identifier)
+        {
+            snprintf_P(label, 96, PSTR("Sensor status<script>periodicUpdateList.push(\"%S&setting=device_status\");</script>"),
+                reinterpret_cast<const char *>(identifier));
+            return label;
+        }
+    }
+
+    DerivedSensor::DerivedSensor(const __FlashStringHelper *device_name, const __FlashStringHelper *device_identifier,
+        const Definition *definition, std::vector<const Device *> &&inputs, compute_t &&compute):
+        Device(device_name, device_identifier),
+        definition(definition),
+        inputs(std::move(inputs)),
+        compute(std::move(compute)),
+        device_status(FPSTR(make_status_label(status_label, device_identifier)), F("device_status"))
+    {
+        static_assert(sizeof(status_label) == 96, "make_status_label writes 96 characters");
+        initialize({definition}, {&device_status, &enabled});
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("Sensor is disabled"));
+                return;
+            }
+            device_status.set(get_status());
+        });
+    }
+
+    void DerivedSensor::setup()
+    {
+        if (subscribed)
+        {
+            return;
+        }
+        subscribed = true;
+
+        ReadingBus::subscribe([this] (const Device &device)
+        {
+            if (std::find(inputs.begin(), inputs.end(), &device) != inputs.end())
+            {
+                update();
+            }
+        });
+        // The inputs may already have readings, e.g. restored after a deep sleep.
+        update();
+    }
+
+    void DerivedSensor::update()
+    {
+        if (!is_enabled())
+        {
+            return;
+        }
+
+        float new_value;
+        if (!compute(new_value) || std::isnan(new_value))
+        {
+            return;
+        }
+
+        value = new_value;
+        clear_is_published();
+    }
+
+    bool DerivedSensor::publish(DynamicJsonDocument &json) const
+    {
+        if (!is_enabled() || std::isnan(value))
+        {
+            return false;
+        }
+
+        return serialize_into(json.createNestedObject(get_publish_key()));
+    }
+
+    bool DerivedSensor::get_definition_value(size_t index, float &result) const
+    {
+        if (index != 0 || std::isnan(value))
+        {
+            return false;
+        }
+        result = value;
+        return true;
+    }
+
+    bool DerivedSensor::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        if (!std::isnan(value))
+        {
+            json[definition->get_field()] = value;
+        }
+        return true;
+    }
+
+    String DerivedSensor::get_status() const
+    {
+        StreamString status;
+        status.reserve(64);
+        print_status(status);
+        return status;
+    }
+
+    void DerivedSensor::print_status(Print &output) const
+    {
+        if (std::isnan(value))
+        {
+            output.print(F("Waiting for the inputs"));
+            return;
+        }
+
+        output.print(value);
+        if (definition->unit_of_measurement != nullptr)
+        {
+            output.print(definition->get_unit_of_measurement());
+        }
+        output.print(F("; "));
+        output.print(get_reading_generation());
+        output.print(F(" updates"));
+    }
+
+    float DerivedSensor::dew_point(float temperature, float humidity)
+    {
+        if (humidity <= 0)
+        {
+            return NAN;
+        }
+
+        constexpr float a = 17.62f;
+        constexpr float b = 243.12f;   // °C
+        float gamma = logf(humidity / 100.0f) + a * temperature / (b + temperature);
+        return b * gamma / (a - gamma);
+    }
+
+    float DerivedSensor::heat_index(float temperature, float humidity)
+    {
+        // The regression is in °F.
+        float t = temperature * 1.8f + 32.0f;
+        float index = 0.5f * (t + 61.0f + (t - 68.0f) * 1.2f + humidity * 0.094f);
+        // That is NOAA's simple formula, which already averages with the temperature; at 80 °F and above the regression is used.
+        if (index >= 80.0f)
+        {
+            index = -42.379f + 2.04901523f * t + 10.14333127f * humidity - 0.22475541f * t * humidity
+                - 0.00683783f * t * t - 0.05481717f * humidity * humidity + 0.00122874f * t * t * humidity
+                + 0.00085282f * t * humidity * humidity - 0.00000199f * t * t * humidity * humidity;
+            if (humidity < 13.0f && t >= 80.0f && t <= 112.0f)
+            {
+                index -= (13.0f - humidity) / 4.0f * sqrtf((17.0f - fabsf(t - 95.0f)) / 17.0f);
+            }
+            else if (humidity > 85.0f && t >= 80.0f && t <= 87.0f)
+            {
+                index += (humidity - 85.0f) / 10.0f * (87.0f - t) / 5.0f;
+            }
+        }
+        return (index - 32.0f) / 1.8f;
+    }
+}
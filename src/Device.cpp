@@ -31,6 +31,7 @@ namespace grmcdorman::device
     static const char unspecified_firmware_name[] PROGMEM = "unspecified_firmware";
 
     const __FlashStringHelper *Device::firmware_name = FPSTR(unspecified_firmware_name);
+    uint32_t Device::definition_generation = 0;
     String Device::system_identifier = std::move([] {
         constexpr size_t unspecified_firmware_name_length = sizeof(unspecified_firmware_name) - 1;
         char name[unspecified_firmware_name_length + 1 + 9 + 1];
@@ -66,26 +67,154 @@ namespace grmcdorman::device
         }
     }
 
-    void Device::set(const String &setting, const String &value)
+    DynamicJsonDocument Device::as_json() const
     {
-        auto setting_instance = std::find_if(settings.begin(), settings.end(), [setting] (const ::grmcdorman::SettingInterface *entry)
+        DynamicJsonDocument json(JSON_DOCUMENT_CAPACITY);
+        if (!serialize_into(json.to<JsonObject>()))
         {
-            return strcmp_P(setting.c_str(), reinterpret_cast<const char *>(entry->name())) == 0;
-        });
+            // Return a null document.
+            return DynamicJsonDocument(8);
+        }
+        json.shrinkToFit();
+        return json;
+    }
 
-        if (setting_instance != settings.end())
+    uint32_t Device::get_status_version() const
+    {
+        String status(get_status());
+        uint32_t version = 2166136261u;
+        for (const char *character = status.c_str(); *character != '\0'; ++character)
         {
-            (*setting_instance)->set_from_string(value);
+            version = combine_status_version(version, static_cast<uint8_t>(*character));
         }
+        return version;
     }
 
-    String Device::get(const String &setting) const
+    const __FlashStringHelper *Device::Definition::get_sensor_name() const
+    {
+        const char *suffix = reinterpret_cast<const char *>(get_unique_id_suffix());
+        if (pgm_read_byte(suffix) == '_')
+        {
+            ++suffix;
+        }
+        return FPSTR(suffix);
+    }
+
+    size_t Device::get_definition_count(const std::vector<Device *> &devices)
+    {
+        size_t definition_count = 0;
+        for (auto &device : devices)
+        {
+            definition_count += device->get_definitions().size();
+        }
+        return definition_count;
+    }
+
+    const Device::Definition *Device::find_definition(const std::vector<Device *> &devices, size_t index)
+    {
+        for (auto &device : devices)
+        {
+            const auto &definitions = device->get_definitions();
+            if (index < definitions.size())
+            {
+                return definitions[index];
+            }
+            index -= definitions.size();
+        }
+        return nullptr;
+    }
+
+    void Device::loop_devices(const std::vector<Device *> &devices)
+    {
+        for (auto &device : devices)
+        {
+            if (device->is_enabled())
+            {
+                DEVICE_TIMING_SCOPE(&device->get_timing().loop);
+                device->loop();
+            }
+        }
+    }
+
+    uint16_t Device::hash_setting_name(const char *name, bool progmem)
+    {
+        uint32_t hash = 2166136261u;
+        for (;;)
+        {
+            char character = progmem ? pgm_read_byte(name) : *name;
+            if (character == '\0')
+            {
+                break;
+            }
+            hash = (hash ^ static_cast<uint8_t>(character)) * 16777619u;
+            ++name;
+        }
+        return static_cast<uint16_t>(hash ^ (hash >> 16));
+    }
+
+    void Device::build_setting_index()
+    {
+        setting_index.clear();
+        setting_index.reserve(settings.size());
+        for (size_t index = 0; index < settings.size(); ++index)
+        {
+            setting_index.push_back({hash_setting_name(reinterpret_cast<const char *>(settings[index]->name()), true),
+                static_cast<uint16_t>(index)});
+        }
+        // Stable, so that for duplicate names the first setting is still found first.
+        std::stable_sort(setting_index.begin(), setting_index.end(), [] (const SettingIndexEntry &first, const SettingIndexEntry &second)
+        {
+            return first.hash < second.hash;
+        });
+    }
+
+    ::grmcdorman::SettingInterface *Device::find_setting(const char *name) const
     {
-        auto setting_instance = std::find_if(settings.begin(), settings.end(), [setting] (const ::grmcdorman::SettingInterface *entry)
+        uint16_t hash = hash_setting_name(name, false);
+        auto entry = std::lower_bound(setting_index.begin(), setting_index.end(), hash, [] (const SettingIndexEntry &entry, uint16_t hash)
         {
-            return strcmp_P(setting.c_str(), reinterpret_cast<const char *>(entry->name())) == 0;
+            return entry.hash < hash;
         });
-        return setting_instance != settings.end() ? (*setting_instance)->as_string() : String();
+
+        for (; entry != setting_index.end() && entry->hash == hash; ++entry)
+        {
+            auto setting = settings[entry->index];
+            if (strcmp_P(name, reinterpret_cast<const char *>(setting->name())) == 0)
+            {
+                return setting;
+            }
+        }
+        return nullptr;
+    }
+
+    void Device::set(const String &setting, const String &value)
+    {
+        auto setting_instance = find_setting(setting.c_str());
+        if (setting_instance != nullptr)
+        {
+            setting_instance->set_from_string(value);
+        }
+    }
+
+    size_t Device::set_many(JsonObjectConst values)
+    {
+        size_t set_count = 0;
+        for (JsonPairConst member: values)
+        {
+            auto setting_instance = find_setting(member.key().c_str());
+            if (setting_instance != nullptr && !member.value().isNull())
+            {
+                setting_instance->set_from_string(member.value().as<String>());
+                ++set_count;
+            }
+        }
+        return set_count;
+    }
+
+    String Device::get(const String &setting) const
+    {
+        auto setting_instance = find_setting(setting.c_str());
+        return setting_instance != nullptr ? setting_instance->as_string() : String();
     }
 
     const ExclusiveOptionSetting::names_list_t Device::data_line_names{ FPSTR("D1"), FPSTR("D2"), FPSTR("D3"), FPSTR("D5"), FPSTR("D6"), FPSTR("D7")};
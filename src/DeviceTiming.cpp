@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "grmcdorman/device/DeviceTiming.h"
+
+#include <algorithm>
+
+namespace grmcdorman::device
+{
+    void TimingStatistics::add(uint32_t elapsed_us, uint32_t elapsed_cycles, int32_t heap_delta, uint32_t max_block)
+    {
+        ++count;
+        total_us += elapsed_us;
+        minimum_us = std::min(minimum_us, elapsed_us);
+        maximum_us = std::max(maximum_us, elapsed_us);
+        total_cycles += elapsed_cycles;
+        maximum_cycles = std::max(maximum_cycles, elapsed_cycles);
+        heap_delta_minimum = std::min(heap_delta_minimum, heap_delta);
+        heap_delta_maximum = std::max(heap_delta_maximum, heap_delta);
+        max_block_minimum = std::min(max_block_minimum, max_block);
+    }
+
+    void TimingStatistics::to_json(JsonObject json) const
+    {
+        json[F("count")] = count;
+        if (count == 0)
+        {
+            return;
+        }
+        json[F("min_us")] = minimum_us;
+        json[F("avg_us")] = get_average_us();
+        json[F("max_us")] = maximum_us;
+        json[F("avg_cycles")] = get_average_cycles();
+        json[F("max_cycles")] = maximum_cycles;
+        json[F("heap_delta_min")] = heap_delta_minimum;
+        json[F("heap_delta_max")] = heap_delta_maximum;
+        json[F("max_block_min")] = max_block_minimum;
+    }
+
+    void DeviceTiming::to_json(JsonObject json) const
+    {
+        loop.to_json(json.createNestedObject(F("loop")));
+        task.to_json(json.createNestedObject(F("task")));
+        publish.to_json(json.createNestedObject(F("publish")));
+        status.to_json(json.createNestedObject(F("status")));
+    }
+}
@@ -23,11 +23,12 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <DHT.h>
-#include <Ticker.h>
+#include <StreamString.h>
 
 #include <algorithm>
 
 #include "grmcdorman/device/DhtSensor.h"
+#include "grmcdorman/device/TimingCoordinator.h"
 #include "grmcdorman/Setting.h"
 
 namespace grmcdorman::device
@@ -39,61 +40,26 @@ namespace grmcdorman::device
         const char dht_identifier[] PROGMEM = "dht";
         const ExclusiveOptionSetting::names_list_t dht_models{ FPSTR("DHT11"), FPSTR("DHT22")};
 
-        class dhtDevice_Temperature_Definition: public Device::Definition
+        const char temperature_name_suffix[] PROGMEM = " DHT Temperature";
+        const char temperature_unique_id_suffix[] PROGMEM = "_dht_temperature";
+        const char temperature_field[] PROGMEM = "temperature";
+        const char humidity_name_suffix[] PROGMEM = " DHT Humidity";
+        const char humidity_unique_id_suffix[] PROGMEM = "_dht_humidity";
+        const char humidity_field[] PROGMEM = "humidity";
+        const char celsius_units[] PROGMEM = "°C";
+        const char percent_units[] PROGMEM = "%";
+        const char thermometer_icon[] PROGMEM = "mdi:thermometer";
+        const char water_percent_icon[] PROGMEM = "mdi:water-percent";
+
+        constexpr Device::Definition temperature_definition PROGMEM
         {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" DHT Temperature");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.dht.temperature.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_dht_temperature");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("°C");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.dht.temperature.last}}\", \"age\": \"{{value_json.dht.temperature.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:thermometer");
-                }
+            temperature_name_suffix, temperature_unique_id_suffix, celsius_units, thermometer_icon,
+            temperature_field, Device::Definition::Layout::ACCUMULATOR, nullptr, 0.1f
         };
-        class dhtDevice_Humidity_Definition: public Device::Definition
+        constexpr Device::Definition humidity_definition PROGMEM
         {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" DHT Humidity");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.dht.humidity.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_dht_humidity");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("%");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.dht.humidity.last}}\", \"age\": \"{{value_json.dht.humidity.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:water-percent");
-                }
+            humidity_name_suffix, humidity_unique_id_suffix, percent_units, water_percent_icon,
+            humidity_field, Device::Definition::Layout::ACCUMULATOR, nullptr, 0.5f
         };
     }
 
@@ -109,9 +75,6 @@ namespace grmcdorman::device
         readInterval(F("Polling interval (seconds)"), F("poll_interval")),
         device_status(F("Sensor status<script>periodicUpdateList.push(\"dht&setting=device_status\");</script>"), F("device_status"))
     {
-        static const dhtDevice_Temperature_Definition temperature_definition;
-        static const dhtDevice_Humidity_Definition humidity_definition;
-
         initialize({&temperature_definition, &humidity_definition}, {&title, &dataPin, &dhtModel, &temperatureOffset, &temperatureScale, &humidityOffset, &humidityScale,
             &readInterval, &device_status, &enabled});
 
@@ -161,23 +124,50 @@ namespace grmcdorman::device
                 temperature.new_reading(new_temperature* temperatureScale.get() + temperatureOffset.get());
                 humidity.new_reading(new_humidity* humidityScale.get() + humidityOffset.get());
                 clear_is_published();
+                consecutive_errors = 0;
                 requested = false;
             });
         });
         dht->onError([this] (uint8_t status)
         {
-            last_status = status;
-            requested = false;
+            schedule_function([this, status]() {
+                record_error(status);
+            });
         });
     }
 
+    void DhtSensor::record_error(uint8_t status)
+    {
+        last_status = status;
+        ++error_count;
+        ++error_counts[status < ERROR_CODES ? status : 0];
+        if (consecutive_errors < UINT8_MAX)
+        {
+            ++consecutive_errors;
+        }
+        requested = false;
+    }
+
+    uint32_t DhtSensor::get_read_spacing_ms() const
+    {
+        // The minimum sampling period; the DHT11 is model 0.
+        uint32_t spacing_ms = dhtModel.get() == 0 ? 1000 : 2000;
+        if (consecutive_errors != 0)
+        {
+            uint32_t shift = std::min<uint32_t>(consecutive_errors, MAX_BACKOFF_SHIFT);
+            spacing_ms = std::max(spacing_ms, (readInterval.get() * 1000) << shift);
+        }
+        return spacing_ms;
+    }
+
     void DhtSensor::loop()
     {
         if (!is_enabled())
         {
             if (dht)
             {
-                ticker.detach();
+                read_task.detach();
+                retry_task.detach();
                 dht.reset();
             }
             return;
@@ -195,15 +185,20 @@ namespace grmcdorman::device
     }
 
     String DhtSensor::get_status() const
+    {
+        StreamString message;
+        message.reserve(150);
+        print_status(message);
+        return message;
+    }
+
+    void DhtSensor::print_status(Print &output) const
     {
         if (!is_enabled())
         {
-            return String();
+            return;
         }
 
-        String message;
-        message.reserve(150);
-
         if (last_status != 0)
         {
             // DHT has a `getError method,
@@ -219,64 +214,147 @@ namespace grmcdorman::device
                     // No error.
                     break;
                 case 1:
-                    message += F("DHT read timeout");
+                    output.print(F("DHT read timeout"));
                     break;
                 case 2:
-                    message += F("DHT responded with a NACK");
+                    output.print(F("DHT responded with a NACK"));
                     break;
                 case 3:
-                    message += F("DHT data was invalid");
+                    output.print(F("DHT data was invalid"));
                     break;
                 case 4:
-                    message += F("DHT data had an invalid checksum");
+                    output.print(F("DHT data had an invalid checksum"));
                     break;
                 default:
-                    message += F("DHT reported an unknown error code: ");
-                    message += last_status;
+                    output.print(F("DHT reported an unknown error code: "));
+                    output.print(last_status);
             }
             if (temperature.get_last_reading() != INVALID_READING)
             {
-                message += F(";");
+                output.print(F("; "));
             }
             else
             {
-                message += '.';
-                return message;
+                output.print('.');
+                return;
             }
         }
 
         if (temperature.get_last_reading() != INVALID_READING)
         {
-            char float_str[64];
-            dtostrf(temperature.get_last_reading(), 1, 1, float_str);
-            message = float_str;
-            message += F(" °C, ");
-            dtostrf(humidity.get_last_reading(), 1, 1, float_str);
-            message += float_str;
-            message += F("% R.H.; ");
+            output.print(temperature.get_last_reading(), 1);
+            output.print(F(" °C, "));
+            output.print(humidity.get_last_reading(), 1);
+            output.print(F("% R.H.; "));
             auto since = millis() - last_read_millis;
-            message += since / 1000;
-            message += F(" seconds since last reading.");
+            output.print(since / 1000);
+            output.print(F(" seconds since last reading."));
         }
         else
         {
-            message += F("No readings have been performed.");
+            output.print(F("No readings have been performed."));
         }
 
-        return message;
+        if (error_count != 0)
+        {
+            output.print(' ');
+            output.print(error_count);
+            output.print(F(" of "));
+            output.print(read_count);
+            output.print(F(" reads failed."));
+        }
+    }
+
+    uint32_t DhtSensor::get_status_version() const
+    {
+        uint32_t version = combine_status_version(get_reading_generation(), last_status);
+        version = combine_status_version(version, error_count);
+        version = combine_status_version(version, read_count);
+        return combine_status_version(version, (millis() - last_read_millis) / 1000);
+    }
+
+    bool DhtSensor::serialize_into(JsonObject json) const
+    {
+        AbstractTemperaturePressureSensor::serialize_into(json);
+        JsonObject errors = json.createNestedObject(F("errors"));
+        errors[F("reads")] = read_count;
+        errors[F("failed")] = error_count;
+        errors[F("error_rate")] = read_count != 0 ? static_cast<float>(error_count) / read_count : 0.0f;
+        errors[F("timeout")] = error_counts[1];
+        errors[F("nack")] = error_counts[2];
+        errors[F("invalid")] = error_counts[3];
+        errors[F("checksum")] = error_counts[4];
+        errors[F("other")] = error_counts[0];
+        errors[F("consecutive")] = consecutive_errors;
+        errors[F("deferred")] = deferred_count;
+
+        return true;
+    }
+
+    void DhtSensor::request_reading()
+    {
+        if (!dht)
+        {
+            return;
+        }
+
+        uint32_t now = millis();
+        if (requested)
+        {
+            if (now - request_previous_mills < READ_TIMEOUT_MS)
+            {
+                return;
+            }
+            // The DHT library did not call back.
+            record_error(1);
+        }
+
+        // The sensor also needs the minimum period after power-up, so the first read is timed from
+        // boot (`request_previous_mills` is zero); a first read requested early is started when it has
+        // passed. Allow for the scheduler running the read task a little early.
+        uint32_t elapsed_ms = now - request_previous_mills;
+        uint32_t spacing_ms = get_read_spacing_ms();
+        if (elapsed_ms + Scheduler::COALESCE_MS < spacing_ms)
+        {
+            if (read_count == 0 && !retry_task.active())
+            {
+                retry_task.once_ms(spacing_ms - elapsed_ms, [this]
+                {
+                    request_reading();
+                });
+            }
+            return;
+        }
+
+        uint32_t wait_ms = TimingCoordinator::get_wait_ms(TimingCoordinator::Activity::SENSOR_READ);
+        if (wait_ms != 0)
+        {
+            if (!retry_task.active())
+            {
+                ++deferred_count;
+                // Past the scheduler's coalescing window, so that the retry is not run at once.
+                retry_task.once_ms(std::max(wait_ms, Scheduler::COALESCE_MS + 1), [this]
+                {
+                    request_reading();
+                });
+            }
+            return;
+        }
+
+        requested = true;
+        request_previous_mills = now;
+        ++read_count;
+        TimingCoordinator::reserve(TimingCoordinator::Activity::SENSOR_READ, READ_DURATION_MS);
+        dht->read();
     }
 
     void DhtSensor::set_timer()
     {
         current_polling_seconds = readInterval.get();
         // A `detach` isn't necessary, this will automatically detach if required.
-        ticker.attach_scheduled(current_polling_seconds, [this]
+        read_task.attach(current_polling_seconds, [this]
         {
-            if (!requested)
-            {
-                requested = true;
-                dht->read();
-            }
+            request_reading();
         });
     }
 }
\ No newline at end of file
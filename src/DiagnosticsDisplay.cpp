@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "grmcdorman/device/BootSequence.h"
+#include "grmcdorman/device/DiagnosticsDisplay.h"
+#include "grmcdorman/device/Scheduler.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char diagnostics_name[] PROGMEM = "Diagnostics";
+        const char diagnostics_identifier[] PROGMEM = "diagnostics";
+
+#ifdef DEVICE_FRAMEWORK_TIMING
+        /**
+         * @brief Append one table cell with the summary of a set of statistics.
+         *
+         * @param text          Text to append to.
+         * @param statistics    The statistics.
+         */
+        void append_statistics(String &text, const TimingStatistics &statistics)
+        {
+            text += F("<td>");
+            if (statistics.get_count() != 0)
+            {
+                text += statistics.get_average_us();
+                text += '/';
+                text += statistics.get_maximum_us();
+                text += F(" µs (");
+                text += statistics.get_count();
+                text += ')';
+            }
+            text += F("</td>");
+        }
+#endif
+    }
+
+    DiagnosticsDisplay::DiagnosticsDisplay():
+        Device(FPSTR(diagnostics_name), FPSTR(diagnostics_identifier)),
+        title(F("<script>periodicUpdateList.push(\"diagnostics\");</script>")),
+        scheduler(F("Scheduler"), F("scheduler")),
+        timings(F("Device timings (mean/maximum, count)"), F("timings")),
+        boot(F("Boot timeline (ms since boot)"), F("boot"))
+    {
+        initialize({}, {&title, &scheduler, &timings, &boot});
+        scheduler.set_request_callback([this] (const ::grmcdorman::InfoSettingHtml &) {
+            String text;
+            text.reserve(80);
+            text = Scheduler::get_task_count();
+            text += F(" tasks; ");
+            text += Scheduler::get_run_count();
+            text += F(" runs in ");
+            text += Scheduler::get_wakeup_count();
+            text += F(" wake-ups");
+            scheduler.set(text);
+        });
+        timings.set_request_callback([this] (const ::grmcdorman::InfoSettingHtml &) {
+            on_request_timings();
+        });
+        boot.set_request_callback([this] (const ::grmcdorman::InfoSettingHtml &) {
+            on_request_boot();
+        });
+    }
+
+    void DiagnosticsDisplay::on_request_boot()
+    {
+        const auto &entries = BootSequence::get_entries();
+        if (entries.empty())
+        {
+            boot.set(F("Devices were not set up by BootSequence::setup_devices."));
+            return;
+        }
+
+        String text;
+        text.reserve(160 + 80 * entries.size());
+        text = F("<table><tr><th></th><th>phase</th><th>setup</th><th>µs</th><th>first reading</th></tr>");
+        for (const auto &entry: entries)
+        {
+            text += F("<tr><td>");
+            text += entry.device->name();
+            text += F("</td><td>");
+            text += BootSequence::get_phase_name(entry.phase);
+            text += F("</td><td>");
+            text += entry.setup_start_ms;
+            text += F("</td><td>");
+            text += entry.setup_us;
+            text += F("</td><td>");
+            if (entry.first_reading_ms != 0)
+            {
+                text += entry.first_reading_ms;
+            }
+            text += F("</td></tr>");
+        }
+        text += F("</table>Setup complete: ");
+        text += BootSequence::get_setup_complete_ms();
+        for (size_t index = 0; index < static_cast<size_t>(BootSequence::Milestone::COUNT); ++index)
+        {
+            auto milestone = static_cast<BootSequence::Milestone>(index);
+            if (BootSequence::get_milestone_ms(milestone) != 0)
+            {
+                text += F("; ");
+                text += BootSequence::get_milestone_name(milestone);
+                text += F(": ");
+                text += BootSequence::get_milestone_ms(milestone);
+            }
+        }
+        boot.set(text);
+    }
+
+    void DiagnosticsDisplay::on_request_timings()
+    {
+#ifdef DEVICE_FRAMEWORK_TIMING
+        if (devices == nullptr)
+        {
+            timings.set(String());
+            return;
+        }
+
+        String text;
+        text.reserve(96 + 112 * devices->size());
+        text = F("<table><tr><th></th><th>loop</th><th>task</th><th>publish</th><th>status</th></tr>");
+        for (const auto &device: *devices)
+        {
+            const auto &timing = device->get_timing();
+            text += F("<tr><td>");
+            text += device->name();
+            text += F("</td>");
+            append_statistics(text, timing.loop);
+            append_statistics(text, timing.task);
+            append_statistics(text, timing.publish);
+            append_statistics(text, timing.status);
+            text += F("</tr>");
+        }
+        text += F("</table>");
+        timings.set(text);
+#else
+        timings.set(F("Build with DEVICE_FRAMEWORK_TIMING defined to collect device timings."));
+#endif
+    }
+
+    DynamicJsonDocument DiagnosticsDisplay::as_json() const
+    {
+        size_t timing_capacity = 0;
+        if (DeviceTiming::ENABLED && devices != nullptr)
+        {
+            // One member per device, keyed by its (copied) identifier, holding its statistics.
+            timing_capacity = JSON_OBJECT_SIZE(devices->size()) + DeviceTiming::JSON_NAMES_SIZE;
+            for (const auto &device: *devices)
+            {
+                timing_capacity += DeviceTiming::JSON_CAPACITY + strlen_P(reinterpret_cast<const char *>(device->identifier())) + 1;
+            }
+        }
+        DynamicJsonDocument json(384 + BootSequence::get_json_capacity() + timing_capacity);
+
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("instrumented")] = DeviceTiming::ENABLED;
+        JsonObject scheduler_json = json.createNestedObject(F("scheduler"));
+        scheduler_json[F("tasks")] = Scheduler::get_task_count();
+        scheduler_json[F("runs")] = Scheduler::get_run_count();
+        scheduler_json[F("wakeups")] = Scheduler::get_wakeup_count();
+        JsonObject heap_json = json.createNestedObject(F("heap"));
+        heap_json[F("free")] = ESP.getFreeHeap();
+        heap_json[F("max_block")] = ESP.getMaxFreeBlockSize();
+        BootSequence::to_json(json.createNestedObject(F("boot")));
+
+#ifdef DEVICE_FRAMEWORK_TIMING
+        if (devices != nullptr)
+        {
+            JsonObject devices_json = json.createNestedObject(F("devices"));
+            for (const auto &device: *devices)
+            {
+                device->get_timing().to_json(devices_json.createNestedObject(device->identifier()));
+            }
+        }
+#endif
+
+        return json;
+    }
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <Arduino.h>
+#include <coredecls.h>
+#include <StreamString.h>
+#include <user_interface.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/DutyCycle.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char duty_cycle_name[] PROGMEM = "Duty Cycle";
+        const char duty_cycle_identifier[] PROGMEM = "duty_cycle";
+
+        /**
+         * @brief Get the record key for a device: the FNV-1a hash of its identifier.
+         *
+         * @param device    The device.
+         * @return The key.
+         */
+        uint32_t get_key(const Device *device)
+        {
+            uint32_t hash = 2166136261u;
+            for (const char *character = reinterpret_cast<const char *>(device->identifier()); pgm_read_byte(character) != '\0'; ++character)
+            {
+                hash = (hash ^ pgm_read_byte(character)) * 16777619u;
+            }
+            return hash;
+        }
+
+        constexpr size_t RECORD_HEADER_SIZE = sizeof(uint32_t) + 1;    //!< The size of a device record header: key and length.
+    }
+
+    DutyCycle::DutyCycle():
+        Device(FPSTR(duty_cycle_name), FPSTR(duty_cycle_identifier)),
+        notes(F("When enabled, the system wakes, takes one reading from each sensor, publishes, and enters deep sleep.<br>"
+            "D0 (GPIO16) must be connected to RST.<br>"
+            "After a power-on or reset, the system stays awake for the configuration window.")),
+        sleep_interval(F("Sleep interval (seconds); 0 to use the shortest polling interval"), F("sleep_interval")),
+        maximum_awake(F("Maximum time awake (seconds)"), F("maximum_awake")),
+        configuration_window(F("Configuration window after reset (seconds)"), F("configuration_window")),
+        device_status(F("Duty cycle status<script>periodicUpdateList.push(\"duty_cycle&setting=device_status\");</script>"), F("device_status"))
+    {
+        initialize({}, {&notes, &sleep_interval, &maximum_awake, &configuration_window, &device_status, &enabled});
+        sleep_interval.set(0);
+        maximum_awake.set(30);
+        configuration_window.set(120);
+
+        // Deep sleep makes the web interface unreachable most of the time; it must be explicitly enabled.
+        set_enabled(false);
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("Duty cycle is disabled"));
+                return;
+            }
+
+            device_status.set(get_status());
+        });
+    }
+
+    void DutyCycle::restore(const std::vector<Device *> &list)
+    {
+        woke = ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE;
+        if (!woke)
+        {
+            return;
+        }
+
+        uint32_t memory[RTC_SIZE / sizeof(uint32_t)];
+        if (!ESP.rtcUserMemoryRead(0, memory, sizeof(memory)))
+        {
+            return;
+        }
+
+        RtcHeader header;
+        memcpy(&header, memory, sizeof(header));
+        const uint8_t *records = reinterpret_cast<const uint8_t *>(memory) + sizeof(header);
+        if (header.magic != RTC_MAGIC || header.length > RTC_SIZE - sizeof(header) ||
+            crc32(records, header.length) != header.crc)
+        {
+            return;
+        }
+
+        wake_count = header.wake_count;
+        size_t offset = 0;
+        while (offset + RECORD_HEADER_SIZE <= header.length)
+        {
+            uint32_t key;
+            memcpy(&key, records + offset, sizeof(key));
+            size_t length = records[offset + sizeof(key)];
+            offset += RECORD_HEADER_SIZE;
+            if (offset + length > header.length)
+            {
+                break;
+            }
+
+            auto device = std::find_if(list.begin(), list.end(), [key] (const Device *device)
+            {
+                return get_key(device) == key;
+            });
+            if (device != list.end())
+            {
+                (*device)->restore_retained_state(records + offset, length, header.sleep_ms);
+            }
+            offset += length;
+        }
+        restored = true;
+    }
+
+    void DutyCycle::setup()
+    {
+    }
+
+    void DutyCycle::loop()
+    {
+        if (devices == nullptr || (!woke && millis() < configuration_window.get() * 1000))
+        {
+            return;
+        }
+
+        if (!started)
+        {
+            started = true;
+            start_ms = millis();
+            start_generations.resize(devices->size());
+            for (size_t index = 0; index < devices->size(); ++index)
+            {
+                auto device = (*devices)[index];
+                start_generations[index] = device->get_reading_generation();
+                if (device->is_enabled() && device->get_poll_interval() != 0)
+                {
+                    device->request_reading();
+                }
+            }
+            return;
+        }
+
+        bool done = true;
+        for (size_t index = 0; index < devices->size() && done; ++index)
+        {
+            auto device = (*devices)[index];
+            done = !device->is_enabled() || device->get_poll_interval() == 0 ||
+                device->get_reading_generation() != start_generations[index];
+        }
+
+        // Only once every reading is in; otherwise a publisher would publish a partial set.
+        if (done)
+        {
+            for (auto &device: *devices)
+            {
+                if (device != this && device->is_enabled() && !device->flush())
+                {
+                    done = false;
+                }
+            }
+        }
+
+        if (done || millis() - start_ms >= maximum_awake.get() * 1000)
+        {
+            sleep();
+        }
+    }
+
+    uint32_t DutyCycle::get_sleep_interval() const
+    {
+        if (sleep_interval.get() != 0)
+        {
+            return sleep_interval.get();
+        }
+
+        uint32_t interval = 0;
+        if (devices != nullptr)
+        {
+            for (auto &device: *devices)
+            {
+                uint32_t poll_interval = device->is_enabled() ? device->get_poll_interval() : 0;
+                if (poll_interval != 0 && (interval == 0 || poll_interval < interval))
+                {
+                    interval = poll_interval;
+                }
+            }
+        }
+        return interval != 0 ? interval : DEFAULT_SLEEP_INTERVAL;
+    }
+
+    void DutyCycle::sleep()
+    {
+        uint32_t memory[RTC_SIZE / sizeof(uint32_t)];
+        uint8_t *records = reinterpret_cast<uint8_t *>(memory) + sizeof(RtcHeader);
+        constexpr size_t capacity = RTC_SIZE - sizeof(RtcHeader);
+
+        size_t offset = 0;
+        for (auto &device: *devices)
+        {
+            if (offset + RECORD_HEADER_SIZE >= capacity)
+            {
+                break;
+            }
+
+            size_t space = std::min<size_t>(capacity - offset - RECORD_HEADER_SIZE, UINT8_MAX);
+            size_t length = device->save_retained_state(records + offset + RECORD_HEADER_SIZE, space);
+            if (length != 0 && length <= space)
+            {
+                uint32_t key = get_key(device);
+                memcpy(records + offset, &key, sizeof(key));
+                records[offset + sizeof(key)] = static_cast<uint8_t>(length);
+                offset += RECORD_HEADER_SIZE + length;
+            }
+        }
+
+        // Subtract the time awake, so that readings are taken at a steady rate.
+        uint64_t interval_ms = static_cast<uint64_t>(get_sleep_interval()) * 1000;
+        uint32_t awake_ms = millis();
+        uint64_t sleep_ms = std::max<uint64_t>(interval_ms > awake_ms ? interval_ms - awake_ms : 0, 1000);
+        sleep_ms = std::min<uint64_t>(sleep_ms, ESP.deepSleepMax() / 1000);
+
+        RtcHeader header{RTC_MAGIC, crc32(records, offset), static_cast<uint16_t>(offset),
+            static_cast<uint16_t>(wake_count + 1), static_cast<uint32_t>(sleep_ms)};
+        memcpy(memory, &header, sizeof(header));
+        ESP.rtcUserMemoryWrite(0, memory, sizeof(header) + ((offset + 3) & ~3u));
+
+        Serial.print(F("Entering deep sleep for "));
+        Serial.print(static_cast<uint32_t>(sleep_ms));
+        Serial.println(F(" ms"));
+        ESP.deepSleep(sleep_ms * 1000);
+    }
+
+    String DutyCycle::get_status() const
+    {
+        StreamString status;
+        status.reserve(100);
+        print_status(status);
+        return status;
+    }
+
+    void DutyCycle::print_status(Print &output) const
+    {
+        if (!woke && millis() < configuration_window.get() * 1000)
+        {
+            output.print(F("Configuration window; deep sleep starts in "));
+            output.print((configuration_window.get() * 1000 - millis()) / 1000);
+            output.print(F(" seconds"));
+        }
+        else
+        {
+            output.print(F("Awake for "));
+            output.print((millis() - start_ms) / 1000);
+            output.print(F(" seconds"));
+        }
+        output.print(F("; sleep interval "));
+        output.print(get_sleep_interval());
+        output.print(F(" seconds; wake count "));
+        output.print(wake_count);
+        if (woke && !restored)
+        {
+            output.print(F("; no retained state"));
+        }
+    }
+
+    uint32_t DutyCycle::get_status_version() const
+    {
+        uint32_t version = combine_status_version(wake_count, woke);
+        version = combine_status_version(version, restored);
+        version = combine_status_version(version, get_sleep_interval());
+        return combine_status_version(version, millis() / 1000);
+    }
+
+    bool DutyCycle::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("woke_from_sleep")] = woke;
+        json[F("state_restored")] = restored;
+        json[F("wake_count")] = wake_count;
+        json[F("sleep_interval")] = get_sleep_interval();
+        return true;
+    }
+}
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+#include <StreamString.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "grmcdorman/device/EspNowGateway.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char gateway_name[] PROGMEM = "ESP-NOW Gateway";
+        const char gateway_identifier[] PROGMEM = "esp_now_gateway";
+        const char remote_name[] PROGMEM = "Remote";
+        const char remote_identifier[] PROGMEM = "remote";
+        const char remote_attributes[] PROGMEM = "node,age_ms";
+        constexpr uint32_t DEFAULT_STALE_MS = 10 * 60 * 1000;  //!< The age of a stale value, for a node with no send interval.
+
+        /**
+         * @brief Copy the next null-terminated string out of a frame.
+         *
+         * @param[in,out] data  The string; advanced past its terminator.
+         * @param end           The end of the frame.
+         * @param destination   Receives the string, truncated if necessary.
+         * @param size          The size of `destination`.
+         * @return `false` if the frame ends before the terminator.
+         */
+        bool extract_string(const uint8_t *&data, const uint8_t *end, char *destination, size_t size)
+        {
+            const uint8_t *terminator = std::find(data, end, 0);
+            if (terminator == end)
+            {
+                return false;
+            }
+            size_t length = std::min<size_t>(terminator - data, size - 1);
+            memcpy(destination, data, length);
+            destination[length] = '\0';
+            data = terminator + 1;
+            return true;
+        }
+    }
+
+    EspNowRemoteNode::SlotNames::SlotNames(uint8_t slot)
+    {
+        snprintf_P(name, sizeof(name), PSTR("%S %u"), remote_name, slot + 1);
+        snprintf_P(identifier, sizeof(identifier), PSTR("%S_%u"), remote_identifier, slot + 1);
+        snprintf_P(status_label, sizeof(status_label),
+            PSTR("Node status<script>periodicUpdateList.push(\"%s&setting=device_status\");</script>"), identifier);
+    }
+
+    EspNowRemoteNode::RemoteDefinition::RemoteDefinition():
+        definition{name, unique_id, units, icon, field, Definition::Layout::VALUE, remote_attributes, 0.0f}
+    {
+    }
+
+    EspNowRemoteNode::EspNowRemoteNode(uint8_t slot):
+        Device(FPSTR(names.name), FPSTR(names.identifier)),
+        names(slot),
+        node_setting(F("Node chip ID (hexadecimal); empty to use the first unknown node"), F("node_id")),
+        device_status(FPSTR(names.status_label), F("device_status"))
+    {
+        initialize({}, {&node_setting, &device_status, &enabled});
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("Node is disabled"));
+                return;
+            }
+            device_status.set(get_status());
+        });
+    }
+
+    void EspNowRemoteNode::setup()
+    {
+        node_id = strtoul(node_setting.get().c_str(), nullptr, 16);
+    }
+
+    void EspNowRemoteNode::assign(uint32_t id)
+    {
+        node_id = id;
+        char text[9];
+        snprintf_P(text, sizeof(text), PSTR("%x"), id);
+        node_setting.set(text);
+        reset(0);
+    }
+
+    void EspNowRemoteNode::reset(size_t count)
+    {
+        values.assign(count, NAN);
+        remote_definitions.clear();
+        remote_definitions.resize(count);
+        received = false;
+        if (!get_definitions().empty())
+        {
+            set_definitions({});
+        }
+    }
+
+    void EspNowRemoteNode::receive(const EspNowProtocol::Header &header, const uint8_t *payload, size_t length)
+    {
+        if (!is_enabled())
+        {
+            return;
+        }
+
+        if (header.definition_count != values.size())
+        {
+            // The node's sensors changed (or this is the first frame); learn them again.
+            reset(std::min<size_t>(header.definition_count, EspNowProtocol::MAX_VALUES));
+        }
+
+        switch (header.type)
+        {
+            case EspNowProtocol::FrameType::READINGS:
+                receive_readings(header, payload, length);
+                break;
+
+            case EspNowProtocol::FrameType::DESCRIPTION:
+                receive_description(header, payload, length);
+                break;
+        }
+    }
+
+    void EspNowRemoteNode::receive_readings(const EspNowProtocol::Header &header, const uint8_t *payload, size_t length)
+    {
+        size_t count = std::min(values.size(), length / sizeof(float));
+        memcpy(values.data(), payload, count * sizeof(float));
+
+        if (received)
+        {
+            uint16_t missed = header.sequence - last_sequence - 1;
+            // A large gap is a restarted node, not lost frames.
+            if (missed < 100)
+            {
+                frames_lost += missed;
+            }
+        }
+
+        received = true;
+        last_sequence = header.sequence;
+        node_interval = header.send_interval;
+        last_receive_ms = millis();
+        ++readings_received;
+        clear_is_published();
+    }
+
+    void EspNowRemoteNode::receive_description(const EspNowProtocol::Header &, const uint8_t *payload, size_t length)
+    {
+        if (length < sizeof(EspNowProtocol::Description))
+        {
+            return;
+        }
+        EspNowProtocol::Description description;
+        memcpy(&description, payload, sizeof(description));
+        if (description.index >= remote_definitions.size())
+        {
+            return;
+        }
+
+        std::unique_ptr<RemoteDefinition> remote(new RemoteDefinition());
+        const uint8_t *data = payload + sizeof(description);
+        const uint8_t *end = payload + length;
+        char node_text[9];
+        char text[32];
+        snprintf_P(node_text, sizeof(node_text), PSTR("%x"), node_id);
+
+        if (!extract_string(data, end, text, sizeof(text)))
+        {
+            return;
+        }
+        snprintf_P(remote->name, sizeof(remote->name), PSTR(" Node %s%s"), node_text, text);
+        if (!extract_string(data, end, text, sizeof(text)))
+        {
+            return;
+        }
+        snprintf_P(remote->unique_id, sizeof(remote->unique_id), PSTR("_node_%s%s"), node_text, text);
+        if (!extract_string(data, end, remote->units, sizeof(remote->units)) ||
+            !extract_string(data, end, remote->icon, sizeof(remote->icon)) ||
+            !extract_string(data, end, remote->field, sizeof(remote->field)))
+        {
+            return;
+        }
+        remote->definition.change_threshold = description.change_threshold;
+
+        // Descriptions repeat; only a change is a new definition.
+        const auto &existing = remote_definitions[description.index];
+        if (existing && strcmp(existing->name, remote->name) == 0 && strcmp(existing->unique_id, remote->unique_id) == 0 &&
+            strcmp(existing->units, remote->units) == 0 && strcmp(existing->icon, remote->icon) == 0 &&
+            strcmp(existing->field, remote->field) == 0 && existing->definition.change_threshold == remote->definition.change_threshold)
+        {
+            return;
+        }
+        remote_definitions[description.index] = std::move(remote);
+
+        // The definitions are only published once all are known, so that the
+        // definition indices match the values.
+        if (std::all_of(remote_definitions.begin(), remote_definitions.end(), [] (const std::unique_ptr<RemoteDefinition> &definition)
+            {
+                return static_cast<bool>(definition);
+            }))
+        {
+            definition_list_t definition_list;
+            definition_list.reserve(remote_definitions.size());
+            for (const auto &definition: remote_definitions)
+            {
+                definition_list.push_back(&definition->definition);
+            }
+            set_definitions(std::move(definition_list));
+        }
+    }
+
+    bool EspNowRemoteNode::is_current() const
+    {
+        uint32_t stale_ms = node_interval != 0 ? 3 * 1000 * static_cast<uint32_t>(node_interval) : DEFAULT_STALE_MS;
+        return received && millis() - last_receive_ms < stale_ms;
+    }
+
+    bool EspNowRemoteNode::publish(DynamicJsonDocument &json) const
+    {
+        if (!is_enabled() || get_definitions().empty() || !is_current())
+        {
+            return false;
+        }
+
+        return serialize_into(json.createNestedObject(get_publish_key()));
+    }
+
+    bool EspNowRemoteNode::get_definition_value(size_t index, float &value) const
+    {
+        if (index >= get_definitions().size() || !is_current() || std::isnan(values[index]))
+        {
+            return false;
+        }
+        value = values[index];
+        return true;
+    }
+
+    bool EspNowRemoteNode::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        char node_text[9];
+        snprintf_P(node_text, sizeof(node_text), PSTR("%x"), node_id);
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("node")] = node_text;
+        if (!received)
+        {
+            return true;
+        }
+
+        json[F("age_ms")] = millis() - last_receive_ms;
+        json[F("sequence")] = last_sequence;
+        json[F("lost_frames")] = frames_lost;
+        for (size_t index = 0; index < remote_definitions.size(); ++index)
+        {
+            // Not-a-number is not valid JSON; an unavailable value is left out.
+            if (remote_definitions[index] && !std::isnan(values[index]))
+            {
+                json[remote_definitions[index]->field] = values[index];
+            }
+        }
+        return true;
+    }
+
+    String EspNowRemoteNode::get_status() const
+    {
+        StreamString status;
+        status.reserve(128);
+        print_status(status);
+        return status;
+    }
+
+    void EspNowRemoteNode::print_status(Print &output) const
+    {
+        if (node_id == 0)
+        {
+            output.print(F("Waiting for a node"));
+            return;
+        }
+
+        output.print(F("Node "));
+        output.print(node_id, HEX);
+        if (!received)
+        {
+            output.print(F(": no readings yet"));
+            return;
+        }
+        output.print(F(": "));
+        output.print(get_definitions().size());
+        output.print('/');
+        output.print(values.size());
+        output.print(F(" sensors described; "));
+        output.print(readings_received);
+        output.print(F(" readings received, "));
+        output.print(frames_lost);
+        output.print(F(" lost; last "));
+        output.print((millis() - last_receive_ms) / 1000);
+        output.print(F(" seconds ago"));
+    }
+
+    uint32_t EspNowRemoteNode::get_status_version() const
+    {
+        uint32_t version = combine_status_version(node_id, get_reading_generation());
+        version = combine_status_version(version, get_definitions().size());
+        return combine_status_version(version, (millis() - last_receive_ms) / 1000);
+    }
+
+    EspNowGateway *EspNowGateway::instance = nullptr;
+
+    EspNowGateway::EspNowGateway(uint8_t remote_count):
+        Device(FPSTR(gateway_name), FPSTR(gateway_identifier)),
+        notes(F("Receives readings from ESP-NOW sensor nodes; the nodes must be set to this gateway's WiFi channel, shown below.")),
+        device_status(F("Gateway status<script>periodicUpdateList.push(\"esp_now_gateway&setting=device_status\");</script>"), F("device_status"))
+    {
+        initialize({}, {&notes, &device_status, &enabled});
+        set_enabled(false);
+
+        remotes.reserve(remote_count);
+        remote_devices.reserve(remote_count);
+        for (uint8_t slot = 0; slot < remote_count; ++slot)
+        {
+            remotes.emplace_back(new EspNowRemoteNode(slot));
+            remote_devices.push_back(remotes.back().get());
+        }
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("ESP-NOW gateway is disabled"));
+                return;
+            }
+            device_status.set(get_status());
+        });
+    }
+
+    void EspNowGateway::setup()
+    {
+        if (!is_enabled() || started)
+        {
+            return;
+        }
+
+        WiFi.setSleepMode(WIFI_NONE_SLEEP);
+        if (esp_now_init() != 0)
+        {
+            return;
+        }
+        esp_now_set_self_role(ESP_NOW_ROLE_SLAVE);
+        instance = this;
+        esp_now_register_recv_cb(on_received);
+        started = true;
+    }
+
+    void EspNowGateway::loop()
+    {
+        while (receive_tail != receive_head)
+        {
+            process(received[receive_tail]);
+            receive_tail = (receive_tail + 1) % RECEIVE_QUEUE_SIZE;
+        }
+    }
+
+    void EspNowGateway::on_received(uint8_t *, uint8_t *data, uint8_t length)
+    {
+        if (instance == nullptr)
+        {
+            return;
+        }
+
+        uint8_t next = (instance->receive_head + 1) % RECEIVE_QUEUE_SIZE;
+        if (next == instance->receive_tail)
+        {
+            ++instance->frames_dropped;
+            return;
+        }
+
+        ReceivedFrame &frame = instance->received[instance->receive_head];
+        frame.length = std::min<size_t>(length, EspNowProtocol::MAX_FRAME_SIZE);
+        memcpy(frame.data, data, frame.length);
+        instance->receive_head = next;
+    }
+
+    void EspNowGateway::process(const ReceivedFrame &frame)
+    {
+        if (!EspNowProtocol::is_valid(frame.data, frame.length))
+        {
+            ++frames_invalid;
+            return;
+        }
+
+        EspNowProtocol::Header header;
+        memcpy(&header, frame.data, sizeof(header));
+        ++frames_received;
+
+        auto remote = std::find_if(remotes.begin(), remotes.end(), [&header] (const std::unique_ptr<EspNowRemoteNode> &node)
+        {
+            return node->get_node_id() == header.node_id;
+        });
+        if (remote == remotes.end())
+        {
+            remote = std::find_if(remotes.begin(), remotes.end(), [] (const std::unique_ptr<EspNowRemoteNode> &node)
+            {
+                return node->is_enabled() && node->get_node_id() == 0;
+            });
+            if (remote == remotes.end())
+            {
+                ++frames_unknown;
+                return;
+            }
+            (*remote)->assign(header.node_id);
+        }
+
+        (*remote)->receive(header, frame.data + sizeof(header), frame.length - sizeof(header));
+    }
+
+    bool EspNowGateway::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("started")] = started;
+        json[F("channel")] = WiFi.channel();
+        json[F("frames_received")] = frames_received;
+        json[F("frames_dropped")] = frames_dropped;
+        json[F("frames_invalid")] = frames_invalid;
+        json[F("frames_unknown")] = frames_unknown;
+        return true;
+    }
+
+    String EspNowGateway::get_status() const
+    {
+        StreamString status;
+        status.reserve(128);
+        print_status(status);
+        return status;
+    }
+
+    void EspNowGateway::print_status(Print &output) const
+    {
+        if (!started)
+        {
+            output.print(F("ESP-NOW is not started"));
+            return;
+        }
+
+        output.print(F("Listening on channel "));
+        output.print(WiFi.channel());
+        output.print(F("; "));
+        output.print(frames_received);
+        output.print(F(" frames received, "));
+        output.print(frames_dropped);
+        output.print(F(" dropped, "));
+        output.print(frames_invalid);
+        output.print(F(" invalid, "));
+        output.print(frames_unknown);
+        output.print(F(" from unknown nodes"));
+    }
+
+    uint32_t EspNowGateway::get_status_version() const
+    {
+        uint32_t version = combine_status_version(started, frames_received);
+        version = combine_status_version(version, frames_dropped);
+        version = combine_status_version(version, frames_invalid);
+        return combine_status_version(version, frames_unknown);
+    }
+}
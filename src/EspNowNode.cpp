@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+#include <StreamString.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "grmcdorman/device/EspNowNode.h"
+#include "grmcdorman/device/EspNowProtocol.h"
+#include "grmcdorman/device/TimingCoordinator.h"
+
+extern "C" {
+#include <user_interface.h>
+}
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char node_name[] PROGMEM = "ESP-NOW Node";
+        const char node_identifier[] PROGMEM = "esp_now_node";
+        constexpr uint32_t DEFAULT_SEND_INTERVAL = 30;  //!< Default send interval, in seconds.
+        constexpr uint32_t DEFAULT_CHANNEL = 1;         //!< Default WiFi channel.
+
+        /**
+         * @brief Parse a MAC address, as six hexadecimal bytes separated by colons.
+         *
+         * @param text          The text.
+         * @param[out] address  Receives the address.
+         * @return `true` if the text is an address.
+         */
+        bool parse_mac(const String &text, uint8_t address[6])
+        {
+            unsigned int bytes[6];
+            if (sscanf_P(text.c_str(), PSTR("%2x:%2x:%2x:%2x:%2x:%2x"), &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6)
+            {
+                return false;
+            }
+            std::copy(std::begin(bytes), std::end(bytes), address);
+            return true;
+        }
+
+        /**
+         * @brief Append a string, with its terminating null, to a frame.
+         *
+         * A string that does not fit is truncated.
+         *
+         * @param frame         The frame.
+         * @param[in,out] offset The end of the frame.
+         * @param value         The string; `nullptr` is written as an empty string.
+         * @return `false` if there is no space left at all.
+         */
+        bool append_string(uint8_t *frame, size_t &offset, const __FlashStringHelper *value)
+        {
+            if (offset >= EspNowProtocol::MAX_FRAME_SIZE)
+            {
+                return false;
+            }
+            char *destination = reinterpret_cast<char *>(frame + offset);
+            size_t space = EspNowProtocol::MAX_FRAME_SIZE - offset;
+            if (value == nullptr)
+            {
+                *destination = '\0';
+            }
+            else
+            {
+                strncpy_P(destination, reinterpret_cast<const char *>(value), space - 1);
+                destination[space - 1] = '\0';
+            }
+            offset += strlen(destination) + 1;
+            return true;
+        }
+    }
+
+    EspNowNode *EspNowNode::instance = nullptr;
+
+    EspNowNode::EspNowNode():
+        Device(FPSTR(node_name), FPSTR(node_identifier)),
+        notes(F("Sends the readings of this node to an ESP-NOW gateway, instead of publishing them to MQTT.<br>"
+            "The node must use the gateway's WiFi channel; if this node is not connected to an access point, the channel below is used.")),
+        gateway_address(F("Gateway MAC address (e.g. 5c:cf:7f:01:02:03); empty to broadcast"), F("gateway_address")),
+        channel(F("WiFi channel, when not connected to an access point"), F("channel")),
+        send_interval(F("Send interval (seconds)"), F("send_interval")),
+        device_status(F("Node status<script>periodicUpdateList.push(\"esp_now_node&setting=device_status\");</script>"), F("device_status"))
+    {
+        initialize({}, {&notes, &gateway_address, &channel, &send_interval, &device_status, &enabled});
+        channel.set(DEFAULT_CHANNEL);
+        send_interval.set(DEFAULT_SEND_INTERVAL);
+        set_enabled(false);
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("ESP-NOW node is disabled"));
+                return;
+            }
+
+            device_status.set(get_status());
+        });
+    }
+
+    void EspNowNode::setup()
+    {
+        if (!is_enabled() || devices == nullptr || started)
+        {
+            return;
+        }
+
+        if (!parse_mac(gateway_address.get(), gateway))
+        {
+            std::fill(std::begin(gateway), std::end(gateway), 0xFF);
+        }
+
+        if (!WiFi.isConnected())
+        {
+            if (WiFi.getMode() == WIFI_OFF)
+            {
+                WiFi.mode(WIFI_STA);
+            }
+            wifi_set_channel(channel.get());
+        }
+
+        if (esp_now_init() != 0)
+        {
+            return;
+        }
+        esp_now_set_self_role(ESP_NOW_ROLE_CONTROLLER);
+        esp_now_register_send_cb(on_sent);
+        esp_now_add_peer(gateway, ESP_NOW_ROLE_SLAVE, channel.get(), nullptr, 0);
+        instance = this;
+        started = true;
+
+        set_timer();
+    }
+
+    void EspNowNode::loop()
+    {
+        if (started && current_interval != send_interval.get())
+        {
+            set_timer();
+        }
+    }
+
+    void EspNowNode::set_timer()
+    {
+        current_interval = send_interval.get();
+        send_task.attach(std::max<uint32_t>(current_interval, 1), [this]
+        {
+            send();
+        });
+    }
+
+    void EspNowNode::send()
+    {
+        if (!started)
+        {
+            return;
+        }
+
+        uint32_t wait_ms = TimingCoordinator::get_wait_ms(TimingCoordinator::Activity::NETWORK_SEND);
+        if (wait_ms != 0)
+        {
+            // Past the scheduler's coalescing window, so that the retry is not run at once.
+            retry_task.once_ms(std::max(wait_ms, Scheduler::COALESCE_MS + 1), [this]
+            {
+                send();
+            });
+            return;
+        }
+
+        if (send_readings())
+        {
+            last_send_ms = millis();
+            ++sequence;
+            for (auto &device: *devices)
+            {
+                if (device->is_enabled())
+                {
+                    device->set_is_published();
+                }
+            }
+        }
+        send_description();
+    }
+
+    bool EspNowNode::send_readings()
+    {
+        size_t count = std::min(Device::get_definition_count(*devices), EspNowProtocol::MAX_VALUES);
+        if (count == 0)
+        {
+            return false;
+        }
+
+        uint8_t frame[EspNowProtocol::MAX_FRAME_SIZE];
+        EspNowProtocol::Header header{EspNowProtocol::MAGIC, EspNowProtocol::VERSION, EspNowProtocol::FrameType::READINGS,
+            static_cast<uint8_t>(count), ESP.getChipId(), sequence, static_cast<uint16_t>(std::min<uint32_t>(current_interval, UINT16_MAX))};
+        memcpy(frame, &header, sizeof(header));
+        size_t offset = sizeof(header);
+
+        size_t index = 0;
+        for (auto &device: *devices)
+        {
+            for (size_t definition = 0; definition < device->get_definitions().size() && index < count; ++definition, ++index)
+            {
+                float value;
+                if (!device->is_enabled() || !device->get_definition_value(definition, value))
+                {
+                    value = NAN;
+                }
+                memcpy(frame + offset, &value, sizeof(value));
+                offset += sizeof(value);
+            }
+        }
+
+        return send_frame(frame, offset);
+    }
+
+    bool EspNowNode::send_description()
+    {
+        size_t count = std::min(Device::get_definition_count(*devices), EspNowProtocol::MAX_VALUES);
+        if (description_index >= count)
+        {
+            description_index = 0;
+        }
+        const Definition *definition = Device::find_definition(*devices, description_index);
+        if (definition == nullptr)
+        {
+            return false;
+        }
+
+        uint8_t frame[EspNowProtocol::MAX_FRAME_SIZE];
+        EspNowProtocol::Header header{EspNowProtocol::MAGIC, EspNowProtocol::VERSION, EspNowProtocol::FrameType::DESCRIPTION,
+            static_cast<uint8_t>(count), ESP.getChipId(), sequence, static_cast<uint16_t>(std::min<uint32_t>(current_interval, UINT16_MAX))};
+        EspNowProtocol::Description description{description_index, {0, 0, 0}, definition->get_change_threshold()};
+        memcpy(frame, &header, sizeof(header));
+        memcpy(frame + sizeof(header), &description, sizeof(description));
+        size_t offset = sizeof(header) + sizeof(description);
+
+        append_string(frame, offset, definition->name_suffix != nullptr ? definition->get_name_suffix() : nullptr);
+        append_string(frame, offset, definition->unique_id_suffix != nullptr ? definition->get_unique_id_suffix() : nullptr);
+        append_string(frame, offset, definition->unit_of_measurement != nullptr ? definition->get_unit_of_measurement() : nullptr);
+        append_string(frame, offset, definition->icon != nullptr ? definition->get_icon() : nullptr);
+        if (!append_string(frame, offset, definition->get_sensor_name()))
+        {
+            // Too long to describe; skip it rather than send a partial description.
+            description_index = (description_index + 1) % count;
+            return false;
+        }
+
+        description_index = (description_index + 1) % count;
+        return send_frame(frame, offset);
+    }
+
+    bool EspNowNode::send_frame(const uint8_t *data, size_t length)
+    {
+        if (esp_now_send(gateway, const_cast<uint8_t *>(data), length) != 0)
+        {
+            ++frames_failed;
+            return false;
+        }
+        ++frames_sent;
+        ++sends_pending;
+        return true;
+    }
+
+    void EspNowNode::on_sent(uint8_t *, uint8_t status)
+    {
+        if (instance == nullptr)
+        {
+            return;
+        }
+        if (instance->sends_pending != 0)
+        {
+            --instance->sends_pending;
+        }
+        if (status == 0)
+        {
+            ++instance->frames_acknowledged;
+        }
+        else
+        {
+            ++instance->frames_failed;
+        }
+    }
+
+    bool EspNowNode::flush()
+    {
+        if (!is_enabled() || !started || devices == nullptr)
+        {
+            return true;
+        }
+
+        // Devices that always report themselves as unpublished (e.g. WiFi RSSI) do not hold up the flush.
+        if (std::any_of(devices->begin(), devices->end(), [] (const Device *device)
+            {
+                return device->is_enabled() && device->has_reading_generation() && !device->get_is_published();
+            }))
+        {
+            send();
+        }
+
+        return sends_pending == 0;
+    }
+
+    size_t EspNowNode::save_retained_state(uint8_t *buffer, size_t size)
+    {
+        if (size < sizeof(RetainedState))
+        {
+            return 0;
+        }
+        RetainedState state{sequence, description_index, 0};
+        memcpy(buffer, &state, sizeof(state));
+        return sizeof(state);
+    }
+
+    void EspNowNode::restore_retained_state(const uint8_t *buffer, size_t size, uint32_t)
+    {
+        if (size == sizeof(RetainedState))
+        {
+            RetainedState state;
+            memcpy(&state, buffer, sizeof(state));
+            sequence = state.sequence;
+            description_index = state.description_index;
+        }
+    }
+
+    bool EspNowNode::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("started")] = started;
+        json[F("channel")] = WiFi.channel();
+        json[F("frames_sent")] = frames_sent;
+        json[F("frames_acknowledged")] = frames_acknowledged;
+        json[F("frames_failed")] = frames_failed;
+        json[F("last_send_ms")] = millis() - last_send_ms;
+        return true;
+    }
+
+    String EspNowNode::get_status() const
+    {
+        StreamString status;
+        status.reserve(128);
+        print_status(status);
+        return status;
+    }
+
+    void EspNowNode::print_status(Print &output) const
+    {
+        if (!started)
+        {
+            output.print(F("ESP-NOW is not started"));
+            return;
+        }
+
+        output.print(F("Channel "));
+        output.print(WiFi.channel());
+        output.print(F("; "));
+        output.print(frames_sent);
+        output.print(F(" frames sent, "));
+        output.print(frames_acknowledged);
+        output.print(F(" acknowledged, "));
+        output.print(frames_failed);
+        output.print(F(" failed"));
+        if (sequence != 0)
+        {
+            output.print(F("; last readings sent "));
+            output.print((millis() - last_send_ms) / 1000);
+            output.print(F(" seconds ago"));
+        }
+    }
+
+    uint32_t EspNowNode::get_status_version() const
+    {
+        uint32_t version = combine_status_version(started, frames_sent);
+        version = combine_status_version(version, frames_acknowledged);
+        version = combine_status_version(version, frames_failed);
+        return combine_status_version(version, (millis() - last_send_ms) / 1000);
+    }
+}
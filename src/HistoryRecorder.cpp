@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <LittleFS.h>
+#include <StreamString.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/HistoryRecorder.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char history_name[] PROGMEM = "History";
+        const char history_identifier[] PROGMEM = "history";
+
+        const char name_1m[] PROGMEM = "1m";
+        const char name_15m[] PROGMEM = "15m";
+        const char name_1h[] PROGMEM = "1h";
+
+        /**
+         * @brief The description of one resolution.
+         *
+         * The file paths are in RAM, as required by the file system.
+         */
+        struct Resolution
+        {
+            uint32_t period;            //!< The period, in seconds.
+            const char *name;           //!< The name, in PROGMEM.
+            const char *path;           //!< The current file path.
+            const char *old_path;       //!< The previous file path.
+        };
+
+        const Resolution resolutions[HistoryRecorder::RESOLUTION_COUNT] =
+        {
+            { 60, name_1m, "/history_1m.bin", "/history_1m.old" },
+            { 900, name_15m, "/history_15m.bin", "/history_15m.old" },
+            { 3600, name_1h, "/history_1h.bin", "/history_1h.old" },
+        };
+    }
+
+    HistoryRecorder::Query::Query(const HistoryRecorder &recorder, size_t resolution, bool all_sensors, size_t index, uint32_t from, uint32_t to):
+        recorder(recorder),
+        resolution(resolution),
+        all_sensors(all_sensors),
+        index(index),
+        from(from),
+        to(to),
+        generation(recorder.generation[resolution]),
+        file_records{recorder.old_records[resolution], recorder.current_records[resolution]},
+        pending(recorder.pending[resolution])
+    {
+    }
+
+    size_t HistoryRecorder::Query::read(uint8_t *buffer, size_t length)
+    {
+        size_t written = 0;
+        while (written < length)
+        {
+            if (line_position == line_length && !next_line())
+            {
+                break;
+            }
+
+            size_t part = std::min(length - written, line_length - line_position);
+            memcpy(buffer + written, line + line_position, part);
+            written += part;
+            line_position += part;
+        }
+        return written;
+    }
+
+    bool HistoryRecorder::Query::next_line()
+    {
+        line_position = 0;
+        line_length = 0;
+        switch (stage)
+        {
+            case 0:
+            {
+                char name[8];
+                strlcpy_P(name, resolutions[resolution].name, sizeof(name));
+                line_length = snprintf_P(line, sizeof(line), PSTR("{\"resolution\":\"%s\",\"period\":%u,\"records\":["),
+                    name, static_cast<unsigned>(resolutions[resolution].period));
+                stage = 1;
+                return true;
+            }
+
+            case 1:
+            {
+                Record record;
+                const Definition *definition = nullptr;
+                while (definition == nullptr)
+                {
+                    if (!next_record(record))
+                    {
+                        line[0] = ']';
+                        line[1] = '}';
+                        line_length = 2;
+                        stage = 2;
+                        return true;
+                    }
+                    // Records for definitions that no longer exist are skipped.
+                    definition = recorder.devices != nullptr ? Device::find_definition(*recorder.devices, record.index) : nullptr;
+                }
+
+                char minimum[16];
+                char mean[16];
+                char maximum[16];
+                dtostrf(record.minimum, 1, 2, minimum);
+                dtostrf(record.mean, 1, 2, mean);
+                dtostrf(record.maximum, 1, 2, maximum);
+                char sensor[48];
+                strlcpy_P(sensor, reinterpret_cast<const char *>(definition->get_sensor_name()), sizeof(sensor));
+                line_length = snprintf_P(line, sizeof(line),
+                    PSTR("%s{\"time\":%u,\"sensor\":\"%s\",\"min\":%s,\"mean\":%s,\"max\":%s,\"count\":%u}"),
+                    first_record ? "" : ",", static_cast<unsigned>(record.timestamp), sensor, minimum, mean, maximum, record.count);
+                line_length = std::min(line_length, sizeof(line) - 1);
+                first_record = false;
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    bool HistoryRecorder::Query::next_record(Record &record)
+    {
+        while (source < 3)
+        {
+            if (source < 2)
+            {
+                // File records are abandoned if the files are rotated; they
+                // are no longer the files that were counted.
+                if (position < file_records[source] && generation == recorder.generation[resolution])
+                {
+                    if (!file)
+                    {
+                        const char *path = source == 0 ? resolutions[resolution].old_path : resolutions[resolution].path;
+                        file = LittleFS.open(path, "r");
+                    }
+
+                    if (file && file.read(reinterpret_cast<uint8_t *>(&record), sizeof(Record)) == sizeof(Record))
+                    {
+                        ++position;
+                    }
+                    else
+                    {
+                        position = file_records[source];
+                        continue;
+                    }
+                }
+                else
+                {
+                    file.close();
+                    ++source;
+                    position = 0;
+                    continue;
+                }
+            }
+            else if (position < pending.size())
+            {
+                record = pending[position++];
+            }
+            else
+            {
+                ++source;
+                continue;
+            }
+
+            if (record.timestamp > to)
+            {
+                // Records are in time order; nothing later can match.
+                file.close();
+                source = 3;
+                return false;
+            }
+
+            if (matches(record))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool HistoryRecorder::Query::matches(const Record &record) const
+    {
+        return record.timestamp >= from && (all_sensors || record.index == index);
+    }
+
+    HistoryRecorder::HistoryRecorder():
+        Device(FPSTR(history_name), FPSTR(history_identifier)),
+        notes(F("Records the minimum, mean and maximum of each sensor at one minute, fifteen minute, and one hour resolutions.<br>"
+            "Recording starts once the system time is set.<br>"
+            "The history is available from <em>/rest/history/get</em> if the REST API is installed.")),
+        sample_interval(F("Sample interval (seconds)"), F("sample_interval")),
+        file_size(F("History file size for each resolution (kilobytes)"), F("file_size")),
+        device_status(F("History status<script>periodicUpdateList.push(\"history&setting=device_status\");</script>"), F("device_status"))
+    {
+        initialize({}, {&notes, &sample_interval, &file_size, &device_status, &enabled});
+        sample_interval.set(10);
+        file_size.set(64);
+
+        // Recording writes to flash; it must be explicitly enabled.
+        set_enabled(false);
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("History is disabled"));
+                return;
+            }
+
+            device_status.set(get_status());
+        });
+    }
+
+    void HistoryRecorder::setup()
+    {
+        for (size_t resolution = 0; resolution < RESOLUTION_COUNT; ++resolution)
+        {
+            pending[resolution].reserve(RAM_RECORDS);
+            current_records[resolution] = count_records(resolutions[resolution].path);
+            old_records[resolution] = count_records(resolutions[resolution].old_path);
+        }
+
+        if (is_enabled())
+        {
+            set_timer();
+        }
+    }
+
+    void HistoryRecorder::loop()
+    {
+        if (current_sample_seconds != sample_interval.get() || !sample_task.active())
+        {
+            set_timer();
+        }
+    }
+
+    void HistoryRecorder::set_timer()
+    {
+        current_sample_seconds = sample_interval.get();
+        sample_task.attach(current_sample_seconds, [this]
+        {
+            record();
+        });
+    }
+
+    void HistoryRecorder::record()
+    {
+        if (!is_enabled() || devices == nullptr)
+        {
+            return;
+        }
+
+        time_t now = time(nullptr);
+        clock_set = now >= MINIMUM_VALID_TIME;
+        if (!clock_set)
+        {
+            return;
+        }
+
+        size_t count = Device::get_definition_count(*devices);
+        if (count != definition_count)
+        {
+            definition_count = count;
+            buckets.assign(definition_count * RESOLUTION_COUNT, Bucket());
+        }
+
+        // Shorter periods are closed first, so that they are included in the longer ones.
+        for (size_t resolution = 0; resolution < RESOLUTION_COUNT; ++resolution)
+        {
+            uint32_t start = now - now % resolutions[resolution].period;
+            if (start != period_start[resolution])
+            {
+                close_period(resolution, now);
+                period_start[resolution] = start;
+            }
+        }
+
+        sample();
+
+        for (size_t resolution = 0; resolution < RESOLUTION_COUNT; ++resolution)
+        {
+            if (!pending[resolution].empty() &&
+                (pending[resolution].size() >= RAM_RECORDS || now - pending_since[resolution] >= FLUSH_INTERVAL))
+            {
+                flush(resolution);
+            }
+        }
+    }
+
+    void HistoryRecorder::sample()
+    {
+        size_t value_index = 0;
+        for (auto &device : *devices)
+        {
+            size_t definitions = device->get_definitions().size();
+            if (device->is_enabled())
+            {
+                for (size_t index = 0; index < definitions; ++index)
+                {
+                    float value;
+                    if (!device->get_definition_value(index, value))
+                    {
+                        continue;
+                    }
+
+                    Bucket &bucket = buckets[value_index + index];
+                    if (bucket.count == 0)
+                    {
+                        bucket.minimum = value;
+                        bucket.maximum = value;
+                    }
+                    else
+                    {
+                        bucket.minimum = std::min(bucket.minimum, value);
+                        bucket.maximum = std::max(bucket.maximum, value);
+                    }
+                    bucket.sum += value;
+                    ++bucket.count;
+                }
+            }
+            value_index += definitions;
+        }
+    }
+
+    void HistoryRecorder::close_period(size_t resolution, uint32_t now)
+    {
+        for (size_t index = 0; index < definition_count; ++index)
+        {
+            Bucket &bucket = buckets[resolution * definition_count + index];
+            if (bucket.count == 0)
+            {
+                continue;
+            }
+
+            if (resolution == 0)
+            {
+                for (size_t longer = 1; longer < RESOLUTION_COUNT; ++longer)
+                {
+                    Bucket &combined = buckets[longer * definition_count + index];
+                    if (combined.count == 0)
+                    {
+                        combined.minimum = bucket.minimum;
+                        combined.maximum = bucket.maximum;
+                    }
+                    else
+                    {
+                        combined.minimum = std::min(combined.minimum, bucket.minimum);
+                        combined.maximum = std::max(combined.maximum, bucket.maximum);
+                    }
+                    combined.sum += bucket.sum;
+                    combined.count += bucket.count;
+                }
+            }
+
+            if (pending[resolution].empty())
+            {
+                pending_since[resolution] = now;
+            }
+            else if (pending[resolution].size() >= RAM_RECORDS)
+            {
+                flush(resolution);
+                pending_since[resolution] = now;
+            }
+
+            pending[resolution].push_back(Record{period_start[resolution], static_cast<uint16_t>(index), bucket.count,
+                bucket.minimum, bucket.sum / bucket.count, bucket.maximum});
+            bucket = Bucket();
+        }
+    }
+
+    void HistoryRecorder::flush(size_t resolution)
+    {
+        auto &records = pending[resolution];
+        if (records.empty())
+        {
+            return;
+        }
+
+        if (current_records[resolution] > 0 &&
+            (current_records[resolution] + records.size()) * sizeof(Record) > file_size.get() * 1024)
+        {
+            rotate(resolution);
+        }
+
+        File file = LittleFS.open(resolutions[resolution].path, "a");
+        if (file)
+        {
+            size_t bytes = records.size() * sizeof(Record);
+            size_t written = file.write(reinterpret_cast<const uint8_t *>(records.data()), bytes);
+            if (written != bytes)
+            {
+                ++write_errors;
+                // Keep the file to whole records.
+                written -= written % sizeof(Record);
+                file.truncate(current_records[resolution] * sizeof(Record) + written);
+            }
+            current_records[resolution] += written / sizeof(Record);
+            file.close();
+        }
+        else
+        {
+            ++write_errors;
+        }
+
+        // Records that could not be written are discarded; the RAM tier does not grow.
+        records.clear();
+    }
+
+    void HistoryRecorder::rotate(size_t resolution)
+    {
+        const char *old_path = resolutions[resolution].old_path;
+        if (LittleFS.exists(old_path))
+        {
+            LittleFS.remove(old_path);
+        }
+        LittleFS.rename(resolutions[resolution].path, old_path);
+        old_records[resolution] = current_records[resolution];
+        current_records[resolution] = 0;
+        ++generation[resolution];
+    }
+
+    size_t HistoryRecorder::count_records(const char *path)
+    {
+        if (!LittleFS.exists(path))
+        {
+            return 0;
+        }
+
+        File file = LittleFS.open(path, "r+");
+        if (!file)
+        {
+            return 0;
+        }
+
+        size_t size = file.size();
+        if (size % sizeof(Record) != 0)
+        {
+            size -= size % sizeof(Record);
+            file.truncate(size);
+        }
+        file.close();
+        return size / sizeof(Record);
+    }
+
+    bool HistoryRecorder::find_resolution(const String &name, size_t &resolution)
+    {
+        for (size_t index = 0; index < RESOLUTION_COUNT; ++index)
+        {
+            if (strcmp_P(name.c_str(), resolutions[index].name) == 0)
+            {
+                resolution = index;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool HistoryRecorder::find_sensor(const String &name, size_t &index) const
+    {
+        if (devices == nullptr)
+        {
+            return false;
+        }
+
+        size_t definition_index = 0;
+        for (auto &device : *devices)
+        {
+            for (auto &definition : device->get_definitions())
+            {
+                if (strcmp_P(name.c_str(), reinterpret_cast<const char *>(definition->get_sensor_name())) == 0)
+                {
+                    index = definition_index;
+                    return true;
+                }
+                ++definition_index;
+            }
+        }
+        return false;
+    }
+
+    String HistoryRecorder::get_status() const
+    {
+        StreamString status;
+        status.reserve(80);
+        print_status(status);
+        return status;
+    }
+
+    void HistoryRecorder::print_status(Print &output) const
+    {
+        if (!clock_set)
+        {
+            output.print(F("Waiting for the system time to be set"));
+            return;
+        }
+
+        output.print(F("Records"));
+        for (size_t resolution = 0; resolution < RESOLUTION_COUNT; ++resolution)
+        {
+            output.print(resolution == 0 ? F(" ") : F(", "));
+            output.print(FPSTR(resolutions[resolution].name));
+            output.print(F(": "));
+            output.print(current_records[resolution] + old_records[resolution] + pending[resolution].size());
+        }
+        if (write_errors != 0)
+        {
+            output.print(F("; write errors: "));
+            output.print(write_errors);
+        }
+    }
+
+    uint32_t HistoryRecorder::get_status_version() const
+    {
+        uint32_t version = combine_status_version(clock_set, write_errors);
+        for (size_t resolution = 0; resolution < RESOLUTION_COUNT; ++resolution)
+        {
+            version = combine_status_version(version, current_records[resolution] + old_records[resolution] + pending[resolution].size());
+        }
+        return version;
+    }
+
+    bool HistoryRecorder::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("clock_set")] = clock_set;
+        json[F("write_errors")] = write_errors;
+        for (size_t resolution = 0; resolution < RESOLUTION_COUNT; ++resolution)
+        {
+            JsonObject resolution_json = json.createNestedObject(FPSTR(resolutions[resolution].name));
+            resolution_json[F("records")] = current_records[resolution] + old_records[resolution];
+            resolution_json[F("pending")] = pending[resolution].size();
+        }
+        return true;
+    }
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <Wire.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/I2cBus.h"
+
+namespace grmcdorman::device
+{
+    std::vector<I2cBus::Conversion *> I2cBus::conversions;
+    Scheduler::Task I2cBus::batch_task;
+    bool I2cBus::converting = false;
+    uint32_t I2cBus::batch_started_ms = 0;
+    uint32_t I2cBus::batch_conversion_ms = 0;
+    bool I2cBus::started = false;
+    int I2cBus::sda_pin = -1;
+    int I2cBus::scl_pin = -1;
+    uint32_t I2cBus::clock = I2cBus::FAST_MODE_CLOCK;
+    uint32_t I2cBus::batch_count = 0;
+    uint32_t I2cBus::conversion_count = 0;
+
+    bool I2cBus::Conversion::request()
+    {
+        if (state != State::IDLE)
+        {
+            return false;
+        }
+
+        state = State::WAITING;
+        conversions.push_back(this);
+        schedule_batch();
+        return true;
+    }
+
+    void I2cBus::Conversion::cancel()
+    {
+        if (state == State::IDLE)
+        {
+            return;
+        }
+
+        state = State::IDLE;
+        auto iterator = std::find(conversions.begin(), conversions.end(), this);
+        if (iterator != conversions.end())
+        {
+            conversions.erase(iterator);
+        }
+    }
+
+    bool I2cBus::begin(int sda, int scl, uint32_t maximum_clock)
+    {
+        if (started && (sda != sda_pin || scl != scl_pin))
+        {
+            return false;
+        }
+
+        uint32_t new_clock = std::min(clock, std::max(maximum_clock, STANDARD_MODE_CLOCK));
+        if (!started)
+        {
+            sda_pin = sda;
+            scl_pin = scl;
+            started = true;
+            Wire.begin(sda, scl);
+        }
+        else if (new_clock == clock)
+        {
+            return true;
+        }
+
+        clock = new_clock;
+        Wire.setClock(clock);
+        return true;
+    }
+
+    void I2cBus::restore_clock()
+    {
+        if (started)
+        {
+            Wire.setClock(clock);
+        }
+    }
+
+    void I2cBus::schedule_batch()
+    {
+        if (!converting && !batch_task.active())
+        {
+            // Conversions requested by tasks in the same scheduler wake-up join this batch;
+            // the scheduler runs tasks due within `COALESCE_MS` in one wake-up.
+            batch_task.once_ms(Scheduler::COALESCE_MS + 1, start_batch);
+        }
+    }
+
+    void I2cBus::start_batch()
+    {
+        uint32_t conversion_ms = 0;
+        for (auto conversion : conversions)
+        {
+            if (conversion->state == Conversion::State::WAITING)
+            {
+                conversion->state = Conversion::State::CONVERTING;
+                conversion_ms = std::max(conversion_ms, conversion->conversion_ms);
+                conversion->start_callback();
+                ++conversion_count;
+            }
+        }
+
+        ++batch_count;
+        converting = true;
+        batch_started_ms = millis();
+        batch_conversion_ms = conversion_ms;
+        batch_task.once_ms(conversion_ms, finish_batch);
+    }
+
+    void I2cBus::finish_batch()
+    {
+        if (millis() - batch_started_ms < batch_conversion_ms)
+        {
+            // Run early by the scheduler; wait until the next wake-up.
+            batch_task.once_ms(Scheduler::COALESCE_MS + 1, finish_batch);
+            return;
+        }
+
+        // Take the started conversions off the list first; the callbacks may request them again.
+        std::vector<Conversion *> finished;
+        finished.reserve(conversions.size());
+        auto end = std::stable_partition(conversions.begin(), conversions.end(), [] (const Conversion *conversion)
+        {
+            return conversion->state != Conversion::State::CONVERTING;
+        });
+        finished.assign(end, conversions.end());
+        conversions.erase(end, conversions.end());
+        converting = false;
+
+        for (auto conversion : finished)
+        {
+            conversion->state = Conversion::State::IDLE;
+        }
+        for (auto conversion : finished)
+        {
+            conversion->finish_callback();
+        }
+
+        if (!conversions.empty())
+        {
+            schedule_batch();
+        }
+    }
+}
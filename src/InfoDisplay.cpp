@@ -24,6 +24,7 @@
 #include <LittleFS.h>
 
 #include "grmcdorman/device/InfoDisplay.h"
+#include "grmcdorman/device/MemoryGovernor.h"
 
 namespace grmcdorman::device
 {
@@ -168,54 +169,57 @@ namespace grmcdorman::device
             return;
         }
 
-        // Get all enabled devices reporting a non-blank status message.
-        // These arrays are going to be oversized; the extra values should
-        // not hurt.
-        String messages[devices->size()];
-        const __FlashStringHelper *names[devices->size()];
-        int count = 0;
-        size_t message_bytes(0);
+        // The key covers which devices are reporting, and their status versions.
+        uint32_t key = 2166136261u;
         for (const auto &device: *devices)
         {
-            if (!device->is_enabled() || device == this || device == nullptr)
+            if (device == nullptr || device == this || !device->is_enabled())
             {
                 continue;
             }
 
-            messages[count] = device->get_status();
-            if (!messages[count].isEmpty())
-            {
-                names[count] = device->name();
-                // Each message line format:
-                // <device-name>: <message><br>
-                // i.e device name length, 2 characters, message length, 4 characters.
-                message_bytes += messages[count].length() + strlen_P(reinterpret_cast<const char *>(device->name())) + 6;
-                ++count;
-            }
+            key = combine_status_version(key, reinterpret_cast<uintptr_t>(device));
+            key = combine_status_version(key, device->get_status_version());
         }
 
-        if (message_bytes > 0)
+        // While memory is low, the last status is shown rather than building a new one.
+        if (!status_valid || (key != status_key && MemoryGovernor::allow(MemoryGovernor::Action::STATUS_UPDATE)))
         {
-            String full_message;
-            full_message.reserve(message_bytes);
-            for (int index = 0; index < count; ++index)
+            // Each message line format:
+            // <device-name>: <message><br>
+            // The text is written in place; its buffer is kept between requests.
+            status_text.remove(0);
+            for (const auto &device: *devices)
             {
-                if (index != 0)
+                if (device == nullptr || device == this || !device->is_enabled())
+                {
+                    continue;
+                }
+
+                auto start = status_text.length();
+                if (start != 0)
+                {
+                    status_text.print(F("<br>"));
+                }
+                status_text.print(device->name());
+                status_text.print(F(": "));
+                auto message_start = status_text.length();
+                {
+                    DEVICE_TIMING_SCOPE(&device->get_timing().status);
+                    device->print_status(status_text);
+                }
+                if (status_text.length() == message_start)
                 {
-                    full_message += F("<br>");
+                    // No status; remove the name.
+                    status_text.remove(start);
                 }
-                full_message += names[index];
-                full_message += ':';
-                full_message += ' ';
-                full_message += messages[index];
             }
 
-            device_status.set(full_message);
-        }
-        else
-        {
-            device_status.set(String());
+            status_key = key;
+            status_valid = true;
         }
+
+        device_status.set(status_text);
     }
 
     DynamicJsonDocument InfoDisplay::as_json() const
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include <StreamString.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/MemoryGovernor.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char governor_name[] PROGMEM = "Memory Governor";
+        const char governor_identifier[] PROGMEM = "memory_governor";
+        const char *const level_names[] = {"normal", "constrained", "critical"};
+        const char *const action_names[] = {"discovery", "rest_response", "publish_batch", "status_update"};
+
+        constexpr uint32_t DEFAULT_CONSTRAINED_FREE_HEAP = 12000;  //!< Default constrained budget, free heap.
+        constexpr uint32_t DEFAULT_CONSTRAINED_MAX_BLOCK = 6000;   //!< Default constrained budget, largest block.
+        constexpr uint32_t DEFAULT_CRITICAL_FREE_HEAP = 6000;      //!< Default critical budget, free heap.
+        constexpr uint32_t DEFAULT_CRITICAL_MAX_BLOCK = 2500;      //!< Default critical budget, largest block.
+
+        /**
+         * @brief Subtract without wrapping below zero.
+         *
+         * @param value     The value.
+         * @param amount    The amount to subtract.
+         * @return The difference, or zero.
+         */
+        uint32_t subtract(uint32_t value, uint32_t amount)
+        {
+            return value > amount ? value - amount : 0;
+        }
+    }
+
+    bool MemoryGovernor::active = false;
+    MemoryGovernor::Level MemoryGovernor::level = MemoryGovernor::Level::NORMAL;
+    uint32_t MemoryGovernor::constrained_free_heap = DEFAULT_CONSTRAINED_FREE_HEAP;
+    uint32_t MemoryGovernor::constrained_max_block = DEFAULT_CONSTRAINED_MAX_BLOCK;
+    uint32_t MemoryGovernor::critical_free_heap = DEFAULT_CRITICAL_FREE_HEAP;
+    uint32_t MemoryGovernor::critical_max_block = DEFAULT_CRITICAL_MAX_BLOCK;
+    uint32_t MemoryGovernor::free_heap_low_water = UINT32_MAX;
+    uint32_t MemoryGovernor::max_block_low_water = UINT32_MAX;
+    uint32_t MemoryGovernor::constrained_count = 0;
+    uint32_t MemoryGovernor::critical_count = 0;
+    uint32_t MemoryGovernor::denied[static_cast<size_t>(Action::COUNT)];
+
+    MemoryGovernor::MemoryGovernor():
+        Device(FPSTR(governor_name), FPSTR(governor_identifier)),
+        notes(F("Defers discovery, MQTT batches, web status and REST responses when the heap is low.<br>"
+            "Budgets are in bytes; zero disables a budget.")),
+        constrained_free_setting(F("Constrained below free heap"), F("constrained_free_heap")),
+        constrained_block_setting(F("Constrained below largest free block"), F("constrained_max_block")),
+        critical_free_setting(F("Critical below free heap"), F("critical_free_heap")),
+        critical_block_setting(F("Critical below largest free block"), F("critical_max_block")),
+        device_status(F("Memory status<script>periodicUpdateList.push(\"memory_governor&setting=device_status\");</script>"), F("device_status"))
+    {
+        initialize({}, {&notes, &constrained_free_setting, &constrained_block_setting, &critical_free_setting, &critical_block_setting,
+            &device_status, &enabled});
+        constrained_free_setting.set(DEFAULT_CONSTRAINED_FREE_HEAP);
+        constrained_block_setting.set(DEFAULT_CONSTRAINED_MAX_BLOCK);
+        critical_free_setting.set(DEFAULT_CRITICAL_FREE_HEAP);
+        critical_block_setting.set(DEFAULT_CRITICAL_MAX_BLOCK);
+
+        device_status.set_request_callback([this] (const InfoSettingHtml &)
+        {
+            if (!is_enabled())
+            {
+                device_status.set(F("Memory governor is disabled"));
+                return;
+            }
+            device_status.set(get_status());
+        });
+    }
+
+    void MemoryGovernor::setup()
+    {
+        active = is_enabled();
+        loop();
+    }
+
+    void MemoryGovernor::loop()
+    {
+        active = is_enabled();
+        if (!active)
+        {
+            level = Level::NORMAL;
+            return;
+        }
+
+        constrained_free_heap = constrained_free_setting.get();
+        constrained_max_block = constrained_block_setting.get();
+        critical_free_heap = critical_free_setting.get();
+        critical_max_block = critical_block_setting.get();
+
+        // Between requests, so that the low-water marks include what runs in between.
+        if (millis() - last_sample_ms >= SAMPLE_INTERVAL_MS)
+        {
+            last_sample_ms = millis();
+            sample();
+        }
+    }
+
+    MemoryGovernor::Level MemoryGovernor::classify(uint32_t free_heap, uint32_t max_block)
+    {
+        if (free_heap < critical_free_heap || max_block < critical_max_block)
+        {
+            return Level::CRITICAL;
+        }
+        if (free_heap < constrained_free_heap || max_block < constrained_max_block)
+        {
+            return Level::CONSTRAINED;
+        }
+        return Level::NORMAL;
+    }
+
+    MemoryGovernor::Level MemoryGovernor::sample()
+    {
+        uint32_t free_heap = ESP.getFreeHeap();
+        uint32_t max_block = ESP.getMaxFreeBlockSize();
+        free_heap_low_water = std::min(free_heap_low_water, free_heap);
+        max_block_low_water = std::min(max_block_low_water, max_block);
+
+        Level current = classify(free_heap, max_block);
+        if (current < level)
+        {
+            // Recover only with some margin, so that the level does not flap.
+            current = std::max(current, classify(subtract(free_heap, HYSTERESIS), subtract(max_block, HYSTERESIS)));
+        }
+        else if (current > level)
+        {
+            ++(current == Level::CRITICAL ? critical_count : constrained_count);
+        }
+        level = current;
+        return level;
+    }
+
+    bool MemoryGovernor::allow(Action action, size_t in_use)
+    {
+        if (!active)
+        {
+            return true;
+        }
+
+        Level current = sample();
+        bool allowed = true;
+        switch (action)
+        {
+            case Action::DISCOVERY:
+            case Action::STATUS_UPDATE:
+                allowed = current == Level::NORMAL;
+                break;
+
+            case Action::REST_RESPONSE:
+                allowed = current == Level::NORMAL || (current == Level::CONSTRAINED && in_use == 0);
+                break;
+
+            case Action::PUBLISH_BATCH:
+                allowed = in_use < get_publish_batch_limit();
+                break;
+
+            case Action::COUNT:
+                break;
+        }
+
+        if (!allowed)
+        {
+            ++denied[static_cast<size_t>(action)];
+        }
+        return allowed;
+    }
+
+    size_t MemoryGovernor::get_publish_batch_limit()
+    {
+        if (!active)
+        {
+            return SIZE_MAX;
+        }
+
+        switch (level)
+        {
+            case Level::NORMAL:
+                return SIZE_MAX;
+
+            case Level::CONSTRAINED:
+                return CONSTRAINED_BATCH_DEVICES;
+
+            case Level::CRITICAL:
+                break;
+        }
+        return 1;
+    }
+
+    bool MemoryGovernor::serialize_into(JsonObject json) const
+    {
+        static const char enabled_string[] PROGMEM = "enabled";
+        json[FPSTR(enabled_string)] = is_enabled();
+        json[F("level")] = level_names[static_cast<size_t>(level)];
+        json[F("free_heap")] = ESP.getFreeHeap();
+        json[F("max_block")] = ESP.getMaxFreeBlockSize();
+        json[F("free_heap_low_water")] = free_heap_low_water;
+        json[F("max_block_low_water")] = max_block_low_water;
+        json[F("constrained_count")] = constrained_count;
+        json[F("critical_count")] = critical_count;
+        JsonObject denied_json = json.createNestedObject(F("denied"));
+        for (size_t index = 0; index < static_cast<size_t>(Action::COUNT); ++index)
+        {
+            denied_json[action_names[index]] = denied[index];
+        }
+        return true;
+    }
+
+    String MemoryGovernor::get_status() const
+    {
+        StreamString status;
+        status.reserve(200);
+        print_status(status);
+        return status;
+    }
+
+    void MemoryGovernor::print_status(Print &output) const
+    {
+        output.print(F("Level "));
+        output.print(level_names[static_cast<size_t>(level)]);
+        output.print(F("; free heap low water "));
+        output.print(free_heap_low_water);
+        output.print(F(", largest block low water "));
+        output.print(max_block_low_water);
+        output.print(F("; deferred "));
+        output.print(denied[static_cast<size_t>(Action::DISCOVERY)]);
+        output.print(F(" discovery, "));
+        output.print(denied[static_cast<size_t>(Action::PUBLISH_BATCH)]);
+        output.print(F(" publish, "));
+        output.print(denied[static_cast<size_t>(Action::STATUS_UPDATE)]);
+        output.print(F(" status; refused "));
+        output.print(denied[static_cast<size_t>(Action::REST_RESPONSE)]);
+        output.print(F(" requests"));
+    }
+
+    uint32_t MemoryGovernor::get_status_version() const
+    {
+        uint32_t version = combine_status_version(static_cast<uint32_t>(level), free_heap_low_water);
+        version = combine_status_version(version, max_block_low_water);
+        for (size_t index = 0; index < static_cast<size_t>(Action::COUNT); ++index)
+        {
+            version = combine_status_version(version, denied[index]);
+        }
+        return version;
+    }
+}
@@ -20,10 +20,19 @@
  * SOFTWARE.
  */
 
+#include "grmcdorman/device/BootSequence.h"
+#include "grmcdorman/device/BufferedPrint.h"
+#include "grmcdorman/device/MemoryGovernor.h"
 #include "grmcdorman/device/MqttPublisher.h"
+#include "grmcdorman/device/StateDocument.h"
+#include "grmcdorman/device/TimingCoordinator.h"
 #include "grmcdorman/Setting.h"
 
 #include <ESP8266WiFi.h>
+#include <StreamString.h>
+
+#include <algorithm>
+#include <cmath>
 
 namespace grmcdorman::device
 {
@@ -33,6 +42,260 @@ namespace grmcdorman::device
         const char * AVAILABILITY_OFFLINE = "offline";
         const char mqtt_name[] PROGMEM = "MQTT";
         const char mqtt_identifier[] PROGMEM = "mqtt_publisher";
+        const char queue_spill_path[] = "/mqtt_queue.bin";
+        const ExclusiveOptionSetting::names_list_t state_encoding_names{ FPSTR("JSON"), FPSTR("JSON and MessagePack"), FPSTR("MessagePack")};
+
+        /**
+         * @brief A Print that only counts the bytes written to it.
+         *
+         * This is used to measure a payload before it is streamed.
+         */
+        class CountingPrint: public Print
+        {
+            public:
+                size_t write(uint8_t) override
+                {
+                    ++count;
+                    return 1;
+                }
+
+                size_t write(const uint8_t *, size_t size) override
+                {
+                    count += size;
+                    return size;
+                }
+
+                /**
+                 * @brief Get the number of bytes written.
+                 *
+                 * @return Byte count.
+                 */
+                size_t get_count() const
+                {
+                    return count;
+                }
+
+            private:
+                size_t count = 0;           //!< Bytes written.
+        };
+
+        /**
+         * @brief Write characters as the content of a JSON string.
+         *
+         * Quotes, backslashes and control characters are escaped.
+         *
+         * @param output    Destination.
+         * @param value     Characters to write.
+         * @param in_flash  `true` if `value` is in PROGMEM.
+         */
+        void write_json_characters(Print &output, const char *value, bool in_flash)
+        {
+            for (;; ++value)
+            {
+                char c = in_flash ? pgm_read_byte(value) : *value;
+                if (c == '\0')
+                {
+                    return;
+                }
+                if (c == '"' || c == '\\')
+                {
+                    output.write('\\');
+                    output.write(c);
+                }
+                else if (static_cast<uint8_t>(c) < 0x20)
+                {
+                    output.printf_P(PSTR("\\u%04x"), c);
+                }
+                else
+                {
+                    output.write(c);
+                }
+            }
+        }
+
+        /**
+         * @brief Write a quoted JSON string.
+         *
+         * @param output    Destination.
+         * @param value     String value; a null pointer writes an empty string.
+         */
+        void write_json_string(Print &output, const __FlashStringHelper *value)
+        {
+            output.write('"');
+            if (value != nullptr)
+            {
+                write_json_characters(output, reinterpret_cast<const char *>(value), true);
+            }
+            output.write('"');
+        }
+
+        /**
+         * @brief Write a quoted JSON string.
+         *
+         * @param output    Destination.
+         * @param value     String value.
+         */
+        void write_json_string(Print &output, const String &value)
+        {
+            output.write('"');
+            write_json_characters(output, value.c_str(), false);
+            output.write('"');
+        }
+
+        /**
+         * @brief Write a quoted JSON string composed of a prefix and a suffix.
+         *
+         * @param output    Destination.
+         * @param prefix    Leading part of the value.
+         * @param suffix    Trailing part of the value.
+         */
+        void write_json_string(Print &output, const String &prefix, const __FlashStringHelper *suffix)
+        {
+            output.write('"');
+            write_json_characters(output, prefix.c_str(), false);
+            write_json_characters(output, reinterpret_cast<const char *>(suffix), true);
+            output.write('"');
+        }
+
+        /**
+         * @brief Write one name from a comma-separated list.
+         *
+         * @param output    Destination.
+         * @param item      The start of the name, in PROGMEM.
+         * @return The character after the name: the comma, or the terminating null.
+         */
+        const char *write_list_item(Print &output, const char *item)
+        {
+            for (char c = pgm_read_byte(item); c != '\0' && c != ','; c = pgm_read_byte(++item))
+            {
+                output.write(c);
+            }
+            return item;
+        }
+
+        /**
+         * @brief Write a Home Assistant template reference to a member of a device's published JSON.
+         *
+         * This writes `{{value_json.`_key_`.`_member_`}}`, with `.`_submember_ before the closing
+         * braces if given. The key and names must not need escaping in a JSON string.
+         *
+         * @param output    Destination.
+         * @param key       The device's publish key.
+         * @param member    The member name, in PROGMEM; it ends at a comma or null.
+         * @param submember The member of `member`, or `nullptr`.
+         */
+        void write_template_reference(Print &output, const __FlashStringHelper *key, const char *member,
+            const __FlashStringHelper *submember)
+        {
+            output.print(F("{{value_json."));
+            output.print(key);
+            output.write('.');
+            write_list_item(output, member);
+            if (submember != nullptr)
+            {
+                output.write('.');
+                output.print(submember);
+            }
+            output.print(F("}}"));
+        }
+
+        /**
+         * @brief Write one attribute of an attributes template, as the content of a JSON string.
+         *
+         * @param output    Destination.
+         * @param name      The attribute name, in PROGMEM; it ends at a comma or null.
+         * @param key       The device's publish key.
+         * @param member    The member holding the value; see `write_template_reference`.
+         * @param submember The member of `member`, or `nullptr`.
+         * @return The character after the name; see `write_list_item`.
+         */
+        const char *write_template_attribute(Print &output, const char *name, const __FlashStringHelper *key,
+            const char *member, const __FlashStringHelper *submember)
+        {
+            output.print(F("\\\""));
+            const char *end = write_list_item(output, name);
+            output.print(F("\\\": \\\""));
+            write_template_reference(output, key, member, submember);
+            output.print(F("\\\""));
+            return end;
+        }
+
+        /**
+         * @brief Write the value template for a definition, as the content of a JSON string.
+         *
+         * @param output        Destination.
+         * @param key           The device's publish key.
+         * @param definition    The definition.
+         */
+        void write_value_template(Print &output, const __FlashStringHelper *key, const Device::Definition &definition)
+        {
+            write_template_reference(output, key, definition.field,
+                definition.layout == Device::Definition::Layout::ACCUMULATOR ? F("average") : nullptr);
+        }
+
+        /**
+         * @brief Determine whether a definition has attributes.
+         *
+         * @param definition    The definition.
+         * @return `true` if there is an attributes template.
+         */
+        bool has_json_attributes(const Device::Definition &definition)
+        {
+            return definition.layout == Device::Definition::Layout::ACCUMULATOR || definition.attributes != nullptr;
+        }
+
+        /**
+         * @brief Write the attributes template for a definition, as the content of a JSON string.
+         *
+         * An accumulator has the `last` reading and the `age` of the last sample; a value
+         * has the members listed in the definition's `attributes`.
+         *
+         * @param output        Destination.
+         * @param key           The device's publish key.
+         * @param definition    The definition; `has_json_attributes` must be `true`.
+         */
+        void write_json_attributes_template(Print &output, const __FlashStringHelper *key, const Device::Definition &definition)
+        {
+            static const char last_string[] PROGMEM = "last";
+            static const char age_string[] PROGMEM = "age";
+            output.write('{');
+            if (definition.layout == Device::Definition::Layout::ACCUMULATOR)
+            {
+                write_template_attribute(output, last_string, key, definition.field, F("last"));
+                output.print(F(", "));
+                write_template_attribute(output, age_string, key, definition.field, F("sample_age_ms"));
+            }
+            else
+            {
+                const char *attribute = definition.attributes;
+                for (;;)
+                {
+                    const char *end = write_template_attribute(output, attribute, key, attribute, nullptr);
+                    if (pgm_read_byte(end) != ',')
+                    {
+                        break;
+                    }
+                    output.print(F(", "));
+                    attribute = end + 1;
+                }
+            }
+            output.write('}');
+        }
+
+        /**
+         * @brief Write a comma and a JSON member name, up to and including the colon.
+         *
+         * @param output    Destination.
+         * @param name      Member name; must not need escaping.
+         */
+        void write_json_member(Print &output, const __FlashStringHelper *name)
+        {
+            output.write(',');
+            output.write('"');
+            output.print(name);
+            output.write('"');
+            output.write(':');
+        }
     }
     MqttPublisher::MqttPublisher(const __FlashStringHelper *manufacturer, const __FlashStringHelper *model, const __FlashStringHelper *software_version, Client *client):
         Device(FPSTR(mqtt_name), FPSTR(mqtt_identifier)),
@@ -47,6 +310,9 @@ namespace grmcdorman::device
         "<ul>"
         "<li><em>prefix</em>/<em>identifier</em>/status"
         "<li><em>prefix</em>/<em>identifier</em>/state"
+        "<li><em>prefix</em>/<em>identifier</em>/state/<em>sensor</em> (when publishing changed values only)"
+        "<li><em>prefix</em>/<em>identifier</em>/msgpack (the state in MessagePack, when selected)"
+        "<li><em>prefix</em>/<em>identifier</em>/queued (readings taken while disconnected)"
         "<li><em>prefix</em>/<em>identifier</em>/command"
         "</ul>"
         "Corresponding Home Assistant configurations will be published.")),
@@ -60,16 +326,22 @@ namespace grmcdorman::device
         password(F("The MQTT password"), F("password")),
         prefix(F("MQTT topic prefix"), F("prefix")),
         identifier(F("MQTT client ID and topic identifier"), F("identifier")),
+        persistent_session(F("Persistent session (send Home Assistant configuration once per boot)"), F("persistent_session")),
+        delta_publish(F("Publish changed values only, to individual topics"), F("delta_publish")),
+        state_encoding(F("State encoding (Home Assistant needs JSON)"), F("state_encoding"), state_encoding_names),
+        queue_size(F("Readings to hold while disconnected (0 to disable)"), F("queue_size")),
+        queue_spill(F("Overflow held readings to flash"), F("queue_spill")),
         device_status(F("Publish status<script>periodicUpdateList.push(\"mqtt_publisher&setting=device_status\");</script>"), F("device_status"))
     {
         initialize({}, {&notes, &server_address, &server_port, &update_interval, &reconnect_interval,
             &keepalive_interval, &buffer_size,
-            &username, &password, &prefix, &identifier, &device_status, &enabled});
+            &username, &password, &prefix, &identifier, &persistent_session, &delta_publish, &state_encoding, &queue_size, &queue_spill, &device_status, &enabled});
         server_port.set(1883);
         update_interval.set(30);
         reconnect_interval.set(60);
         keepalive_interval.set(30);
         buffer_size.set(2048);
+        queue_size.set(32);
 
         // Unlike other devices, this is disabled by default.
         set_enabled(false);
@@ -127,19 +399,42 @@ namespace grmcdorman::device
         topicState += identifier.get();
         topicState += F("/state");
 
+        topicStateMsgPack.reserve(prefix.get().length() + 1 + identifier.get().length() + sizeof("/msgpack"));
+        topicStateMsgPack = prefix.get();
+        topicStateMsgPack += '/';
+        topicStateMsgPack += identifier.get();
+        topicStateMsgPack += F("/msgpack");
+
+        topicQueued.reserve(prefix.get().length() + 1 + identifier.get().length() + sizeof("/queued"));
+        topicQueued = prefix.get();
+        topicQueued += '/';
+        topicQueued += identifier.get();
+        topicQueued += F("/queued");
+
         if (is_enabled() && !server_address.get().isEmpty())
         {
             mqttClient.reset(new PubSubClient(*client));
             mqttClient->setServer(server_address.get().c_str(), server_port.get());
             mqttClient->setKeepAlive(keepalive_interval.get());
             mqttClient->setBufferSize(buffer_size.get());
+            queue.begin(queue_size.get(), queue_spill.get() ? queue_spill_path : nullptr);
+            for (const auto &record: restored_readings)
+            {
+                queue.push(record);
+            }
+            restored_readings.clear();
+            restored_readings.shrink_to_fit();
 
             set_timer();
 
-            // Connect & publish immediately.
-            schedule_function([this] {
-                publish();
-            });
+            // Connect & publish immediately if WiFi is up. Otherwise `loop` connects
+            // when WiFi does, and the readings taken meanwhile are then published.
+            if (WiFi.isConnected())
+            {
+                schedule_function([this] {
+                    publish();
+                });
+            }
 
         }
 
@@ -166,8 +461,42 @@ namespace grmcdorman::device
 
         if (mqttClient)
         {
+            // Connect as soon as WiFi does, rather than at the next retry.
+            bool wifi_connected = WiFi.isConnected();
+            if (wifi_connected && !wifi_was_connected && !mqttClient->connected())
+            {
+                connect_task.detach();
+                retry_count = 0;
+                reconnect();
+            }
+            wifi_was_connected = wifi_connected;
+
             mqttClient->loop();
             last_state = mqttClient->state();
+
+            // Discovery is sent one definition per pass so that
+            // a reconnect does not block other devices. Nothing is sent while a sensor read is in progress.
+            if (TimingCoordinator::get_wait_ms(TimingCoordinator::Activity::NETWORK_SEND) != 0)
+            {
+                return;
+            }
+
+            if (!discovery_pending && mqttClient->connected() && discovery_generation != Device::get_definition_generation())
+            {
+                // A device's definitions changed; describe everything again.
+                discovery_sent = false;
+                start_discovery();
+            }
+
+            // Discovery waits while memory is low; it is only needed once.
+            if (discovery_pending && mqttClient->connected() && MemoryGovernor::allow(MemoryGovernor::Action::DISCOVERY))
+            {
+                publish_next_discovery();
+            }
+            else if (!queue.empty() && mqttClient->connected() && millis() - previous_queue_send_ms >= QUEUE_DRAIN_INTERVAL)
+            {
+                send_queued_reading();
+            }
         }
     }
 
@@ -179,18 +508,30 @@ namespace grmcdorman::device
             return;
         }
 
+        // Without WiFi the attempt can only fail; `loop` reconnects when WiFi connects.
+        if (!WiFi.isConnected())
+        {
+            return;
+        }
+
         previous_connection_attempt_ms = millis();
 
         bool connected = false;
+        bool clean_session = !persistent_session.get();
         if (username.get().isEmpty()) {
-            connected = mqttClient->connect(identifier.get().c_str(), topicAvailability.c_str(), 1, true, AVAILABILITY_OFFLINE);
+            connected = mqttClient->connect(identifier.get().c_str(), nullptr, nullptr, topicAvailability.c_str(), 1, true, AVAILABILITY_OFFLINE, clean_session);
         } else {
-            connected = mqttClient->connect(identifier.get().c_str(), username.get().c_str(), password.get().c_str(), topicAvailability.c_str(), 1, true, AVAILABILITY_OFFLINE);
+            connected = mqttClient->connect(identifier.get().c_str(), username.get().c_str(), password.get().c_str(), topicAvailability.c_str(), 1, true, AVAILABILITY_OFFLINE, clean_session);
         }
 
         if (connected) {
+            BootSequence::mark(BootSequence::Milestone::MQTT_CONNECTED);
             mqttClient->publish(topicAvailability.c_str(), AVAILABILITY_ONLINE, true);
-            publish_auto_config();
+            start_discovery();
+            if (!discovery_pending)
+            {
+                publish_new_readings();
+            }
         }
         else
         {
@@ -207,7 +548,7 @@ namespace grmcdorman::device
                 next_interval = CONNECTION_RETRY_INTERVAL;
             }
 
-            connect_ticker.once_scheduled(next_interval, [this] {
+            connect_task.once(next_interval, [this] {
                 reconnect();
             });
         }
@@ -216,78 +557,168 @@ namespace grmcdorman::device
     void MqttPublisher::set_timer()
     {
         current_publish_seconds = update_interval.get();
-        publish_ticker.attach_scheduled(current_publish_seconds, [this]
+        publish_task.attach(current_publish_seconds, [this]
         {
             publish();
         });
     }
 
-    void MqttPublisher::publish_auto_config()
+    void MqttPublisher::start_discovery()
     {
         if (devices == nullptr)
         {
             return;
         }
 
-        // See https://www.home-assistant.io/integrations/sensor.mqtt for descriptions
-        // of this message.
+        if (persistent_session.get() && discovery_sent)
+        {
+            // The broker retained the configurations from the earlier connection.
+            return;
+        }
 
-        DynamicJsonDocument device_json(256);
-        StaticJsonDocument<64> identifiersDoc;
-        JsonArray identifiers = identifiersDoc.to<JsonArray>();
+        if (state_encoding.get() == STATE_MSGPACK && !delta_publish.get())
+        {
+            // The templates read the JSON state, which is not published.
+            return;
+        }
 
-        identifiers.add(identifier.get());
+        discovery_pending = true;
+        discovery_device = 0;
+        discovery_definition = 0;
+        discovery_generation = Device::get_definition_generation();
+    }
 
-        device_json["identifiers"] = identifiers;
-        device_json["manufacturer"] =  publish_manufacturer;
-        device_json["model"] = publish_model;
-        device_json["name"] = identifier.get();
-        device_json["sw_version"] =  publish_software_version;
-        device_json["configuration_url"] = F("http://") + WiFi.localIP().toString();
+    void MqttPublisher::publish_next_discovery()
+    {
+        if (discovery_device_json.isEmpty())
+        {
+            // This part of the message is constant for the lifetime of the system;
+            // build it once, on first use (when the IP address is known).
+            DynamicJsonDocument device_json(256);
+            JsonArray identifiers = device_json.createNestedArray("identifiers");
+            identifiers.add(identifier.get());
+            device_json["manufacturer"] =  publish_manufacturer;
+            device_json["model"] = publish_model;
+            device_json["name"] = identifier.get();
+            device_json["sw_version"] =  publish_software_version;
+            device_json["configuration_url"] = F("http://") + WiFi.localIP().toString();
+            serializeJson(device_json, discovery_device_json);
+        }
 
-        for (auto &device: *devices)
+        while (discovery_device < devices->size())
         {
-            if (device->is_enabled())
+            auto device = (*devices)[discovery_device];
+            if (device->is_enabled() && discovery_definition < device->get_definitions().size())
             {
-                for (auto &definition: device->get_definitions())
+                // A failure is not retried; the next connection will send it again.
+                publish_discovery(device, device->get_definitions()[discovery_definition]);
+                ++discovery_definition;
+                return;
+            }
+
+            ++discovery_device;
+            discovery_definition = 0;
+        }
+
+        discovery_pending = false;
+        discovery_sent = true;
+        publish_new_readings();
+    }
+
+    void MqttPublisher::publish_new_readings()
+    {
+        // Checked again when run, as a publish already in progress may send them first.
+        if (has_unpublished_readings())
+        {
+            schedule_function([this] {
+                if (has_unpublished_readings())
                 {
-                    DynamicJsonDocument autoconfPayload(1024);
-                    autoconfPayload["device"] = device_json.as<JsonObject>();
-                    autoconfPayload["availability_topic"] = topicAvailability;
-                    autoconfPayload["state_topic"] = topicState;
-                    autoconfPayload["name"] = identifier.get() + definition->get_name_suffix();
-                    autoconfPayload["value_template"] = definition->get_value_template();
-                    autoconfPayload["unique_id"] = identifier.get() + definition->get_unique_id_suffix();
-                    autoconfPayload["unit_of_measurement"] =  definition->get_unit_of_measurement();
-                    if (definition->get_json_attributes_template() != nullptr)
-                    {
-                        autoconfPayload["json_attributes_topic"] = topicState;
-                        autoconfPayload["json_attributes_template"] = definition->get_json_attributes_template();
-                    }
-                    autoconfPayload["icon"] = definition->get_icon();
-                    auto size = measureJson(autoconfPayload) + 1;
-                    std::unique_ptr<char[]> buffer(new char[size]);
-                    buffer.get()[0] = '\0';
-
-                    ::serializeJson(autoconfPayload, buffer.get(), size);
-                    String topic;
-                    topic.reserve(sizeof ("homeassistant/sensor/") + prefix.get().length() +
-                        1 +     // slash
-                        identifier.get().length() +
-                        strlen_P(reinterpret_cast<const char *>(definition->get_unique_id_suffix())) +
-                        sizeof("/config"));
-
-                    topic += "homeassistant/sensor/";
-                    topic += prefix.get();
-                    topic += '/';
-                    topic += identifier.get();
-                    topic += definition->get_unique_id_suffix();
-                    topic += "/config";
-                    mqttClient->publish(topic.c_str(), buffer.get(), true);
-                    autoconfPayload.clear();
+                    publish();
                 }
+            });
+        }
+    }
+
+    bool MqttPublisher::has_unpublished_readings() const
+    {
+        // Devices that always report themselves as unpublished (e.g. WiFi RSSI) are not counted.
+        return devices != nullptr && std::any_of(devices->begin(), devices->end(), [] (const Device *device)
+            {
+                return device->is_enabled() && device->has_reading_generation() && !device->get_is_published();
+            });
+    }
+
+    bool MqttPublisher::publish_discovery(const Device *device, const Definition *definition)
+    {
+        const String state_topic(delta_publish.get() ? get_definition_topic(definition) : topicState);
+
+        static const char topic_prefix[] PROGMEM = "homeassistant/sensor/";
+        static const char topic_suffix[] PROGMEM = "/config";
+        String topic;
+        topic.reserve(sizeof (topic_prefix) + prefix.get().length() +
+            1 +     // slash
+            identifier.get().length() +
+            strlen_P(reinterpret_cast<const char *>(definition->get_unique_id_suffix())) +
+            sizeof(topic_suffix));
+
+        topic += FPSTR(topic_prefix);
+        topic += prefix.get();
+        topic += '/';
+        topic += identifier.get();
+        topic += definition->get_unique_id_suffix();
+        topic += FPSTR(topic_suffix);
+
+        CountingPrint counter;
+        write_discovery(counter, device, definition, state_topic);
+        if (!mqttClient->beginPublish(topic.c_str(), counter.get_count(), true))
+        {
+            return false;
+        }
+
+        BufferedPrint output(*mqttClient);
+        write_discovery(output, device, definition, state_topic);
+        output.flush();
+
+        return mqttClient->endPublish() == 1 && output.get_written() == counter.get_count();
+    }
+
+    void MqttPublisher::write_discovery(Print &output, const Device *device, const Definition *definition, const String &state_topic) const
+    {
+        // See https://www.home-assistant.io/integrations/sensor.mqtt for descriptions
+        // of this message. This is written directly, rather than via a JSON document,
+        // so that it can be streamed to the connection without any allocations.
+        output.print(F("{\"device\":"));
+        output.print(discovery_device_json);
+        write_json_member(output, F("availability_topic"));
+        write_json_string(output, topicAvailability);
+        write_json_member(output, F("name"));
+        write_json_string(output, identifier.get(), definition->get_name_suffix());
+        write_json_member(output, F("unique_id"));
+        write_json_string(output, identifier.get(), definition->get_unique_id_suffix());
+        write_json_member(output, F("unit_of_measurement"));
+        write_json_string(output, definition->get_unit_of_measurement());
+        write_json_member(output, F("state_topic"));
+        write_json_string(output, state_topic);
+        if (!delta_publish.get())
+        {
+            // In delta mode the value is the entire payload; there are no attributes.
+            write_json_member(output, F("value_template"));
+            output.write('"');
+            write_value_template(output, device->get_publish_key(), *definition);
+            output.write('"');
+            if (has_json_attributes(*definition))
+            {
+                write_json_member(output, F("json_attributes_topic"));
+                write_json_string(output, topicState);
+                write_json_member(output, F("json_attributes_template"));
+                output.write('"');
+                write_json_attributes_template(output, device->get_publish_key(), *definition);
+                output.write('"');
             }
         }
+        write_json_member(output, F("icon"));
+        write_json_string(output, definition->get_icon());
+        output.write('}');
     }
 
     void MqttPublisher::publish()
@@ -302,7 +733,7 @@ namespace grmcdorman::device
 
         if (!mqttClient->connected())
         {
-            if (!connect_ticker.active())
+            if (!connect_task.active())
             {
                 retry_count = 0;
                 reconnect();
@@ -310,40 +741,299 @@ namespace grmcdorman::device
 
             if (!mqttClient->connected())
             {
+                enqueue_readings();
                 return;
             }
         }
 
+        uint32_t wait_ms = TimingCoordinator::get_wait_ms(TimingCoordinator::Activity::NETWORK_SEND);
+        if (wait_ms != 0)
+        {
+            // Past the scheduler's coalescing window, so that the retry is not run at once.
+            deferred_publish_task.once_ms(std::max(wait_ms, Scheduler::COALESCE_MS + 1), [this]
+            {
+                publish();
+            });
+            return;
+        }
+
         tried_publish = true;
         previous_publish_ms = millis();
-        DynamicJsonDocument state_json(1024 * devices->size());
+
+        if (delta_publish.get())
+        {
+            publish_changed();
+            return;
+        }
+
+        // When memory is low, the devices are published a few at a time; the rest follow shortly.
+        DynamicJsonDocument state_json(StateDocument::get_capacity(*devices));
+        auto built = StateDocument::build(*devices, state_json);
+        if (!built.complete)
+        {
+            deferred_publish_task.once_ms(BATCH_INTERVAL_MS, [this]
+            {
+                publish();
+            });
+        }
+
+        bool failed = false;
+        if (state_encoding.get() != STATE_MSGPACK)
+        {
+            failed = !publish_json(topicState.c_str(), state_json, true);
+        }
+        if (state_encoding.get() != STATE_JSON)
+        {
+            failed = !publish_msgpack(topicStateMsgPack.c_str(), state_json, true) || failed;
+        }
+        last_publish_failed = failed;
+        if (!failed && built.has_reading)
+        {
+            BootSequence::mark(BootSequence::Milestone::FIRST_READING_PUBLISHED);
+        }
+   }
+
+    bool MqttPublisher::publish_json(const char *topic, const JsonDocument &json, bool retained)
+    {
+        auto length = measureJson(json);
+        if (!mqttClient->beginPublish(topic, length, retained))
+        {
+            return false;
+        }
+
+        size_t written = StateDocument::write_json(json, *mqttClient);
+        return mqttClient->endPublish() == 1 && written == length;
+    }
+
+    bool MqttPublisher::publish_msgpack(const char *topic, const JsonDocument &json, bool retained)
+    {
+        auto length = measureMsgPack(json);
+        if (!mqttClient->beginPublish(topic, length, retained))
+        {
+            return false;
+        }
+
+        size_t written = StateDocument::write_msgpack(json, *mqttClient);
+        return mqttClient->endPublish() == 1 && written == length;
+    }
+
+    void MqttPublisher::publish_changed()
+    {
+        // The list is indexed by the definitions of all devices, enabled or not,
+        // so that the index for a given definition does not change.
+        size_t definition_count = Device::get_definition_count(*devices);
+        if (published_values.size() != definition_count)
+        {
+            published_values.assign(definition_count, NAN);
+        }
+
+        bool failed = false;
+        size_t value_index = 0;
         for (auto &device : *devices)
         {
+            const auto &definitions = device->get_definitions();
             if (device->is_enabled() && !device->get_is_published())
             {
-                device->publish(state_json);
+                for (size_t index = 0; index < definitions.size(); ++index)
+                {
+                    float value;
+                    float &previous = published_values[value_index + index];
+                    if (!device->get_definition_value(index, value))
+                    {
+                        continue;
+                    }
+
+                    // Compare against the last *published* value, so that slow drift
+                    // is eventually published even if each change is below the threshold.
+                    if (!std::isnan(previous) &&
+                        (value == previous || std::fabs(value - previous) < definitions[index]->get_change_threshold()))
+                    {
+                        continue;
+                    }
+
+                    char payload[16];
+                    dtostrf(value, 1, 2, payload);
+                    if (mqttClient->publish(get_definition_topic(definitions[index]).c_str(), payload, true))
+                    {
+                        previous = value;
+                        BootSequence::mark(BootSequence::Milestone::FIRST_READING_PUBLISHED);
+                    }
+                    else
+                    {
+                        failed = true;
+                    }
+                }
                 device->set_is_published();
             }
+            value_index += definitions.size();
         }
 
-        auto size = measureJson(state_json) + 1;
-        std::unique_ptr<char[]> buffer(new char[size]);
-        buffer.get()[0] = '\0';
+        last_publish_failed = failed;
+    }
 
-        ::serializeJson(state_json, buffer.get(), size);
-        last_publish_failed = !mqttClient->publish(topicState.c_str(), buffer.get(), true);
-   }
+    void MqttPublisher::enqueue_readings()
+    {
+        if (queue.get_capacity() == 0)
+        {
+            return;
+        }
+
+        auto now = millis();
+        size_t value_index = 0;
+        for (auto &device : *devices)
+        {
+            const auto &definitions = device->get_definitions();
+            if (device->is_enabled() && !device->get_is_published())
+            {
+                for (size_t index = 0; index < definitions.size(); ++index)
+                {
+                    float value;
+                    if (device->get_definition_value(index, value))
+                    {
+                        queue.push(ReadingQueue::Record{now, static_cast<uint16_t>(value_index + index), value});
+                    }
+                }
+                device->set_is_published();
+            }
+            value_index += definitions.size();
+        }
+    }
+
+    bool MqttPublisher::flush()
+    {
+        if (!is_enabled() || mqttClient == nullptr || devices == nullptr)
+        {
+            return true;
+        }
+
+        if (!mqttClient->connected() || discovery_pending)
+        {
+            return false;
+        }
+
+        // Devices that always report themselves as unpublished (e.g. WiFi RSSI) do not hold up the flush.
+        if (has_unpublished_readings())
+        {
+            publish();
+        }
 
-    DynamicJsonDocument MqttPublisher::as_json() const
+        if (!queue.empty())
+        {
+            return false;
+        }
+
+        client->flush();
+        return true;
+    }
+
+    size_t MqttPublisher::save_retained_state(uint8_t *buffer, size_t size)
+    {
+        if (size < 1)
+        {
+            return 0;
+        }
+
+        if (devices != nullptr)
+        {
+            enqueue_readings();
+        }
+        buffer[0] = discovery_sent ? 1 : 0;
+
+        // Keep the newest readings that fit.
+        size_t fit = (size - 1) / RETAINED_READING_SIZE;
+        while (queue.size() > fit)
+        {
+            queue.pop();
+        }
+
+        size_t used = 1;
+        auto now = millis();
+        ReadingQueue::Record record;
+        while (queue.peek(record))
+        {
+            uint32_t age = now - record.timestamp;
+            memcpy(buffer + used, &age, sizeof(age));
+            memcpy(buffer + used + 4, &record.index, sizeof(record.index));
+            memcpy(buffer + used + 6, &record.value, sizeof(record.value));
+            used += RETAINED_READING_SIZE;
+            queue.pop();
+        }
+        return used;
+    }
+
+    void MqttPublisher::restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms)
+    {
+        if (size < 1)
+        {
+            return;
+        }
+
+        discovery_sent = buffer[0] != 0;
+        auto now = millis();
+        for (size_t offset = 1; offset + RETAINED_READING_SIZE <= size; offset += RETAINED_READING_SIZE)
+        {
+            uint32_t age;
+            ReadingQueue::Record record;
+            memcpy(&age, buffer + offset, sizeof(age));
+            memcpy(&record.index, buffer + offset + 4, sizeof(record.index));
+            memcpy(&record.value, buffer + offset + 6, sizeof(record.value));
+            record.timestamp = now - age - elapsed_ms;
+            restored_readings.push_back(record);
+        }
+    }
+
+    void MqttPublisher::send_queued_reading()
+    {
+        previous_queue_send_ms = millis();
+
+        ReadingQueue::Record record;
+        if (!queue.peek(record))
+        {
+            return;
+        }
+
+        auto definition = Device::find_definition(*devices, record.index);
+        if (definition == nullptr)
+        {
+            queue.pop();
+            return;
+        }
+
+        StaticJsonDocument<128> json;
+        json[F("sensor")] = definition->get_sensor_name();
+        json[F("value")] = record.value;
+        json[F("age_ms")] = previous_queue_send_ms - record.timestamp;
+        if (publish_json(topicQueued.c_str(), json, false))
+        {
+            queue.pop();
+        }
+    }
+
+    String MqttPublisher::get_definition_topic(const Definition *definition) const
+    {
+        auto sensor_name = definition->get_sensor_name();
+        String topic;
+        topic.reserve(topicState.length() + 1 + strlen_P(reinterpret_cast<const char *>(sensor_name)));
+        topic = topicState;
+        topic += '/';
+        topic += sensor_name;
+        return topic;
+    }
+
+    bool MqttPublisher::serialize_into(JsonObject json) const
     {
-        DynamicJsonDocument json(512);
         static const char enabled_string[] PROGMEM = "enabled";
         json[FPSTR(enabled_string)] = is_enabled();
         json[F("connected")] = is_enabled() && mqttClient != nullptr ? mqttClient->connected() : false;
         json[F("last_connect_attempt_ms")] = millis() - previous_connection_attempt_ms;
         json[F("last_publish_ms")] = millis() - previous_publish_ms;
         json[F("publish_succeeded")] = !last_publish_failed;
-        return json;
+        JsonObject queue_json = json.createNestedObject(F("queue"));
+        queue_json[F("size")] = queue.size();
+        queue_json[F("capacity")] = queue.get_capacity();
+        queue_json[F("high_water")] = queue.get_high_water();
+        queue_json[F("dropped")] = queue.get_dropped();
+        return true;
     }
 
     String MqttPublisher::get_error_state_message(int state) const
@@ -405,40 +1095,53 @@ namespace grmcdorman::device
     }
 
     String MqttPublisher::get_status() const
+    {
+        StreamString message;
+        print_status(message);
+        return message;
+    }
+
+    void MqttPublisher::print_status(Print &output) const
     {
         if (!is_enabled() ||
             mqttClient == nullptr ||
             server_address.get().isEmpty() ||
             devices == nullptr)
         {
-            return String();
+            return;
         }
 
         if (last_state != MQTT_CONNECTED)
         {
             auto timeSinceConnect = millis() - previous_connection_attempt_ms;
-            String message("Last connection attempt ");
-            message += timeSinceConnect / 1000;
-            message += " seconds ago: ";
-            message += get_error_state_message(last_state);
-            return message;
+            output.print(F("Last connection attempt "));
+            output.print(timeSinceConnect / 1000);
+            output.print(F(" seconds ago: "));
+            output.print(get_error_state_message(last_state));
+            return;
         }
 
         if (tried_publish)
         {
             auto timeSincePublish = millis() - previous_publish_ms;
-            String message(F("Last publish "));
-            message += last_publish_failed ? F("failed ") : F("succeeded ");
-            message += timeSincePublish / 1000;
-            message += F(" seconds ago.");
-            return message;
+            output.print(F("Last publish "));
+            output.print(last_publish_failed ? F("failed ") : F("succeeded "));
+            output.print(timeSincePublish / 1000);
+            output.print(F(" seconds ago."));
         }
         else
         {
-            return F("Never published.");
+            output.print(F("Never published."));
         }
+    }
 
-        // NOT REACHED
+    uint32_t MqttPublisher::get_status_version() const
+    {
+        uint32_t version = combine_status_version(last_state, tried_publish);
+        version = combine_status_version(version, last_publish_failed);
+        version = combine_status_version(version, mqttClient != nullptr);
+        uint32_t since_ms = millis() - (last_state != MQTT_CONNECTED ? previous_connection_attempt_ms : previous_publish_ms);
+        return combine_status_version(version, since_ms / 1000);
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include <Schedule.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/ReadingBus.h"
+
+namespace grmcdorman::device
+{
+    std::vector<ReadingBus::subscriber_t> ReadingBus::subscribers;
+    std::vector<const Device *> ReadingBus::pending;
+    bool ReadingBus::delivery_scheduled = false;
+    uint32_t ReadingBus::delivered_count = 0;
+
+    void ReadingBus::subscribe(subscriber_t &&subscriber)
+    {
+        subscribers.push_back(std::move(subscriber));
+    }
+
+    void ReadingBus::post(const Device *device)
+    {
+        if (subscribers.empty())
+        {
+            return;
+        }
+
+        if (std::find(pending.begin(), pending.end(), device) == pending.end())
+        {
+            pending.push_back(device);
+        }
+
+        if (!delivery_scheduled)
+        {
+            delivery_scheduled = schedule_function(deliver);
+        }
+    }
+
+    void ReadingBus::deliver()
+    {
+        delivery_scheduled = false;
+
+        // Subscribers may post readings of their own; those are delivered in the same
+        // pass, up to a limit, so that a cycle of derived sensors cannot stall the loop.
+        std::vector<const Device *> delivering;
+        for (size_t round = 0; round < MAX_ROUNDS && !pending.empty(); ++round)
+        {
+            delivering.swap(pending);
+            pending.clear();
+            for (const auto device: delivering)
+            {
+                for (const auto &subscriber: subscribers)
+                {
+                    subscriber(*device);
+                }
+                ++delivered_count;
+            }
+        }
+
+        if (!pending.empty())
+        {
+            delivery_scheduled = schedule_function(deliver);
+        }
+    }
+}
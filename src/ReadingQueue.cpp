@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <LittleFS.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/ReadingQueue.h"
+
+namespace grmcdorman::device
+{
+    void ReadingQueue::begin(size_t new_capacity, const char *new_spill_path)
+    {
+        capacity = new_capacity;
+        records.reset(capacity > 0 ? new Record[capacity] : nullptr);
+        head = 0;
+        count = 0;
+        high_water = 0;
+        dropped = 0;
+        spill_path = capacity > 0 ? new_spill_path : nullptr;
+        clear_spill();
+    }
+
+    void ReadingQueue::push(const Record &record)
+    {
+        if (capacity == 0)
+        {
+            ++dropped;
+            return;
+        }
+
+        if (count == capacity)
+        {
+            if (!spill_oldest())
+            {
+                ++dropped;
+            }
+            head = (head + 1) % capacity;
+            --count;
+        }
+
+        records[(head + count) % capacity] = record;
+        ++count;
+        high_water = std::max(high_water, size());
+    }
+
+    bool ReadingQueue::peek(Record &record)
+    {
+        if (spill_read < spill_count)
+        {
+            File file = LittleFS.open(spill_path, "r");
+            if (file && file.seek(spill_read * sizeof(Record)) &&
+                file.read(reinterpret_cast<uint8_t *>(&record), sizeof(Record)) == sizeof(Record))
+            {
+                return true;
+            }
+
+            // The spill file is unusable; discard what it holds.
+            dropped += spill_count - spill_read;
+            clear_spill();
+        }
+
+        if (count == 0)
+        {
+            return false;
+        }
+
+        record = records[head];
+        return true;
+    }
+
+    void ReadingQueue::pop()
+    {
+        if (spill_read < spill_count)
+        {
+            if (++spill_read == spill_count)
+            {
+                clear_spill();
+            }
+            return;
+        }
+
+        if (count > 0)
+        {
+            head = (head + 1) % capacity;
+            --count;
+        }
+    }
+
+    bool ReadingQueue::spill_oldest()
+    {
+        if (spill_path == nullptr || spill_count >= capacity * SPILL_FACTOR)
+        {
+            return false;
+        }
+
+        File file = LittleFS.open(spill_path, "a");
+        if (!file)
+        {
+            return false;
+        }
+
+        bool written = file.write(reinterpret_cast<const uint8_t *>(&records[head]), sizeof(Record)) == sizeof(Record);
+        file.close();
+        if (written)
+        {
+            ++spill_count;
+        }
+        return written;
+    }
+
+    void ReadingQueue::clear_spill()
+    {
+        if (spill_path != nullptr && LittleFS.exists(spill_path))
+        {
+            LittleFS.remove(spill_path);
+        }
+        spill_count = 0;
+        spill_read = 0;
+    }
+}
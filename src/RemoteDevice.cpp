@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include <algorithm>
+
+#include "grmcdorman/device/RemoteDevice.h"
+
+namespace grmcdorman::device
+{
+    namespace
+    {
+        const char events_request[] PROGMEM = "GET /rest/events HTTP/1.1\r\nHost: %s\r\n"
+            "Accept: text/event-stream\r\nCache-Control: no-cache\r\n\r\n";
+        const char event_prefix[] PROGMEM = "event:";
+        const char data_prefix[] PROGMEM = "data:";
+        const char readings_event_name[] PROGMEM = "readings";
+
+        /**
+         * @brief Get the value of a server-sent event field, if the line is that field.
+         *
+         * @param line      The line.
+         * @param prefix    The field name, with the colon, in PROGMEM.
+         * @return The value, without the optional leading space; `nullptr` if the line is another field.
+         */
+        char *field_value(char *line, const char *prefix)
+        {
+            size_t prefix_length = strlen_P(prefix);
+            if (strncmp_P(line, prefix, prefix_length) != 0)
+            {
+                return nullptr;
+            }
+            char *value = line + prefix_length;
+            return *value == ' ' ? value + 1 : value;
+        }
+    }
+
+    RemoteDevice::RemoteDevice(const String &host, uint16_t port):
+        host(host),
+        port(port),
+        // Allows the first connection at once.
+        disconnected_ms(millis() - MIN_RETRY_MS)
+    {
+    }
+
+    void RemoteDevice::set_server(const String &new_host, uint16_t new_port)
+    {
+        client.stop();
+        state = State::DISCONNECTED;
+        host = new_host;
+        port = new_port;
+        http_status = 0;
+        retry_ms = MIN_RETRY_MS;
+        disconnected_ms = millis() - retry_ms;
+    }
+
+    size_t RemoteDevice::add_sensor(const String &name)
+    {
+        sensors.emplace_back();
+        sensors.back().name = name;
+
+        // The filter is rebuilt, as a document cannot grow; this is done once, at setup.
+        size_t capacity = JSON_OBJECT_SIZE(sensors.size());
+        for (const auto &sensor: sensors)
+        {
+            capacity += sensor.name.length() + 1;
+        }
+        filter = DynamicJsonDocument(capacity);
+        for (const auto &sensor: sensors)
+        {
+            filter[sensor.name] = true;
+        }
+
+        return sensors.size() - 1;
+    }
+
+    void RemoteDevice::loop()
+    {
+        if (state == State::DISCONNECTED)
+        {
+            if (!host.isEmpty() && WiFi.status() == WL_CONNECTED && millis() - disconnected_ms >= retry_ms)
+            {
+                connect();
+            }
+            return;
+        }
+
+        if (!client.connected() && client.available() == 0)
+        {
+            disconnect();
+            return;
+        }
+
+        size_t available = std::min<size_t>(client.available(), MAX_READ_PER_LOOP);
+        if (available == 0)
+        {
+            if (millis() - last_data_ms >= IDLE_TIMEOUT_MS)
+            {
+                disconnect();
+            }
+            return;
+        }
+
+        uint8_t buffer[MAX_READ_PER_LOOP];
+        size_t length = client.read(buffer, available);
+        last_data_ms = millis();
+        for (size_t index = 0; index < length && state != State::DISCONNECTED; ++index)
+        {
+            char c = static_cast<char>(buffer[index]);
+            if (c == '\r')
+            {
+                continue;
+            }
+            if (c != '\n')
+            {
+                if (line_length < sizeof(line) - 1)
+                {
+                    line[line_length++] = c;
+                }
+                else
+                {
+                    line_overflow = true;
+                }
+                continue;
+            }
+
+            line[line_length] = '\0';
+            if (!line_overflow)
+            {
+                handle_line();
+            }
+            line_length = 0;
+            line_overflow = false;
+        }
+    }
+
+    void RemoteDevice::connect()
+    {
+        client.setTimeout(CONNECT_TIMEOUT_MS);
+        if (!client.connect(host, port))
+        {
+            disconnect();
+            return;
+        }
+
+        client.keepAlive();
+        char request[sizeof(events_request) + 64];
+        snprintf_P(request, sizeof(request), events_request, host.c_str());
+        client.write(request, strlen(request));
+
+        state = State::HEADERS;
+        http_status = 0;
+        line_length = 0;
+        line_overflow = false;
+        readings_event = false;
+        last_data_ms = millis();
+    }
+
+    void RemoteDevice::disconnect()
+    {
+        client.stop();
+        // A stream that ends normally, e.g. when the server restarts, is retried promptly;
+        // a failure backs off.
+        retry_ms = state == State::STREAMING ? MIN_RETRY_MS : std::min(retry_ms * 2, MAX_RETRY_MS);
+        state = State::DISCONNECTED;
+        disconnected_ms = millis();
+    }
+
+    void RemoteDevice::handle_line()
+    {
+        if (state == State::HEADERS)
+        {
+            if (http_status == 0)
+            {
+                // The status line, e.g. "HTTP/1.1 200 OK".
+                const char *status = strchr(line, ' ');
+                http_status = status != nullptr ? atoi(status + 1) : -1;
+                if (http_status != 200)
+                {
+                    disconnect();
+                }
+            }
+            else if (line_length == 0)
+            {
+                state = State::STREAMING;
+                retry_ms = MIN_RETRY_MS;
+            }
+            return;
+        }
+
+        if (line_length == 0)
+        {
+            // The end of an event.
+            readings_event = false;
+            return;
+        }
+
+        const char *event = field_value(line, event_prefix);
+        if (event != nullptr)
+        {
+            readings_event = strcmp_P(event, readings_event_name) == 0;
+            return;
+        }
+
+        if (readings_event && field_value(line, data_prefix) != nullptr)
+        {
+            handle_readings();
+        }
+    }
+
+    void RemoteDevice::handle_readings()
+    {
+        if (sensors.empty())
+        {
+            return;
+        }
+
+        // The line is parsed in place, so the document needs no room for strings.
+        DynamicJsonDocument readings(JSON_OBJECT_SIZE(sensors.size()));
+        if (deserializeJson(readings, field_value(line, data_prefix), DeserializationOption::Filter(filter)) != DeserializationError::Ok)
+        {
+            return;
+        }
+
+        JsonObjectConst values = readings.as<JsonObjectConst>();
+        bool updated = false;
+        uint32_t now = millis();
+        for (auto &sensor: sensors)
+        {
+            JsonVariantConst value = values[sensor.name];
+            if (value.is<float>())
+            {
+                sensor.value = value.as<float>();
+                sensor.received_ms = now;
+                sensor.available = true;
+                updated = true;
+            }
+        }
+
+        if (updated)
+        {
+            ++update_generation;
+        }
+    }
+
+    bool RemoteDevice::get_value(size_t index, float &value) const
+    {
+        if (index >= sensors.size() || !sensors[index].available)
+        {
+            return false;
+        }
+        value = sensors[index].value;
+        return true;
+    }
+
+    uint32_t RemoteDevice::get_value_age_ms(size_t index) const
+    {
+        if (index >= sensors.size() || !sensors[index].available)
+        {
+            return UINT32_MAX;
+        }
+        return millis() - sensors[index].received_ms;
+    }
+}
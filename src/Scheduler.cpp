@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "grmcdorman/device/Scheduler.h"
+#include "grmcdorman/device/Device.h"
+
+#include <algorithm>
+
+namespace grmcdorman::device
+{
+    std::vector<Scheduler::Task *> Scheduler::heap;
+    Ticker Scheduler::timer;
+    bool Scheduler::armed = false;
+    bool Scheduler::running = false;
+    uint32_t Scheduler::armed_deadline_ms = 0;
+    uint32_t Scheduler::wakeup_count = 0;
+    uint32_t Scheduler::run_count = 0;
+
+    void Scheduler::Task::attach_ms(uint32_t milliseconds, callback_t callback)
+    {
+        schedule(milliseconds, milliseconds, std::move(callback));
+    }
+
+    void Scheduler::Task::once_ms(uint32_t milliseconds, callback_t callback)
+    {
+        schedule(milliseconds, 0, std::move(callback));
+    }
+
+    void Scheduler::Task::detach()
+    {
+        if (active())
+        {
+            Scheduler::remove(this);
+            Scheduler::arm();
+        }
+    }
+
+    void Scheduler::Task::schedule(uint32_t delay_ms, uint32_t period, callback_t &&new_callback)
+    {
+        if (active())
+        {
+            Scheduler::remove(this);
+        }
+        callback = std::move(new_callback);
+        period_ms = period;
+        deadline_ms = millis() + delay_ms;
+        Scheduler::add(this);
+        Scheduler::arm();
+    }
+
+    uint32_t Scheduler::get_time_to_next_ms()
+    {
+        if (heap.empty())
+        {
+            return UINT32_MAX;
+        }
+        int32_t remaining = static_cast<int32_t>(heap.front()->deadline_ms - millis());
+        return remaining > 0 ? remaining : 0;
+    }
+
+    void Scheduler::add(Task *task)
+    {
+        heap.push_back(task);
+        task->heap_index = heap.size() - 1;
+        sift_up(task->heap_index);
+    }
+
+    void Scheduler::remove(Task *task)
+    {
+        size_t index = task->heap_index;
+        Task *last = heap.back();
+        heap.pop_back();
+        task->heap_index = Task::NOT_SCHEDULED;
+        if (last != task)
+        {
+            place(index, last);
+            sift_up(index);
+            sift_down(last->heap_index);
+        }
+    }
+
+    void Scheduler::sift_up(size_t index)
+    {
+        Task *task = heap[index];
+        while (index > 0)
+        {
+            size_t parent = (index - 1) / 2;
+            if (!is_before(task, heap[parent]))
+            {
+                break;
+            }
+            place(index, heap[parent]);
+            index = parent;
+        }
+        place(index, task);
+    }
+
+    void Scheduler::sift_down(size_t index)
+    {
+        Task *task = heap[index];
+        for (;;)
+        {
+            size_t child = index * 2 + 1;
+            if (child >= heap.size())
+            {
+                break;
+            }
+            if (child + 1 < heap.size() && is_before(heap[child + 1], heap[child]))
+            {
+                ++child;
+            }
+            if (!is_before(heap[child], task))
+            {
+                break;
+            }
+            place(index, heap[child]);
+            index = child;
+        }
+        place(index, task);
+    }
+
+    void Scheduler::arm()
+    {
+        if (running)
+        {
+            return;
+        }
+
+        if (heap.empty())
+        {
+            if (armed)
+            {
+                timer.detach();
+                armed = false;
+            }
+            return;
+        }
+
+        uint32_t deadline = heap.front()->deadline_ms;
+        if (armed && deadline == armed_deadline_ms)
+        {
+            return;
+        }
+
+        armed = true;
+        armed_deadline_ms = deadline;
+        timer.once_ms_scheduled(std::max<uint32_t>(get_time_to_next_ms(), 1), [] {
+            armed = false;
+            run();
+        });
+    }
+
+    void Scheduler::run()
+    {
+        ++wakeup_count;
+        running = true;
+        uint32_t now = millis();
+        while (!heap.empty() && static_cast<int32_t>(heap.front()->deadline_ms - now) <= static_cast<int32_t>(COALESCE_MS))
+        {
+            Task *task = heap.front();
+            remove(task);
+            if (task->period_ms != 0)
+            {
+                task->deadline_ms += task->period_ms;
+                if (static_cast<int32_t>(task->deadline_ms - now) <= 0)
+                {
+                    // Too far behind; skip the missed periods rather than running them back to back.
+                    task->deadline_ms = now + task->period_ms;
+                }
+                add(task);
+            }
+
+            // The callback may reschedule or detach its own task; run a copy.
+            Task::callback_t callback = task->callback;
+            ++run_count;
+            DEVICE_TIMING_SCOPE(task->owner != nullptr ? &task->owner->get_timing().task : nullptr);
+            callback();
+        }
+        running = false;
+        arm();
+    }
+}
@@ -23,6 +23,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <SHT31.h>
+#include <StreamString.h>
 
 #include <algorithm>
 
@@ -37,70 +38,72 @@ namespace grmcdorman::device
         constexpr int DEFAULT_SDA = Device::D5;     /// Default SDA connection.
         constexpr int DEFAULT_SCL = Device::D6;     /// Default SCL connection.
         constexpr int address_map[2] = { 0x44, 0x45 };
+        constexpr uint32_t CONVERSION_MS = 16;      /// High repeatability measurement time, maximum.
         const char sht31_name[] PROGMEM = "SHT31-D";
         const char sht31_identifier[] PROGMEM = "sht31_d";
         const ExclusiveOptionSetting::names_list_t address_names{ FPSTR("0x44"), FPSTR("0x45")};
 
-        class Sht31Device_Temperature_Definition: public Device::Definition
-        {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" SHT31-D Temperature");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.sht31_d.temperature.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_sht31d_temperature");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("°C");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.sht31_d.temperature.last}}\", \"age\": \"{{value_json.temperature.sht31_d.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:thermometer");
-                }
+        const char temperature_name_suffix[] PROGMEM = " SHT31-D Temperature";
+        const char temperature_unique_id_suffix[] PROGMEM = "_sht31d_temperature";
+        const char temperature_field[] PROGMEM = "temperature";
+        const char humidity_name_suffix[] PROGMEM = " SHT31-D Humidity";
+        const char humidity_unique_id_suffix[] PROGMEM = "_sht31d_humidity";
+        const char humidity_field[] PROGMEM = "humidity";
+        const char celsius_units[] PROGMEM = "°C";
+        const char percent_units[] PROGMEM = "%";
+        const char thermometer_icon[] PROGMEM = "mdi:thermometer";
+        const char water_percent_icon[] PROGMEM = "mdi:water-percent";
+
+        constexpr Device::Definition temperature_definition PROGMEM
+        {
+            temperature_name_suffix, temperature_unique_id_suffix, celsius_units, thermometer_icon,
+            temperature_field, Device::Definition::Layout::ACCUMULATOR, nullptr, 0.1f
         };
-        class Sht31Device_Humidity_Definition: public Device::Definition
-        {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" SHT31-D Humidity");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.sht31_d.humidity.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_sht31d_humidity");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("%");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.sht31_d.humidity.last}}\", \"age\": \"{{value_json.sht31_d.humidity.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:water-percent");
-                }
+        constexpr Device::Definition humidity_definition PROGMEM
+        {
+            humidity_name_suffix, humidity_unique_id_suffix, percent_units, water_percent_icon,
+            humidity_field, Device::Definition::Layout::ACCUMULATOR, nullptr, 0.5f
         };
     }
 
-    Sht31Sensor::Sht31Sensor():
-        AbstractTemperaturePressureSensor(FPSTR(sht31_name), FPSTR(sht31_identifier)),
+    Sht31Sensor::InstanceNames::InstanceNames(uint8_t instance)
+    {
+        if (instance == 0)
+        {
+            strncpy_P(name, sht31_name, sizeof(name));
+            strncpy_P(identifier, sht31_identifier, sizeof(identifier));
+        }
+        else
+        {
+            snprintf_P(name, sizeof(name), PSTR("%S %u"), sht31_name, instance + 1);
+            snprintf_P(identifier, sizeof(identifier), PSTR("%S_%u"), sht31_identifier, instance + 1);
+        }
+        snprintf_P(status_label, sizeof(status_label),
+            PSTR("Sensor status<script>periodicUpdateList.push(\"%s&setting=device_status\");</script>"), identifier);
+    }
+
+    Sht31Sensor::InstanceDefinitions::InstanceDefinitions(const InstanceNames &names):
+        temperature{temperature_name, temperature_unique_id, temperature_definition.unit_of_measurement,
+            temperature_definition.icon, temperature_definition.field, temperature_definition.layout,
+            temperature_definition.attributes, temperature_definition.change_threshold},
+        humidity{humidity_name, humidity_unique_id, humidity_definition.unit_of_measurement,
+            humidity_definition.icon, humidity_definition.field, humidity_definition.layout,
+            humidity_definition.attributes, humidity_definition.change_threshold}
+    {
+        // The unique IDs use the identifier without the underscore in "sht31_d", as in
+        // the instance 0 unique IDs; the instance suffix follows.
+        const char *instance_suffix = names.identifier + strlen_P(sht31_identifier);
+        snprintf_P(temperature_name, sizeof(temperature_name), PSTR(" %s Temperature"), names.name);
+        snprintf_P(temperature_unique_id, sizeof(temperature_unique_id), PSTR("_sht31d%s_%S"),
+            instance_suffix, temperature_field);
+        snprintf_P(humidity_name, sizeof(humidity_name), PSTR(" %s Humidity"), names.name);
+        snprintf_P(humidity_unique_id, sizeof(humidity_unique_id), PSTR("_sht31d%s_%S"),
+            instance_suffix, humidity_field);
+    }
+
+    Sht31Sensor::Sht31Sensor(uint8_t instance):
+        AbstractTemperaturePressureSensor(FPSTR(names.name), FPSTR(names.identifier)),
+        names(instance),
         title(F("<h2>SHT31-D Temperature and Humidity Sensor</h2>")),
         dataPin(F("SDA (Data) Connection"), F("sda"), data_line_names),
         clockPin(F("SCL (Clock) Connection"), F("scl"), data_line_names),
@@ -110,17 +113,21 @@ namespace grmcdorman::device
         humidityOffset(F("Humidity Offset"), F("humidity_offset")),
         humidityScale(F("Humidity Scale Factor"), F("humidity_scale")),
         readInterval(F("Polling interval (seconds)"), F("poll_interval")),
-        device_status(F("Sensor status<script>periodicUpdateList.push(\"sht31_d&setting=device_status\");</script>"), F("device_status"))
+        device_status(FPSTR(names.status_label), F("device_status"))
     {
-        static const Sht31Device_Temperature_Definition temperature_definition;
-        static const Sht31Device_Humidity_Definition humidity_definition;
+        definition_list_t definition_list{&temperature_definition, &humidity_definition};
+        if (instance != 0)
+        {
+            instance_definitions.reset(new InstanceDefinitions(names));
+            definition_list = {&instance_definitions->temperature, &instance_definitions->humidity};
+        }
 
-        initialize({&temperature_definition, &humidity_definition}, {&title, &dataPin, &clockPin, &address, &temperatureOffset, &temperatureScale, &humidityOffset, &humidityScale,
+        initialize(std::move(definition_list), {&title, &dataPin, &clockPin, &address, &temperatureOffset, &temperatureScale, &humidityOffset, &humidityScale,
             &readInterval, &device_status, &enabled});
 
         dataPin.set(dataline_to_index(DEFAULT_SDA));
         clockPin.set(dataline_to_index(DEFAULT_SCL));
-        address.set(0);
+        address.set(instance % 2);
         temperatureOffset.set(0);
         temperatureScale.set(1);
         humidityOffset.set(0);
@@ -136,6 +143,12 @@ namespace grmcdorman::device
                 return;
             }
 
+            if (bus_conflict)
+            {
+                device_status.set(F("The I2C bus was started on other SDA and SCL lines; all I2C devices must use the same lines."));
+                return;
+            }
+
             if (!available)
             {
                 device_status.set(F("SHT31-D failed to start or is not connected, or was disabled at boot."));
@@ -153,86 +166,101 @@ namespace grmcdorman::device
             return;
         }
 
-        Wire.begin();
-        if (!sht.begin(address_map[address.get()], index_to_dataline(dataPin.get()), index_to_dataline(clockPin.get())))
+        auto sda = index_to_dataline(dataPin.get());
+        auto scl = index_to_dataline(clockPin.get());
+        // The SHT31 supports up to 1 MHz.
+        if (!I2cBus::begin(sda, scl, I2cBus::FAST_MODE_CLOCK))
         {
+            bus_conflict = true;
             return;
         }
-        Wire.setClock(100000);
-        if (!sht.isConnected())
+        // The library calls `Wire.begin` itself, with the same lines.
+        bool started = sht.begin(address_map[address.get()], sda, scl);
+        I2cBus::restore_clock();
+        if (!started || !sht.isConnected())
         {
             return;
         }
 
         available = true;
+        conversion.set(CONVERSION_MS, [this]
+        {
+            sht.requestData();
+        },
+        [this]
+        {
+            read();
+        });
         set_timer();
-        sht.requestData();                // request for next sample
-        requested = true;
+        request_reading();
     }
 
     void Sht31Sensor::loop()
     {
-        if (!available || !is_enabled())
-        {
-            return;
-        }
+        // Readings are made by the I2C bus conversion callbacks.
+    }
 
-        if (requested && sht.dataReady())
+    void Sht31Sensor::read()
+    {
+        if (sht.dataReady() && sht.readData())   // default = true = fast
         {
-            bool success  = sht.readData();   // default = true = fast
-            if (success)
-            {
-                last_read_millis = millis();
-                temperature.new_reading(sht.getTemperature() * temperatureScale.get() + temperatureOffset.get());
-                humidity.new_reading(sht.getHumidity() * humidityScale.get() + humidityOffset.get());
-                clear_is_published();
-            }
-
-            requested = false;
+            last_read_millis = millis();
+            temperature.new_reading(sht.getTemperature() * temperatureScale.get() + temperatureOffset.get());
+            humidity.new_reading(sht.getHumidity() * humidityScale.get() + humidityOffset.get());
+            clear_is_published();
         }
     }
 
     String Sht31Sensor::get_status() const
+    {
+        StreamString message;
+        message.reserve(150);
+        print_status(message);
+        return message;
+    }
+
+    void Sht31Sensor::print_status(Print &output) const
     {
         if (!is_enabled() || !available)
         {
-            return String();
+            return;
         }
 
-        String message;
-        message.reserve(150);
-
         if (temperature.has_accumulation())
         {
-            char float_str[64];
-            dtostrf(temperature.get_last_reading(), 1, 1, float_str);
-            message = float_str;
-            message += F(" °C, ");
-            dtostrf(humidity.get_last_reading(), 1, 1, float_str);
-            message += float_str;
-            message += F("% R.H.; ");
+            output.print(temperature.get_last_reading(), 1);
+            output.print(F(" °C, "));
+            output.print(humidity.get_last_reading(), 1);
+            output.print(F("% R.H.; "));
             auto since = millis() - last_read_millis;
-            message += since / 1000;
-            message += F(" seconds since last reading.");
+            output.print(since / 1000);
+            output.print(F(" seconds since last reading."));
         }
         else
         {
-            message += F("No readings have been performed.");
+            output.print(F("No readings have been performed."));
         }
+    }
 
-        return message;
+    uint32_t Sht31Sensor::get_status_version() const
+    {
+        uint32_t version = combine_status_version(get_reading_generation(), available);
+        return combine_status_version(version, (millis() - last_read_millis) / 1000);
+    }
+
+    void Sht31Sensor::request_reading()
+    {
+        if (available && conversion.request())
+        {
+            statusReadPreviousMillis = millis();
+        }
     }
 
     void Sht31Sensor::set_timer()
     {
         current_polling_seconds = readInterval.get();
-        ticker.attach_scheduled(current_polling_seconds, [this] {
-            if (!requested)
-            {
-                statusReadPreviousMillis = millis();
-                sht.requestData();                // request for next sample
-                requested = true;
-            }
+        read_task.attach(current_polling_seconds, [this] {
+            request_reading();
         });
 
     }
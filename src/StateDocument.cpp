@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "grmcdorman/device/StateDocument.h"
+
+#include <algorithm>
+
+#include "grmcdorman/device/BufferedPrint.h"
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/device/MemoryGovernor.h"
+
+namespace grmcdorman::device
+{
+    size_t StateDocument::get_capacity(const std::vector<Device *> &devices)
+    {
+        return Device::JSON_DOCUMENT_CAPACITY * std::min(devices.size(), MemoryGovernor::get_publish_batch_limit());
+    }
+
+    StateDocument::BuildResult StateDocument::build(const std::vector<Device *> &devices, DynamicJsonDocument &json)
+    {
+        BuildResult result;
+        for (auto &device : devices)
+        {
+            if (device->is_enabled() && !device->get_is_published())
+            {
+                if (!MemoryGovernor::allow(MemoryGovernor::Action::PUBLISH_BATCH, result.added))
+                {
+                    result.complete = false;
+                    break;
+                }
+                DEVICE_TIMING_SCOPE(&device->get_timing().publish);
+                device->publish(json);
+                result.has_reading = result.has_reading || (device->has_reading_generation() && device->get_reading_generation() != 0);
+                device->set_is_published();
+                ++result.added;
+            }
+        }
+        return result;
+    }
+
+    size_t StateDocument::write_json(const JsonDocument &json, Print &output)
+    {
+        BufferedPrint buffered(output);
+        ::serializeJson(json, buffered);
+        buffered.flush();
+        return buffered.get_written();
+    }
+
+    size_t StateDocument::write_msgpack(const JsonDocument &json, Print &output)
+    {
+        BufferedPrint buffered(output);
+        ::serializeMsgPack(json, buffered);
+        buffered.flush();
+        return buffered.get_written();
+    }
+}
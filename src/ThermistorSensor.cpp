@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <StreamString.h>
+
 #include "grmcdorman/device/ThermistorSensor.h"
 #include "grmcdorman/Setting.h"
 
@@ -30,33 +32,17 @@ namespace grmcdorman::device
         const char thermistor_name[] PROGMEM = "Temperature";
         const char thermistor_identifier[] PROGMEM = "thermistor";
 
-        class Thermistor_Definition: public Device::Definition
+        const char thermistor_name_suffix[] PROGMEM = " Temperature";
+        const char thermistor_unique_id_suffix[] PROGMEM = "_thermistor";
+        const char celsius_units[] PROGMEM = "°C";
+        const char thermometer_icon[] PROGMEM = "mdi:thermometer";
+        const char temperature_field[] PROGMEM = "temperature";
+        const char last_temperature_field[] PROGMEM = "last_temperature";
+
+        constexpr Device::Definition definition PROGMEM
         {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" Temperature");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.thermistor.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_thermistor");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("°C");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.thermistor.last}}\", \"age\": \"{{value_json.thermistor.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:thermometer");
-                }
+            thermistor_name_suffix, thermistor_unique_id_suffix, celsius_units, thermometer_icon,
+            temperature_field, Device::Definition::Layout::VALUE, last_temperature_field, 0.1f
         };
     }
 
@@ -67,10 +53,8 @@ namespace grmcdorman::device
         title(F("<h2>Temperature (ThermistorSensor)</h2>")),
         device_status(F("Sensor status<script>periodicUpdateList.push(\"thermistor&setting=device_status\");</script>"), F("device_status"))
     {
-        static const Thermistor_Definition definition;
-
         initialize({&definition}, {&title, &scale, &offset,
-            &readInterval, &device_status, &enabled});
+            &readInterval, &oversampling, &device_status, &enabled});
 
         set_enabled(false);
 
@@ -85,41 +69,40 @@ namespace grmcdorman::device
         });
     }
 
-    DynamicJsonDocument ThermistorSensor::as_json() const
+    bool ThermistorSensor::serialize_into(JsonObject json) const
     {
-        static const char temperature_string[] PROGMEM = "temperature";
-        static const char last_temperature_string[] PROGMEM = "last_temperature";
         static const char enabled_string[] PROGMEM = "enabled";
-        DynamicJsonDocument json(512);
 
         json[FPSTR(enabled_string)] = is_enabled();
-        json[FPSTR(temperature_string)] = get_current_average();
-        json[FPSTR(last_temperature_string)] = get_last_reading();
+        json[FPSTR(temperature_field)] = get_current_average();
+        json[FPSTR(last_temperature_field)] = get_last_reading();
 
-        return json;
+        return true;
     }
 
     String ThermistorSensor::get_status() const
+    {
+        StreamString message;
+        message.reserve(150);
+        print_status(message);
+        return message;
+    }
+
+    void ThermistorSensor::print_status(Print &output) const
     {
         if (!is_enabled())
         {
-            return String();
+            return;
         }
 
-        String message;
-        message.reserve(150);
-        char float_str[64];
-        dtostrf(get_last_reading(), 1, 1, float_str);
-        message = float_str;
-        message += F("°C; ");
+        output.print(get_last_reading(), 1);
+        output.print(F("°C; "));
         auto since = millis() - last_read_millis;
-        message += since / 1000;
-        message += F(" seconds since last reading.");
-
-        return message;
+        output.print(since / 1000);
+        output.print(F(" seconds since last reading."));
     }
 
-    float ThermistorSensor::transform_raw_reading(int reading)
+    float ThermistorSensor::transform_raw_reading(float reading)
     {
         // Equations are from https://www.jameco.com/Jameco/workshop/TechTip/temperature-measurement-ntc-thermistors.html
         // Due to the requirements that:
@@ -127,7 +110,7 @@ namespace grmcdorman::device
         // b) the series resistor is sufficiently close to the thermistor at the temperatures being measured
         // the simplified equation can be used:
         //   1/T0 + 1/B * ln( ( adcMax / adcVal ) – 1 )
-        float tempK_inverse = inverse_t1 + inverse_thermal_index * log(1023.0 / reading - 1);
+        float tempK_inverse = inverse_t1 + inverse_thermal_index * logf(1023.0f / reading - 1);
         // Convert 1/K to degrees C.
         float tempC = 1 / tempK_inverse - 273.15;
 
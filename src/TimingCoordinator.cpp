@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "grmcdorman/device/TimingCoordinator.h"
+
+#include <algorithm>
+
+namespace grmcdorman::device
+{
+    uint32_t TimingCoordinator::reserved_until_ms[static_cast<size_t>(Activity::COUNT)];
+    bool TimingCoordinator::reserved[static_cast<size_t>(Activity::COUNT)];
+
+    uint32_t TimingCoordinator::get_wait_ms(Activity activity)
+    {
+        uint32_t now = millis();
+        uint32_t wait_ms = 0;
+        for (size_t index = 0; index < static_cast<size_t>(Activity::COUNT); ++index)
+        {
+            if (index == static_cast<size_t>(activity) || !reserved[index])
+            {
+                continue;
+            }
+
+            int32_t remaining = static_cast<int32_t>(reserved_until_ms[index] - now);
+            if (remaining <= 0)
+            {
+                reserved[index] = false;
+                continue;
+            }
+
+            wait_ms = std::max<uint32_t>(wait_ms, remaining);
+        }
+
+        return wait_ms;
+    }
+}
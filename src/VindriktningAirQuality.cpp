@@ -20,7 +20,10 @@
  * SOFTWARE.
  */
 
+#include <StreamString.h>
+
 #include "grmcdorman/device/VindriktningAirQuality.h"
+#include "grmcdorman/device/TimingCoordinator.h"
 
 namespace grmcdorman::device
 {
@@ -29,33 +32,16 @@ namespace grmcdorman::device
         constexpr static const uint32_t UART_SPEED = 9600;
         const char vindriktning_name[] PROGMEM = "Vindriktning";
         const char vindriktning_identifier[] PROGMEM = "vindriktning";
-        class Vindriktning_Definition: public Device::Definition
+        const char pm25_name_suffix[] PROGMEM = " PM 2.5";
+        const char pm25_unique_id_suffix[] PROGMEM = "_pm25";
+        const char pm25_units[] PROGMEM = "μg/m³";
+        const char air_filter_icon[] PROGMEM = "mdi:air-filter";
+        const char pm25_field[] PROGMEM = "pm25";
+
+        constexpr Device::Definition vindriktning_definition PROGMEM
         {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" PM 2.5");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.vindriktning.pm25.average}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_pm25");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("μg/m³");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"last\": \"{{value_json.vindriktning.pm25.last}}\", \"age\": \"{{value_json.vindriktning.pm25.sample_age_ms}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:air-filter");
-                }
+            pm25_name_suffix, pm25_unique_id_suffix, pm25_units, air_filter_icon,
+            pm25_field, Device::Definition::Layout::ACCUMULATOR, nullptr, 1.0f
         };
     }
 
@@ -66,7 +52,6 @@ namespace grmcdorman::device
         device_status(F("Sensor status<script>periodicUpdateList.push(\"vindriktning&setting=device_status\");</script>"), F("device_status")),
         sensorSerial()
     {
-        static const Vindriktning_Definition vindriktning_definition;
         initialize({&vindriktning_definition}, {&title, &serialDataPin, &device_status, &enabled});
 
         serialDataPin.set(dataline_to_index(DEFAULT_RX_PIN));
@@ -90,86 +75,108 @@ namespace grmcdorman::device
         if (is_enabled())
         {
             sensorSerial.begin(UART_SPEED, SWSERIAL_8N1, index_to_dataline(serialDataPin.get()), -1, false, buffer_size);
+            // The callback is scheduled by the serial library, i.e. it runs in loop context.
+            // Older versions of the library pass the available byte count; newer ones do not.
+            sensorSerial.onReceive([this] (auto...)
+            {
+                receive();
+            });
         }
     }
 
     void VindriktningAirQuality::loop()
     {
-        if (!is_enabled())
-        {
-            return;
-        }
-
-        // read serial; this will read all data available,
-        // up to `buffer_reserved_size` bytes. The expected message is 20 bytes,
-        // first three bytes are 0x16 0x11 0x0B
-        if (!sensorSerial.available()) {
-            return;
-        }
-
-        if (rxBufIdx >= buffer_size) {
-            rxBufIdx = 0;
-        }
-
-        rxBufIdx += sensorSerial.read(&buffer[rxBufIdx], sizeof (buffer) - rxBufIdx);
+        // Data is handled by the receive callback.
+    }
 
-        if (rxBufIdx >= vindriktning_message_size)
+    void VindriktningAirQuality::receive()
+    {
+        DEVICE_TIMING_SCOPE(&get_timing().task);
+        uint8_t data[vindriktning_message_size];
+        while (sensorSerial.available() > 0)
         {
-            // Find the header, if possible.
-            auto ptr = find_message(buffer, rxBufIdx);
-            if (ptr != nullptr)
+            auto count = sensorSerial.read(data, sizeof(data));
+            if (count == 0)
             {
-                parse(ptr);
-                // Move any later data in the buffer to the start, for the next cycle.
-                auto offset = ptr - buffer + vindriktning_message_size;
-                memmove(&buffer[0], &buffer[offset], rxBufIdx - offset);
-                rxBufIdx -= offset;
+                break;
             }
-            else
+            if (!is_enabled())
             {
-                last_read_state = State::NO_HEADER_FOUND;
+                continue;
+            }
+            for (size_t index = 0; index < count; ++index)
+            {
+                add_byte(data[index]);
             }
         }
+
+        // Hold off DHT reads for the rest of the message: about a millisecond per byte at 9600 baud.
+        uint32_t remaining_ms = 0;
+        if (window_count != 0)
+        {
+            remaining_ms = (window_count < vindriktning_message_size ? vindriktning_message_size - window_count : vindriktning_message_size) + 2;
+        }
+        TimingCoordinator::reserve(TimingCoordinator::Activity::SERIAL_FRAME, remaining_ms);
     }
 
-    const uint8_t *VindriktningAirQuality::find_message(const uint8_t *ptr, uint8_t byte_count) const
+    void VindriktningAirQuality::add_byte(uint8_t data)
     {
-        const uint8_t *candidate(ptr - 1);
-        do
+        // The expected message is 20 bytes; the first three bytes are 0x16 0x11 0x0B,
+        // and all the bytes sum to zero.
+        if (window_count == vindriktning_message_size)
         {
-            candidate = reinterpret_cast<uint8_t *>(memchr(candidate + 1, HEADER_BYTE_0, byte_count));
-            if (candidate == nullptr)
+            // Slide the window; the oldest byte cannot start a message.
+            window_sum -= window[window_start];
+            window[window_start] = data;
+            window_start = window_start + 1 == vindriktning_message_size ? 0 : window_start + 1;
+            if (discarded_bytes < UINT16_MAX)
             {
-                return nullptr;
+                ++discarded_bytes;
             }
-            auto bytes_left = byte_count - (candidate - ptr);
-            if (bytes_left < vindriktning_message_size)
+            if (discarded_bytes >= vindriktning_message_size)
             {
-                return nullptr;
+                last_read_state = State::NO_HEADER_FOUND;
             }
-        } while (candidate[1] != HEADER_BYTE_1 && candidate[2] != HEADER_BYTE_2 && is_valid_checksum(candidate));
+        }
+        else
+        {
+            window[window_count] = data;
+            ++window_count;
+        }
+        window_sum += data;
 
-        return candidate;
-    }
+        if (window_count < vindriktning_message_size ||
+            get_window_byte(0) != HEADER_BYTE_0 || get_window_byte(1) != HEADER_BYTE_1 || get_window_byte(2) != HEADER_BYTE_2)
+        {
+            return;
+        }
 
-    bool VindriktningAirQuality::is_valid_checksum(const uint8_t *data) const
-    {
-        uint8_t checksum = 0;
+        if (window_sum != 0)
+        {
+            ++bad_checksums;
+            return;
+        }
 
-        for (uint8_t i = 0; i < vindriktning_message_size; i++) {
-            checksum += data[i];
+        ++good_messages;
+        if (discarded_bytes != 0)
+        {
+            ++resynchronized_messages;
         }
+        parse();
 
-        return checksum == 0;
+        window_start = 0;
+        window_count = 0;
+        window_sum = 0;
+        discarded_bytes = 0;
     }
 
-    void VindriktningAirQuality::parse(const uint8_t *data)
+    void VindriktningAirQuality::parse()
     {
         /**
          *         MSB  DF 3     DF 4  LSB
          * uint16_t = xxxxxxxx xxxxxxxx
          */
-        auto new_pm25 = (data[5] << 8) | data[6];
+        auto new_pm25 = (get_window_byte(5) << 8) | get_window_byte(6);
         pm25.new_reading(new_pm25);
         last_read_millis = millis();
         last_read_state = State::READ;
@@ -183,54 +190,80 @@ namespace grmcdorman::device
             return false;
         }
 
-        json[FPSTR(vindriktning_identifier)] = as_json();
+        return serialize_into(json.createNestedObject(get_publish_key()));
+    }
+
+    bool VindriktningAirQuality::get_definition_value(size_t index, float &value) const
+    {
+        if (index != 0 || !pm25.has_accumulation())
+        {
+            return false;
+        }
 
+        value = pm25.get_current_average();
         return true;
     }
 
-    DynamicJsonDocument VindriktningAirQuality::as_json() const
+    bool VindriktningAirQuality::serialize_into(JsonObject json) const
     {
         static const char enabled_string[] PROGMEM = "enabled";
-        static const char pm25_string[] PROGMEM = "pm25";
-        DynamicJsonDocument json(512);
 
         json[FPSTR(enabled_string)] = is_enabled();
-        json[FPSTR(pm25_string)] = pm25.as_json();
+        pm25.serialize_into(json.createNestedObject(FPSTR(pm25_field)));
+        json[F("good_messages")] = good_messages;
+        json[F("bad_checksums")] = bad_checksums;
+        json[F("resynchronized_messages")] = resynchronized_messages;
 
-        return json;
+        return true;
     }
 
     String VindriktningAirQuality::get_status() const
     {
-        String state_message;
+        StreamString state_message;
         state_message.reserve(256);
-        if (last_read_millis > 0)
-        {
-            state_message += pm25.get_last_reading();
-            state_message += F("µg/m³, ");
-            state_message += (millis() - last_read_millis) / 1000;
-            state_message += F(" seconds since last reading. ");
-        }
+        print_status(state_message);
+        return state_message;
+    }
 
+    void VindriktningAirQuality::print_status(Print &output) const
+    {
         switch (last_read_state)
         {
             case State::NEVER_READ:
-                state_message = F("Never got a reading.");
+                output.print(F("Never got a reading."));
                 break;
 
             case State::NO_HEADER_FOUND:
-                state_message = F("Did not find a header in the last 20 bytes read.");
+                output.print(F("Did not find a message in the last 20 bytes read."));
                 break;
 
             case State::READ:
-                // No message.
+                output.print(pm25.get_last_reading());
+                output.print(F("µg/m³, "));
+                output.print((millis() - last_read_millis) / 1000);
+                output.print(F(" seconds since last reading. "));
                 break;
 
             default:
-                state_message = F("Something went wrong.");
+                output.print(F("Something went wrong."));
                 break;
         }
 
-        return state_message;
+        output.print(F(" Messages: "));
+        output.print(good_messages);
+        output.print(F(" good, "));
+        output.print(bad_checksums);
+        output.print(F(" bad checksums, "));
+        output.print(resynchronized_messages);
+        output.print(F(" after resynchronizing."));
+    }
+
+    uint32_t VindriktningAirQuality::get_status_version() const
+    {
+        uint32_t version = combine_status_version(get_reading_generation(), static_cast<uint32_t>(last_read_state));
+        version = combine_status_version(version, good_messages);
+        version = combine_status_version(version, bad_checksums);
+        version = combine_status_version(version, resynchronized_messages);
+        return combine_status_version(version, (millis() - last_read_millis) / 1000);
     }
 }
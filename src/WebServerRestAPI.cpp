@@ -26,15 +26,389 @@
 #include <ESPAsyncWebServer.h>
 
 #include "grmcdorman/device/WebServerRestAPI.h"
+#include "grmcdorman/device/HistoryRecorder.h"
+#include "grmcdorman/device/MemoryGovernor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
 
 namespace grmcdorman::device
 {
+    namespace
+    {
+        /**
+         * @brief A Print that keeps only a window of its output.
+         *
+         * Characters before the window start are counted and discarded, as
+         * are characters after the window is full. This allows a JSON document to be
+         * serialized into a response a part at a time, without an intermediate buffer.
+         */
+        class WindowPrint: public Print
+        {
+            public:
+                /**
+                 * @brief Construct a new WindowPrint object.
+                 *
+                 * @param buffer    Buffer to receive the window.
+                 * @param skip      Number of characters before the window.
+                 * @param length    Size of the window.
+                 */
+                WindowPrint(uint8_t *buffer, size_t skip, size_t length):
+                    buffer(buffer), skip(skip), length(length)
+                {
+                }
+
+                size_t write(uint8_t character) override
+                {
+                    return write(&character, 1);
+                }
+
+                size_t write(const uint8_t *data, size_t size) override
+                {
+                    size_t end = position + size;
+                    if (end > skip && position < skip + length)
+                    {
+                        size_t first = std::max(position, skip);
+                        size_t last = std::min(end, skip + length);
+                        memcpy(buffer + (first - skip), data + (first - position), last - first);
+                    }
+                    position = end;
+                    return size;
+                }
+
+                /**
+                 * @brief Get the number of characters placed in the window.
+                 *
+                 * @return Character count.
+                 */
+                size_t get_copied() const
+                {
+                    return position > skip ? std::min(position - skip, length) : 0;
+                }
+
+            private:
+                uint8_t *buffer;        //!< The window buffer.
+                size_t skip;            //!< Characters before the window.
+                size_t length;          //!< The window size.
+                size_t position = 0;    //!< Characters written so far.
+        };
+
+        /**
+         * @brief Remove all but the selected fields from a JSON object.
+         *
+         * A member is kept if its name is one of the fields, or if it is an object
+         * that still has members after its own unselected members are removed.
+         *
+         * @param object    The object.
+         * @param fields    The field names to keep.
+         */
+        void select_fields(JsonObject object, const std::vector<String> &fields)
+        {
+            // Keys are collected first; members are not removed while iterating.
+            // The key strings remain valid, as the document's memory is not released by `remove`.
+            std::vector<const char *> unwanted;
+            for (JsonPair member: object)
+            {
+                const char *key = member.key().c_str();
+                if (std::find(fields.begin(), fields.end(), key) != fields.end())
+                {
+                    continue;
+                }
+
+                JsonObject child = member.value().as<JsonObject>();
+                if (!child.isNull())
+                {
+                    select_fields(child, fields);
+                    if (child.size() != 0)
+                    {
+                        continue;
+                    }
+                }
+                unwanted.push_back(key);
+            }
+
+            for (const auto key: unwanted)
+            {
+                object.remove(key);
+            }
+        }
+
+        /**
+         * @brief Add the values of all parameters with a given name to a list.
+         *
+         * Each parameter may hold a comma-separated list of values.
+         *
+         * @param request   Incoming web request.
+         * @param name      Parameter name.
+         * @param[out] list Receives the values.
+         */
+        void get_parameter_list(AsyncWebServerRequest *request, const __FlashStringHelper *name, std::vector<String> &list)
+        {
+            for (size_t index = 0; index < request->params(); ++index)
+            {
+                const AsyncWebParameter *parameter = request->getParam(index);
+                if (parameter->isPost() || parameter->isFile() || parameter->name() != name)
+                {
+                    continue;
+                }
+
+                const String &value = parameter->value();
+                int start = 0;
+                while (start <= static_cast<int>(value.length()))
+                {
+                    int end = value.indexOf(',', start);
+                    if (end < 0)
+                    {
+                        end = value.length();
+                    }
+                    if (end > start)
+                    {
+                        list.push_back(value.substring(start, end));
+                    }
+                    start = end + 1;
+                }
+            }
+        }
+
+        /**
+         * @brief Check whether a request asks for MessagePack.
+         *
+         * @param request   Incoming web request.
+         * @return `true` if the `Accept` header names MessagePack (`application/msgpack`
+         *         or `application/x-msgpack`).
+         */
+        bool accepts_msgpack(AsyncWebServerRequest *request)
+        {
+            return request->hasHeader(F("Accept")) && request->getHeader(F("Accept"))->value().indexOf(F("msgpack")) >= 0;
+        }
+
+        /**
+         * @brief The state of a streamed device-state response.
+         *
+         * The response is an object with one member per device, keyed by identifier,
+         * with the values from `serialize_into`; it is JSON, or MessagePack if requested. One document is owned by the response and
+         * reused for each device: it is filled when the response reaches the device and
+         * serialized into the response buffers a part at a time. A device that does not
+         * implement `serialize_into`, or whose values do not fit, is taken from `as_json`
+         * instead; the document then grows to that size.
+         *
+         * If a list of fields is given, only those fields are included; see `select_fields`.
+         */
+        class DeviceStateStream
+        {
+            public:
+                /**
+                 * @brief Construct a new DeviceStateStream object.
+                 *
+                 * @param devices   The devices to include.
+                 * @param msgpack   Whether to encode the response as MessagePack.
+                 * @param release   Called when the response is complete or abandoned.
+                 */
+                DeviceStateStream(std::vector<const Device *> &&devices, bool msgpack, std::function<void()> &&release):
+                    devices(std::move(devices)), msgpack(msgpack), release(std::move(release))
+                {
+                }
+
+                /**
+                 * @brief Construct a new DeviceStateStream object with selected fields.
+                 *
+                 * @param devices   The devices to include.
+                 * @param fields    The fields to include; if empty, all fields are included.
+                 * @param msgpack   Whether to encode the response as MessagePack.
+                 * @param release   Called when the response is complete or abandoned.
+                 */
+                DeviceStateStream(std::vector<const Device *> &&devices, std::vector<String> &&fields, bool msgpack, std::function<void()> &&release):
+                    devices(std::move(devices)), fields(std::move(fields)), msgpack(msgpack), release(std::move(release))
+                {
+                }
+
+                DeviceStateStream(const DeviceStateStream &) = delete;
+                DeviceStateStream &operator=(const DeviceStateStream &) = delete;
+
+                ~DeviceStateStream()
+                {
+                    release();
+                }
+
+                /**
+                 * @brief Get the next part of the response.
+                 *
+                 * @param buffer    Buffer to receive the text.
+                 * @param length    Size of the buffer.
+                 * @return The number of bytes written; zero when the response is complete.
+                 */
+                size_t read(uint8_t *buffer, size_t length)
+                {
+                    size_t written = 0;
+                    while (written < length)
+                    {
+                        if (text_offset < text.size())
+                        {
+                            size_t part = std::min(length - written, text.size() - text_offset);
+                            memcpy(buffer + written, text.data() + text_offset, part);
+                            written += part;
+                            text_offset += part;
+                        }
+                        else if (document_pending)
+                        {
+                            WindowPrint window(buffer + written, document_offset, length - written);
+                            if (msgpack)
+                            {
+                                serializeMsgPack(document, window);
+                            }
+                            else
+                            {
+                                serializeJson(document, window);
+                            }
+                            written += window.get_copied();
+                            document_offset += window.get_copied();
+                            if (document_offset >= document_length)
+                            {
+                                document_pending = false;
+                            }
+                        }
+                        else if (!next_part())
+                        {
+                            break;
+                        }
+                    }
+                    return written;
+                }
+
+            private:
+                /**
+                 * @brief Prepare the next device, or the end of the response.
+                 *
+                 * @return `false` if the response is complete.
+                 */
+                bool next_part()
+                {
+                    text_offset = 0;
+                    text.clear();
+                    if (done)
+                    {
+                        return false;
+                    }
+
+                    if (msgpack)
+                    {
+                        if (next_device == 0)
+                        {
+                            append_msgpack_header(0x80, 0xde, devices.size());
+                        }
+                        if (next_device == devices.size())
+                        {
+                            done = true;
+                            return true;
+                        }
+                        append_msgpack_string(devices[next_device]->identifier());
+                    }
+                    else
+                    {
+                        if (next_device == devices.size())
+                        {
+                            append_text(next_device == 0 ? F("{}") : F("}"));
+                            done = true;
+                            return true;
+                        }
+                        append_text(next_device == 0 ? F("{\"") : F(",\""));
+                        append_text(devices[next_device]->identifier());
+                        append_text(F("\":"));
+                    }
+
+                    const Device *device = devices[next_device];
+                    {
+                        DEVICE_TIMING_SCOPE(&device->get_timing().publish);
+                        if (!device->serialize_into(document.to<JsonObject>()) || document.overflowed())
+                        {
+                            document = device->as_json();
+                        }
+                    }
+                    if (!fields.empty() && document.is<JsonObject>())
+                    {
+                        select_fields(document.as<JsonObject>(), fields);
+                    }
+                    document_offset = 0;
+                    document_length = msgpack ? measureMsgPack(document) : measureJson(document);
+                    document_pending = true;
+                    ++next_device;
+                    return true;
+                }
+
+                /**
+                 * @brief Append a string to the text before a device document.
+                 *
+                 * @param string    The string.
+                 */
+                void append_text(const __FlashStringHelper *string)
+                {
+                    const char *characters = reinterpret_cast<const char *>(string);
+                    size_t offset = text.size();
+                    text.resize(offset + strlen_P(characters));
+                    memcpy_P(text.data() + offset, characters, text.size() - offset);
+                }
+
+                /**
+                 * @brief Append a MessagePack map or string header.
+                 *
+                 * @param fix_type  The type byte of the one-byte form, which holds sizes up to 15 (maps) or 31 (strings).
+                 * @param type16    The type byte of the form with a 16-bit size.
+                 * @param size      The number of map members or string bytes.
+                 */
+                void append_msgpack_header(uint8_t fix_type, uint8_t type16, size_t size)
+                {
+                    size_t fix_limit = fix_type == 0x80 ? 16 : 32;
+                    if (size < fix_limit)
+                    {
+                        text.push_back(static_cast<uint8_t>(fix_type | size));
+                    }
+                    else
+                    {
+                        text.push_back(type16);
+                        text.push_back(static_cast<uint8_t>(size >> 8));
+                        text.push_back(static_cast<uint8_t>(size & 0xff));
+                    }
+                }
+
+                /**
+                 * @brief Append a MessagePack string.
+                 *
+                 * @param string    The string.
+                 */
+                void append_msgpack_string(const __FlashStringHelper *string)
+                {
+                    append_msgpack_header(0xa0, 0xda, strlen_P(reinterpret_cast<const char *>(string)));
+                    append_text(string);
+                }
+
+                std::vector<const Device *> devices;            //!< The devices to include.
+                std::vector<String> fields;                     //!< The fields to include; all if empty.
+                bool msgpack;                                   //!< Whether the response is MessagePack rather than JSON.
+                std::function<void()> release;                  //!< Called on destruction.
+                size_t next_device = 0;                         //!< The next device to include.
+                std::vector<uint8_t> text;                      //!< Text before or after a device document; binary for MessagePack.
+                size_t text_offset = 0;                         //!< The next character of `text` to return.
+                DynamicJsonDocument document{Device::JSON_DOCUMENT_CAPACITY}; //!< The current device's document.
+                bool document_pending = false;                  //!< Whether `document` has not been completely returned.
+                size_t document_offset = 0;                     //!< The next character of the document to return.
+                size_t document_length = 0;                     //!< The serialized length of the document.
+                bool done = false;                              //!< Whether the closing brace has been prepared.
+        };
+    }
+
     WebServerRestApi::WebServerRestApi()
     {
     }
 
+    WebServerRestApi::~WebServerRestApi()
+    {
+    }
+
     void WebServerRestApi::setup(AsyncWebServer &server, const std::vector<Device *> &devices)
     {
+        boot_id = ESP.random();
 
         // The filters are required because the AsyncWebServer accepts any path
         // that *starts* with the URI.
@@ -53,6 +427,15 @@ namespace grmcdorman::device
             );
         }
 
+        server.on("/rest/devices/state", HTTP_GET, [this, &devices] (AsyncWebServerRequest *request)
+        {
+            handle_on_devices_state(request, devices);
+        }).setFilter([] (AsyncWebServerRequest *request)
+            {
+                return request->url() == F("/rest/devices/state");
+            }
+        );
+
         server.on("/rest/devices/get", HTTP_GET, [&devices]  (AsyncWebServerRequest *request)
         {
             auto response = new AsyncJsonResponse(true);
@@ -71,13 +454,293 @@ namespace grmcdorman::device
         );
     }
 
+    void WebServerRestApi::setup_history(AsyncWebServer &server, const HistoryRecorder &history)
+    {
+        server.on("/rest/history/get", HTTP_GET, [this, &history] (AsyncWebServerRequest *request)
+        {
+            size_t resolution = 0;
+            if (request->hasParam(F("resolution")) &&
+                !HistoryRecorder::find_resolution(request->getParam(F("resolution"))->value(), resolution))
+            {
+                request->send(400, F("text/plain"), F("Unknown resolution"));
+                return;
+            }
+
+            size_t index = 0;
+            bool all_sensors = !request->hasParam(F("sensor"));
+            if (!all_sensors && !history.find_sensor(request->getParam(F("sensor"))->value(), index))
+            {
+                request->send(400, F("text/plain"), F("Unknown sensor"));
+                return;
+            }
+
+            uint32_t from = request->hasParam(F("from")) ? strtoul(request->getParam(F("from"))->value().c_str(), nullptr, 10) : 0;
+            uint32_t to = request->hasParam(F("to")) ? strtoul(request->getParam(F("to"))->value().c_str(), nullptr, 10) : UINT32_MAX;
+
+            if (!claim_response(request))
+            {
+                return;
+            }
+
+            // The response holds the query until it is complete. The slot is
+            // released when the response, and thus the query, is destroyed.
+            std::shared_ptr<HistoryRecorder::Query> query(new HistoryRecorder::Query(history, resolution, all_sensors, index, from, to),
+                [this] (HistoryRecorder::Query *query)
+                {
+                    delete query;
+                    release_response();
+                });
+            auto response = request->beginChunkedResponse(F("application/json"), [query] (uint8_t *buffer, size_t max_length, size_t) -> size_t
+            {
+                return query->read(buffer, max_length);
+            });
+            response->addHeader("Cache-Control", "no-cache");
+            request->send(response);
+        }).setFilter([] (AsyncWebServerRequest *request)
+            {
+                return request->url() == F("/rest/history/get");
+            }
+        );
+    }
+
+    void WebServerRestApi::setup_events(AsyncWebServer &server, const std::vector<Device *> &devices)
+    {
+        event_devices = &devices;
+        pushed_generations.assign(devices.size(), 0);
+        for (size_t index = 0; index < devices.size(); ++index)
+        {
+            pushed_generations[index] = devices[index]->get_reading_generation();
+        }
+
+        events.reset(new AsyncEventSource("/rest/events"));
+        events->onConnect([this] (AsyncEventSourceClient *client)
+        {
+            handle_on_event_connect(client);
+        });
+        server.addHandler(events.get());
+
+        ReadingBus::subscribe([this] (const Device &)
+        {
+            schedule_push();
+        });
+    }
+
+    void WebServerRestApi::schedule_push()
+    {
+        if (!event_task.active())
+        {
+            event_task.once_ms(EVENT_CHECK_INTERVAL, [this] { push_readings(); });
+        }
+    }
+
+    String WebServerRestApi::get_readings_event(bool changed_only) const
+    {
+        size_t definition_count = 0;
+        for (const auto &device: *event_devices)
+        {
+            definition_count += device->get_definitions().size();
+        }
+
+        // Room for the members, and for copies of the flash-string keys.
+        DynamicJsonDocument json(JSON_OBJECT_SIZE(definition_count) + definition_count * 32);
+        for (size_t device_index = 0; device_index < event_devices->size(); ++device_index)
+        {
+            const Device *device = (*event_devices)[device_index];
+            if (!device->is_enabled() || !device->has_reading_generation() ||
+                (changed_only && device->get_reading_generation() == pushed_generations[device_index]))
+            {
+                continue;
+            }
+
+            const auto &definitions = device->get_definitions();
+            for (size_t index = 0; index < definitions.size(); ++index)
+            {
+                float value;
+                if (device->get_definition_value(index, value) && std::isfinite(value))
+                {
+                    json[definitions[index]->get_sensor_name()] = value;
+                }
+            }
+        }
+
+        String text;
+        if (json.size() != 0)
+        {
+            serializeJson(json, text);
+        }
+        return text;
+    }
+
+    void WebServerRestApi::handle_on_event_connect(AsyncEventSourceClient *client)
+    {
+        if (events->count() > MAX_EVENT_SUBSCRIBERS)
+        {
+            client->close();
+            return;
+        }
+
+        String text(get_readings_event(false));
+        if (!text.isEmpty())
+        {
+            client->send(text.c_str(), "readings", event_id);
+        }
+    }
+
+    void WebServerRestApi::push_readings()
+    {
+        if (events->count() != 0)
+        {
+            // While the clients have a backlog, queue nothing; the generations
+            // are left as they are, so the newest values are sent once it drains.
+            if (events->avgPacketsWaiting() >= MAX_QUEUED_EVENTS)
+            {
+                schedule_push();
+                return;
+            }
+
+            String text(get_readings_event(true));
+            if (!text.isEmpty())
+            {
+                events->send(text.c_str(), "readings", ++event_id);
+            }
+        }
+
+        // Without clients, the generations are still updated; clients get all values on connect.
+        for (size_t index = 0; index < event_devices->size(); ++index)
+        {
+            pushed_generations[index] = (*event_devices)[index]->get_reading_generation();
+        }
+    }
+
+    String WebServerRestApi::get_etag(const std::vector<const Device *> &devices, bool msgpack) const
+    {
+        // FNV-1a over the identity, enabled state, and generation of each device.
+        uint32_t hash = 2166136261u;
+        auto add = [&hash] (uint32_t value)
+        {
+            for (int byte = 0; byte < 4; ++byte)
+            {
+                hash = (hash ^ ((value >> (byte * 8)) & 0xff)) * 16777619u;
+            }
+        };
+
+        for (const auto &device: devices)
+        {
+            if (!device->has_reading_generation())
+            {
+                return String();
+            }
+            add(reinterpret_cast<uintptr_t>(device));
+            add(device->is_enabled());
+            add(device->get_reading_generation());
+        }
+
+        // The encodings are different representations, so have different tags.
+        char etag[sizeof("\"12345678-12345678-m\"")];
+        snprintf_P(etag, sizeof(etag), msgpack ? PSTR("\"%08x-%08x-m\"") : PSTR("\"%08x-%08x\""),
+            static_cast<unsigned>(boot_id), static_cast<unsigned>(hash));
+        return String(etag);
+    }
+
+    bool WebServerRestApi::send_not_modified(AsyncWebServerRequest *request, const String &etag)
+    {
+        if (etag.isEmpty() || !request->hasHeader(F("If-None-Match")) ||
+            request->getHeader(F("If-None-Match"))->value().indexOf(etag) < 0)
+        {
+            return false;
+        }
+
+        auto response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
+        return true;
+    }
+
+    bool WebServerRestApi::claim_response(AsyncWebServerRequest *request)
+    {
+        if (in_flight_responses >= MAX_IN_FLIGHT_RESPONSES)
+        {
+            auto response = request->beginResponse(503, F("text/plain"), F("Too many requests in progress"));
+            response->addHeader("Retry-After", "1");
+            request->send(response);
+            return false;
+        }
+
+        if (!MemoryGovernor::allow(MemoryGovernor::Action::REST_RESPONSE, in_flight_responses))
+        {
+            auto response = request->beginResponse(503, F("text/plain"), F("Low on memory"));
+            response->addHeader("Retry-After", "5");
+            request->send(response);
+            return false;
+        }
+
+        ++in_flight_responses;
+        return true;
+    }
+
+    void WebServerRestApi::handle_on_devices_state(AsyncWebServerRequest *request, const std::vector<Device *> &devices)
+    {
+        std::vector<String> identifiers;
+        std::vector<String> fields;
+        get_parameter_list(request, F("device"), identifiers);
+        get_parameter_list(request, F("field"), fields);
+
+        std::vector<const Device *> selected;
+        selected.reserve(devices.size());
+        for (const auto &device: devices)
+        {
+            if (device->is_enabled() &&
+                (identifiers.empty() || std::find(identifiers.begin(), identifiers.end(), device->identifier()) != identifiers.end()))
+            {
+                selected.push_back(device);
+            }
+        }
+
+        bool msgpack = accepts_msgpack(request);
+        String etag(get_etag(selected, msgpack));
+        if (send_not_modified(request, etag) || !claim_response(request))
+        {
+            return;
+        }
+
+        auto stream = std::make_shared<DeviceStateStream>(std::move(selected), std::move(fields), msgpack, [this] { release_response(); });
+        auto response = request->beginChunkedResponse(msgpack ? F("application/msgpack") : F("application/json"),
+            [stream] (uint8_t *buffer, size_t max_length, size_t) -> size_t
+        {
+            return stream->read(buffer, max_length);
+        });
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Vary", "Accept");
+        if (!etag.isEmpty())
+        {
+            response->addHeader("ETag", etag);
+        }
+        request->send(response);
+    }
+
     void WebServerRestApi::handle_on_device_get(AsyncWebServerRequest *request, const Device *device)
     {
-        auto response = new AsyncJsonResponse(false);
-        auto & root = response->getRoot();
-        root[device->identifier()] =  device->as_json();
-        response->setLength();
+        std::vector<const Device *> selected{device};
+        bool msgpack = accepts_msgpack(request);
+        String etag(get_etag(selected, msgpack));
+        if (send_not_modified(request, etag) || !claim_response(request))
+        {
+            return;
+        }
+
+        auto stream = std::make_shared<DeviceStateStream>(std::move(selected), msgpack, [this] { release_response(); });
+        auto response = request->beginChunkedResponse(msgpack ? F("application/msgpack") : F("application/json"),
+            [stream] (uint8_t *buffer, size_t max_length, size_t) -> size_t
+        {
+            return stream->read(buffer, max_length);
+        });
         response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Vary", "Accept");
+        if (!etag.isEmpty())
+        {
+            response->addHeader("ETag", etag);
+        }
         request->send(response);
     }
 }
\ No newline at end of file
@@ -21,7 +21,10 @@
  */
 
 #include <ESP8266WiFi.h>
+#include <LittleFS.h>
 
+#include "grmcdorman/device/BootSequence.h"
+#include "grmcdorman/device/ConfigFile.h"
 #include "grmcdorman/device/WifiSetup.h"
 
 namespace grmcdorman::device
@@ -33,33 +36,18 @@ namespace grmcdorman::device
         auto WIFI_STRING_LOWER = FPSTR(wifi_string_lower);
         const char wifi_name[] PROGMEM = "WiFi";
         const char wifi_identifier[] PROGMEM = "wifi_setup";
-        class WifiSetupDevice_Definition: public Device::Definition
+        const char *cache_path = "/wifi_cache.bin";     // In RAM, as required by the file system.
+        const char wifi_name_suffix[] PROGMEM = " WiFi";
+        const char wifi_unique_id_suffix[] PROGMEM = "_wifi";
+        const char dbm_units[] PROGMEM = "dBm";
+        const char wifi_icon[] PROGMEM = "mdi:wifi";
+        const char rssi_field[] PROGMEM = "rssi";
+        const char wifi_attributes[] PROGMEM = "ssid,ip";
+
+        constexpr Device::Definition wifi_device_definition PROGMEM
         {
-            public:
-                virtual const __FlashStringHelper *get_name_suffix() const override
-                {
-                    return F(" WiFi");
-                }
-                virtual const __FlashStringHelper *get_value_template() const override
-                {
-                    return F("{{value_json.wifi.rssi}}");
-                }
-                virtual const __FlashStringHelper *get_unique_id_suffix() const override
-                {
-                    return F("_wifi");
-                }
-                virtual const __FlashStringHelper *get_unit_of_measurement() const override
-                {
-                    return F("dBm");
-                }
-                virtual const __FlashStringHelper *get_json_attributes_template() const override
-                {
-                    return F("{\"ssid\": \"{{value_json.wifi.ssid}}\", \"ip\": \"{{value_json.wifi.ip}}\"}");
-                }
-                virtual const __FlashStringHelper *get_icon() const override
-                {
-                    return F("mdi:wifi");
-                }
+            wifi_name_suffix, wifi_unique_id_suffix, dbm_units, wifi_icon,
+            rssi_field, Device::Definition::Layout::VALUE, wifi_attributes, 3.0f
         };
     }
 
@@ -76,13 +64,12 @@ namespace grmcdorman::device
         dns_1(F("Preferred DNS server"), F("dns_1")),
         dns_2(F("Alternative DNS server"), F("dns_2")),
         connection_timeout(F("Connection timeout (seconds)"), F("connection_timeout")),
+        reuse_lease(F("Reuse the last DHCP address when reconnecting to the same access point"), F("reuse_lease")),
         publish_rssi(F("Publish WiFi signal strength"), F("publish_rssi"))
     {
-        const static WifiSetupDevice_Definition wifi_device_definition;
-
         initialize({&wifi_device_definition}, {&hostname, &ssid, &password, &use_dhcp, &ip_address, &subnet_mask, &default_gateway,
             &auto_dns, &dns_1, &dns_2,
-            &connection_timeout,
+            &connection_timeout, &reuse_lease,
             &publish_rssi});
 
         use_dhcp.set(true);
@@ -98,26 +85,19 @@ namespace grmcdorman::device
 
     void WifiSetup::setup()
     {
-        connect_to_ap();
+        if (!cache_valid)
+        {
+            load_cache();
+        }
 
-        if (WiFi.status() != WL_CONNECTED)
+        if (ssid.get().isEmpty())
         {
             // No SSID. Start in AP.
-            Serial.println(F("Starting in AP mode"));
-  #ifdef ESP8266
-    // @bug workaround for bug #4372 https://github.com/esp8266/Arduino/issues/4372
-            WiFi.enableAP(true);
-            delay(500); // workaround delay
-  #endif
-            WiFi.mode(WIFI_AP);
-            // "target_hostname" is the SSID.
-            WiFi.softAP(hostname.get().isEmpty()? get_system_identifier() : hostname.get());
-            delay(500);
-            Serial.print(F("Soft AP started at address "));
-            Serial.println(WiFi.softAPIP().toString());
-            dns_server = std::make_unique<DNSServer>();
-            dns_server->setErrorReplyCode(DNSReplyCode::NoError);
-            dns_server->start(53, "*", WiFi.softAPIP());
+            start_soft_ap();
+        }
+        else
+        {
+            connect_to_ap();
         }
     }
 
@@ -131,95 +111,243 @@ namespace grmcdorman::device
             use_dhcp.set(true);
         }
 
-        if (!ssid.get().isEmpty())
+        tried_connect_on_setup = true;
+        dns_server.reset();
+
+        Serial.print(F("Attempting to connect to "));
+        Serial.println(ssid.get());
+        // Do not use persistent WiFi settings, we manage those ourselves.
+        WiFi.persistent(false);
+        if (!WiFi.mode(WIFI_STA))
         {
-            tried_connect_on_setup = true;
+            Serial.println(F("Unable to set STA mode"));
+        }
+        if (!WiFi.hostname(target_hostname))
+        {
+            Serial.println(F("Unable to set host name"));
+        }
+
+        // The cache is only used if it is for this SSID.
+        fast_connect = cache_valid && cache.ssid_hash == hash_ssid();
 
-            Serial.print(F("Attempting to connect to "));
-            Serial.println(ssid.get());
-            // Do not use persistent WiFi settings, we manage those ourselves.
-            WiFi.persistent(false);
-            if (!WiFi.mode(WIFI_STA))
+        if (use_dhcp.get())
+        {
+            if (fast_connect && reuse_lease.get() && cache.has_lease)
+            {
+                // Skip DHCP; reuse the previous lease as a static configuration.
+                WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet),
+                    IPAddress(cache.dns_1), IPAddress(cache.dns_2));
+            }
+            else if (!WiFi.config(0u, 0u, 0u))
             {
-                Serial.println(F("Unable to set STA mode"));
+                Serial.println(F("Config for DHCP failed"));
             }
-            if (!WiFi.hostname(target_hostname))
+        }
+        else
+        {
+            // This will explode if the user hasn't set things correctly. :-(
+            IPAddress host_ip;
+            IPAddress gateway_ip;
+            IPAddress subnet_mask_ip;
+            IPAddress dns_1_ip;
+            IPAddress dns_2_ip;
+            if (!host_ip.fromString(ip_address.get()))
+            {
+                Serial.print(F("Host IP address '"));
+                Serial.print(ip_address.get());
+                Serial.println(F("' could not be converted to IP."));
+            }
+            if (!subnet_mask_ip.fromString(subnet_mask.get()))
             {
-                Serial.println(F("Unable to set host name"));
+                Serial.print(F("Subnet mask '"));
+                Serial.print(subnet_mask.get());
+                Serial.println(F("' could not be converted to IP."));
             }
+            gateway_ip.fromString(default_gateway.get());
+            if (!auto_dns.get())
+            {
+                dns_1_ip.fromString(dns_1.get());
+                dns_2_ip.fromString(dns_2.get());
+            }
+
+            WiFi.config(host_ip, gateway_ip, subnet_mask_ip, dns_1_ip, dns_2_ip);
+        }
 
+        if (fast_connect)
+        {
+            // Skip the scan; connect directly to the last access point.
+            WiFi.begin(ssid.get(), password.get(), cache.channel, cache.bssid);
+        }
+        else
+        {
             WiFi.begin(ssid.get(), password.get());
+        }
+
+        state = State::CONNECTING;
+        state_start_ms = millis();
+    }
 
-            if (use_dhcp.get())
+    void WifiSetup::start_soft_ap()
+    {
+        Serial.println(F("Starting in AP mode"));
+  #ifdef ESP8266
+        // @bug workaround for bug #4372 https://github.com/esp8266/Arduino/issues/4372
+        WiFi.enableAP(true);
+  #endif
+        state = State::AP_ENABLING;
+        state_start_ms = millis();
+    }
+
+    void WifiSetup::loop()
+    {
+        switch (state)
+        {
+            case State::CONNECTING:
             {
-                if (!WiFi.config(0u, 0u, 0u))
+                auto status = WiFi.status();
+                if (status == WL_CONNECTED)
+                {
+                    Serial.print(F("Connected to the access point in "));
+                    Serial.print(millis() - state_start_ms);
+                    Serial.println(F(" ms"));
+                    state = State::CONNECTED;
+                    BootSequence::mark(BootSequence::Milestone::NETWORK_CONNECTED);
+                    update_cache();
+                }
+                else if (fast_connect && millis() - state_start_ms >= FAST_CONNECT_TIMEOUT)
                 {
-                    Serial.println(F("Config for DHCP failed"));
+                    // The access point may have moved; try again with a scan.
+                    Serial.println(F("Unable to connect to the cached access point"));
+                    cache_valid = false;
+                    connect_to_ap();
                 }
+                else if (status == WL_CONNECT_FAILED || millis() - state_start_ms >= connection_timeout.get() * 1000)
+                {
+                    Serial.println(F("Unable to connect to the access point, status =") + String(status));
+                    start_soft_ap();
+                }
+                break;
             }
-            else
-            {
-                // This will explode if the user hasn't set things correctly. :-(
-                IPAddress host_ip;
-                IPAddress gateway_ip;
-                IPAddress subnet_mask_ip;
-                IPAddress dns_1_ip;
-                IPAddress dns_2_ip;
-                if (!host_ip.fromString(ip_address.get()))
+
+            case State::AP_ENABLING:
+                if (millis() - state_start_ms >= SOFT_AP_DELAY)   // workaround delay
                 {
-                    Serial.print(F("Host IP address '"));
-                    Serial.print(ip_address.get());
-                    Serial.println(F("' could not be converted to IP."));
+                    WiFi.mode(WIFI_AP);
+                    // "target_hostname" is the SSID.
+                    WiFi.softAP(hostname.get().isEmpty()? get_system_identifier() : hostname.get());
+                    state = State::AP_STARTING;
+                    state_start_ms = millis();
                 }
-                if (!subnet_mask_ip.fromString(subnet_mask.get()))
+                break;
+
+            case State::AP_STARTING:
+                if (millis() - state_start_ms >= SOFT_AP_DELAY)
                 {
-                    Serial.print(F("Subnet mask '"));
-                    Serial.print(subnet_mask.get());
-                    Serial.println(F("' could not be converted to IP."));
+                    Serial.print(F("Soft AP started at address "));
+                    Serial.println(WiFi.softAPIP().toString());
+                    dns_server = std::make_unique<DNSServer>();
+                    dns_server->setErrorReplyCode(DNSReplyCode::NoError);
+                    dns_server->start(53, "*", WiFi.softAPIP());
+                    state = State::SOFT_AP;
                 }
-                gateway_ip.fromString(default_gateway.get());
-                if (!auto_dns.get())
+                break;
+
+            case State::SOFT_AP:
+                if (!ssid.get().isEmpty() && !tried_connect_on_setup)
                 {
-                    dns_1_ip.fromString(dns_1.get());
-                    dns_2_ip.fromString(dns_2.get());
+                    // There is an SSID, but there was no attempt to connect on the `setup` call.
+                    // Try to connect now. This disconnects the Soft AP; if the connection
+                    // fails, the Soft AP is started again.
+                    connect_to_ap();
+                    return;
                 }
 
-                WiFi.config(host_ip, gateway_ip, subnet_mask_ip, dns_1_ip, dns_2_ip);
-            }
-            // Loop continuously while WiFi is not connected
-            unsigned int tries = 0;
-            // Each poll is 100ms, so 10 polls = 1 second.
-            auto status = WiFi.status();
-            while (status != WL_CONNECTED && status != WL_CONNECT_FAILED && tries < connection_timeout.get() * 10)
-            {
-                delay(100);
-                ++tries;
-                status = WiFi.status();
-            }
-            if (status != WL_CONNECTED)
-            {
-                Serial.print(F("Unable to connect to the access point, status =") + String(status));
-            }
+                dns_server->processNextRequest();
+                break;
+
+            case State::CONNECTED:
+                break;
         }
+    }
 
+    uint32_t WifiSetup::hash_ssid() const
+    {
+        uint32_t hash = 2166136261u;
+        for (const char *character = ssid.get().c_str(); *character != '\0'; ++character)
+        {
+            hash = (hash ^ static_cast<uint8_t>(*character)) * 16777619u;
+        }
+        return hash;
     }
-    void WifiSetup::loop()
+
+    void WifiSetup::update_cache()
     {
-        if (dns_server)
+        ConnectionCache current{};
+        current.ssid_hash = hash_ssid();
+        memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+        current.channel = WiFi.channel();
+        // Only a DHCP lease is cached; a static configuration is already known.
+        current.has_lease = use_dhcp.get();
+        if (current.has_lease)
         {
-            if (!ssid.get().isEmpty() && !tried_connect_on_setup)
-            {
-                // There is an SSID, but there was no attempt to connect on the `setup` call.
-                // Try to connect now. This may disconnect the Soft AP.
-                connect_to_ap();
-                if (WiFi.status() == WL_CONNECTED)
-                {
-                    dns_server.reset();
-                    return;
-                }
-            }
+            current.ip = WiFi.localIP();
+            current.gateway = WiFi.gatewayIP();
+            current.subnet = WiFi.subnetMask();
+            current.dns_1 = WiFi.dnsIP(0);
+            current.dns_2 = WiFi.dnsIP(1);
+        }
 
-            dns_server->processNextRequest();
+        if (cache_valid && memcmp(&current, &cache, sizeof(cache)) == 0)
+        {
+            return;
+        }
+
+        cache = current;
+        cache_valid = true;
+
+        // Written only when the access point or lease changes, to limit flash wear.
+        // WifiSetup is set up before the file system phase, so it mounts the file system itself.
+        if (!ConfigFile::mount())
+        {
+            return;
+        }
+        File file = LittleFS.open(cache_path, "w");
+        if (file)
+        {
+            file.write(reinterpret_cast<const uint8_t *>(&cache), sizeof(cache));
+            file.close();
+        }
+    }
+
+    void WifiSetup::load_cache()
+    {
+        if (!ConfigFile::mount())
+        {
+            cache_valid = false;
+            return;
+        }
+
+        File file = LittleFS.open(cache_path, "r");
+        cache_valid = file && file.read(reinterpret_cast<uint8_t *>(&cache), sizeof(cache)) == sizeof(cache);
+    }
+
+    size_t WifiSetup::save_retained_state(uint8_t *buffer, size_t size)
+    {
+        if (!cache_valid || size < sizeof(cache))
+        {
+            return 0;
+        }
+
+        memcpy(buffer, &cache, sizeof(cache));
+        return sizeof(cache);
+    }
+
+    void WifiSetup::restore_retained_state(const uint8_t *buffer, size_t size, uint32_t)
+    {
+        if (size == sizeof(cache))
+        {
+            memcpy(&cache, buffer, sizeof(cache));
+            cache_valid = true;
         }
     }
 
@@ -230,22 +358,35 @@ namespace grmcdorman::device
             return false;
         }
 
+        return serialize_into(json.createNestedObject(get_publish_key()));
+    }
+
+    const __FlashStringHelper *WifiSetup::get_publish_key() const
+    {
         // This device is unique in not using the device identifier here.
-        json[WIFI_STRING_LOWER] = as_json();
+        return WIFI_STRING_LOWER;
+    }
 
+    bool WifiSetup::get_definition_value(size_t index, float &value) const
+    {
+        if (index != 0 || !publish_rssi.get() || !WiFi.isConnected())
+        {
+            return false;
+        }
+
+        value = WiFi.RSSI();
         return true;
     }
 
-    DynamicJsonDocument WifiSetup::as_json() const
+    bool WifiSetup::serialize_into(JsonObject json) const
     {
         static const char enabled_string[] PROGMEM = "enabled";
-        DynamicJsonDocument json(512);
 
         json[FPSTR(enabled_string)] = is_enabled();
         json[SSID_STRING_LOWER] = WiFi.SSID();
         json[F("ip")] = WiFi.localIP().toString();
-        json[F("rssi")] = WiFi.RSSI();
+        json[FPSTR(rssi_field)] = WiFi.RSSI();
 
-        return json;
+        return true;
     }
 }
@@ -82,11 +82,10 @@
      * - load settings: @code{.cpp}
      * config.load(devices);
      * @endcode
-     * - Setup devices and add to the web settings: @code{.cpp}
+     * - Setup devices, in boot phase order (see @ref grmcdorman::device::BootSequence "BootSequence"), and add to the web settings: @code{.cpp}
+     * BootSequence::setup_devices(devices);
      * for (auto &device : devices)
      * {
-     *     device->setup();
-     *     device->set_devices(devices);
      *     webServer.add_setting_set(device->name(), device->identifier(), device->get_settings());
      * }
      * @endcode
@@ -23,10 +23,12 @@
 #pragma once
 
 #include <Arduino.h>
-#include <Ticker.h>
+
+#include <vector>
 
 #include "grmcdorman/device/Device.h"
 #include "grmcdorman/device/Accumulator.h"
+#include "grmcdorman/device/Scheduler.h"
 
 namespace grmcdorman::device
 {
@@ -37,9 +39,14 @@ namespace grmcdorman::device
      * a scale and an offset before reporting. The value can also
      * be inverted (i.e. 1/value).
      *
+     * Each reading is a burst of samples (the `oversampling` setting). The samples
+     * are sorted, the lowest and highest quarter are discarded, and the rest are averaged;
+     * this rejects spikes, and gives a raw value with a fractional part.
+     *
      * This device doesn't provide full services; it's intended to
      * be derived in other classes that can transform the raw
-     * value into meaningful output.
+     * value into meaningful output. A derived class with a costly transform can
+     * use a lookup table instead; see `use_transform_table`.
      *
      */
     class AbstractAnalog: public Device
@@ -60,6 +67,57 @@ namespace grmcdorman::device
             void setup() override;
             void loop() override;
             bool publish(DynamicJsonDocument &json) const override;
+            bool get_definition_value(size_t index, float &value) const override;
+
+            /**
+             * @brief Get whether the device's state changes only with new readings.
+             *
+             * @return `true`; the state is the accumulated readings.
+             */
+            bool has_reading_generation() const override
+            {
+                return true;
+            }
+
+            /**
+             * @brief Get the polling interval.
+             *
+             * @return The configured polling interval, in seconds.
+             */
+            uint32_t get_poll_interval() const override
+            {
+                return readInterval.get();
+            }
+
+            /**
+             * @brief Take a reading now.
+             *
+             */
+            void request_reading() override;
+
+            /**
+             * @brief Save the accumulated readings.
+             *
+             * @param buffer    Receives the state.
+             * @param size      The size of the buffer.
+             * @return The number of bytes used; zero if they do not fit.
+             */
+            size_t save_retained_state(uint8_t *buffer, size_t size) override
+            {
+                return sensor_reading.save_state(buffer, size);
+            }
+
+            /**
+             * @brief Restore the accumulated readings.
+             *
+             * @param buffer        The state.
+             * @param size          The size of the state.
+             * @param elapsed_ms    Approximate milliseconds since the state was saved.
+             */
+            void restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms) override
+            {
+                sensor_reading.restore_state(buffer, size, elapsed_ms);
+            }
 
             /**
              * @brief Last computed reading.
@@ -94,7 +152,19 @@ namespace grmcdorman::device
                 return sensor_reading.get_current_average();
             }
 
-            DynamicJsonDocument as_json() const override;
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the readings and the age in seconds of the last reading.
+             */
+            uint32_t get_status_version() const override
+            {
+                return combine_status_version(get_reading_generation(), (millis() - last_read_millis) / 1000);
+            }
+
+            static constexpr uint32_t MAX_OVERSAMPLING = 32;        //!< The maximum number of samples per reading.
         protected:
             /**
              * @brief Transform the raw reading into the reported value.
@@ -104,20 +174,56 @@ namespace grmcdorman::device
              *
              * Do not apply the scaling, offset, and invert values in this method;
              * they will be automatically applied on the returned value.
-             * @param reading   The raw reading.
+             * @param reading   The raw reading, 0 to 1023; with oversampling, this has a fractional part.
              * @return float    The transformed reading.
              */
-            virtual float transform_raw_reading(int reading) = 0;
+            virtual float transform_raw_reading(float reading) = 0;
+
+            /**
+             * @brief Get whether to use a lookup table for `transform_raw_reading`.
+             *
+             * If `true`, `setup` computes the transform at every 16th raw value, and readings
+             * interpolate between those values; the transform is then not called for each
+             * reading, except within 6 steps (96 raw values) of either end of the range. For the
+             * `ThermistorSensor` the interpolation error is then at most about 0.1°C. The transform must depend only on the
+             * reading, not on settings that can change after `setup`.
+             *
+             * @return `true` to use a lookup table; by default, `false`.
+             */
+            virtual bool use_transform_table() const
+            {
+                return false;
+            }
+
             FloatSetting scale;                 //!< Offset.
             FloatSetting offset;                //!< Scaling.
             ToggleSetting invertReading;        //!< Whether to invert the reading.
             UnsignedIntegerSetting readInterval;//!< How often to request a reading.
+            UnsignedIntegerSetting oversampling;//!< The number of samples per reading.
             uint32_t last_read_millis = 0;      //!< Timestamp of last read.
             constexpr static uint32_t statusReadInterval = (30 / 5) * 1000;//!< Default read interval. Chosen such that there should be 5 readings per 30 seconds.
             Accumulator<float, 5> sensor_reading;  //!< Reading.
         private:
-            void set_timer();                   //!< Set up ticker timer.
-            Ticker ticker;                      //!< Ticker to handle readings.
+            static constexpr uint32_t TABLE_STEP = 16;                          //!< The raw value step between lookup table entries.
+            static constexpr uint32_t TABLE_SIZE = 1024 / TABLE_STEP + 1;       //!< The number of lookup table entries.
+            static constexpr uint32_t TABLE_EXACT_STEPS = 6;                    //!< The number of steps at each end that are computed, not interpolated.
+
+            void set_timer();                   //!< Set up the read task.
+            /**
+             * @brief Take a burst of samples.
+             *
+             * @return The trimmed mean of the samples.
+             */
+            float sample();
+            /**
+             * @brief Transform a raw value, using the lookup table if there is one.
+             *
+             * @param reading   The raw value.
+             * @return The transformed value.
+             */
+            float transform(float reading);
+            std::vector<float> transform_table; //!< The transform at every `TABLE_STEP` raw values; empty if not used.
+            Scheduler::Task read_task{this};    //!< Task to handle readings.
             uint32_t current_polling_seconds = 0;//!< Current polling interval.
             float last_raw_value = 0;           //!< Last raw value.
     };
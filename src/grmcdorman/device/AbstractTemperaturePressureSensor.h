@@ -47,18 +47,17 @@ namespace grmcdorman::device
                 Device(device_name, device_identifier)
             {
             }
-            DynamicJsonDocument as_json() const override
+            bool serialize_into(JsonObject json) const override
             {
                 static const char temperature_string[] PROGMEM = "temperature";
                 static const char humidity_string[] PROGMEM = "humidity";
                 static const char enabled_string[] PROGMEM = "enabled";
-                DynamicJsonDocument json(1024);
 
                 json[FPSTR(enabled_string)] = is_enabled();
-                json[FPSTR(temperature_string)] = std::move(temperature.as_json());
-                json[FPSTR(humidity_string)] = std::move(humidity.as_json());
+                temperature.serialize_into(json.createNestedObject(FPSTR(temperature_string)));
+                humidity.serialize_into(json.createNestedObject(FPSTR(humidity_string)));
 
-                return json;
+                return true;
             }
 
             bool publish(DynamicJsonDocument &json) const
@@ -68,11 +67,84 @@ namespace grmcdorman::device
                     return false;
                 }
 
-                json[identifier()] = as_json();
+                return serialize_into(json.createNestedObject(get_publish_key()));
+            }
 
+            /**
+             * @brief Get whether the device's state changes only with new readings.
+             *
+             * @return `true`; the state is the accumulated readings.
+             */
+            bool has_reading_generation() const override
+            {
                 return true;
             }
 
+            /**
+             * @brief Save the accumulated readings.
+             *
+             * @param buffer    Receives the state.
+             * @param size      The size of the buffer.
+             * @return The number of bytes used; zero if they do not fit.
+             */
+            size_t save_retained_state(uint8_t *buffer, size_t size) override
+            {
+                if (size < 2 * decltype(temperature)::get_state_size())
+                {
+                    return 0;
+                }
+                size_t used = temperature.save_state(buffer, size);
+                return used + humidity.save_state(buffer + used, size - used);
+            }
+
+            /**
+             * @brief Restore the accumulated readings.
+             *
+             * @param buffer        The state.
+             * @param size          The size of the state.
+             * @param elapsed_ms    Approximate milliseconds since the state was saved.
+             */
+            void restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms) override
+            {
+                if (size == 2 * decltype(temperature)::get_state_size())
+                {
+                    temperature.restore_state(buffer, size / 2, elapsed_ms);
+                    humidity.restore_state(buffer + size / 2, size / 2, elapsed_ms);
+                }
+            }
+
+            /**
+             * @brief Get the current value for a definition.
+             *
+             * Derived classes must list the temperature definition first,
+             * followed by the humidity definition.
+             *
+             * @param index         Index of the definition; 0 is temperature, 1 is humidity.
+             * @param[out] value    Receives the current average.
+             * @return `true` if a value is available.
+             */
+            bool get_definition_value(size_t index, float &value) const override
+            {
+                if (!temperature.has_accumulation())
+                {
+                    return false;
+                }
+
+                switch (index)
+                {
+                    case 0:
+                        value = temperature.get_current_average();
+                        return true;
+
+                    case 1:
+                        value = humidity.get_current_average();
+                        return true;
+
+                    default:
+                        return false;
+                }
+            }
+
             /**
              * @brief Get the last temperature reading.
              *
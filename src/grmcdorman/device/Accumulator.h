@@ -26,11 +26,54 @@
 #include <ArduinoJson.h>
 
 #include <algorithm>
-#include <numeric>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
 #include <vector>
 
 namespace grmcdorman::device
 {
+        /**
+         * @brief The default accumulator policy.
+         *
+         * Floating-point readings are summed as `float`, since the hardware has no
+         * double-precision support; integer readings are summed exactly in 64 bits.
+         * The sum of squares, and thus the variance, is maintained.
+         *
+         * A policy supplies the `sum_type` used for the running sums, and a
+         * `track_variance` flag; see `CompactIntegerAccumulatorPolicy` for an example.
+         *
+         * @tparam T        The type being accumulated.
+         */
+        template<typename T>
+        struct AccumulatorPolicy
+        {
+            typedef typename std::conditional<std::is_floating_point<T>::value, float, int64_t>::type sum_type;  //!< The type used for the running sums.
+            static constexpr bool track_variance = true;    //!< Whether the sum of squares, and thus the variance, is maintained.
+        };
+
+        /**
+         * @brief An accumulator policy for small integer readings.
+         *
+         * The sums are held in 32 bits, which is cheaper in both RAM and cycles than
+         * the default 64 bits. The sum of squares must fit in 32 bits; i.e. `N` times the
+         * square of the largest reading must be less than 2<sup>32</sup> (for example, readings up to
+         * 4095 with `N` up to 255). If that cannot be guaranteed, set `track_variance` to `false`
+         * to drop the sum of squares; the sum alone then need only fit `N` times the largest reading.
+         *
+         * Integer sums also allow `Accumulator::get_current_average_fixed`, which computes
+         * the average with no floating-point operations.
+         *
+         * @tparam T                The type being accumulated; must be an integer type.
+         * @tparam variance         Whether the variance is maintained.
+         */
+        template<typename T, bool variance = true>
+        struct CompactIntegerAccumulatorPolicy
+        {
+            static_assert(std::is_integral<T>::value, "CompactIntegerAccumulatorPolicy requires an integer type");
+            typedef typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type sum_type;  //!< The type used for the running sums.
+            static constexpr bool track_variance = variance;    //!< Whether the sum of squares, and thus the variance, is maintained.
+        };
 
         /**
          * @brief A class to handle accumulating values.
@@ -45,18 +88,33 @@ namespace grmcdorman::device
          * reading is published, at which time `reset` is called
          * to begin accumulating anew.
          *
+         * The sum and sum of squares of the window are maintained as each reading
+         * arrives, so the average and variance cost the same regardless of `N`. For
+         * floating-point types the sums are recomputed from the window each time it
+         * wraps, which bounds the rounding drift from repeated add/subtract. The window
+         * minimum and maximum are also maintained; the window is only rescanned when the
+         * reading leaving the window was the minimum or maximum.
+         *
+         * The representation is selected at compile time: the storage width by `T`, the
+         * width of the running sums and whether the variance is kept by `Policy`. When `N` is
+         * a power of two the window index wraps with a mask.
+         *
          * @tparam T        The type being accumulated; must be an arithmetic type, e.g. int32_t or float.
+         * @tparam N        The number of readings in the rolling average.
          * @tparam unset    The unset value. Defaults to `T()`, which is likely to be zero.
          * @tparam zero     The zero value; defaults to 0.
+         * @tparam Policy   The accumulation policy; defaults to `AccumulatorPolicy<T>`.
          */
-        template<typename T, uint8_t N, int unset = 0, int zero = 0>
+        template<typename T, uint8_t N, int unset = 0, int zero = 0, typename Policy = AccumulatorPolicy<T>>
         class Accumulator
         {
+            static_assert(N > 0, "An accumulator needs at least one reading");
         public:
             static constexpr T unset_value = unset;     //!< The unset value.
             static constexpr T zero_value = zero;       //!< The zero value.
             static constexpr uint8_t average_points = N;//!< The number of readings for the rolling average.
             typedef T value_type;                       //!< The value type.
+            typedef typename Policy::sum_type sum_type; //!< The type used for the running sums.
 
             /**
              * @brief Get the current value.
@@ -82,8 +140,55 @@ namespace grmcdorman::device
              */
             float get_current_average() const
             {
-                uint8_t count = std::min(data_read_first, average_points);
-                return count == 0 ? unset_value : std::accumulate(&last_reading_set[0], &last_reading_set[count], zero_value) / static_cast<float>(count);
+                return data_read_first == 0 ? unset_value : static_cast<float>(sum) / data_read_first;
+            }
+            /**
+             * @brief Get the current rolling average in Q16.16 fixed point.
+             *
+             * This is only available when the policy's sum type is an integer;
+             * no floating-point operations are used. The integer part of the
+             * average is the result shifted right by 16.
+             *
+             * @return Current average, times 65536.
+             */
+            int32_t get_current_average_fixed() const
+            {
+                static_assert(std::is_integral<sum_type>::value, "Fixed-point averages require an integer sum type");
+                return data_read_first == 0 ?
+                    static_cast<int32_t>(unset_value) * 65536 :
+                    static_cast<int32_t>(static_cast<int64_t>(sum) * 65536 / data_read_first);
+            }
+            /**
+             * @brief Get the minimum reading in the rolling average set.
+             *
+             * @return Minimum reading; `unset_value` if there are no readings.
+             */
+            T get_minimum() const
+            {
+                return data_read_first == 0 ? unset_value : minimum;
+            }
+            /**
+             * @brief Get the maximum reading in the rolling average set.
+             *
+             * @return Maximum reading; `unset_value` if there are no readings.
+             */
+            T get_maximum() const
+            {
+                return data_read_first == 0 ? unset_value : maximum;
+            }
+            /**
+             * @brief Get the (population) variance of the rolling average set.
+             *
+             * @return Variance; zero if there are no readings, or the policy does not track the variance.
+             */
+            float get_variance() const
+            {
+                if (!Policy::track_variance || data_read_first == 0)
+                {
+                    return 0.0f;
+                }
+                float mean = static_cast<float>(sum) / data_read_first;
+                return std::max(0.0f, static_cast<float>(sum_of_squares) / data_read_first - mean * mean);
             }
             /**
              * @brief Record a new reading.
@@ -95,13 +200,57 @@ namespace grmcdorman::device
              */
             void new_reading(T new_value)
             {
-                last_reading = new_value;
-                last_reading_set[current_index] = new_value;
-                current_index = (current_index + 1) % N;
+                bool rescan = false;
                 if (data_read_first < N)
                 {
                     ++data_read_first;
                 }
+                else
+                {
+                    T old_value = last_reading_set[current_index];
+                    sum -= old_value;
+                    if constexpr (Policy::track_variance)
+                    {
+                        sum_of_squares -= static_cast<sum_type>(old_value) * old_value;
+                    }
+                    rescan = old_value == minimum || old_value == maximum;
+                }
+
+                last_reading = new_value;
+                last_reading_set[current_index] = new_value;
+                sum += new_value;
+                if constexpr (Policy::track_variance)
+                {
+                    sum_of_squares += static_cast<sum_type>(new_value) * new_value;
+                }
+                if constexpr ((N & (N - 1)) == 0)
+                {
+                    current_index = (current_index + 1) & (N - 1);
+                }
+                else
+                {
+                    current_index = current_index + 1 == N ? 0 : current_index + 1;
+                }
+
+                if (std::is_floating_point<sum_type>::value && current_index == 0)
+                {
+                    // Re-normalise once per pass through the window.
+                    rescan_window();
+                }
+                else if (rescan)
+                {
+                    rescan_extremes();
+                }
+                else if (data_read_first == 1)
+                {
+                    minimum = new_value;
+                    maximum = new_value;
+                }
+                else
+                {
+                    minimum = std::min(minimum, new_value);
+                    maximum = std::max(maximum, new_value);
+                }
                 last_sample_time = millis();
             }
             /**
@@ -138,29 +287,131 @@ namespace grmcdorman::device
             }
 
             /**
-             * @brief Get the values in standard JSON.
+             * @brief Get the size of a saved state.
              *
-             * @return DynamicJsonDocument containing values.
+             * @return The size of the state saved by `save_state`.
              */
-            DynamicJsonDocument as_json() const
+            static constexpr size_t get_state_size()
+            {
+                return sizeof(Accumulator);
+            }
+
+            /**
+             * @brief Save the accumulator, e.g. across a deep sleep.
+             *
+             * The state is a copy of the accumulator, with the sample time
+             * replaced by the sample age. It is only meaningful to the same build.
+             *
+             * @param buffer    Receives the state.
+             * @param size      The size of the buffer.
+             * @return The number of bytes used, `get_state_size()`; zero if the buffer is too small.
+             */
+            size_t save_state(uint8_t *buffer, size_t size) const
+            {
+                static_assert(std::is_trivially_copyable<Accumulator>::value, "Accumulators are saved by copying");
+                if (size < get_state_size())
+                {
+                    return 0;
+                }
+                Accumulator copy(*this);
+                copy.last_sample_time = get_last_sample_age();
+                memcpy(buffer, &copy, get_state_size());
+                return get_state_size();
+            }
+
+            /**
+             * @brief Restore an accumulator saved by `save_state`.
+             *
+             * @param buffer        The state.
+             * @param size          The size of the state.
+             * @param elapsed_ms    Milliseconds since the state was saved; added to the sample age.
+             * @return `true` if the state was restored.
+             */
+            bool restore_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms)
+            {
+                if (size < get_state_size())
+                {
+                    return false;
+                }
+                memcpy(this, buffer, get_state_size());
+                last_sample_time = millis() - (last_sample_time + elapsed_ms);
+                return true;
+            }
+
+            /**
+             * @brief Write the values in standard JSON.
+             *
+             * @param json  The object to receive the values.
+             */
+            void serialize_into(JsonObject json) const
             {
                 static const char average_string[] PROGMEM = "average";
                 static const char last_string[] PROGMEM = "last";
+                static const char minimum_string[] PROGMEM = "min";
+                static const char maximum_string[] PROGMEM = "max";
+                static const char variance_string[] PROGMEM = "variance";
                 static const char sample_count_string[] PROGMEM = "sample_count";
                 static const char sample_age_string[] PROGMEM = "sample_age_ms";
 
-                DynamicJsonDocument json(128);
                 json[FPSTR(average_string)] = get_current_average();
                 json[FPSTR(last_string)] = get_last_reading();
+                json[FPSTR(minimum_string)] = get_minimum();
+                json[FPSTR(maximum_string)] = get_maximum();
+                json[FPSTR(variance_string)] = get_variance();
                 json[FPSTR(sample_count_string)] = get_sample_count();
                 json[FPSTR(sample_age_string)] = get_last_sample_age();
+            }
+
+            /**
+             * @brief Get the values in standard JSON.
+             *
+             * @return DynamicJsonDocument containing values.
+             */
+            DynamicJsonDocument as_json() const
+            {
+                DynamicJsonDocument json(256);
+                serialize_into(json.to<JsonObject>());
                 return json;
             }
 
         private:
+            /**
+             * @brief Recompute the sums, minimum and maximum from the window.
+             *
+             */
+            void rescan_window()
+            {
+                sum = zero_value;
+                sum_of_squares = zero_value;
+                for (uint8_t index = 0; index < data_read_first; ++index)
+                {
+                    sum += last_reading_set[index];
+                    if constexpr (Policy::track_variance)
+                    {
+                        sum_of_squares += static_cast<sum_type>(last_reading_set[index]) * last_reading_set[index];
+                    }
+                }
+                rescan_extremes();
+            }
+
+            /**
+             * @brief Recompute the minimum and maximum from the window.
+             *
+             */
+            void rescan_extremes()
+            {
+                auto extremes = std::minmax_element(&last_reading_set[0], &last_reading_set[data_read_first]);
+                minimum = *extremes.first;
+                maximum = *extremes.second;
+            }
+
             T last_reading = unset_value;           //!< The last reading.
             T last_reading_set[N];                  //!< The last <N> readings.
-            uint32_t current_index = 0;             //!< The number of readings since the last reset.
+            sum_type sum = zero_value;              //!< The sum of the readings in `last_reading_set`.
+            sum_type sum_of_squares = zero_value;   //!< The sum of the squares of the readings in `last_reading_set`.
+            T minimum = unset_value;                //!< The minimum reading in `last_reading_set`.
+            T maximum = unset_value;                //!< The maximum reading in `last_reading_set`.
+            uint8_t current_index = 0;              //!< The index in `last_reading_set` for the next reading.
             uint8_t data_read_first = 0;            //!< The number of points in the first set; no more than N.
             uint32_t last_sample_time = 0;          //!< The last sample time.
         };
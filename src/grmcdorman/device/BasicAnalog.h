@@ -81,8 +81,15 @@ namespace grmcdorman::device
              * @return String containing status report.
              */
             virtual String get_status() const;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
         protected:
-            virtual float transform_raw_reading(int reading) override
+            virtual float transform_raw_reading(float reading) override
             {
                 return reading;
             };
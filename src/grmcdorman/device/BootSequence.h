@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <vector>
+
+#include "grmcdorman/device/Device.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief Sets up the devices in boot phase order, and records the boot timeline.
+     *
+     * `setup_devices` replaces the usual loop calling `setup` for each device. It calls
+     * `set_devices` for every device first, and then `setup` for each device in the order
+     * of its boot phase (`Device::get_boot_phase`), keeping the list order within a phase:
+     *
+     * - `NETWORK_START` devices first, so that WiFi association runs while the others are set up.
+     * - `HARDWARE` devices next; once each is set up, its first reading is requested with
+     *   `Device::request_reading`, rather than waiting for the first polling interval. A sensor
+     *   that must settle after power-up, such as `DhtSensor`, starts that read once it has.
+     * - `FILESYSTEM` devices, after the file system is mounted with `ConfigFile::mount`.
+     * - `NETWORK` devices last.
+     *
+     * The ESP8266 runs one task; the phases do not run in parallel. WiFi association,
+     * the sensor conversions and, for some sensors, the reading itself proceed in the
+     * background, so taking the first readings while associating, and connecting the
+     * MQTT publisher once WiFi is up, gets the first reading published sooner after boot.
+     *
+     * The timeline records, for each device, when `setup` started, how long it took, and when the
+     * first reading was made; and the times of a few milestones, such as the WiFi connection.
+     * All times are milliseconds since boot, from `millis`; zero means "not yet". It is shown
+     * by `DiagnosticsDisplay`.
+     */
+    class BootSequence
+    {
+        public:
+            /**
+             * @brief Boot milestones.
+             *
+             * Each is recorded the first time it is reached.
+             */
+            enum class Milestone: uint8_t
+            {
+                FILESYSTEM_MOUNTED,         //!< The file system was mounted.
+                NETWORK_CONNECTED,          //!< The WiFi connection was made.
+                MQTT_CONNECTED,             //!< The MQTT publisher connected to the broker.
+                FIRST_READING_PUBLISHED,    //!< The MQTT publisher published a reading.
+                COUNT                       //!< The number of milestones.
+            };
+
+            /**
+             * @brief The boot timeline of one device.
+             */
+            struct Entry
+            {
+                Device *device;                 //!< The device.
+                Device::BootPhase phase;        //!< The boot phase.
+                uint32_t setup_start_ms;        //!< When `setup` was called.
+                uint32_t setup_us;              //!< How long `setup`, and requesting the first reading, took, in microseconds.
+                uint32_t first_reading_ms;      //!< When the first reading was made; zero if there has not been one.
+            };
+
+            /**
+             * @brief Set up the devices.
+             *
+             * This must be called once, after the settings are loaded.
+             *
+             * @param devices   The devices. This must be persistent; it is passed to `Device::set_devices`.
+             */
+            static void setup_devices(const std::vector<Device *> &devices);
+
+            /**
+             * @brief Record a milestone.
+             *
+             * Only the first time is kept.
+             *
+             * @param milestone The milestone reached.
+             */
+            static void mark(Milestone milestone)
+            {
+                auto &time = milestones[static_cast<size_t>(milestone)];
+                if (time == 0)
+                {
+                    time = millis();
+                }
+            }
+
+            /**
+             * @brief Get the time of a milestone.
+             *
+             * @param milestone The milestone.
+             * @return When it was reached; zero if it has not been.
+             */
+            static uint32_t get_milestone_ms(Milestone milestone)
+            {
+                return milestones[static_cast<size_t>(milestone)];
+            }
+
+            /**
+             * @brief Get the time the last device was set up.
+             *
+             * @return When `setup_devices` finished; zero if it has not been called.
+             */
+            static uint32_t get_setup_complete_ms()
+            {
+                return setup_complete_ms;
+            }
+
+            /**
+             * @brief Get the device timelines.
+             *
+             * @return The timeline of each device, in the order they were set up.
+             */
+            static const std::vector<Entry> &get_entries()
+            {
+                return entries;
+            }
+
+            /**
+             * @brief Get the name of a boot phase.
+             *
+             * @param phase The phase.
+             * @return The name, e.g. `network_start`.
+             */
+            static const __FlashStringHelper *get_phase_name(Device::BootPhase phase);
+
+            /**
+             * @brief Get the name of a milestone.
+             *
+             * @param milestone The milestone.
+             * @return The name, e.g. `network_connected`.
+             */
+            static const __FlashStringHelper *get_milestone_name(Milestone milestone);
+
+            /**
+             * @brief Add the timeline to a JSON object.
+             *
+             * The members are `setup_complete_ms`; `milestones`, an object with the time of each
+             * milestone reached, by name; and `devices`, an object with one object per device,
+             * by identifier, with its `phase`, `setup_start_ms`, `setup_us` and, if made, `first_reading_ms`.
+             *
+             * @param json  The object to receive the timeline.
+             */
+            static void to_json(JsonObject json);
+
+            /**
+             * @brief Get the JSON document capacity needed by `to_json`.
+             *
+             * @return The capacity, including copied strings.
+             */
+            static size_t get_json_capacity()
+            {
+                return JSON_BASE_CAPACITY + JSON_DEVICE_CAPACITY * entries.size();
+            }
+
+        private:
+            static constexpr size_t JSON_BASE_CAPACITY = 224;   //!< Capacity of the milestones in `to_json`, with their names.
+            static constexpr size_t JSON_DEVICE_CAPACITY = 176; //!< Capacity of each device in `to_json`, with its identifier and member names.
+
+            /**
+             * @brief Record the first reading of a device.
+             *
+             * @param device    The device with a new reading.
+             */
+            static void on_reading(const Device &device);
+
+            static std::vector<Entry> entries;                                      //!< The device timelines.
+            static uint32_t milestones[static_cast<size_t>(Milestone::COUNT)];      //!< The milestone times.
+            static uint32_t setup_complete_ms;                                      //!< When `setup_devices` finished.
+            static size_t awaiting_first_reading;                                   //!< The number of devices with readings, waiting for their first.
+            static bool subscribed;                                                 //!< Whether `on_reading` is subscribed to the `ReadingBus`.
+    };
+}
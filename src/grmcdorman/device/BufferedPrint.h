@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <Print.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief A small buffer in front of a Print.
+     *
+     * ArduinoJson serializes mostly a character at a time; writing
+     * each character directly to the MQTT client would write each
+     * to the network client individually. This collects characters
+     * and writes them in blocks.
+     */
+    class BufferedPrint: public Print
+    {
+        public:
+            /**
+             * @brief Construct a new BufferedPrint object.
+             *
+             * @param target    The destination for buffered output.
+             */
+            explicit BufferedPrint(Print &target): target(target)
+            {
+            }
+
+            size_t write(uint8_t c) override
+            {
+                buffer[used++] = c;
+                if (used == sizeof(buffer))
+                {
+                    flush();
+                }
+                return 1;
+            }
+
+            size_t write(const uint8_t *data, size_t size) override
+            {
+                for (size_t remaining = size; remaining > 0; )
+                {
+                    size_t count = std::min(remaining, sizeof(buffer) - used);
+                    memcpy(&buffer[used], data, count);
+                    used += count;
+                    data += count;
+                    remaining -= count;
+                    if (used == sizeof(buffer))
+                    {
+                        flush();
+                    }
+                }
+                return size;
+            }
+
+            /**
+             * @brief Write any buffered data to the target.
+             *
+             */
+            void flush()
+            {
+                if (used > 0)
+                {
+                    written += target.write(buffer, used);
+                    used = 0;
+                }
+            }
+
+            /**
+             * @brief Get the number of bytes accepted by the target.
+             *
+             * @return Bytes written.
+             */
+            size_t get_written() const
+            {
+                return written;
+            }
+
+        private:
+            Print &target;              //!< The destination for output.
+            uint8_t buffer[64];         //!< The buffered data.
+            size_t used = 0;            //!< Bytes used in `buffer`.
+            size_t written = 0;         //!< Bytes accepted by `target`.
+    };
+}
@@ -27,14 +27,27 @@
 
 #include <ArduinoJson.h>
 
+class Print;
+
 namespace grmcdorman::device
 {
     class Device;
 
     /**
-     * @brief This class provides simple JSON configuration file save/load.
+     * @brief This class provides simple configuration file save/load.
+     *
+     * Device settings are saved in a compact binary file, by default `/config.bin`. The
+     * file is a header (`MAGIC` then `VERSION`) followed by one record per setting: a 32-bit key,
+     * the FNV-1a hash of the device identifier, a `/`, and the setting name; a 16-bit value
+     * length; and the value, as from `SettingInterface::as_string`, without a terminator.
+     * All integers are little-endian. The file is read one record at a time.
      *
+     * A save is skipped when no setting has changed since the file was last loaded or saved.
+     * Otherwise the file is written under a temporary name and then renamed over the previous
+     * file, so that an interrupted save leaves the previous settings intact.
      *
+     * If there is no binary file, settings are loaded from the JSON file, by default `/config.json`,
+     * as saved by earlier versions; the binary file is then written. The JSON file is left in place.
      */
     class ConfigFile
     {
@@ -42,7 +55,7 @@ namespace grmcdorman::device
         /**
          * @brief Construct a new Config File object
          *
-         * This will have the default file path, `/config.json`.
+         * This will have the default file paths, `/config.json` and `/config.bin`.
          *
          */
         ConfigFile(): ConfigFile("/config.json")
@@ -52,10 +65,12 @@ namespace grmcdorman::device
         /**
          * @brief Construct a new Config File object.
          *
-         * @param explicit_path     The explicit path to the config file. Must be a persisent pointer; do not pass a `.c_str()` value.
+         * @param explicit_path         The explicit path to the JSON config file. Must be a persisent pointer; do not pass a `.c_str()` value.
+         * @param explicit_binary_path  The explicit path to the binary config file. Must be a persisent pointer.
          *
          */
-        explicit ConfigFile(const char *explicit_path): path(explicit_path)
+        explicit ConfigFile(const char *explicit_path, const char *explicit_binary_path = "/config.bin"):
+            path(explicit_path), binary_path(explicit_binary_path)
         {
         }
 
@@ -69,11 +84,22 @@ namespace grmcdorman::device
             return path;
         }
 
+        /**
+         * @brief Get the binary configuration file path.
+         *
+         * @return Binary configuration file path.
+         */
+        const char *get_binary_path() const
+        {
+            return binary_path;
+        }
+
         /**
          * @brief Save all device settings.
          *
-         * This saves all applicable device settings. If
-         * there are no devices with savable settings,
+         * This saves all applicable device settings to the binary
+         * file. If there are no devices with savable settings,
+         * or no setting has changed since the last load or save,
          * no config file is saved.
          *
          * @param devices   The set of devices to save.
@@ -83,7 +109,8 @@ namespace grmcdorman::device
         /**
          * @brief Load all device settings.
          *
-         * This loads all applicable device settings.
+         * This loads all applicable device settings from the binary
+         * file or, if it does not exist, from the JSON file.
          *
          * @param devices   The set of devices to save.
          * @return `true` if settings were loaded.
@@ -91,14 +118,14 @@ namespace grmcdorman::device
         bool load(const std::vector<Device *> &devices);
 
         /**
-         * @brief Save the JSON settings to the file system.
+         * @brief Save the JSON settings to the JSON file.
          *
          * @param json  JSON to save.
          */
         void save(DynamicJsonDocument &json);
 
         /**
-         * @brief Load the JSON settings from the file system.
+         * @brief Load the JSON settings from the JSON file.
          *
          * If the settings cannot be retrieved, or an error occurred,
          * an unset value is returned.
@@ -107,7 +134,43 @@ namespace grmcdorman::device
          */
         std::optional<DynamicJsonDocument> load();
 
+        /**
+         * @brief Mount the file system.
+         *
+         * `LittleFS` is mounted on the first call; later calls only report the result,
+         * so that loading the settings, and `BootSequence` before the file system phase,
+         * do not each mount it again. If mounting fails it is retried on the next call.
+         *
+         * @return `true` if the file system is mounted.
+         */
+        static bool mount();
+
+        static constexpr uint8_t MAGIC[4] = {'D', 'F', 'C', 'F'};  //!< The binary file signature.
+        static constexpr uint8_t VERSION = 1;                       //!< The binary file format version.
+
     private:
-        const char *path;       //!< The configuration file path.
+        /**
+         * @brief Load all device settings from the binary file.
+         *
+         * @param devices   The set of devices to load.
+         * @return `true` if the file exists and has a valid header.
+         */
+        bool load_binary(const std::vector<Device *> &devices);
+
+        /**
+         * @brief Write the settings records, or compute their hash.
+         *
+         * @param devices   The set of devices to save.
+         * @param output    If not `nullptr`, receives the records.
+         * @param[out] record_count Receives the number of records.
+         * @return The hash of the records, as written; if writing to the output failed, the complement of the hash.
+         */
+        static uint32_t write_records(const std::vector<Device *> &devices, Print *output, size_t &record_count);
+
+        const char *path;               //!< The JSON configuration file path.
+        const char *binary_path;        //!< The binary configuration file path.
+        uint32_t saved_hash = 0;        //!< The hash of the records last loaded or saved.
+        bool saved_hash_valid = false;  //!< Whether `saved_hash` is set.
+        static bool mounted;            //!< Whether the file system has been mounted.
     };
 }
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief A virtual sensor whose value is computed from other devices' readings.
+     *
+     * The value is recomputed when one of the input devices has a new reading (see
+     * `ReadingBus`), not on a timer; each new value is a new reading of this device, so it is
+     * published, pushed and recorded like any other sensor, and can itself be an input.
+     *
+     * The sensor has a single definition, supplied by the sketch; its layout is `VALUE`, and its
+     * `field` is the member of this device's JSON holding the value. For example, a dew point
+     * from a DHT sensor, with the strings in `PROGMEM` (see `DhtSensorWithLCDExample`):
+     * @code{.cpp}
+     * constexpr Device::Definition dew_point_definition PROGMEM
+     * {
+     *     dew_point_name_suffix, dew_point_unique_id_suffix, celsius_units, dew_point_icon,
+     *     dew_point_field, Device::Definition::Layout::VALUE, nullptr, 0.1f
+     * };
+     * DerivedSensor dew_point(FPSTR(dew_point_name), FPSTR(dew_point_identifier), &dew_point_definition, {&dht_sensor}, [] (float &value)
+     * {
+     *     value = DerivedSensor::dew_point(dht_sensor.get_temperature(), dht_sensor.get_humidity());
+     *     return true;
+     * });
+     * @endcode
+     */
+    class DerivedSensor: public Device
+    {
+        public:
+            /**
+             * @brief Compute the value.
+             *
+             * @param[out] value    Receives the value.
+             * @return `false` if the value cannot be computed, e.g. because an input has no reading.
+             */
+            typedef std::function<bool(float &value)> compute_t;
+
+            /**
+             * @brief Construct a derived sensor.
+             *
+             * @param device_name       The device name; must be a persistent pointer.
+             * @param device_identifier The device identifier; must be a persistent pointer.
+             * @param definition        The sensor definition; must be a persistent pointer.
+             * @param inputs            The devices whose readings the value depends on.
+             * @param compute           Computes the value.
+             */
+            DerivedSensor(const __FlashStringHelper *device_name, const __FlashStringHelper *device_identifier,
+                const Definition *definition, std::vector<const Device *> &&inputs, compute_t &&compute);
+
+            void setup() override;
+            void loop() override
+            {
+            }
+
+            bool publish(DynamicJsonDocument &json) const override;
+            bool get_definition_value(size_t index, float &value) const override;
+            bool serialize_into(JsonObject json) const override;
+
+            bool has_reading_generation() const override
+            {
+                return true;
+            }
+
+            /**
+             * @brief Get the value.
+             *
+             * @return The last computed value; NaN if there is none.
+             */
+            float get_value() const
+            {
+                return value;
+            }
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return The reading generation.
+             */
+            uint32_t get_status_version() const override
+            {
+                return get_reading_generation();
+            }
+
+            /**
+             * @brief Compute the dew point, using the Magnus formula.
+             *
+             * @param temperature   The temperature, in °C.
+             * @param humidity      The relative humidity, in percent.
+             * @return The dew point, in °C.
+             */
+            static float dew_point(float temperature, float humidity);
+
+            /**
+             * @brief Compute the heat index, using the NOAA (Rothfusz) regression.
+             *
+             * @param temperature   The temperature, in °C.
+             * @param humidity      The relative humidity, in percent.
+             * @return The heat index, in °C.
+             */
+            static float heat_index(float temperature, float humidity);
+
+        private:
+            void update();                      //!< Recompute the value.
+
+            const Definition *definition;       //!< The sensor definition.
+            std::vector<const Device *> inputs; //!< The input devices.
+            compute_t compute;                  //!< Computes the value.
+            float value = NAN;                  //!< The last computed value.
+            bool subscribed = false;            //!< Whether `setup` has subscribed to the inputs.
+            char status_label[96];              //!< The `device_status` label, with the update script; before `device_status`.
+            InfoSettingHtml device_status;      //!< Output only; current state.
+    };
+}
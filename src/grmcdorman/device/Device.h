@@ -22,11 +22,14 @@
 
 #pragma once
 
+#include <Print.h>
 #include <WString.h>
 #include <vector>
 #include <ArduinoJson.h>
 
 #include "grmcdorman/Setting.h"
+#include "grmcdorman/device/DeviceTiming.h"
+#include "grmcdorman/device/ReadingBus.h"
 
 namespace grmcdorman::device
 {
@@ -68,75 +71,171 @@ namespace grmcdorman::device
             static constexpr int D7 = 13; //!< D7 is GPIO13; SPI (MOSI)
             static constexpr int D8 = 15; //!< D8 is GPIO15; pulled to GND; SPI (CS); not recommended
 
+            /**
+             * @brief The boot phases, in the order `BootSequence` sets up their devices.
+             *
+             * A phase states what the device's `setup` depends on. Each phase may also use
+             * whatever the earlier phases provide.
+             */
+            enum class BootPhase: uint8_t
+            {
+                NETWORK_START,  //!< Starts the network connection, e.g. WiFi association, which then proceeds while the other devices are set up.
+                HARDWARE,       //!< Needs only its own hardware, e.g. a sensor; its first reading is requested once it is set up. The default.
+                FILESYSTEM,     //!< Needs the file system, which is mounted before this phase.
+                NETWORK,        //!< Uses the network connection. The connection may not be up yet; the device must connect once it is.
+                COUNT           //!< The number of phases.
+            };
+
             /**
              * @brief A sensor definition to be published to MQTT.
              *
              * This allows MQTT listeners, such as Home Assistant, to automatically discover and
              * recognize the sensor. It also provides the definitions to be used for publishing
              * the device data.
+             *
+             * This is a plain descriptor, normally a `constexpr` object in PROGMEM with its
+             * strings in PROGMEM as well; there are no virtual methods, so a definition is only
+             * its members. Every member is 32 bits wide, so that members of a PROGMEM definition
+             * can be read directly. A definition may also be in RAM, with RAM strings, where
+             * the names depend on the device instance.
+             *
+             * The value and attribute templates are not stored; they are generated from the
+             * key of the device in the published JSON (`get_publish_key`) and from `field`, so
+             * that they always match the JSON written by `serialize_into`.
              */
-            class Definition
+            struct Definition
             {
-                public:
-                    /**
-                     * @brief Get the name suffix.
-                     *
-                     * The unique ESP identifer is suffixed with this to generate a unique
-                     * human-readable device name.
-                     *
-                     * @return Device name.
-                     */
-                    virtual const __FlashStringHelper *get_name_suffix() const = 0;
+                /**
+                 * @brief How the value is found in the device's JSON.
+                 */
+                enum class Layout: uint32_t
+                {
                     /**
-                     * @brief Get the value template.
-                     *
-                     * The value template describes which JSON attribute corresponds to
-                     * the sensor's measurement value.
-                     *
-                     * @return Value template.
+                     * `field` is an `Accumulator` object; the value is its `average`, and
+                     * its `last` and `sample_age_ms` are the `last` and `age` attributes.
                      */
-                    virtual const __FlashStringHelper *get_value_template() const = 0;
-
+                    ACCUMULATOR,
                     /**
-                     * @brief Get the unique id suffix.
-                     *
-                     * The unique ESP identifier is suffixed with this to generate a unique
-                     * system-wide sensor identifier. Unlike the `name` value, this is not
-                     * human-readable and should follow identifier rules.
-                     *
-                     * @return Unique id suffix.
+                     * `field` is the value. `attributes` lists other members of the device's
+                     * JSON to be published as attributes.
                      */
-                    virtual const __FlashStringHelper *get_unique_id_suffix() const = 0;
-                    /**
-                     * @brief Get the unit of measurement.
-                     *
-                     * The units for the value, e.g. dBm. Most systems support UTF-8,
-                     * allowing characters like the degree symbol.
-                     *
-                     * @return Units string.
-                     */
-                    virtual const __FlashStringHelper *get_unit_of_measurement() const = 0;
-                    /**
-                     * @brief Get the json attributes template.
-                     *
-                     * Attributes are additional values other than the primary value;
-                     * this describes where they are in the JSON. This should be a null
-                     * (`nullptr`) if there are no attributes.
-                     *
-                     * Examples include SSID for the WiFi RSSI value.
-                     *
-                     * @return Template for attributes.
-                     */
-                    virtual const __FlashStringHelper *get_json_attributes_template() const = 0;
-                    /**
-                     * @brief Get the icon.
-                     *
-                     * This is the icon to be used by applications like Home Assistant.
-                     * Examples include "mdi:wifi".
-                     *
-                     * @return Icon string.
-                     */
-                    virtual const __FlashStringHelper *get_icon() const = 0;
+                    VALUE
+                };
+
+                /**
+                 * @brief The name suffix.
+                 *
+                 * The unique ESP identifer is suffixed with this to generate a unique
+                 * human-readable device name.
+                 */
+                const char *name_suffix;
+                /**
+                 * @brief The unique id suffix.
+                 *
+                 * The unique ESP identifier is suffixed with this to generate a unique
+                 * system-wide sensor identifier. Unlike the `name` value, this is not
+                 * human-readable and should follow identifier rules.
+                 */
+                const char *unique_id_suffix;
+                /**
+                 * @brief The unit of measurement.
+                 *
+                 * The units for the value, e.g. dBm. Most systems support UTF-8,
+                 * allowing characters like the degree symbol.
+                 */
+                const char *unit_of_measurement;
+                /**
+                 * @brief The icon.
+                 *
+                 * This is the icon to be used by applications like Home Assistant.
+                 * Examples include "mdi:wifi".
+                 */
+                const char *icon;
+                /**
+                 * @brief The name of the member of the device's JSON holding the value.
+                 */
+                const char *field;
+                Layout layout;                  //!< How `field` holds the value.
+                /**
+                 * @brief Attribute member names, for the `VALUE` layout.
+                 *
+                 * A comma-separated list of members of the device's JSON, e.g. "ssid,ip"
+                 * for the WiFi RSSI value; `nullptr` if there are no attributes.
+                 */
+                const char *attributes;
+                /**
+                 * @brief The change threshold.
+                 *
+                 * When only changed values are published, a new value is not
+                 * published unless it differs from the last published value by at
+                 * least this amount, in the units of measurement. Zero publishes any change.
+                 */
+                float change_threshold;
+
+                /**
+                 * @brief Get the name suffix.
+                 *
+                 * @return Name suffix.
+                 */
+                const __FlashStringHelper *get_name_suffix() const
+                {
+                    return FPSTR(name_suffix);
+                }
+                /**
+                 * @brief Get the unique id suffix.
+                 *
+                 * @return Unique id suffix.
+                 */
+                const __FlashStringHelper *get_unique_id_suffix() const
+                {
+                    return FPSTR(unique_id_suffix);
+                }
+                /**
+                 * @brief Get the unit of measurement.
+                 *
+                 * @return Units string.
+                 */
+                const __FlashStringHelper *get_unit_of_measurement() const
+                {
+                    return FPSTR(unit_of_measurement);
+                }
+                /**
+                 * @brief Get the icon.
+                 *
+                 * @return Icon string.
+                 */
+                const __FlashStringHelper *get_icon() const
+                {
+                    return FPSTR(icon);
+                }
+                /**
+                 * @brief Get the name of the member holding the value.
+                 *
+                 * @return Field name.
+                 */
+                const __FlashStringHelper *get_field() const
+                {
+                    return FPSTR(field);
+                }
+                /**
+                 * @brief Get the change threshold.
+                 *
+                 * @return Change threshold, in the units of measurement.
+                 */
+                float get_change_threshold() const
+                {
+                    return change_threshold;
+                }
+                /**
+                 * @brief Get the sensor name.
+                 *
+                 * This is the unique id suffix without any leading underscore;
+                 * it is used where a single sensor is named, for example in
+                 * per-sensor MQTT topics.
+                 *
+                 * @return Sensor name, in PROGMEM.
+                 */
+                const __FlashStringHelper *get_sensor_name() const;
             };
 
             /**
@@ -162,6 +261,19 @@ namespace grmcdorman::device
                 return device_identifier;
             }
 
+            /**
+             * @brief Get the key of the device's node in the published JSON.
+             *
+             * This is the member added by `publish`, and the start of the generated
+             * value and attribute templates. The default is the device identifier.
+             *
+             * @return Publish key, in PROGMEM.
+             */
+            virtual const __FlashStringHelper *get_publish_key() const
+            {
+                return identifier();
+            }
+
             /**
              * @brief Set the system identifier values.
              *
@@ -236,6 +348,8 @@ namespace grmcdorman::device
              * as preparing UI settings (notably info settings) for communication.
              *
              * This must be called after initial values are loaded.
+             * `BootSequence::setup_devices` calls it for each device in
+             * the order of their boot phases; see `get_boot_phase`.
              */
             virtual void setup() = 0;
 
@@ -270,19 +384,58 @@ namespace grmcdorman::device
                 return false;
             }
 
+            /**
+             * @brief The capacity of the document created by the default `as_json`.
+             *
+             * This is also the capacity of the REST API's per-response document.
+             */
+            static constexpr size_t JSON_DOCUMENT_CAPACITY = 1024;
+
+
+            /**
+             * @brief Get the current value for a single definition.
+             *
+             * This is used when publishing individual values instead of
+             * the complete document from `publish`. The index is the position
+             * of the definition in the list returned by `get_definitions`.
+             *
+             * @param index         Index of the definition.
+             * @param[out] value    Receives the current value.
+             * @return `true` if a value is available; `false` otherwise.
+             */
+            virtual bool get_definition_value(size_t index, float &value) const
+            {
+                return false;
+            }
+
+            /**
+             * @brief Write the values into a JSON object.
+             *
+             * The members are added directly to `json`, which is normally part of a
+             * document owned by the caller (the MQTT publisher's state document, or
+             * the REST API's response document). No intermediate documents are created.
+             *
+             * Devices that override `as_json` instead of this method return `false`, the
+             * default; callers then fall back to `as_json`.
+             *
+             * @param json  The object to receive the values.
+             * @return `true` if values were written; `false` if the device has none.
+             */
+            virtual bool serialize_into(JsonObject json) const
+            {
+                return false;
+            }
 
             /**
              * @brief Get the values, as a JSON document.
              *
              * The structure is identical to the document created inside `publish`.
+             * The default creates a document of `JSON_DOCUMENT_CAPACITY` bytes and fills
+             * it with `serialize_into`; if that returns `false`, a null document is returned.
              *
              * @return DynamicJsonDocument
              */
-            virtual DynamicJsonDocument as_json() const
-            {
-                // Return a null document.
-                return DynamicJsonDocument(8);
-            }
+            virtual DynamicJsonDocument as_json() const;
 
             /**
              * @brief The type containing a list of Definition objects.
@@ -303,6 +456,20 @@ namespace grmcdorman::device
                 return definitions;
             }
 
+            /**
+             * @brief Get the definition generation.
+             *
+             * This increases whenever a device changes its definitions after construction
+             * (see `set_definitions`), for example when a remote node describes its sensors;
+             * `MqttPublisher` then sends discovery again.
+             *
+             * @return Definition generation; zero until a definition list changes.
+             */
+            static uint32_t get_definition_generation()
+            {
+                return definition_generation;
+            }
+
             /**
              * @brief Get the settings list.
              *
@@ -345,22 +512,34 @@ namespace grmcdorman::device
              *
              * If the setting cannot be found, nothing is done.
              *
-             * Internally, this searches the list of settings
-             * for the named setting, and then uses `Setting::set_from_string`.
+             * Internally, this looks up the named setting in the
+             * index built by `initialize`, and then uses `Setting::set_from_string`.
              *
              * @param setting   Name of setting.
              * @param value     New value for setting.
              */
             void set(const String &setting, const String &value);
 
+            /**
+             * @brief Set several settings from a JSON object.
+             *
+             * Each member of the object is applied as for `set`, with the member
+             * name as the setting name and the member value, converted to a string,
+             * as the new value. Members that do not name a setting, or that are null, are ignored.
+             *
+             * @param values    The setting values.
+             * @return The number of settings that were set.
+             */
+            size_t set_many(JsonObjectConst values);
+
             /**
              * @brief Get a setting value, as a string.
              *
              * The setting is located by name, and its value
              * is converted to a string if necessary.
              *
-             * Internally, this search the list of settings
-             * for the named setting, and then returns the value of `Setting::as_string`.
+             * Internally, this looks up the named setting in the index
+             * built by `initialize`, and then returns the value of `Setting::as_string`.
              *
              * If the setting is not found, an empty string is returned.
              *
@@ -382,6 +561,34 @@ namespace grmcdorman::device
                 return String();
             }
 
+            /**
+             * @brief Write the status report.
+             *
+             * This is the form of `get_status` used by `InfoDisplay`; a device that overrides it
+             * can write its report without building a `String`. By default this writes
+             * the result of `get_status`.
+             *
+             * @param output    Receives the status report.
+             */
+            virtual void print_status(Print &output) const
+            {
+                output.print(get_status());
+            }
+
+            /**
+             * @brief Get the status version.
+             *
+             * This is a value that changes whenever the status report may change, including
+             * when an age in seconds in the report changes. While the versions of all devices
+             * are unchanged, `InfoDisplay` reuses the report it already has.
+             *
+             * By default, this is a hash of `get_status`; a device that overrides `print_status`
+             * should override this so that the report is not built to get its version.
+             *
+             * @return The status version.
+             */
+            virtual uint32_t get_status_version() const;
+
             /**
              * @brief Get whether the device readings have been published.
              *
@@ -408,17 +615,176 @@ namespace grmcdorman::device
             /**
              * @brief Set the device as not having published readings.
              *
+             * This should be called for each new reading, once the values are
+             * updated; it also advances the reading generation, and posts a
+             * new-reading event to the `ReadingBus`.
              */
             void clear_is_published()
             {
                 is_published = false;
+                ++reading_generation;
+                ReadingBus::post(this);
+            }
+
+            /**
+             * @brief Get the reading generation.
+             *
+             * This increases by one for each new reading, i.e. on each call to `clear_is_published`.
+             * It starts at zero on each boot.
+             *
+             * @return Reading generation.
+             */
+            uint32_t get_reading_generation() const
+            {
+                return reading_generation;
+            }
+
+            /**
+             * @brief Get whether the device's state changes only with new readings.
+             *
+             * If `true`, the readings returned by `as_json` (not counting values derived
+             * from the current time, such as sample ages) only change when the reading
+             * generation changes; this allows clients to cache them, e.g. via conditional
+             * REST requests. By default this is `false`.
+             *
+             * @return `true` if the reading generation tracks the device's state.
+             */
+            virtual bool has_reading_generation() const
+            {
+                return false;
+            }
+
+            /**
+             * @brief Get the polling interval.
+             *
+             * This is used by `DutyCycle` to choose the deep sleep interval.
+             *
+             * @return The interval between readings, in seconds; zero, the default, if the device is not polled.
+             */
+            virtual uint32_t get_poll_interval() const
+            {
+                return 0;
+            }
+
+            /**
+             * @brief Take a reading as soon as possible.
+             *
+             * This is used by `DutyCycle`, on waking, rather than waiting for
+             * the polling interval. The reading is reported as usual, i.e. by
+             * `clear_is_published`. By default this does nothing.
+             */
+            virtual void request_reading()
+            {
+            }
+
+            /**
+             * @brief Send any pending data.
+             *
+             * This is used by `DutyCycle` before entering deep sleep; it is called
+             * from each `loop` pass until it returns `true`, or the wake time runs out.
+             *
+             * @return `true`, the default, if there is nothing left to send.
+             */
+            virtual bool flush()
+            {
+                return true;
+            }
+
+            /**
+             * @brief Save state to be kept across a deep sleep.
+             *
+             * This is used by `DutyCycle` just before entering deep sleep. The state is
+             * kept in RTC memory, which is small; only what is needed to continue where the
+             * device left off, for example accumulated readings, should be saved. By default
+             * nothing is saved.
+             *
+             * @param buffer    Receives the state.
+             * @param size      The size of the buffer.
+             * @return The number of bytes used; zero if there is nothing to save, or it does not fit.
+             */
+            virtual size_t save_retained_state(uint8_t *buffer, size_t size)
+            {
+                return 0;
+            }
+
+            /**
+             * @brief Restore state saved by `save_retained_state`.
+             *
+             * This is called by `DutyCycle::restore` on waking from deep sleep, before `setup`.
+             * By default this does nothing.
+             *
+             * @param buffer        The state.
+             * @param size          The size of the state.
+             * @param elapsed_ms    Approximate milliseconds since the state was saved.
+             */
+            virtual void restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms)
+            {
+            }
+
+            /**
+             * @brief Get the boot phase in which the device is set up.
+             *
+             * This is used by `BootSequence::setup_devices`. By default, a device
+             * only needs its own hardware.
+             *
+             * @return The boot phase.
+             */
+            virtual BootPhase get_boot_phase() const
+            {
+                return BootPhase::HARDWARE;
+            }
+
+            /**
+             * @brief Get the total number of definitions in a list of devices.
+             *
+             * Where readings from several devices are tracked together, definitions are
+             * indexed in device order and then definition order, including disabled devices.
+             *
+             * @param devices   The list of devices.
+             * @return Definition count.
+             */
+            static size_t get_definition_count(const std::vector<Device *> &devices);
+
+            /**
+             * @brief Find a definition by its overall index.
+             *
+             * @param devices   The list of devices.
+             * @param index     Index, as described for `get_definition_count`.
+             * @return The definition, or `nullptr` if the index is out of range.
+             */
+            static const Definition *find_definition(const std::vector<Device *> &devices, size_t index);
+
+            /**
+             * @brief Run the `loop` method of each enabled device.
+             *
+             * This is equivalent to calling `loop` on each enabled device in turn
+             * from the sketch's `loop` function; it also records loop timings
+             * when the library is built with `DEVICE_FRAMEWORK_TIMING`.
+             *
+             * @param devices   The list of devices.
+             */
+            static void loop_devices(const std::vector<Device *> &devices);
+
+            /**
+             * @brief Get the device timing statistics.
+             *
+             * The statistics are only recorded when the library is built with `DEVICE_FRAMEWORK_TIMING`;
+             * otherwise they stay empty.
+             *
+             * @return Timing statistics; these may be updated through a `const` device.
+             */
+            DeviceTiming &get_timing() const
+            {
+                return timing;
             }
+
             static const ExclusiveOptionSetting::names_list_t data_line_names;  //!< Names for each configurable data line; see `settingsMap`.
         protected:
             /**
              * @brief Initialize the definition and setting lists.
              *
-             * The lists are moved to the private class attributes.
+             * The lists are moved to the private class attributes, and
+             * the index used to look up settings by name is built.
              *
              * @param definition_list   Device sensor definition list, for MQTT publishing.
              * @param setting_list      Device settings, for use by the WebSettings library.
@@ -427,6 +793,21 @@ namespace grmcdorman::device
             {
                 definitions = std::move(definition_list);
                 settings = std::move(setting_list);
+                build_setting_index();
+            }
+
+            /**
+             * @brief Replace the definition list after construction.
+             *
+             * This is for devices whose sensors are only known at run time. The
+             * definition generation is advanced.
+             *
+             * @param definition_list   Device sensor definition list, for MQTT publishing.
+             */
+            void set_definitions(definition_list_t &&definition_list)
+            {
+                definitions = std::move(definition_list);
+                ++definition_generation;
             }
 
             /**
@@ -463,17 +844,71 @@ namespace grmcdorman::device
              */
             static const int settingsMap[6];
 
+            /**
+             * @brief Combine a value into a status version.
+             *
+             * @param version   The version so far.
+             * @param value     A value the status report depends on.
+             * @return The new version.
+             */
+            static uint32_t combine_status_version(uint32_t version, uint32_t value)
+            {
+                return (version ^ value) * 16777619u;
+            }
+
             ToggleSetting enabled;                                      //!< Whether this device is enabled.
         private:
             const __FlashStringHelper *device_name;                     //!< The device name, from the constructor.
             const __FlashStringHelper *device_identifier;               //!< The device identifier, from the constructor.
             bool is_published = true;                                   //!< Whether this device has published since last reading. Initially `true` until first reading.
+            uint32_t reading_generation = 0;                            //!< Incremented for each new reading.
+            mutable DeviceTiming timing;                                //!< Timing statistics. Present whether or not they are recorded, so that the layout does not depend on the build.
+
+            /**
+             * @brief An entry in the setting lookup index.
+             *
+             */
+            struct SettingIndexEntry
+            {
+                uint16_t hash;      //!< The hash of the setting name; see `hash_setting_name`.
+                uint16_t index;     //!< The position of the setting in `settings`.
+            };
+
+            /**
+             * @brief Hash a setting name.
+             *
+             * This is a 32-bit FNV-1a hash, folded to 16 bits.
+             *
+             * @param name      The name.
+             * @param progmem   Whether the name is in PROGMEM.
+             * @return The hash.
+             */
+            static uint16_t hash_setting_name(const char *name, bool progmem);
+
+            /**
+             * @brief Build the setting lookup index.
+             *
+             * The index holds the hash of each setting's name, sorted by hash. A
+             * lookup is a binary search for the hash, with a name comparison only
+             * for matching hashes; an unknown name almost never needs a comparison.
+             */
+            void build_setting_index();
+
+            /**
+             * @brief Find a setting by name.
+             *
+             * @param name  The setting name.
+             * @return The setting; `nullptr` if not found.
+             */
+            ::grmcdorman::SettingInterface *find_setting(const char *name) const;
 
             static const __FlashStringHelper *firmware_name;            //!< The unique firmware prefix.
             static String system_identifier;                            //!< The unique system identifier.
+            static uint32_t definition_generation;                      //!< Advanced by `set_definitions`.
 
 
             definition_list_t definitions;                              //!< The list of definitions. Set by `initialize`.
             ::grmcdorman::SettingInterface::settings_list_t settings;   //!< The list of settiongs. Set by `initialize`.
+            std::vector<SettingIndexEntry> setting_index;               //!< The setting lookup index. Set by `initialize`.
     };
 }
\ No newline at end of file
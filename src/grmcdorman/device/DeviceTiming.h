@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief Timing and heap statistics for one kind of call.
+     *
+     * Each call records its duration, in microseconds and in CPU cycles, the change in
+     * free heap across the call, and the largest allocatable block afterwards. The cycle
+     * count resolves the short calls (an accumulator update, parsing a serial byte) that
+     * take only a few microseconds; it wraps after about 53 seconds at 80MHz, far longer
+     * than any call.
+     */
+    class TimingStatistics
+    {
+        public:
+            static constexpr size_t JSON_MEMBERS = 9;   //!< The most members added by `to_json`.
+            static constexpr size_t JSON_CAPACITY = JSON_OBJECT_SIZE(JSON_MEMBERS); //!< The document capacity used by `to_json`, without the member names.
+            //! The size of the member names added by `to_json`, which are copied into the document once.
+            static constexpr size_t JSON_NAMES_SIZE = sizeof("count") + sizeof("min_us") + sizeof("avg_us") + sizeof("max_us") +
+                sizeof("avg_cycles") + sizeof("max_cycles") + sizeof("heap_delta_min") + sizeof("heap_delta_max") + sizeof("max_block_min");
+
+            /**
+             * @brief Record a call.
+             *
+             * @param elapsed_us        Duration of the call, in microseconds.
+             * @param elapsed_cycles    Duration of the call, in CPU cycles.
+             * @param heap_delta        Change in free heap across the call, in bytes.
+             * @param max_block         Largest allocatable block after the call, in bytes.
+             */
+            void add(uint32_t elapsed_us, uint32_t elapsed_cycles, int32_t heap_delta, uint32_t max_block);
+
+            /**
+             * @brief Discard all recorded calls.
+             *
+             */
+            void reset()
+            {
+                *this = TimingStatistics();
+            }
+
+            /**
+             * @brief Get the number of calls recorded.
+             *
+             * @return Call count.
+             */
+            uint32_t get_count() const
+            {
+                return count;
+            }
+
+            /**
+             * @brief Get the mean call duration.
+             *
+             * @return Mean duration, in microseconds; zero if there are no calls.
+             */
+            uint32_t get_average_us() const
+            {
+                return count == 0 ? 0 : total_us / count;
+            }
+
+            /**
+             * @brief Get the longest call duration.
+             *
+             * @return Longest duration, in microseconds.
+             */
+            uint32_t get_maximum_us() const
+            {
+                return maximum_us;
+            }
+
+            /**
+             * @brief Get the mean call duration in CPU cycles.
+             *
+             * @return Mean duration, in cycles; zero if there are no calls.
+             */
+            uint32_t get_average_cycles() const
+            {
+                return count == 0 ? 0 : total_cycles / count;
+            }
+
+            /**
+             * @brief Get the longest call duration in CPU cycles.
+             *
+             * @return Longest duration, in cycles.
+             */
+            uint32_t get_maximum_cycles() const
+            {
+                return maximum_cycles;
+            }
+
+            /**
+             * @brief Add the statistics to a JSON object.
+             *
+             * The members are `count` and, if there are calls, `min_us`, `avg_us`, `max_us`,
+             * `avg_cycles`, `max_cycles`, `heap_delta_min`, `heap_delta_max` and `max_block_min`.
+             * `JSON_MEMBERS` and `JSON_NAMES_SIZE` must be kept in step with these.
+             *
+             * @param json  The object to receive the statistics.
+             */
+            void to_json(JsonObject json) const;
+
+        private:
+            uint32_t count = 0;                     //!< The number of calls.
+            uint32_t minimum_us = UINT32_MAX;       //!< The shortest call.
+            uint32_t maximum_us = 0;                //!< The longest call.
+            uint64_t total_us = 0;                  //!< The total time in all calls.
+            uint32_t maximum_cycles = 0;            //!< The longest call, in CPU cycles.
+            uint64_t total_cycles = 0;              //!< The total CPU cycles in all calls.
+            int32_t heap_delta_minimum = INT32_MAX; //!< The largest loss (most negative change) of free heap in a call.
+            int32_t heap_delta_maximum = INT32_MIN; //!< The largest gain of free heap in a call.
+            uint32_t max_block_minimum = UINT32_MAX;//!< The smallest largest-allocatable-block seen after a call.
+    };
+
+    /**
+     * @brief The timing statistics kept for each device.
+     *
+     * These are only collected when the library is built with `DEVICE_FRAMEWORK_TIMING`
+     * defined (for example, `build_flags = -D DEVICE_FRAMEWORK_TIMING` in `platformio.ini`);
+     * a `#define` in the sketch does not reach the library sources. Without it there is no
+     * instrumentation code. The statistics are part of `Device` either way, so that the
+     * define cannot change the layout of any class.
+     */
+    struct DeviceTiming
+    {
+#ifdef DEVICE_FRAMEWORK_TIMING
+        static constexpr bool ENABLED = true;   //!< Whether timing statistics are collected.
+#else
+        static constexpr bool ENABLED = false;  //!< Whether timing statistics are collected.
+#endif
+
+        TimingStatistics loop;                  //!< Calls to `loop`, via `Device::loop_devices`.
+        TimingStatistics task;                  //!< Scheduler task callbacks, and other callbacks such as serial receive.
+        TimingStatistics publish;               //!< Calls to `publish` and `serialize_into` by the MQTT publisher and REST API.
+        TimingStatistics status;                //!< Calls to `get_status` for the system overview.
+
+        static constexpr size_t JSON_MEMBERS = 4;      //!< The members added by `to_json`, one per kind of call.
+        //! The document capacity used by `to_json`, without the member names.
+        static constexpr size_t JSON_CAPACITY = JSON_OBJECT_SIZE(JSON_MEMBERS) + JSON_MEMBERS * TimingStatistics::JSON_CAPACITY;
+        //! The size of the member names added by `to_json`, and by the statistics, which are copied into the document once.
+        static constexpr size_t JSON_NAMES_SIZE = sizeof("loop") + sizeof("task") + sizeof("publish") + sizeof("status") +
+            TimingStatistics::JSON_NAMES_SIZE;
+
+        /**
+         * @brief Add all statistics to a JSON object.
+         *
+         * The object needs `JSON_CAPACITY` in the document, and `JSON_NAMES_SIZE`
+         * for the first device added to the document.
+         *
+         * @param json  The object to receive the statistics; one nested object is added per kind of call.
+         */
+        void to_json(JsonObject json) const;
+    };
+
+    /**
+     * @brief Time a block of code.
+     *
+     * This records the time, CPU cycles and heap change from construction to destruction.
+     * Use `DEVICE_TIMING_SCOPE`, which compiles to nothing unless `DEVICE_FRAMEWORK_TIMING` is defined.
+     */
+    class TimingScope
+    {
+        public:
+            /**
+             * @brief Construct a new TimingScope object.
+             *
+             * @param statistics    Statistics to receive the timing; if `nullptr`, nothing is recorded.
+             */
+            explicit TimingScope(TimingStatistics *statistics):
+                statistics(statistics),
+                start_us(micros()),
+                start_cycles(ESP.getCycleCount()),
+                start_heap(statistics != nullptr ? ESP.getFreeHeap() : 0)
+            {
+            }
+
+            TimingScope(const TimingScope &) = delete;
+            TimingScope &operator=(const TimingScope &) = delete;
+
+            /**
+             * @brief Destroy the TimingScope object, recording the timing.
+             *
+             */
+            ~TimingScope()
+            {
+                if (statistics != nullptr)
+                {
+                    uint32_t elapsed_cycles = ESP.getCycleCount() - start_cycles;
+                    uint32_t elapsed = micros() - start_us;
+                    statistics->add(elapsed, elapsed_cycles, static_cast<int32_t>(ESP.getFreeHeap()) - static_cast<int32_t>(start_heap), ESP.getMaxFreeBlockSize());
+                }
+            }
+
+        private:
+            TimingStatistics *statistics;           //!< The statistics to update.
+            uint32_t start_us;                      //!< The start time.
+            uint32_t start_cycles;                  //!< The CPU cycle count at the start.
+            uint32_t start_heap;                    //!< The free heap at the start.
+    };
+}
+
+#ifdef DEVICE_FRAMEWORK_TIMING
+/**
+ * @brief Time the rest of the enclosing block.
+ *
+ * @param statistics    Pointer to the `TimingStatistics` to update; may be `nullptr`. Not evaluated
+ *                      unless `DEVICE_FRAMEWORK_TIMING` is defined.
+ */
+#define DEVICE_TIMING_SCOPE(statistics) ::grmcdorman::device::TimingScope device_timing_scope(statistics)
+#else
+#define DEVICE_TIMING_SCOPE(statistics)
+#endif
@@ -25,9 +25,9 @@
 #include <memory>
 
 #include <DHT.h>
-#include <Ticker.h>
 
 #include "grmcdorman/device/AbstractTemperaturePressureSensor.h"
+#include "grmcdorman/device/Scheduler.h"
 
 namespace grmcdorman::device
 {
@@ -45,8 +45,15 @@ namespace grmcdorman::device
      * is required on the signal pin (pin 2). Pin 1 is VDD, and pin 4 is GND. Pins are numbered
      * from left to right when viewing the front (performated) side of the sensor.
      *
-     * The minimum read interval for DHT11 is 1 second; for DHT22 is 2 seconds. The
-     * settings do not enforce this minimum.
+     * The minimum read interval for DHT11 is 1 second; for DHT22 is 2 seconds. Requests
+     * closer together than this are ignored. The sensor needs the same time to settle after
+     * power-up, so a first read requested sooner after boot is started when that time has passed.
+     *
+     * After an error, reads back off: after _n_ consecutive errors, the polling interval is
+     * doubled _n_ times, up to 16 times the interval. A successful read restores the interval.
+     *
+     * A read is not started while a serial message is being received, and MQTT sends wait for a read
+     * to finish (see `TimingCoordinator`). The read and error counts are reported by `serialize_into`.
      */
     class DhtSensor: public AbstractTemperaturePressureSensor
     {
@@ -56,6 +63,24 @@ namespace grmcdorman::device
             void setup() override;
             void loop() override;
 
+            /**
+             * @brief Get the polling interval.
+             *
+             * @return The configured polling interval, in seconds.
+             */
+            uint32_t get_poll_interval() const override
+            {
+                return readInterval.get();
+            }
+
+            /**
+             * @brief Request a reading now, unless one is already in progress.
+             *
+             */
+            void request_reading() override;
+
+            bool serialize_into(JsonObject json) const override;
+
             /**
              * @brief Get a status report.
              *
@@ -68,20 +93,56 @@ namespace grmcdorman::device
              * @return String containing status report.
              */
             virtual String get_status() const;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the readings, the error status and the age in seconds of the last reading.
+             */
+            uint32_t get_status_version() const override;
         private:
             //!< Default read interval. Chosen such that there should be 5 readings per 30 seconds.
             constexpr static uint32_t statusReadInterval = (30 / 5) * 1000;
+            constexpr static uint32_t READ_DURATION_MS = 25;    //!< The longest read: the DHT11's 18 ms start signal, and the data.
+            constexpr static uint32_t READ_TIMEOUT_MS = 1000;   //!< A read with no result after this long is counted as a timeout.
+            constexpr static uint8_t MAX_BACKOFF_SHIFT = 4;     //!< The most times the polling interval is doubled after errors.
+            constexpr static uint8_t ERROR_CODES = 5;           //!< The number of error counters; see `error_counts`.
 
             void set_timer();                           //!< Set the timer callback.
             void reset_dht();                           //!< Reset DHT on the first read request following an error.
+            /**
+             * @brief Record a read error.
+             *
+             * @param status    The DHT status code.
+             */
+            void record_error(uint8_t status);
+            /**
+             * @brief Get the minimum time between reads.
+             *
+             * @return The model's minimum sampling period, or the backed-off polling interval after errors.
+             */
+            uint32_t get_read_spacing_ms() const;
 
             std::unique_ptr<DHT> dht;                   //!< Ether DHT11 or DHT22, depending on configuration.
-            Ticker ticker;                              //!< Ticker used to schedule readings.
+            Scheduler::Task read_task{this};            //!< Task used to schedule readings.
+            Scheduler::Task retry_task{this};           //!< Task used to start a read that had to wait for another activity.
             int last_status = 0;                        //!< Last reported error status.
             uint32_t last_read_millis = 0;              //!< Last read millis().
             uint32_t current_polling_seconds = 0;       //!< Current polling interval.
             bool requested = false;                     //!< Whether a reading was requested.
-            uint32_t request_previous_mills = 0;        //!< The time since the last read request.
+            uint32_t request_previous_mills = 0;        //!< The time of the last read request.
+            uint32_t read_count = 0;                    //!< The number of reads started.
+            uint32_t error_count = 0;                   //!< The number of reads that failed.
+            uint32_t error_counts[ERROR_CODES] = {};    //!< Failed reads by status: 1 timeout, 2 NACK, 3 invalid data, 4 checksum; 0 any other.
+            uint32_t deferred_count = 0;                //!< The number of reads that waited for another activity.
+            uint8_t consecutive_errors = 0;             //!< The number of errors since the last good read.
             NoteSetting title;                          //!< Device tab title.
             ExclusiveOptionSetting dataPin;             //!< Data pin configuration.
             ExclusiveOptionSetting dhtModel;            //!< Choice of DHT11 or DHT22.
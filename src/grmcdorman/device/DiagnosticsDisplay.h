@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief This class is a readonly diagnostics panel.
+     *
+     * It does not publish data and has no configuration.
+     *
+     * It shows the scheduler counters and, when the library is built with
+     * `DEVICE_FRAMEWORK_TIMING`, the timing statistics for each attached device:
+     * `loop` calls (when run through `Device::loop_devices`), scheduler task callbacks,
+     * `publish`/`as_json` calls, and `get_status` calls. Each reports the call count, mean and
+     * maximum duration, and the change in free heap across a call.
+     *
+     * It also shows the boot timeline recorded by `BootSequence`.
+     *
+     * The same information is returned by `as_json`, and thus by the REST API
+     * at `/rest/device/diagnostics/get`.
+     */
+    class DiagnosticsDisplay: public Device
+    {
+        public:
+            /**
+             * @brief Construct a new DiagnosticsDisplay Device object.
+             *
+             */
+            DiagnosticsDisplay();
+
+            /**
+             * @brief Setup.
+             *
+             * This class has no setup operations.
+             */
+            void setup() override
+            {
+            }
+            /**
+             * @brief Loop.
+             *
+             * This class has no loop operations.
+             */
+            void loop() override
+            {
+            }
+
+            DynamicJsonDocument as_json() const override;
+
+            /**
+             * @brief Add the list of devices to report on.
+             *
+             * @param list      List of devices.
+             */
+            virtual void set_devices(const std::vector<Device *> &list) override
+            {
+                devices = &list;
+            }
+
+        private:
+            /**
+             * @brief Update the device timing table.
+             *
+             */
+            void on_request_timings();
+
+            /**
+             * @brief Update the boot timeline.
+             *
+             */
+            void on_request_boot();
+
+            NoteSetting title;                              //!< The panel title. Includes script for panel updating.
+            InfoSettingHtml scheduler;                      //!< Scheduler counters.
+            InfoSettingHtml timings;                        //!< Device timing table.
+            InfoSettingHtml boot;                           //!< Boot timeline.
+            const std::vector<Device *> *devices = nullptr; //!< The list of attached devices to report on.
+    };
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief This class runs the system as a duty cycle, sleeping between readings.
+     *
+     * When enabled, on each wake the system takes one reading from each enabled, polled device
+     * (see `Device::get_poll_interval` and `Device::request_reading`), flushes each device (see
+     * `Device::flush`; `MqttPublisher` publishes the readings), and enters deep sleep. If
+     * this takes longer than the maximum wake time, the system sleeps anyway.
+     *
+     * The sleep interval is, unless configured explicitly, the shortest polling interval of the enabled
+     * devices; the time awake is subtracted, so that readings are taken at a steady rate.
+     *
+     * Just before sleeping, each device's retained state (see `Device::save_retained_state`) is
+     * saved to RTC memory; on waking, `restore` gives it back. This keeps, for example, the rolling
+     * averages, the MQTT offline queue, and the WiFi access point across sleeps. The RTC user
+     * memory is 512 bytes; a device's state is dropped if it does not fit.
+     *
+     * After a power-on or reset (rather than a wake from deep sleep), the system stays awake for
+     * the configuration window, so that the settings can be changed through the web interface.
+     *
+     * Deep sleep requires D0 (GPIO16) to be connected to RST.
+     */
+    class DutyCycle: public Device
+    {
+        public:
+            static constexpr uint32_t RTC_MAGIC = 0x44435931;           //!< Marks valid retained state in RTC memory.
+            static constexpr size_t RTC_SIZE = 512;                     //!< The size of the RTC user memory, in bytes.
+            static constexpr uint32_t DEFAULT_SLEEP_INTERVAL = 300;     //!< The sleep interval, in seconds, when no device is polled.
+
+            DutyCycle();
+
+            void setup() override;
+            void loop() override;
+
+            /**
+             * @brief Add the list of devices to cycle.
+             *
+             * @param list      List of devices.
+             */
+            virtual void set_devices(const std::vector<Device *> &list) override
+            {
+                devices = &list;
+            }
+
+            /**
+             * @brief Restore the devices' retained state.
+             *
+             * This must be called after the settings are loaded and before
+             * the devices are set up. If the system did not wake from
+             * deep sleep, or there is no valid retained state, nothing is done.
+             *
+             * @param list      List of devices; must be the same list, in the same order, as when the state was saved.
+             */
+            void restore(const std::vector<Device *> &list);
+
+            /**
+             * @brief Get the sleep interval.
+             *
+             * @return The configured sleep interval or, if it is zero, the shortest polling interval; in seconds.
+             */
+            uint32_t get_sleep_interval() const;
+
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the wake count and the time in seconds.
+             */
+            uint32_t get_status_version() const override;
+
+        private:
+            /**
+             * @brief The header of the retained state in RTC memory.
+             *
+             * The header is followed by one record per device: a 32-bit hash of the device
+             * identifier, an 8-bit length, and the device's state.
+             */
+            struct RtcHeader
+            {
+                uint32_t magic;         //!< `RTC_MAGIC`.
+                uint32_t crc;           //!< The CRC-32 of the records.
+                uint16_t length;        //!< The length of the records.
+                uint16_t wake_count;    //!< The number of consecutive wakes from deep sleep.
+                uint32_t sleep_ms;      //!< The requested sleep time.
+            };
+
+            /**
+             * @brief Save the retained state, and enter deep sleep.
+             *
+             */
+            void sleep();
+
+            const std::vector<Device *> *devices = nullptr; //!< The list of attached devices.
+            std::vector<uint32_t> start_generations;        //!< For each device, the reading generation when the readings were requested.
+            bool woke = false;                              //!< Whether the system woke from deep sleep.
+            bool restored = false;                          //!< Whether retained state was restored.
+            bool started = false;                           //!< Whether readings have been requested.
+            uint16_t wake_count = 0;                        //!< The number of consecutive wakes from deep sleep.
+            uint32_t start_ms = 0;                          //!< When readings were requested.
+
+            NoteSetting notes;                              //!< A note describing the duty cycle.
+            UnsignedIntegerSetting sleep_interval;          //!< The sleep interval in seconds; zero to use the shortest polling interval.
+            UnsignedIntegerSetting maximum_awake;           //!< The longest time to stay awake, in seconds.
+            UnsignedIntegerSetting configuration_window;    //!< The time to stay awake after power-on or reset, in seconds.
+            InfoSettingHtml device_status;                  //!< Output only; current state.
+    };
+}
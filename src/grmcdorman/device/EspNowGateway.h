@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/device/EspNowProtocol.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief The readings of one `EspNowNode`, as received by an `EspNowGateway`.
+     *
+     * This is a proxy device: it has no hardware of its own, but once the node has described
+     * its sensors, it has one definition per sensor on the node and is published like any local
+     * device. The definitions are `VALUE` layout definitions of the proxy's JSON, named after the
+     * node's chip ID, e.g. "gateway Node 1a2b3c DHT Temperature", so that several nodes with the
+     * same sensors are distinct. The publisher sends discovery again when the definitions change.
+     *
+     * Each proxy is a slot; the node ID setting selects the node, and an empty slot is assigned
+     * to the first unknown node heard. A value older than three of the node's send intervals is
+     * not published.
+     */
+    class EspNowRemoteNode: public Device
+    {
+        public:
+            /**
+             * @brief Construct a proxy.
+             *
+             * @param slot      The slot number; slot 0 has the identifier `remote_1`.
+             */
+            explicit EspNowRemoteNode(uint8_t slot);
+
+            void setup() override;
+            void loop() override
+            {
+            }
+
+            /**
+             * @brief Get the node ID.
+             *
+             * @return The chip ID of the node; zero if the slot is not assigned.
+             */
+            uint32_t get_node_id() const
+            {
+                return node_id;
+            }
+
+            /**
+             * @brief Assign the slot to a node.
+             *
+             * This also sets the node ID setting; the settings must be saved to keep it.
+             *
+             * @param id        The chip ID of the node.
+             */
+            void assign(uint32_t id);
+
+            /**
+             * @brief Handle a frame from the node.
+             *
+             * @param header    The frame header.
+             * @param payload   The frame contents after the header.
+             * @param length    The length of `payload`.
+             */
+            void receive(const EspNowProtocol::Header &header, const uint8_t *payload, size_t length);
+
+            bool publish(DynamicJsonDocument &json) const override;
+            bool get_definition_value(size_t index, float &value) const override;
+            bool serialize_into(JsonObject json) const override;
+
+            bool has_reading_generation() const override
+            {
+                return true;
+            }
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the readings and the age in seconds of the last reading.
+             */
+            uint32_t get_status_version() const override;
+
+        private:
+            /**
+             * @brief The names for the slot.
+             *
+             * These are passed to the base class before they are constructed;
+             * the base class only stores the pointers.
+             */
+            struct SlotNames
+            {
+                /**
+                 * @brief Construct the names.
+                 *
+                 * @param slot      The slot number.
+                 */
+                explicit SlotNames(uint8_t slot);
+
+                char name[16];                  //!< The device name.
+                char identifier[16];            //!< The device identifier.
+                char status_label[96];          //!< The `device_status` label, with the update script.
+            };
+
+            /**
+             * @brief A definition described by the node.
+             *
+             * The definition points into the strings, so this is neither copied nor moved.
+             */
+            struct RemoteDefinition
+            {
+                RemoteDefinition();
+                RemoteDefinition(const RemoteDefinition &) = delete;
+                RemoteDefinition &operator=(const RemoteDefinition &) = delete;
+
+                char name[48];                  //!< The name suffix.
+                char unique_id[48];             //!< The unique ID suffix.
+                char units[16];                 //!< The unit of measurement.
+                char icon[32];                  //!< The icon.
+                char field[32];                 //!< The JSON member; the node's sensor name.
+                Definition definition;          //!< The definition.
+            };
+
+            void reset(size_t count);           //!< Forget the values and definitions, for a node with `count` definitions.
+            void receive_readings(const EspNowProtocol::Header &header, const uint8_t *payload, size_t length);
+            void receive_description(const EspNowProtocol::Header &header, const uint8_t *payload, size_t length);
+            bool is_current() const;            //!< Whether the last readings are recent enough to publish.
+
+            SlotNames names;                    //!< The slot names.
+            uint32_t node_id = 0;               //!< The node's chip ID; zero if not assigned.
+            std::vector<float> values;          //!< The last values, in the node's definition order.
+            std::vector<std::unique_ptr<RemoteDefinition>> remote_definitions;  //!< The described definitions, by index.
+            bool received = false;              //!< Whether readings have been received.
+            uint32_t last_receive_ms = 0;       //!< When the last readings were received.
+            uint16_t last_sequence = 0;         //!< The sequence number of the last readings.
+            uint16_t node_interval = 0;         //!< The node's send interval, in seconds.
+            uint32_t readings_received = 0;     //!< The number of readings frames received.
+            uint32_t frames_lost = 0;           //!< Readings frames missed, from the sequence numbers.
+
+            StringSetting node_setting;         //!< The node's chip ID, in hexadecimal.
+            InfoSettingHtml device_status;      //!< Output only; current state.
+    };
+
+    /**
+     * @brief Receives readings from `EspNowNode` sensor nodes and republishes them.
+     *
+     * The gateway is a normal, connected node; battery-powered nodes send their readings to it
+     * over ESP-NOW instead of connecting to WiFi and MQTT themselves. Each node is represented by
+     * an `EspNowRemoteNode` proxy device, which the sketch adds to its device list (see
+     * `get_remote_devices`) so that the readings are published through `MqttPublisher`.
+     *
+     * The nodes must use the gateway's WiFi channel, i.e. that of its access point; this is shown
+     * in the status. Modem sleep is turned off, so that frames are not missed. Frames are received
+     * by the WiFi stack; they are copied to a small queue and handled in `loop`. ESP-NOW frames are
+     * not encrypted.
+     */
+    class EspNowGateway: public Device
+    {
+        public:
+            static constexpr size_t RECEIVE_QUEUE_SIZE = 4;    //!< The number of frames that can wait for `loop`.
+
+            /**
+             * @brief Construct the gateway.
+             *
+             * @param remote_count  The number of nodes that can be received.
+             */
+            explicit EspNowGateway(uint8_t remote_count = 2);
+
+            void setup() override;
+            void loop() override;
+
+            /**
+             * @brief Get the boot phase.
+             *
+             * Setup uses the WiFi mode and channel, as set by `WifiSetup`.
+             *
+             * @return `BootPhase::NETWORK`.
+             */
+            BootPhase get_boot_phase() const override
+            {
+                return BootPhase::NETWORK;
+            }
+
+            /**
+             * @brief Get the proxy devices.
+             *
+             * These are to be added to the sketch's device list, after the gateway.
+             *
+             * @return The proxy devices.
+             */
+            const std::vector<Device *> &get_remote_devices() const
+            {
+                return remote_devices;
+            }
+
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the frame counts.
+             */
+            uint32_t get_status_version() const override;
+
+        private:
+            /**
+             * @brief A frame waiting for `loop`.
+             */
+            struct ReceivedFrame
+            {
+                uint8_t length;                                     //!< The length of the frame.
+                uint8_t data[EspNowProtocol::MAX_FRAME_SIZE];       //!< The frame.
+            };
+
+            /**
+             * @brief Handle a received frame.
+             *
+             * This is called by the WiFi stack, not in loop context.
+             *
+             * @param mac       The sender.
+             * @param data      The frame.
+             * @param length    The length of the frame.
+             */
+            static void on_received(uint8_t *mac, uint8_t *data, uint8_t length);
+
+            void process(const ReceivedFrame &frame);               //!< Handle a frame in loop context.
+
+            static EspNowGateway *instance;                         //!< The gateway receiving frames.
+
+            std::vector<std::unique_ptr<EspNowRemoteNode>> remotes; //!< The proxy devices.
+            std::vector<Device *> remote_devices;                   //!< The proxy devices, for the sketch's device list.
+            ReceivedFrame received[RECEIVE_QUEUE_SIZE];             //!< Frames waiting for `loop`.
+            volatile uint8_t receive_head = 0;                      //!< The next free slot; advanced by `on_received`.
+            volatile uint8_t receive_tail = 0;                      //!< The next frame to handle; advanced by `loop`.
+            bool started = false;                                   //!< Whether ESP-NOW was started.
+            volatile uint32_t frames_dropped = 0;                   //!< Frames lost because the queue was full.
+            uint32_t frames_received = 0;                           //!< Frames handled.
+            uint32_t frames_invalid = 0;                            //!< Frames not in this protocol.
+            uint32_t frames_unknown = 0;                            //!< Frames from nodes with no slot.
+
+            NoteSetting notes;                                      //!< A note describing the gateway.
+            InfoSettingHtml device_status;                          //!< Output only; current state.
+    };
+}
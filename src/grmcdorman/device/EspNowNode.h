@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/device/Scheduler.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief Sends the readings of a sensor node to an `EspNowGateway` over ESP-NOW.
+     *
+     * This replaces `MqttPublisher` on a sensor-only node: rather than keeping a WiFi association,
+     * a TCP connection and an MQTT session, the node sends a readings frame (see `EspNowProtocol`)
+     * every send interval, with one description frame, to the gateway. The gateway republishes
+     * the readings.
+     *
+     * ESP-NOW needs no access point, but the node must use the gateway's WiFi channel, shown in
+     * the gateway's status. If the node is connected to WiFi, the connection's channel is used;
+     * otherwise the configured channel. For the least radio time, leave the node's access point
+     * unset. With `DutyCycle`, readings are sent by `flush` before sleeping.
+     */
+    class EspNowNode: public Device
+    {
+        public:
+            EspNowNode();
+
+            void setup() override;
+            void loop() override;
+
+            /**
+             * @brief Get the boot phase.
+             *
+             * Setup uses the WiFi mode and channel, as set by `WifiSetup`.
+             *
+             * @return `BootPhase::NETWORK`.
+             */
+            BootPhase get_boot_phase() const override
+            {
+                return BootPhase::NETWORK;
+            }
+
+            /**
+             * @brief Add the list of devices whose readings are sent.
+             *
+             * @param list      List of devices.
+             */
+            virtual void set_devices(const std::vector<Device *> &list) override
+            {
+                devices = &list;
+            }
+
+            /**
+             * @brief Send any unsent readings.
+             *
+             * @return `true` once the readings have been sent and the send has completed.
+             */
+            bool flush() override;
+
+            size_t save_retained_state(uint8_t *buffer, size_t size) override;
+            void restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms) override;
+
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the send counts and the time in seconds since the last send.
+             */
+            uint32_t get_status_version() const override;
+
+        private:
+            /**
+             * @brief The state kept across a deep sleep.
+             */
+            struct RetainedState
+            {
+                uint16_t sequence;          //!< The next readings sequence number.
+                uint8_t description_index;  //!< The next definition to describe.
+                uint8_t reserved;           //!< Zero.
+            };
+
+            void set_timer();               //!< Set up the send task.
+            void send();                    //!< Send the readings frame and the next description.
+            bool send_readings();           //!< Send the readings frame.
+            bool send_description();        //!< Send the next description frame.
+            bool send_frame(const uint8_t *data, size_t length);    //!< Send a frame to the gateway.
+
+            /**
+             * @brief Handle the completion of a send.
+             *
+             * This is called by the WiFi stack, not in loop context.
+             *
+             * @param mac       The destination.
+             * @param status    Zero if the frame was acknowledged.
+             */
+            static void on_sent(uint8_t *mac, uint8_t status);
+
+            static EspNowNode *instance;                    //!< The node receiving send completions.
+
+            const std::vector<Device *> *devices = nullptr; //!< The list of devices to send.
+            Scheduler::Task send_task{this};                //!< Task to send readings.
+            Scheduler::Task retry_task{this};               //!< Task to retry a send deferred by another activity.
+            uint8_t gateway[6];                             //!< The gateway address; broadcast if not configured.
+            bool started = false;                           //!< Whether ESP-NOW was started.
+            uint16_t sequence = 0;                          //!< The next readings sequence number.
+            uint8_t description_index = 0;                  //!< The next definition to describe.
+            uint32_t current_interval = 0;                  //!< The send interval of the task.
+            uint32_t last_send_ms = 0;                      //!< When the last readings frame was sent.
+            uint32_t frames_sent = 0;                       //!< Frames handed to ESP-NOW.
+            volatile uint32_t frames_acknowledged = 0;      //!< Frames acknowledged by the gateway.
+            volatile uint32_t frames_failed = 0;            //!< Frames not acknowledged.
+            volatile uint8_t sends_pending = 0;             //!< Frames sent and not yet completed.
+
+            NoteSetting notes;                              //!< A note describing the node.
+            StringSetting gateway_address;                  //!< The gateway's MAC address; empty to broadcast.
+            UnsignedIntegerSetting channel;                 //!< The WiFi channel when not connected to an access point.
+            UnsignedIntegerSetting send_interval;           //!< The send interval, in seconds.
+            InfoSettingHtml device_status;                  //!< Output only; current state.
+    };
+}
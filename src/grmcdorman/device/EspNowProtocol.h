@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief The frames sent from `EspNowNode` to `EspNowGateway`.
+     *
+     * Every frame starts with a `Header`. A readings frame follows it with one `float` per
+     * definition of the node, in `Device::get_definition_count` order; a value that is not
+     * available is NaN. A description frame follows it with a `Description` and then five
+     * null-terminated strings: the name suffix, the unique id suffix, the unit of measurement,
+     * the icon, and the sensor name (see `Device::Definition`).
+     *
+     * A node sends one description after each readings frame, cycling through its definitions,
+     * so that a gateway learns them, and relearns them after a restart, without a request.
+     * All values are little-endian, as on the ESP8266.
+     */
+    class EspNowProtocol
+    {
+        public:
+            static constexpr uint8_t MAGIC = 0xD7;              //!< The first byte of every frame.
+            static constexpr uint8_t VERSION = 1;               //!< The protocol version.
+            static constexpr size_t MAX_FRAME_SIZE = 250;       //!< The largest ESP-NOW payload.
+
+            /**
+             * @brief The type of frame.
+             */
+            enum class FrameType: uint8_t
+            {
+                READINGS = 1,   //!< The current value of each definition.
+                DESCRIPTION = 2 //!< One definition.
+            };
+
+            /**
+             * @brief The header of every frame.
+             */
+            struct Header
+            {
+                uint8_t magic;              //!< `MAGIC`.
+                uint8_t version;            //!< `VERSION`.
+                FrameType type;             //!< The frame type.
+                uint8_t definition_count;   //!< The number of definitions on the node.
+                uint32_t node_id;           //!< The node's chip ID.
+                uint16_t sequence;          //!< Advances by one for each readings frame.
+                uint16_t send_interval;     //!< The node's send interval, in seconds.
+            };
+
+            /**
+             * @brief The fixed part of a description frame.
+             */
+            struct Description
+            {
+                uint8_t index;              //!< The index of the definition.
+                uint8_t reserved[3];        //!< Zero.
+                float change_threshold;     //!< The definition's change threshold.
+            };
+
+            static constexpr size_t MAX_VALUES = (MAX_FRAME_SIZE - sizeof(Header)) / sizeof(float);    //!< The most definitions a node can send.
+            static constexpr size_t DESCRIPTION_STRINGS = 5;   //!< The number of strings in a description.
+
+            /**
+             * @brief Check that a frame has a valid header for this protocol version.
+             *
+             * @param data      The frame.
+             * @param length    The length of the frame.
+             * @return `true` if the frame can be decoded.
+             */
+            static bool is_valid(const uint8_t *data, size_t length)
+            {
+                return length >= sizeof(Header) && data[0] == MAGIC && data[1] == VERSION;
+            }
+    };
+
+    static_assert(sizeof(EspNowProtocol::Header) == 12, "The frame header is part of the wire format");
+    static_assert(sizeof(EspNowProtocol::Description) == 8, "The description is part of the wire format");
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <FS.h>
+#include <time.h>
+
+#include <array>
+#include <vector>
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/device/Scheduler.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief This class records a downsampled history of device readings.
+     *
+     * Every sample interval, the current value of each definition of each enabled attached
+     * device is read with `get_definition_value`. The samples are combined into minimum, mean, and
+     * maximum records at three resolutions: one minute, fifteen minutes, and one hour.
+     *
+     * Completed records are first held in a small RAM buffer for each resolution. The buffer is
+     * appended to a file on `LittleFS` when it holds `RAM_RECORDS` records, or when its oldest record
+     * is `FLUSH_INTERVAL` seconds old; writing in batches keeps the number of flash writes low. Each
+     * resolution's file is limited to the configured size. When it is full it is renamed to a `.old`
+     * file, replacing the previous one, and a new file is started; each resolution thus
+     * keeps between one and two files' worth of records, and no file is ever rewritten.
+     *
+     * Records are time stamped from the system clock (`time()`), so that the history remains meaningful
+     * across a reboot. Nothing is recorded until the clock has been set, for example by `configTime`.
+     * Records identify the sensor by its overall definition index (see `Device::get_definition_count`);
+     * changing the list of devices invalidates the recorded history.
+     *
+     * The history is read with a `Query`, which produces JSON a piece at a time straight from
+     * the files; see `WebServerRestApi::setup_history`.
+     */
+    class HistoryRecorder: public Device
+    {
+        public:
+            static constexpr size_t RESOLUTION_COUNT = 3;                   //!< The number of resolutions recorded.
+            static constexpr size_t RAM_RECORDS = 16;                       //!< Completed records held in RAM, per resolution, before writing to flash.
+            static constexpr uint32_t FLUSH_INTERVAL = 900;                 //!< The longest time, in seconds, a completed record is held in RAM.
+            static constexpr time_t MINIMUM_VALID_TIME = 1609459200;        //!< The system clock is taken to be set once it passes this time (2021-01-01).
+
+            /**
+             * @brief A single history record, as stored.
+             *
+             */
+            struct Record
+            {
+                uint32_t timestamp;     //!< The start of the period, in seconds since the epoch.
+                uint16_t index;         //!< The definition index.
+                uint16_t count;         //!< The number of samples in the period.
+                float minimum;          //!< The lowest sample.
+                float mean;             //!< The mean of the samples.
+                float maximum;          //!< The highest sample.
+            };
+
+            /**
+             * @brief A query over the recorded history.
+             *
+             * The result is a JSON document, produced in pieces by `read`; the
+             * records are read from the files as required, so that the document is never
+             * held in memory. Records held in RAM are included, as of the time the query is
+             * created. If a file is rotated while the query runs, the remaining
+             * file records are skipped; the document is still complete JSON.
+             *
+             * The document has the form:
+             * @code{.json}
+             * {"resolution":"1m","period":60,"records":[
+             * {"time":1640995200,"sensor":"sht31_temperature","min":20.1,"mean":20.25,"max":20.4,"count":6}
+             * ]}
+             * @endcode
+             */
+            class Query
+            {
+                public:
+                    /**
+                     * @brief Construct a new Query object.
+                     *
+                     * @param recorder      The history recorder; must outlive the query.
+                     * @param resolution    The resolution index; see `find_resolution`.
+                     * @param all_sensors   If `true`, records for all sensors are returned, and `index` is ignored.
+                     * @param index         The definition index of the sensor.
+                     * @param from          The earliest period start time to return.
+                     * @param to            The latest period start time to return.
+                     */
+                    Query(const HistoryRecorder &recorder, size_t resolution, bool all_sensors, size_t index, uint32_t from, uint32_t to);
+
+                    /**
+                     * @brief Get the next part of the document.
+                     *
+                     * @param buffer    Buffer to receive the text.
+                     * @param length    Size of the buffer.
+                     * @return The number of bytes written; zero when the document is complete.
+                     */
+                    size_t read(uint8_t *buffer, size_t length);
+
+                private:
+                    /**
+                     * @brief Format the next part of the document into `line`.
+                     *
+                     * @return `false` if the document is complete.
+                     */
+                    bool next_line();
+
+                    /**
+                     * @brief Get the next record to return.
+                     *
+                     * @param[out] record   Receives the record.
+                     * @return `true` if there was a record.
+                     */
+                    bool next_record(Record &record);
+
+                    /**
+                     * @brief Get whether a record should be returned.
+                     *
+                     * @param record    The record.
+                     * @return `true` if the record matches the query.
+                     */
+                    bool matches(const Record &record) const;
+
+                    static constexpr size_t LINE_SIZE = 160;    //!< The size of the line buffer; long enough for one record.
+
+                    const HistoryRecorder &recorder;            //!< The history recorder.
+                    size_t resolution;                          //!< The resolution index.
+                    bool all_sensors;                           //!< Whether to return all sensors.
+                    size_t index;                               //!< If not all sensors, the sensor's definition index.
+                    uint32_t from;                              //!< The earliest period start to return.
+                    uint32_t to;                                //!< The latest period start to return.
+                    uint32_t generation;                        //!< The recorder's file generation when the query was created.
+                    std::array<size_t, 2> file_records;         //!< The number of records in the old and current files when the query was created.
+                    std::vector<Record> pending;                //!< The records held in RAM when the query was created.
+                    uint8_t source = 0;                         //!< The record source: the old file, the current file, RAM, or done.
+                    size_t position = 0;                        //!< The next record in the source.
+                    File file;                                  //!< The open file, if any.
+                    uint8_t stage = 0;                          //!< The document stage: header, records, or done.
+                    bool first_record = true;                   //!< Whether no record has been formatted yet.
+                    char line[LINE_SIZE];                       //!< The text being returned.
+                    size_t line_length = 0;                     //!< The length of the text in `line`.
+                    size_t line_position = 0;                   //!< The next character in `line` to return.
+            };
+
+            /**
+             * @brief Construct a new HistoryRecorder object.
+             *
+             */
+            HistoryRecorder();
+
+            void setup() override;
+            void loop() override;
+
+            /**
+             * @brief Get the boot phase.
+             *
+             * Setup counts the records in the history files.
+             *
+             * @return `BootPhase::FILESYSTEM`.
+             */
+            BootPhase get_boot_phase() const override
+            {
+                return BootPhase::FILESYSTEM;
+            }
+
+            /**
+             * @brief Add the list of devices to record.
+             *
+             * @param list      List of devices to record.
+             */
+            virtual void set_devices(const std::vector<Device *> &list) override
+            {
+                devices = &list;
+            }
+
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the record counts and write errors.
+             */
+            uint32_t get_status_version() const override;
+
+            /**
+             * @brief Find a resolution by name.
+             *
+             * The names are `1m`, `15m` and `1h`.
+             *
+             * @param name              Resolution name.
+             * @param[out] resolution   Receives the resolution index.
+             * @return `true` if the name was found.
+             */
+            static bool find_resolution(const String &name, size_t &resolution);
+
+            /**
+             * @brief Find a sensor by name.
+             *
+             * @param name          Sensor name; see `Definition::get_sensor_name`.
+             * @param[out] index    Receives the definition index.
+             * @return `true` if the sensor was found.
+             */
+            bool find_sensor(const String &name, size_t &index) const;
+
+        private:
+            /**
+             * @brief Readings combined over a single period.
+             *
+             */
+            struct Bucket
+            {
+                float minimum = 0.0f;   //!< The lowest sample.
+                float maximum = 0.0f;   //!< The highest sample.
+                float sum = 0.0f;       //!< The sum of the samples.
+                uint16_t count = 0;     //!< The number of samples.
+            };
+
+            /**
+             * @brief Set up the sample task.
+             *
+             */
+            void set_timer();
+
+            /**
+             * @brief Take a sample, completing and writing records as required.
+             *
+             * This is run by the sample task.
+             */
+            void record();
+
+            /**
+             * @brief Add the current value of each definition to the one-minute buckets.
+             *
+             */
+            void sample();
+
+            /**
+             * @brief Complete the current period for a resolution.
+             *
+             * A record is added for each definition with samples. One-minute buckets are
+             * also combined into the longer resolutions.
+             *
+             * @param resolution    Resolution index.
+             * @param now           The current time.
+             */
+            void close_period(size_t resolution, uint32_t now);
+
+            /**
+             * @brief Write the RAM records for a resolution to its file.
+             *
+             * The file is rotated first, if it would exceed the configured size.
+             *
+             * @param resolution    Resolution index.
+             */
+            void flush(size_t resolution);
+
+            /**
+             * @brief Rotate the file for a resolution.
+             *
+             * @param resolution    Resolution index.
+             */
+            void rotate(size_t resolution);
+
+            /**
+             * @brief Get the number of whole records in a file.
+             *
+             * Any partial record at the end of the file, left by a failed write, is removed.
+             *
+             * @param path      File path.
+             * @return Record count.
+             */
+            static size_t count_records(const char *path);
+
+            const std::vector<Device *> *devices = nullptr;                 //!< The list of attached devices that will be recorded.
+            std::vector<Bucket> buckets;                                    //!< The buckets, for all definitions, for each resolution in turn.
+            size_t definition_count = 0;                                    //!< The number of definitions when the buckets were allocated.
+            std::array<uint32_t, RESOLUTION_COUNT> period_start{};          //!< The start time of the current period, for each resolution.
+            std::array<std::vector<Record>, RESOLUTION_COUNT> pending;      //!< Completed records not yet written, for each resolution.
+            std::array<uint32_t, RESOLUTION_COUNT> pending_since{};         //!< When the oldest record in `pending` was completed, for each resolution.
+            std::array<size_t, RESOLUTION_COUNT> current_records{};         //!< The number of records in the current file, for each resolution.
+            std::array<size_t, RESOLUTION_COUNT> old_records{};             //!< The number of records in the old file, for each resolution.
+            std::array<uint32_t, RESOLUTION_COUNT> generation{};            //!< Incremented when a resolution's file is rotated.
+            Scheduler::Task sample_task{this};                              //!< The task that takes samples.
+            uint32_t current_sample_seconds = 0;                            //!< The current sample interval.
+            uint32_t write_errors = 0;                                      //!< The number of failed file writes.
+            bool clock_set = false;                                         //!< Whether the system clock has been seen to be set.
+
+            NoteSetting notes;                                              //!< A note describing the history.
+            UnsignedIntegerSetting sample_interval;                         //!< How often to sample, in seconds.
+            UnsignedIntegerSetting file_size;                               //!< The largest file size for each resolution, in kilobytes.
+            InfoSettingHtml device_status;                                  //!< Output only; recording status.
+    };
+}
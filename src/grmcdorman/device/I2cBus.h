@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+#include "grmcdorman/device/Scheduler.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief The shared I2C bus.
+     *
+     * The ESP8266 has one I2C (`Wire`) bus. Rather than each device calling `Wire.begin`
+     * and `Wire.setClock`, which would reconfigure the bus for every other device on it,
+     * devices call `begin` with their pins and the fastest clock they support. The first
+     * device chooses the pins; other devices must use the same pins. The clock is the slowest of the
+     * device maximums, and at most fast mode (400 kHz).
+     *
+     * Devices that start a measurement and read it later own a `Conversion`. Conversions
+     * requested at about the same time are batched: all are started, one after another,
+     * then, once the longest conversion time has passed, all are read. The bus is not held while
+     * the sensors convert, and several sensors take no longer than one.
+     */
+    class I2cBus
+    {
+        public:
+            static constexpr uint32_t STANDARD_MODE_CLOCK = 100000;     //!< Standard mode; all devices support this.
+            static constexpr uint32_t FAST_MODE_CLOCK = 400000;         //!< Fast mode; the fastest clock used.
+
+            /**
+             * @brief A measurement that is started, then read later.
+             *
+             * A conversion is removed from the bus when it is destroyed.
+             */
+            class Conversion
+            {
+                public:
+                    typedef std::function<void()> callback_t;   //!< The callback type.
+
+                    Conversion() = default;
+                    Conversion(const Conversion &) = delete;
+                    Conversion &operator=(const Conversion &) = delete;
+                    /**
+                     * @brief Destroy the Conversion object.
+                     *
+                     * The conversion is cancelled.
+                     */
+                    ~Conversion()
+                    {
+                        cancel();
+                    }
+
+                    /**
+                     * @brief Set the conversion callbacks.
+                     *
+                     * @param conversion_time_ms    The time between `start` and the reading being available.
+                     * @param start                 Starts the measurement.
+                     * @param finish                Reads the measurement.
+                     */
+                    void set(uint32_t conversion_time_ms, callback_t start, callback_t finish)
+                    {
+                        conversion_ms = conversion_time_ms;
+                        start_callback = std::move(start);
+                        finish_callback = std::move(finish);
+                    }
+
+                    /**
+                     * @brief Request the conversion.
+                     *
+                     * It will be started with the next batch.
+                     *
+                     * @return `true` if requested; `false` if the conversion is already waiting or in progress.
+                     */
+                    bool request();
+
+                    /**
+                     * @brief Cancel the conversion.
+                     *
+                     * If it is in progress, it will not be read.
+                     */
+                    void cancel();
+
+                    /**
+                     * @brief Get whether the conversion is waiting or in progress.
+                     *
+                     * @return `true` if the conversion is waiting to start, or to be read.
+                     */
+                    bool is_requested() const
+                    {
+                        return state != State::IDLE;
+                    }
+
+                private:
+                    friend class I2cBus;
+
+                    /**
+                     * @brief The conversion state.
+                     */
+                    enum class State: uint8_t
+                    {
+                        IDLE,                                   //!< Not requested.
+                        WAITING,                                //!< Requested; waiting for the next batch.
+                        CONVERTING                              //!< Started; waiting to be read.
+                    };
+
+                    callback_t start_callback;                  //!< Starts the measurement.
+                    callback_t finish_callback;                 //!< Reads the measurement.
+                    uint32_t conversion_ms = 0;                 //!< The conversion time.
+                    State state = State::IDLE;                  //!< The conversion state.
+            };
+
+            /**
+             * @brief Attach a device to the bus.
+             *
+             * The first call starts the bus on the given pins. Later calls must give the same pins;
+             * the clock is lowered if the device does not support the current clock.
+             *
+             * @param sda               The data line.
+             * @param scl               The clock line.
+             * @param maximum_clock     The fastest clock the device supports.
+             * @return `true` if the device can use the bus; `false` if the bus uses other pins.
+             */
+            static bool begin(int sda, int scl, uint32_t maximum_clock);
+
+            /**
+             * @brief Set the bus clock again.
+             *
+             * Some device libraries call `Wire.begin` themselves, which may reset the clock;
+             * call this after initializing such a library.
+             */
+            static void restore_clock();
+
+            /**
+             * @brief Get whether the bus has been started.
+             *
+             * @return `true` if `begin` has been called successfully.
+             */
+            static bool is_started()
+            {
+                return started;
+            }
+
+            /**
+             * @brief Get the bus clock.
+             *
+             * @return The clock, in Hz.
+             */
+            static uint32_t get_clock()
+            {
+                return clock;
+            }
+
+            /**
+             * @brief Get the number of conversion batches since boot.
+             *
+             * @return Batch count.
+             */
+            static uint32_t get_batch_count()
+            {
+                return batch_count;
+            }
+
+            /**
+             * @brief Get the number of conversions since boot.
+             *
+             * The difference from the batch count is the number of conversions that
+             * shared a batch.
+             *
+             * @return Conversion count.
+             */
+            static uint32_t get_conversion_count()
+            {
+                return conversion_count;
+            }
+
+        private:
+            /**
+             * @brief Schedule the next batch, unless one is scheduled or in progress.
+             */
+            static void schedule_batch();
+            /**
+             * @brief Start all waiting conversions.
+             */
+            static void start_batch();
+            /**
+             * @brief Read all started conversions.
+             */
+            static void finish_batch();
+
+            static std::vector<Conversion *> conversions;   //!< Requested conversions, in request order.
+            static Scheduler::Task batch_task;              //!< Starts or finishes a batch.
+            static bool converting;                         //!< Whether a batch is in progress.
+            static uint32_t batch_started_ms;               //!< When the batch in progress was started, system time.
+            static uint32_t batch_conversion_ms;            //!< The longest conversion time in the batch in progress.
+            static bool started;                            //!< Whether the bus has been started.
+            static int sda_pin;                             //!< The data line.
+            static int scl_pin;                             //!< The clock line.
+            static uint32_t clock;                          //!< The bus clock.
+            static uint32_t batch_count;                    //!< The number of batches.
+            static uint32_t conversion_count;               //!< The number of conversions.
+    };
+}
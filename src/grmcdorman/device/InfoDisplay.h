@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <StreamString.h>
 
 #include "grmcdorman/device/Device.h"
 #include "grmcdorman/Setting.h"
@@ -66,8 +67,12 @@ namespace grmcdorman::device
             /**
              * @brief Add a list of devices that will report status.
              *
-             * The status message (`get_status`) will be reported any device
-             * that is enabled and returns a non-blank status message.
+             * The status message (`print_status`) will be reported any device
+             * that is enabled and writes a non-blank status message.
+             *
+             * The combined report is kept, and written again only when the status
+             * version (`get_status_version`) of a device changes, or a device is
+             * enabled or disabled.
              *
              * @param list      List of devices to query for status reports..
              */
@@ -103,6 +108,9 @@ namespace grmcdorman::device
             InfoSettingHtml device_status;                  //!< Status of linked devices.
 
             const std::vector<Device *> *devices = nullptr; //!< The list of attached devices which will report status.
+            StreamString status_text;                       //!< The last combined status report.
+            uint32_t status_key = 0;                        //!< The hash of the devices and status versions in `status_text`.
+            bool status_valid = false;                      //!< Whether `status_text` has been written.
 
             /**
              * @brief Accumulate status message for all attached enabled devices.
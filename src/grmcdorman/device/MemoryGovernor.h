@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "grmcdorman/device/Device.h"
+#include "grmcdorman/Setting.h"
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief Sheds optional work when the heap runs low.
+     *
+     * The governor compares the free heap and the largest free block against two budgets.
+     * Below the constrained budget, the framework defers work that can wait: Home Assistant
+     * discovery is postponed, the MQTT state is published a few devices at a time, only one
+     * REST state or history response is served at once, and `InfoDisplay` shows its last
+     * device status instead of building a new one. Below the critical budget, REST state and
+     * history requests are refused with status 503 and one device is published at a time.
+     * A level is left only when the heap is back above its budget by `HYSTERESIS` bytes.
+     *
+     * The checks are static, so that other devices need no reference to the governor; they
+     * always allow everything unless a governor is in the device list and enabled. The counts
+     * of deferred work and the low-water marks are in the status and the JSON.
+     */
+    class MemoryGovernor: public Device
+    {
+        public:
+            static constexpr uint32_t HYSTERESIS = 1024;            //!< Bytes above a budget needed to leave its level.
+            static constexpr uint32_t SAMPLE_INTERVAL_MS = 100;     //!< How often `loop` samples the heap.
+            static constexpr size_t CONSTRAINED_BATCH_DEVICES = 2;  //!< Devices per MQTT state publish when constrained.
+
+            /**
+             * @brief The memory pressure.
+             */
+            enum class Level: uint8_t
+            {
+                NORMAL,         //!< Within budget.
+                CONSTRAINED,    //!< Below the constrained budget; optional work is deferred.
+                CRITICAL        //!< Below the critical budget; requests are refused.
+            };
+
+            /**
+             * @brief Work that may be deferred or refused.
+             */
+            enum class Action: uint8_t
+            {
+                DISCOVERY,      //!< Sending a Home Assistant discovery message.
+                REST_RESPONSE,  //!< Starting a streamed REST response.
+                PUBLISH_BATCH,  //!< Adding a device to an MQTT state publish.
+                STATUS_UPDATE,  //!< Building the combined device status for the web UI.
+                COUNT           //!< The number of actions.
+            };
+
+            MemoryGovernor();
+
+            void setup() override;
+            void loop() override;
+
+            /**
+             * @brief Check whether an action may go ahead now.
+             *
+             * The heap is sampled; a refusal is counted.
+             *
+             * @param action    The action.
+             * @param in_use    For `REST_RESPONSE`, the responses in progress; for `PUBLISH_BATCH`, the devices already in the batch.
+             * @return `true` if the action may go ahead.
+             */
+            static bool allow(Action action, size_t in_use = 0);
+
+            /**
+             * @brief Get the most devices to include in one MQTT state publish.
+             *
+             * @return The device limit; `SIZE_MAX` when there is no memory pressure.
+             */
+            static size_t get_publish_batch_limit();
+
+            /**
+             * @brief Get the current memory pressure.
+             *
+             * @return The level, as of the last sample.
+             */
+            static Level get_level()
+            {
+                return level;
+            }
+
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get a status report.
+             *
+             * @return Status report.
+             */
+            String get_status() const override;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the level, the low-water marks, and the counts.
+             */
+            uint32_t get_status_version() const override;
+
+        private:
+            /**
+             * @brief Sample the heap and update the level.
+             *
+             * @return The level.
+             */
+            static Level sample();
+
+            /**
+             * @brief Get the level for a heap state, ignoring hysteresis.
+             *
+             * @param free_heap     The free heap.
+             * @param max_block     The largest free block.
+             * @return The level.
+             */
+            static Level classify(uint32_t free_heap, uint32_t max_block);
+
+            static bool active;                             //!< Whether an enabled governor has been set up.
+            static Level level;                             //!< The current level.
+            static uint32_t constrained_free_heap;          //!< The constrained budget for the free heap.
+            static uint32_t constrained_max_block;          //!< The constrained budget for the largest block.
+            static uint32_t critical_free_heap;             //!< The critical budget for the free heap.
+            static uint32_t critical_max_block;             //!< The critical budget for the largest block.
+            static uint32_t free_heap_low_water;            //!< The lowest free heap sampled.
+            static uint32_t max_block_low_water;            //!< The smallest largest block sampled.
+            static uint32_t constrained_count;              //!< Times the constrained level was entered.
+            static uint32_t critical_count;                 //!< Times the critical level was entered.
+            static uint32_t denied[static_cast<size_t>(Action::COUNT)];    //!< Refusals, by action.
+
+            uint32_t last_sample_ms = 0;                    //!< When `loop` last sampled the heap.
+
+            NoteSetting notes;                              //!< A note describing the governor.
+            UnsignedIntegerSetting constrained_free_setting;    //!< The constrained budget for the free heap.
+            UnsignedIntegerSetting constrained_block_setting;   //!< The constrained budget for the largest block.
+            UnsignedIntegerSetting critical_free_setting;       //!< The critical budget for the free heap.
+            UnsignedIntegerSetting critical_block_setting;      //!< The critical budget for the largest block.
+            InfoSettingHtml device_status;                  //!< Output only; current state.
+    };
+}
@@ -24,9 +24,10 @@
 
 #include <memory>
 #include <PubSubClient.h>
-#include <Ticker.h>
 
 #include "grmcdorman/device/Device.h"
+#include "grmcdorman/device/ReadingQueue.h"
+#include "grmcdorman/device/Scheduler.h"
 #include "grmcdorman/Setting.h"
 
 class Client;
@@ -41,15 +42,29 @@ namespace grmcdorman::device
      * It does not support subscriptions.
      *
      * If the connection is lost, an immediate attempt to connect is made on the next publish attempt.
+     * An attempt is also made as soon as WiFi connects; no attempt is made while WiFi is down,
+     * so at boot the first attempt waits for WiFi rather than failing and counting as a retry.
+     * Once connected, and discovery is sent, any unpublished readings are published at once.
+     *
+     * By default, all device values are published as a single JSON document to the state topic. If
+     * "publish changed values only" is enabled, each definition's value is instead published as
+     * plain text to its own topic under the state topic, and only when it has changed by at least
+     * the definition's change threshold since it was last published.
      *
      * When a connection is attempted, the device will attempt `CONNECTION_TRIES` at an interval of `CONNECTION_RETRY_INTERVAL`. If this
      * fails, it will not attempt a connection again until the configured reconnection interval elapses.
+     *
+     * Readings taken while the connection is down are held in a fixed-size queue, optionally spilling to `LittleFS`.
+     * Once the connection is re-established they are sent, oldest first, at most one every `QUEUE_DRAIN_INTERVAL`
+     * milliseconds, to <em>prefix</em>/<em>identifier</em>/queued. Each message is a small JSON object with the sensor
+     * name (the definition's unique ID suffix), the value, and the age of the reading in milliseconds.
      */
     class MqttPublisher: public Device
     {
         public:
             static constexpr uint16_t CONNECTION_TRIES = 5;             //!< Number of times to try establishing a connection.
             static constexpr uint32_t CONNECTION_RETRY_INTERVAL = 5;    //!< Second between attempts to retry establishing a connection.
+            static constexpr uint32_t QUEUE_DRAIN_INTERVAL = 100;       //!< Milliseconds between sending queued readings after a reconnect.
             /**
              * @brief Construct a new Mqtt Device object.
              *
@@ -83,7 +98,19 @@ namespace grmcdorman::device
             void setup() override;
             void loop() override;
 
-            DynamicJsonDocument as_json() const override;
+            /**
+             * @brief Get the boot phase.
+             *
+             * The connection is made once WiFi connects; the readings queue may spill to a file.
+             *
+             * @return `BootPhase::NETWORK`.
+             */
+            BootPhase get_boot_phase() const override
+            {
+                return BootPhase::NETWORK;
+            }
+
+            bool serialize_into(JsonObject json) const override;
 
             /**
              * @brief Add a list of devices that will publish.
@@ -117,22 +144,126 @@ namespace grmcdorman::device
              */
             virtual String get_status() const;
 
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the connection and publish state, and the age in seconds of the last attempt.
+             */
+            uint32_t get_status_version() const override;
+
+            /**
+             * @brief Publish any unpublished readings now.
+             *
+             * If connected, this publishes the readings of any device with unpublished
+             * readings, rather than waiting for the update interval.
+             *
+             * @return `true` once there is nothing left to send, including queued readings and discovery messages.
+             */
+            bool flush() override;
+
+            /**
+             * @brief Save the queued readings, and whether discovery has been sent.
+             *
+             * Unpublished readings are queued first. If the queued readings do not all fit,
+             * the newest are kept. The queue is emptied.
+             *
+             * @param buffer    Receives the state.
+             * @param size      The size of the buffer.
+             * @return The number of bytes used.
+             */
+            size_t save_retained_state(uint8_t *buffer, size_t size) override;
+
+            /**
+             * @brief Restore the queued readings, and whether discovery has been sent.
+             *
+             * The readings are added to the queue by `setup`.
+             *
+             * @param buffer        The state.
+             * @param size          The size of the state.
+             * @param elapsed_ms    Approximate milliseconds since the state was saved; added to the reading ages.
+             */
+            void restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms) override;
+
         private:
+            static constexpr size_t RETAINED_READING_SIZE = 10;         //!< The size of a retained queued reading: age, index, and value.
+            static constexpr uint32_t BATCH_INTERVAL_MS = 200;          //!< The delay between state publishes when memory limits the batch size.
+
+            /**
+             * @brief The encodings of the state document; the options of `state_encoding`.
+             */
+            enum StateEncoding
+            {
+                STATE_JSON,                 //!< JSON, to the state topic.
+                STATE_JSON_AND_MSGPACK,     //!< JSON, and MessagePack to the MessagePack state topic.
+                STATE_MSGPACK               //!< MessagePack only; there is no Home Assistant discovery.
+            };
+
             /**
              * @brief Reconnect to MQTT.
              *
              * This is used at startup, and when an MQTT disconnect is detected and
-             * the reconnect interval has been exceeded.
+             * the reconnect interval has been exceeded. Nothing is done while WiFi is down.
              */
             void reconnect();
             /**
-             * @brief Publish Home Assistant automatic configuration.
+             * @brief Start publishing Home Assistant automatic configuration.
              *
-             * This uses data from each attached device to construct a series
-             * of publish notifications that describe the device's sensors to
-             * Home Assistant.
+             * This is called on connection. The configurations are then sent, one
+             * definition per `loop` pass, by `publish_next_discovery`. If the session
+             * is persistent and all configurations have already been sent since boot,
+             * nothing is sent.
              */
-            void publish_auto_config();
+            void start_discovery();
+            /**
+             * @brief Publish the next Home Assistant automatic configuration.
+             *
+             * This uses data from the next definition of the attached devices to
+             * publish a notification that describes the sensor to Home Assistant.
+             */
+            void publish_next_discovery();
+            /**
+             * @brief Arrange to publish any unpublished readings.
+             *
+             * This is used once connected and discovery is complete, so that readings
+             * taken while connecting, notably at boot, are not held until the next interval.
+             */
+            void publish_new_readings();
+            /**
+             * @brief Get whether any device has an unpublished reading.
+             *
+             * Devices without a reading generation are not counted.
+             *
+             * @return `true` if an enabled device has an unpublished reading.
+             */
+            bool has_unpublished_readings() const;
+            /**
+             * @brief Publish the Home Assistant configuration for a definition.
+             *
+             * @param device        The device with the definition.
+             * @param definition    The definition to describe.
+             * @return `true` if the message was sent.
+             */
+            bool publish_discovery(const Device *device, const Definition *definition);
+            /**
+             * @brief Write the Home Assistant configuration for a definition.
+             *
+             * The JSON is written directly from the definition and the cached device
+             * description; no JSON document is built. The value and attribute templates
+             * are generated from the device's publish key and the definition's field.
+             *
+             * @param output        Destination for the JSON.
+             * @param device        The device with the definition.
+             * @param definition    The definition to describe.
+             * @param state_topic   The state topic for the definition.
+             */
+            void write_discovery(Print &output, const Device *device, const Definition *definition, const String &state_topic) const;
             /**
              * @brief Publish.
              *
@@ -141,6 +272,67 @@ namespace grmcdorman::device
              * complete data from all devices must be published.
              */
             void publish();
+            /**
+             * @brief Publish a JSON document.
+             *
+             * The document is serialized directly to the MQTT connection;
+             * no intermediate copy of the payload is made. As a result, the
+             * payload size is not limited by the configured MQTT buffer size.
+             *
+             * @param topic     Topic to publish to.
+             * @param json      Document to publish.
+             * @param retained  Whether the message should be retained.
+             * @return `true` if the message was sent.
+             */
+            bool publish_json(const char *topic, const JsonDocument &json, bool retained);
+            /**
+             * @brief Publish a document as MessagePack.
+             *
+             * As for `publish_json`, the document is serialized directly to the
+             * MQTT connection. Floating-point values are sent as 32-bit binary
+             * floats rather than formatted as text.
+             *
+             * @param topic     Topic to publish to.
+             * @param json      Document to publish.
+             * @param retained  Whether the message should be retained.
+             * @return `true` if the message was sent.
+             */
+            bool publish_msgpack(const char *topic, const JsonDocument &json, bool retained);
+            /**
+             * @brief Publish changed values only.
+             *
+             * This is used instead of the full state publish when
+             * `delta_publish` is set. Each definition's value is
+             * published, as plain text, to its own topic under the
+             * state topic; values that have not changed by at least the
+             * definition's change threshold are not published.
+             */
+            void publish_changed();
+
+            /**
+             * @brief Queue the current readings of all unpublished devices.
+             *
+             * This is used when a publish is due but there is no connection.
+             * The devices are marked as published.
+             */
+            void enqueue_readings();
+            /**
+             * @brief Send the oldest queued reading.
+             *
+             */
+            void send_queued_reading();
+
+            /**
+             * @brief Get the state topic for a single definition.
+             *
+             * This is the state topic, a slash, and the definition's unique ID
+             * suffix without any leading underscore; for example,
+             * <em>prefix</em>/<em>identifier</em>/state/dht_temperature.
+             *
+             * @param definition    The definition.
+             * @return The topic string.
+             */
+            String get_definition_topic(const Definition *definition) const;
 
             /**
              * @brief Get the MQTT string for the state.
@@ -175,14 +367,28 @@ namespace grmcdorman::device
             bool tried_publish = false;                     //!< Set to true on the first publish attempt.
             bool last_publish_failed = false;               //!< Success/fail for last data publish.
             int last_state = -1;                            //!< Last known MQTT state.
+            bool wifi_was_connected = false;                //!< Whether WiFi was connected on the previous `loop` pass.
             uint32_t current_publish_seconds = 0;           //!< Current publish interval.
 
             String topicAvailability;                       //!< The availability topic string. Used when connecting.
             String topicState;                              //!< The state topic string. Used when connecting.
             String topicCommand;                            //!< The command - i.e. data publish - topic string.
+            String topicStateMsgPack;                       //!< The topic for the state in MessagePack.
+            String topicQueued;                             //!< The topic for readings sent from the offline queue.
+            ReadingQueue queue;                             //!< Readings taken while disconnected.
+            uint32_t previous_queue_send_ms = 0;            //!< The last time a queued reading was sent.
+            String discovery_device_json;                   //!< The serialized device description for discovery. Built once, on first use.
+            size_t discovery_device = 0;                    //!< When sending discovery, the index of the current device.
+            size_t discovery_definition = 0;                //!< When sending discovery, the index of the next definition in the current device.
+            bool discovery_pending = false;                 //!< Whether discovery messages remain to be sent.
+            bool discovery_sent = false;                    //!< Whether all discovery messages have been sent since boot.
+            uint32_t discovery_generation = 0;              //!< The definition generation when discovery was started.
+            std::vector<float> published_values;            //!< When publishing changed values only, the last value published for each definition of each device.
+            std::vector<ReadingQueue::Record> restored_readings;    //!< Readings restored from before a deep sleep, to be queued by `setup`.
 
-            Ticker connect_ticker;                          //!< Timer for checking connection & reconnecting.
-            Ticker publish_ticker;                          //!< Timer for publishing.
+            Scheduler::Task connect_task{this};             //!< Task for checking connection & reconnecting.
+            Scheduler::Task publish_task{this};             //!< Task for publishing.
+            Scheduler::Task deferred_publish_task{this};    //!< Task for a publish that waited for a sensor read.
             NoteSetting notes;                              //!< A note setting with a description of the MQTT device.
             StringSetting server_address;                   //!< The user-configured server address.
             UnsignedIntegerSetting server_port;             //!< The user-configured server port.
@@ -194,6 +400,11 @@ namespace grmcdorman::device
             PasswordSetting password;                       //!< If applicable, the MQTT password.
             StringSetting prefix;                           //!< The prefix for topics.
             StringSetting identifier;                       //!< The unique identifier for topics.
+            ToggleSetting persistent_session;               //!< If true, use a persistent session and send discovery only once per boot.
+            ToggleSetting delta_publish;                    //!< If true, publish only changed values, each to its own topic.
+            ExclusiveOptionSetting state_encoding;          //!< The encodings of the state document; see `StateEncoding`.
+            UnsignedIntegerSetting queue_size;              //!< Number of readings to hold while disconnected. Applied at boot.
+            ToggleSetting queue_spill;                      //!< If true, queued readings overflow to a file. Applied at boot.
             InfoSettingHtml device_status;                    //!< Output only; last update information.
     };
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace grmcdorman::device
+{
+    class Device;
+
+    /**
+     * @brief Delivers new-reading events from devices to subscribers.
+     *
+     * A device posts an event whenever it records a new reading (see
+     * `Device::clear_is_published`, which posts for it). Events are not delivered
+     * from inside the device: they are collected, one per device, and delivered
+     * together once the current loop pass has finished, so that the device has
+     * finished updating its values and each subscriber is called once per new reading.
+     *
+     * A subscriber receives the device; it reads the values it needs with
+     * `Device::get_definition_value`, or the device's own accessors. A subscriber
+     * may itself record a reading, as `DerivedSensor` does; its event is delivered
+     * in the same pass.
+     *
+     * Everything here runs in loop context. Subscribers are not removed; they are
+     * expected to live as long as the devices do.
+     */
+    class ReadingBus
+    {
+        public:
+            typedef std::function<void(const Device &device)> subscriber_t; //!< A subscriber.
+            static constexpr size_t MAX_ROUNDS = 4;    //!< The longest chain of readings caused by readings delivered in one pass.
+
+            /**
+             * @brief Add a subscriber.
+             *
+             * @param subscriber    Called with each device that has a new reading.
+             */
+            static void subscribe(subscriber_t &&subscriber);
+
+            /**
+             * @brief Post a new-reading event.
+             *
+             * Several posts by a device before delivery are delivered once.
+             *
+             * @param device        The device with a new reading.
+             */
+            static void post(const Device *device);
+
+            /**
+             * @brief Get the number of events delivered.
+             *
+             * @return The number of events delivered since boot.
+             */
+            static uint32_t get_delivered_count()
+            {
+                return delivered_count;
+            }
+
+        private:
+            static void deliver();                              //!< Deliver the pending events.
+
+            static std::vector<subscriber_t> subscribers;       //!< The subscribers.
+            static std::vector<const Device *> pending;         //!< Devices with undelivered events.
+            static bool delivery_scheduled;                     //!< Whether `deliver` is scheduled.
+            static uint32_t delivered_count;                    //!< Events delivered.
+    };
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief A bounded first-in, first-out queue of timestamped readings.
+     *
+     * This holds readings that could not be published, for example while
+     * the MQTT connection is down, so they can be sent later.
+     *
+     * The queue is allocated once, by `begin`; it never grows. When it is full
+     * the oldest reading is either moved to a spill file on `LittleFS`, if a spill
+     * path was supplied, or discarded. The spill file is itself limited to
+     * `SPILL_FACTOR` times the queue capacity; when that is full, readings
+     * are discarded. Readings always come out of the queue in the order they went in.
+     *
+     * The spill file does not survive a reboot; it is removed by `begin`, as the
+     * time stamps are meaningless after a restart.
+     */
+    class ReadingQueue
+    {
+        public:
+            static constexpr size_t SPILL_FACTOR = 8;  //!< The spill file holds up to this many times the queue capacity.
+
+            /**
+             * @brief A single queued reading.
+             *
+             */
+            struct Record
+            {
+                uint32_t timestamp;     //!< The `millis()` value when the reading was queued.
+                uint16_t index;         //!< The reading's definition index; see `Device::get_definition_count`.
+                float value;            //!< The reading value.
+            };
+
+            /**
+             * @brief Allocate the queue.
+             *
+             * Any previous contents, including a spill file, are discarded.
+             *
+             * @param capacity      Number of readings to hold in RAM. Zero disables the queue.
+             * @param spill_path    Path for the spill file, or `nullptr` for no spill file. Must be a persistent pointer.
+             */
+            void begin(size_t capacity, const char *spill_path);
+
+            /**
+             * @brief Add a reading.
+             *
+             * If the queue is full, the oldest reading is spilled or discarded.
+             *
+             * @param record    The reading to add.
+             */
+            void push(const Record &record);
+
+            /**
+             * @brief Get the oldest reading, without removing it.
+             *
+             * @param[out] record   Receives the reading.
+             * @return `true` if there was a reading.
+             */
+            bool peek(Record &record);
+
+            /**
+             * @brief Remove the oldest reading.
+             *
+             */
+            void pop();
+
+            /**
+             * @brief Get whether the queue is empty.
+             *
+             * @return `true` if no readings are queued.
+             */
+            bool empty() const
+            {
+                return size() == 0;
+            }
+
+            /**
+             * @brief Get the number of queued readings, including spilled readings.
+             *
+             * @return Reading count.
+             */
+            size_t size() const
+            {
+                return count + spill_count - spill_read;
+            }
+
+            /**
+             * @brief Get the RAM capacity.
+             *
+             * @return Capacity, in readings.
+             */
+            size_t get_capacity() const
+            {
+                return capacity;
+            }
+
+            /**
+             * @brief Get the largest number of readings queued since `begin`.
+             *
+             * @return High-water mark.
+             */
+            size_t get_high_water() const
+            {
+                return high_water;
+            }
+
+            /**
+             * @brief Get the number of readings discarded because the queue was full.
+             *
+             * @return Discarded reading count.
+             */
+            uint32_t get_dropped() const
+            {
+                return dropped;
+            }
+
+        private:
+            /**
+             * @brief Move the oldest reading in RAM to the spill file.
+             *
+             * @return `true` if the reading was written.
+             */
+            bool spill_oldest();
+
+            /**
+             * @brief Remove the spill file and reset its counters.
+             *
+             */
+            void clear_spill();
+
+            std::unique_ptr<Record[]> records;      //!< The ring buffer.
+            size_t capacity = 0;                    //!< The ring buffer size.
+            size_t head = 0;                        //!< Index of the oldest reading.
+            size_t count = 0;                       //!< Readings in the ring buffer.
+            size_t high_water = 0;                  //!< The high-water mark.
+            uint32_t dropped = 0;                   //!< Readings discarded.
+            const char *spill_path = nullptr;       //!< The spill file path, if any.
+            size_t spill_count = 0;                 //!< Readings written to the spill file.
+            size_t spill_read = 0;                  //!< Readings already removed from the spill file.
+    };
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFiClient.h>
+
+#include <vector>
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief Mirrors sensor readings from another board running `WebServerRestApi`.
+     *
+     * This is for display boards. Rather than one HTTP request per device per update, the client
+     * keeps a single connection to the other board's event stream, `/rest/events` (see
+     * `WebServerRestApi::setup_events`), and receives each new reading as it is taken. Only the
+     * sensors added with `add_sensor` are parsed, using an ArduinoJson filter; other members
+     * of the event are skipped without being stored.
+     *
+     * All work is done in `loop`, which reads whatever has arrived and returns; it never waits for
+     * the server. Only opening the connection blocks, for at most `CONNECT_TIMEOUT_MS`. A lost or
+     * refused connection is retried with a growing delay, and TCP keep-alive detects a server that
+     * has gone away without closing the connection.
+     */
+    class RemoteDevice
+    {
+        public:
+            static constexpr uint16_t DEFAULT_PORT = 80;                //!< The default server port.
+            static constexpr uint32_t CONNECT_TIMEOUT_MS = 1000;        //!< The longest `loop` waits to connect.
+            static constexpr uint32_t MIN_RETRY_MS = 2000;              //!< The first delay before reconnecting.
+            static constexpr uint32_t MAX_RETRY_MS = 60000;             //!< The longest delay before reconnecting.
+            static constexpr uint32_t IDLE_TIMEOUT_MS = 5 * 60 * 1000;  //!< Reconnect if nothing arrives for this long.
+            static constexpr size_t MAX_LINE_LENGTH = 512;              //!< The longest event line; longer lines are skipped.
+            static constexpr size_t MAX_READ_PER_LOOP = 256;            //!< The most bytes handled by one call to `loop`.
+
+            /**
+             * @brief The connection state.
+             */
+            enum class State
+            {
+                DISCONNECTED,       //!< Not connected; waiting to retry.
+                HEADERS,            //!< Connected; receiving the response headers.
+                STREAMING           //!< Receiving events.
+            };
+
+            /**
+             * @brief Construct a client.
+             *
+             * @param host      The host name or IP address of the other board; empty to not connect.
+             * @param port      The port of its web server.
+             */
+            explicit RemoteDevice(const String &host = String(), uint16_t port = DEFAULT_PORT);
+
+            /**
+             * @brief Change the server.
+             *
+             * Any current connection is closed; the new server is connected on the next `loop`.
+             *
+             * @param host      The host name or IP address of the other board; empty to not connect.
+             * @param port      The port of its web server.
+             */
+            void set_server(const String &host, uint16_t port = DEFAULT_PORT);
+
+            /**
+             * @brief Add a sensor to mirror.
+             *
+             * The name is the sensor name, as in the MQTT per-sensor topics and the REST history,
+             * e.g. `sht31d_temperature` or `pm25`.
+             *
+             * @param name      The sensor name.
+             * @return The index of the sensor, for `get_value`.
+             */
+            size_t add_sensor(const String &name);
+
+            /**
+             * @brief Read and handle what has arrived, and reconnect if needed.
+             *
+             * This is to be called from the sketch's `loop`.
+             */
+            void loop();
+
+            /**
+             * @brief Get the last value of a sensor.
+             *
+             * @param index         The sensor index from `add_sensor`.
+             * @param[out] value    Receives the value.
+             * @return `true` if a value has been received.
+             */
+            bool get_value(size_t index, float &value) const;
+
+            /**
+             * @brief Get the time since a sensor's last value was received.
+             *
+             * @param index     The sensor index from `add_sensor`.
+             * @return The age of the value, in milliseconds; `UINT32_MAX` if none has been received.
+             */
+            uint32_t get_value_age_ms(size_t index) const;
+
+            /**
+             * @brief Get the update generation.
+             *
+             * This increases by one for each event that updated any of the sensors; a display
+             * need only be redrawn when it changes.
+             *
+             * @return Update generation.
+             */
+            uint32_t get_update_generation() const
+            {
+                return update_generation;
+            }
+
+            /**
+             * @brief Get the connection state.
+             *
+             * @return Connection state.
+             */
+            State get_state() const
+            {
+                return state;
+            }
+
+            /**
+             * @brief Get the HTTP status of the last response.
+             *
+             * @return HTTP status, e.g. 404 if the server does not have the event stream; zero if there has been no response.
+             */
+            int get_http_status() const
+            {
+                return http_status;
+            }
+
+        private:
+            /**
+             * @brief A mirrored sensor.
+             */
+            struct Sensor
+            {
+                String name;                    //!< The sensor name.
+                float value = NAN;              //!< The last value.
+                uint32_t received_ms = 0;       //!< When the value was received.
+                bool available = false;         //!< Whether a value has been received.
+            };
+
+            void connect();                     //!< Open the connection and send the request.
+            void disconnect();                  //!< Close the connection and schedule a retry.
+            void handle_line();                 //!< Handle the complete line in `line`.
+            void handle_readings();             //!< Parse the readings in the `data` line in `line`.
+
+            WiFiClient client;                  //!< The connection.
+            String host;                        //!< The server host.
+            uint16_t port;                      //!< The server port.
+            State state = State::DISCONNECTED;  //!< The connection state.
+            std::vector<Sensor> sensors;        //!< The mirrored sensors.
+            DynamicJsonDocument filter{JSON_OBJECT_SIZE(0)};   //!< The sensors to parse.
+            char line[MAX_LINE_LENGTH];         //!< The line being received.
+            size_t line_length = 0;             //!< The length of `line`.
+            bool line_overflow = false;         //!< Whether the line being received is too long and is skipped.
+            bool readings_event = false;        //!< Whether the event being received is a `readings` event.
+            int http_status = 0;                //!< The HTTP status of the last response.
+            uint32_t retry_ms = MIN_RETRY_MS;   //!< The delay before the next connection attempt.
+            uint32_t disconnected_ms = 0;       //!< When the connection was closed.
+            uint32_t last_data_ms = 0;          //!< When data last arrived.
+            uint32_t update_generation = 0;     //!< Advanced by each event that updates a sensor.
+    };
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Ticker.h>
+
+#include <functional>
+#include <vector>
+
+namespace grmcdorman::device
+{
+    class Device;
+
+    /**
+     * @brief A single scheduler for all periodic and one-shot device tasks.
+     *
+     * Devices own `Task` objects, used much as a `Ticker` would be. Rather than each
+     * task arming its own timer, the scheduler holds all tasks in a min-heap ordered by
+     * deadline, and arms one `Ticker` for the earliest. When it fires, every task due within
+     * `COALESCE_MS` is run, so tasks that fall due close together share one wake-up.
+     *
+     * Callbacks always run from the main loop (via `schedule_function`), never from the timer
+     * interrupt; they may use the network, the file system, and so on.
+     *
+     * Periodic tasks are rescheduled from their previous deadline, not from when they
+     * ran, so running a task early or late does not accumulate drift.
+     */
+    class Scheduler
+    {
+        public:
+            static constexpr uint32_t COALESCE_MS = 50;     //!< Tasks due within this many milliseconds of the task being run are run with it.
+
+            /**
+             * @brief A task managed by the scheduler.
+             *
+             * The interface follows `Ticker`. A task is removed from the scheduler
+             * when it is destroyed.
+             *
+             * When built with `DEVICE_FRAMEWORK_TIMING`, the callback timings are added to
+             * the owning device's statistics.
+             */
+            class Task
+            {
+                public:
+                    typedef std::function<void()> callback_t;   //!< The task callback type.
+
+                    /**
+                     * @brief Construct a new Task object.
+                     *
+                     * @param task_owner    The device that owns the task, if any.
+                     */
+                    explicit Task(Device *task_owner = nullptr): owner(task_owner)
+                    {
+                    }
+                    Task(const Task &) = delete;
+                    Task &operator=(const Task &) = delete;
+                    /**
+                     * @brief Destroy the Task object.
+                     *
+                     * The task is detached.
+                     */
+                    ~Task()
+                    {
+                        detach();
+                    }
+
+                    /**
+                     * @brief Run a callback periodically.
+                     *
+                     * Any previous schedule is replaced. The first call is one period from now.
+                     *
+                     * @param seconds       The period, in seconds.
+                     * @param callback      The callback.
+                     */
+                    void attach(uint32_t seconds, callback_t callback)
+                    {
+                        attach_ms(seconds * 1000, std::move(callback));
+                    }
+
+                    /**
+                     * @brief Run a callback periodically.
+                     *
+                     * Any previous schedule is replaced. The first call is one period from now.
+                     *
+                     * @param milliseconds  The period, in milliseconds.
+                     * @param callback      The callback.
+                     */
+                    void attach_ms(uint32_t milliseconds, callback_t callback);
+
+                    /**
+                     * @brief Run a callback once.
+                     *
+                     * Any previous schedule is replaced.
+                     *
+                     * @param seconds       The delay, in seconds.
+                     * @param callback      The callback.
+                     */
+                    void once(uint32_t seconds, callback_t callback)
+                    {
+                        once_ms(seconds * 1000, std::move(callback));
+                    }
+
+                    /**
+                     * @brief Run a callback once.
+                     *
+                     * Any previous schedule is replaced.
+                     *
+                     * @param milliseconds  The delay, in milliseconds.
+                     * @param callback      The callback.
+                     */
+                    void once_ms(uint32_t milliseconds, callback_t callback);
+
+                    /**
+                     * @brief Stop the task.
+                     *
+                     */
+                    void detach();
+
+                    /**
+                     * @brief Get whether the task is scheduled.
+                     *
+                     * A one-shot task is not active while its callback runs.
+                     *
+                     * @return `true` if the task is waiting to run.
+                     */
+                    bool active() const
+                    {
+                        return heap_index != NOT_SCHEDULED;
+                    }
+
+                private:
+                    friend class Scheduler;
+                    static constexpr size_t NOT_SCHEDULED = SIZE_MAX;  //!< The `heap_index` of an inactive task.
+
+                    /**
+                     * @brief Schedule the task.
+                     *
+                     * @param delay_ms      Time until the first call.
+                     * @param period        The period, or zero for a one-shot task.
+                     * @param new_callback  The callback.
+                     */
+                    void schedule(uint32_t delay_ms, uint32_t period, callback_t &&new_callback);
+
+                    callback_t callback;                    //!< The callback.
+                    uint32_t period_ms = 0;                 //!< The period; zero for a one-shot task.
+                    uint32_t deadline_ms = 0;               //!< The next time to run, system time.
+                    size_t heap_index = NOT_SCHEDULED;      //!< The task's position in the heap.
+                    Device *owner;                          //!< The owning device, for timing statistics.
+            };
+
+            /**
+             * @brief Get the time until the next task is due.
+             *
+             * This is the time the system may sleep without delaying any task.
+             *
+             * @return Milliseconds until the next deadline; zero if a task is overdue,
+             *         `UINT32_MAX` if there are no tasks.
+             */
+            static uint32_t get_time_to_next_ms();
+
+            /**
+             * @brief Get the number of scheduled tasks.
+             *
+             * @return Task count.
+             */
+            static size_t get_task_count()
+            {
+                return heap.size();
+            }
+
+            /**
+             * @brief Get the number of timer wake-ups since boot.
+             *
+             * @return Wake-up count.
+             */
+            static uint32_t get_wakeup_count()
+            {
+                return wakeup_count;
+            }
+
+            /**
+             * @brief Get the number of task callbacks run since boot.
+             *
+             * The difference from the wake-up count is the number of
+             * wake-ups saved by coalescing.
+             *
+             * @return Callback count.
+             */
+            static uint32_t get_run_count()
+            {
+                return run_count;
+            }
+
+        private:
+            /**
+             * @brief Get whether one task's deadline is before another's.
+             *
+             * This allows for `millis()` wrap-around.
+             *
+             * @param first     The first task.
+             * @param second    The second task.
+             * @return `true` if the first task is due before the second.
+             */
+            static bool is_before(const Task *first, const Task *second)
+            {
+                return static_cast<int32_t>(first->deadline_ms - second->deadline_ms) < 0;
+            }
+
+            /**
+             * @brief Add a task to the heap.
+             *
+             * @param task  The task, which must not be in the heap.
+             */
+            static void add(Task *task);
+
+            /**
+             * @brief Remove a task from the heap.
+             *
+             * @param task  The task, which must be in the heap.
+             */
+            static void remove(Task *task);
+
+            /**
+             * @brief Move a heap entry towards the root until the heap is ordered.
+             *
+             * @param index     Heap index.
+             */
+            static void sift_up(size_t index);
+
+            /**
+             * @brief Move a heap entry towards the leaves until the heap is ordered.
+             *
+             * @param index     Heap index.
+             */
+            static void sift_down(size_t index);
+
+            /**
+             * @brief Place a task at a heap index.
+             *
+             * @param index     Heap index.
+             * @param task      The task.
+             */
+            static void place(size_t index, Task *task)
+            {
+                heap[index] = task;
+                task->heap_index = index;
+            }
+
+            /**
+             * @brief Arm the timer for the earliest deadline.
+             *
+             */
+            static void arm();
+
+            /**
+             * @brief Run all tasks that are due.
+             *
+             * This is called from the main loop when the timer fires.
+             */
+            static void run();
+
+            static std::vector<Task *> heap;        //!< The scheduled tasks, as a min-heap on deadline.
+            static Ticker timer;                    //!< The single timer.
+            static bool armed;                      //!< Whether the timer is armed.
+            static bool running;                    //!< Whether `run` is active; the timer is armed once it completes.
+            static uint32_t armed_deadline_ms;      //!< The deadline the timer is armed for.
+            static uint32_t wakeup_count;           //!< The number of timer wake-ups.
+            static uint32_t run_count;              //!< The number of callbacks run.
+    };
+}
@@ -23,9 +23,12 @@
 #pragma once
 
 #include <SHT31.h>
-#include <Ticker.h>
+
+#include <memory>
 
 #include "grmcdorman/device/AbstractTemperaturePressureSensor.h"
+#include "grmcdorman/device/I2cBus.h"
+#include "grmcdorman/device/Scheduler.h"
 
 namespace grmcdorman::device
 {
@@ -34,15 +37,44 @@ namespace grmcdorman::device
      *
      * The device provides humidity and temperature. Readings are published
      * as the average of all readings made since the last publish.
+     *
+     * The sensor is on the shared `I2cBus`, at up to 400 kHz, and its measurements are batched
+     * with those of other I2C devices.
+     *
+     * A sensor can be at address 0x44 or 0x45, so two may share the bus. For more than
+     * one, give each an instance number; instance 0 has the identifier `sht31_d`, and instance
+     * _n_ the identifier `sht31_d_`_n+1_, with its own MQTT sensors. All instances must be
+     * configured with the same SDA and SCL lines.
      */
     class Sht31Sensor: public AbstractTemperaturePressureSensor
     {
         public:
-            Sht31Sensor();
+            /**
+             * @brief Construct a new Sht31Sensor object.
+             *
+             * @param instance  The instance number, for more than one sensor. Odd instances default to address 0x45.
+             */
+            explicit Sht31Sensor(uint8_t instance = 0);
 
             void setup() override;
             void loop() override;
 
+            /**
+             * @brief Get the polling interval.
+             *
+             * @return The configured polling interval, in seconds.
+             */
+            uint32_t get_poll_interval() const override
+            {
+                return readInterval.get();
+            }
+
+            /**
+             * @brief Request a reading now, unless one is already in progress.
+             *
+             */
+            void request_reading() override;
+
             /**
              * @brief Get a status report.
              *
@@ -56,16 +88,80 @@ namespace grmcdorman::device
              */
             virtual String get_status() const;
 
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the readings and the age in seconds of the last reading.
+             */
+            uint32_t get_status_version() const override;
+
         private:
-            void set_timer();                   //!< Set up ticker timer.
+            /**
+             * @brief The names for the instance.
+             *
+             * These are passed to the base class before they are constructed;
+             * the base class only stores the pointers.
+             */
+            struct InstanceNames
+            {
+                /**
+                 * @brief Construct the names.
+                 *
+                 * @param instance  The instance number.
+                 */
+                explicit InstanceNames(uint8_t instance);
+
+                char name[16];                  //!< The device name.
+                char identifier[16];            //!< The device identifier.
+                char status_label[96];          //!< The `device_status` label, with the update script.
+            };
+
+            /**
+             * @brief The sensor definitions for an instance other than instance 0.
+             *
+             * The names include the instance; the other members are those of the instance 0
+             * definitions. The templates follow from the instance identifier, as for any definition.
+             * The definitions point into the name strings, so this is neither copied nor moved.
+             */
+            struct InstanceDefinitions
+            {
+                /**
+                 * @brief Construct the definitions.
+                 *
+                 * @param names     The instance names.
+                 */
+                explicit InstanceDefinitions(const InstanceNames &names);
+                InstanceDefinitions(const InstanceDefinitions &) = delete;
+                InstanceDefinitions &operator=(const InstanceDefinitions &) = delete;
+
+                char temperature_name[32];              //!< The temperature name suffix.
+                char temperature_unique_id[32];         //!< The temperature unique ID suffix.
+                char humidity_name[32];                 //!< The humidity name suffix.
+                char humidity_unique_id[32];            //!< The humidity unique ID suffix.
+                Definition temperature;                 //!< The temperature definition.
+                Definition humidity;                    //!< The humidity definition.
+            };
+
+            void set_timer();                   //!< Set up the read task.
+            void read();                        //!< Read the measurement requested by `conversion`.
 
+            InstanceNames names;                //!< The instance names.
+            std::unique_ptr<const InstanceDefinitions> instance_definitions;   //!< Definitions, for instances other than 0.
             SHT31 sht;
-            Ticker ticker;                      //!< Ticker to handle readings.
+            Scheduler::Task read_task{this};    //!< Task to handle readings.
+            I2cBus::Conversion conversion;      //!< The measurement, batched with other I2C devices.
             uint32_t current_polling_seconds = 0;//!< Current polling interval.
 
             uint32_t last_read_millis;          //!< Timestamp of last read.
-            bool requested = false;             //!< Whether a reading was requested.
             bool available = false;             //!< Whether the device is available.
+            bool bus_conflict = false;          //!< Whether the I2C bus was started on other pins.
             uint32_t statusReadPreviousMillis = 0;  // The time since the last read.
             //!< Default read interval. Chosen such that there should be 5 readings per 30 seconds.
             constexpr static uint32_t statusReadInterval = (30 / 5) * 1000;
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <ArduinoJson.h>
+#include <Print.h>
+
+#include <vector>
+
+namespace grmcdorman::device
+{
+    class Device;
+
+    /**
+     * @brief Builds and writes the state document published by `MqttPublisher`.
+     *
+     * The document has one member per enabled device with an unpublished reading,
+     * as written by `Device::publish`. When memory is low, `MemoryGovernor` limits the
+     * number of devices in one document; the others are left for a later document.
+     * The document is written straight to its destination, through a `BufferedPrint`,
+     * so that there is no copy of the payload.
+     *
+     * This is separate from `MqttPublisher` so that it can be run on the build machine,
+     * by the host benchmarks (see `test/support/bench.h`).
+     */
+    class StateDocument
+    {
+        public:
+            /**
+             * @brief What `build` added to a document.
+             */
+            struct BuildResult
+            {
+                size_t added = 0;           //!< The number of devices added.
+                bool has_reading = false;   //!< Whether any device added has taken a reading since boot.
+                bool complete = true;       //!< `false` if devices were left for a later document.
+            };
+
+            /**
+             * @brief Get the capacity for a state document.
+             *
+             * @param devices   The devices.
+             * @return `Device::JSON_DOCUMENT_CAPACITY` for each device that may be added to one document.
+             */
+            static size_t get_capacity(const std::vector<Device *> &devices);
+
+            /**
+             * @brief Add the devices with unpublished readings to a document.
+             *
+             * Each device added is marked as published.
+             *
+             * @param devices   The devices.
+             * @param json      The document; its capacity should be `get_capacity`.
+             * @return What was added.
+             */
+            static BuildResult build(const std::vector<Device *> &devices, DynamicJsonDocument &json);
+
+            /**
+             * @brief Write a document as JSON.
+             *
+             * @param json      The document.
+             * @param output    The destination.
+             * @return The number of bytes accepted by `output`; compare with `measureJson`.
+             */
+            static size_t write_json(const JsonDocument &json, Print &output);
+
+            /**
+             * @brief Write a document as MessagePack.
+             *
+             * @param json      The document.
+             * @param output    The destination.
+             * @return The number of bytes accepted by `output`; compare with `measureMsgPack`.
+             */
+            static size_t write_msgpack(const JsonDocument &json, Print &output);
+    };
+}
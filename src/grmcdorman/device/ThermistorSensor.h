@@ -68,6 +68,9 @@ namespace grmcdorman::device
      * Only the thermal index (beta) and T1 value are needed.
      *
      * When publishing to MQTT, only the last reading is published, not the average reading over the interval.
+     *
+     * The transform is computed once, in `setup`, into a lookup table; readings interpolate in the table
+     * rather than computing a logarithm.
      */
     class ThermistorSensor: public AbstractAnalog
     {
@@ -80,7 +83,7 @@ namespace grmcdorman::device
              */
             ThermistorSensor(float thermalIndex, float t1Kelvin);
 
-            DynamicJsonDocument as_json() const override;
+            bool serialize_into(JsonObject json) const override;
 
             /**
              * @brief Get a status report.
@@ -91,6 +94,13 @@ namespace grmcdorman::device
              * @return String containing status report.
              */
             virtual String get_status() const;
+
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
         protected:
             /**
              * @brief Transform the raw reading to a temperature.
@@ -101,7 +111,16 @@ namespace grmcdorman::device
              * @param reading   Raw reading.
              * @return Temperature, in degrees C.
              */
-            virtual float transform_raw_reading(int reading) override;
+            virtual float transform_raw_reading(float reading) override;
+            /**
+             * @brief Get whether to use a lookup table for `transform_raw_reading`.
+             *
+             * @return `true`; the transform depends only on the constructor parameters.
+             */
+            bool use_transform_table() const override
+            {
+                return true;
+            }
             float inverse_thermal_index;        //!< The inverse of thermal index of the thermistor.
             float inverse_t1;                   //!< The inverse of the T1 temperature of the thermistor.
             NoteSetting title;                  //!< Device tab title.
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+namespace grmcdorman::device
+{
+    /**
+     * @brief Keeps timing-sensitive activities from overlapping.
+     *
+     * Some peripherals are sensitive to interrupt latency: the DHT's bits are timed by
+     * interrupts, SoftwareSerial's bits likewise, and a network send can hold off interrupts.
+     * Before starting such an activity, a device asks how long it must wait for the others to
+     * finish. An activity that continues after the call that starts it returns, such as
+     * a DHT read or a serial message, reserves the time it will take; one that completes
+     * within a loop pass, such as an MQTT publish, need not.
+     *
+     * Everything here runs in loop context. A reservation covers only what the device
+     * can predict; it is a means to avoid collisions, not a guarantee.
+     */
+    class TimingCoordinator
+    {
+        public:
+            /**
+             * @brief An activity.
+             */
+            enum class Activity: uint8_t
+            {
+                SERIAL_FRAME,       //!< A serial message is being received, e.g. from the Vindriktning.
+                SENSOR_READ,        //!< An interrupt-timed sensor read, e.g. from the DHT.
+                NETWORK_SEND,       //!< A network send, e.g. an MQTT publish.
+                COUNT               //!< The number of activities.
+            };
+
+            /**
+             * @brief Reserve time for an activity.
+             *
+             * This replaces any earlier reservation for the activity; a zero duration
+             * ends the reservation.
+             *
+             * @param activity      The activity.
+             * @param duration_ms   The time, from now, the activity will take.
+             */
+            static void reserve(Activity activity, uint32_t duration_ms)
+            {
+                reserved_until_ms[static_cast<size_t>(activity)] = millis() + duration_ms;
+                reserved[static_cast<size_t>(activity)] = duration_ms != 0;
+            }
+
+            /**
+             * @brief Get the time until the other activities are finished.
+             *
+             * @param activity  The activity about to start; its own reservation is ignored.
+             * @return The milliseconds to wait; zero if nothing else is reserved.
+             */
+            static uint32_t get_wait_ms(Activity activity);
+
+        private:
+            static uint32_t reserved_until_ms[static_cast<size_t>(Activity::COUNT)];   //!< The end of each reservation, system time.
+            static bool reserved[static_cast<size_t>(Activity::COUNT)];                //!< Whether each activity has a reservation.
+    };
+}
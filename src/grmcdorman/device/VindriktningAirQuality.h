@@ -50,9 +50,12 @@ namespace grmcdorman::device
      * will not overflow in any reasonable publishing interval (8,589,934 readings times 20 seconds
      * is 171,798,691 seconds, over a year, which is 31,557,988 seconds).
      *
-     * When a valid reading is discovered in the received Vindriktning data, the reading is added to the sum
-     * and all buffered data up to and including the processed message is discarded. Any following
-     * data is retained.
+     * Received bytes are handed to the parser from the serial receive callback, not polled from `loop`.
+     * The parser keeps a sliding window of the last 20 bytes, and their sum; each byte costs
+     * the same, and nothing is ever rescanned. When the window starts with the header and sums to
+     * zero, it is a message: the reading is added, and the window is emptied. The numbers of good
+     * messages, of windows with a header but a bad checksum, and of good messages that followed
+     * discarded bytes (i.e. the parser resynchronized) are reported by `serialize_into` and `get_status`.
      *
      * Derived from work by Hypfer's GitHub project, https://github.com/Hypfer/esp8266-vindriktning-particle-sensor.
      * All work on message deciphering comes from that project.
@@ -65,7 +68,18 @@ namespace grmcdorman::device
             void setup() override;
             void loop() override;
             bool publish(DynamicJsonDocument &json) const override;
-            DynamicJsonDocument as_json() const override;
+            bool get_definition_value(size_t index, float &value) const override;
+            bool serialize_into(JsonObject json) const override;
+
+            /**
+             * @brief Get whether the device's state changes only with new readings.
+             *
+             * @return `true`; the state is the accumulated readings.
+             */
+            bool has_reading_generation() const override
+            {
+                return true;
+            }
 
             /**
              * @brief Get a status report.
@@ -79,6 +93,20 @@ namespace grmcdorman::device
              */
             virtual String get_status() const;
 
+            /**
+             * @brief Write the status report.
+             *
+             * @param output    Receives the status report; see `get_status`.
+             */
+            void print_status(Print &output) const override;
+
+            /**
+             * @brief Get the status version.
+             *
+             * @return A value that changes with the readings, the message counts and the age in seconds of the last reading.
+             */
+            uint32_t get_status_version() const override;
+
             /**
              * @brief Get the last PM 2.5 reading.
              *
@@ -94,32 +122,34 @@ namespace grmcdorman::device
         private:
             static constexpr uint16_t vindriktning_message_size = 20;
             /**
-             * @brief Parse the serial data and extract the reading.
+             * @brief Read the available serial data.
              *
-             * This extracts the reading from the serial data and adds it to the sum.
+             * This is the serial receive callback.
+             */
+            void receive();
+            /**
+             * @brief Add a received byte to the message window.
              *
-             * The provided data may be at some offset in the serial buffer.
-             * @param data  Data from the Vindriktning; should be 20 bytes in length.
+             * @param data  The byte.
              */
-            void parse(const uint8_t *data);
+            void add_byte(uint8_t data);
             /**
-             * @brief Verify the data checksum.
+             * @brief Get a byte of the message window.
              *
-             * Verify that the checksum in the 20-byte data is valid (i.e. sums to zero)
-             * @param data  Data from the Vindriktning; should be 20 bytes in length.
-             * @return true if the checksum is valid.
+             * @param offset    Offset from the start of the window.
+             * @return The byte.
              */
-            bool is_valid_checksum(const uint8_t *data) const;
+            uint8_t get_window_byte(uint8_t offset) const
+            {
+                uint8_t index = window_start + offset;
+                return window[index >= vindriktning_message_size ? index - vindriktning_message_size : index];
+            }
             /**
-             * @brief Find the message in read data.
+             * @brief Extract the reading from the message in the window.
              *
-             * This searches for a valid message - correct header and checksum - in
-             * the raw data read.
-             * @param data              The raw data.
-             * @param byte_count        The number of bytes read.
-             * @return A pointer to valid 20-byte message, or `nullptr` if no message can be located.
+             * This extracts the reading from the window and adds it to the accumulation.
              */
-            const uint8_t *find_message(const uint8_t *data, uint8_t byte_count) const;
+            void parse();
 
             /**
              * @brief The current device state.
@@ -128,7 +158,7 @@ namespace grmcdorman::device
             enum class State
             {
                 NEVER_READ,         //!< Never read anything.
-                NO_HEADER_FOUND,    //!< Last read didn't find a header.
+                NO_HEADER_FOUND,    //!< At least a message's worth of bytes has been discarded since the last message.
                 READ                //!< Last read succeeded.
             };
             NoteSetting title;                        //!< The title for the device tab.
@@ -140,14 +170,25 @@ namespace grmcdorman::device
             SoftwareSerial sensorSerial;                    //!< The software serial reader, used to read from the device.
             uint32_t last_read_millis = 0;                  //!< The time of the last read.
             State last_read_state = State::NEVER_READ;      //!< The last read state.
-            static constexpr uint16_t buffer_size = 2 * vindriktning_message_size;    //!< The buffer size. Do not set this high; high values need a lot of heap.
-            uint8_t buffer[buffer_size];                    //!< Read buffer.
-            uint32_t rxBufIdx = 0;                          //!< The current read index in the buffer.
+            static constexpr uint16_t buffer_size = 2 * vindriktning_message_size;    //!< The serial receive buffer size. Do not set this high; high values need a lot of heap.
+            uint8_t window[vindriktning_message_size];      //!< The last bytes received, as a ring buffer.
+            uint8_t window_start = 0;                       //!< The index in `window` of the oldest byte.
+            uint8_t window_count = 0;                       //!< The number of bytes in `window`.
+            uint8_t window_sum = 0;                         //!< The sum of the bytes in `window`, modulo 256.
+            uint16_t discarded_bytes = 0;                   //!< The number of bytes discarded since the last message; saturates.
+            uint32_t good_messages = 0;                     //!< The number of valid messages.
+            uint32_t bad_checksums = 0;                     //!< The number of windows with a valid header but an invalid checksum.
+            uint32_t resynchronized_messages = 0;           //!< The number of valid messages that followed discarded bytes.
 
             static constexpr uint8_t HEADER_BYTE_0 = 0x16;  //!< The value in the first byte of the message header.
             static constexpr uint8_t HEADER_BYTE_1 = 0x11;  //!< The value in the second byte of the message header.
             static constexpr uint8_t HEADER_BYTE_2 = 0x0B;  //!< The value in the third byte of the message header.
 
-            Accumulator<uint32_t, 5> pm25;                  //!< The PM 2.5 readings.
+            /**
+             * @brief The PM 2.5 readings.
+             *
+             * Readings are at most about 1000; 16-bit storage and 32-bit sums are ample.
+             */
+            Accumulator<uint16_t, 5, 0, 0, CompactIntegerAccumulatorPolicy<uint16_t>> pm25;
     };
 }
\ No newline at end of file
@@ -22,25 +22,52 @@
 
 #pragma once
 
+#include <memory>
+
 #include "grmcdorman/device/Device.h"
+#include "grmcdorman/device/Scheduler.h"
 
+class AsyncEventSource;
+class AsyncEventSourceClient;
 class AsyncWebServer;
 class AsyncWebServerRequest;
 
 namespace grmcdorman::device
 {
     class Device;
+    class HistoryRecorder;
 
     /**
      * @brief This class provides a REST API for the attached devices.
      *
      * This leverages the `Definitions` list in the Devices to create the API end points,
      * and the `publish` method to serve requests.
+     *
+     * Device state is streamed: each device's values are written by `serialize_into`
+     * into a single document owned by the response, which is serialized straight
+     * into the response buffers, a part at a time, and reused for the next device. At most `MAX_IN_FLIGHT_RESPONSES` device state or history responses
+     * are in progress at once; further requests are answered with status 503.
+     *
+     * Device state responses carry an `ETag` when every included device has a reading
+     * generation (see `Device::has_reading_generation`). A request with a matching
+     * `If-None-Match` header is answered with `304 Not Modified`, without building any JSON.
+     *
+     * A device state request whose `Accept` header names MessagePack (`application/msgpack`)
+     * is answered in MessagePack, with the same structure; floating-point values are then sent
+     * in binary rather than formatted as text.
+     *
+     * New readings can also be pushed to clients as server-sent events; see `setup_events`.
      */
     class WebServerRestApi
     {
     public:
+        static constexpr uint8_t MAX_IN_FLIGHT_RESPONSES = 2;  //!< The most streamed responses in progress at one time.
+        static constexpr uint8_t MAX_EVENT_SUBSCRIBERS = 4;    //!< The most connected event stream clients.
+        static constexpr uint8_t MAX_QUEUED_EVENTS = 4;        //!< Events are not queued while the average client has this many unsent.
+        static constexpr uint32_t EVENT_CHECK_INTERVAL = 250;  //!< Milliseconds over which new readings are collected into one event.
+
         WebServerRestApi();
+        ~WebServerRestApi();
         /**
          * @brief Set up with the web server.
          *
@@ -50,6 +77,7 @@ namespace grmcdorman::device
          *
          * The URIs added are:
          * - `/rest/devices/get` to return all devices
+         * - `/rest/devices/state` to return the state of all enabled devices in one response
          * - `/rest/device/`_device-id_`/get` to return values for one device
          *
          * @param server    Web server to install API on.
@@ -57,7 +85,131 @@ namespace grmcdorman::device
          */
         void setup(AsyncWebServer &server, const std::vector<Device *> &devices);
 
+        /**
+         * @brief Set up the history end point.
+         *
+         * This registers `/rest/history/get`, which returns the history recorded by
+         * a `HistoryRecorder` as described for `HistoryRecorder::Query`. The response
+         * is streamed, a part at a time, from the history files.
+         *
+         * The optional query parameters are:
+         * - `resolution`: one of `1m`, `15m` or `1h`; the default is `1m`.
+         * - `sensor`: a sensor name (see `Device::Definition::get_sensor_name`); the default is all sensors.
+         * - `from` and `to`: the range of period start times to return, in seconds since the epoch; the default is all records.
+         *
+         * An unknown resolution or sensor is answered with status 400.
+         *
+         * @param server    Web server to install API on.
+         * @param history   The history recorder. A reference is held to this; it must exist for the lifetime of this object.
+         */
+        void setup_history(AsyncWebServer &server, const HistoryRecorder &history);
+
+        /**
+         * @brief Set up the event stream end point.
+         *
+         * This registers `/rest/events`, a server-sent event stream. Each `readings` event
+         * is a JSON object with the current value of each sensor, keyed by sensor name (see
+         * `Device::Definition::get_sensor_name`); for example, `{"dht_temperature":23.6,"dht_humidity":41}`.
+         *
+         * When a client connects, it is sent the values of all sensors. After that, the sensors of
+         * each device with a new reading are sent; the `ReadingBus` signals new readings, and those
+         * within `EVENT_CHECK_INTERVAL` milliseconds of the first are sent in one event.
+         * Only enabled devices that have a reading generation (see `Device::has_reading_generation`)
+         * are included.
+         *
+         * At most `MAX_EVENT_SUBSCRIBERS` clients may be connected; further clients are disconnected.
+         * If clients are not keeping up, i.e. they have on average `MAX_QUEUED_EVENTS` or more events
+         * not yet sent, no new event is queued; the values are instead sent later, once the queues drain.
+         * Intermediate readings are thus skipped, not queued.
+         *
+         * @param server    Web server to install API on.
+         * @param devices   List of devices to push readings for. A reference is held to this; this list must exist for the lifetime of this object.
+         */
+        void setup_events(AsyncWebServer &server, const std::vector<Device *> &devices);
+
     private:
+        /**
+         * @brief Get the event text for the sensors of the selected devices.
+         *
+         * @param changed_only  If `true`, include only devices whose reading generation is not in `pushed_generations`.
+         * @return The JSON text; empty if there are no values.
+         */
+        String get_readings_event(bool changed_only) const;
+
+        /**
+         * @brief Send an event to a newly connected client.
+         *
+         * @param client    The client.
+         */
+        void handle_on_event_connect(AsyncEventSourceClient *client);
+
+        /**
+         * @brief Check for new readings, and send them to the event clients.
+         *
+         */
+        void push_readings();
+
+        /**
+         * @brief Arrange for `push_readings`, unless it is already due.
+         *
+         */
+        void schedule_push();
+
+        /**
+         * @brief Get the entity tag for the state of a list of devices.
+         *
+         * The tag combines a per-boot value with each device's identity, enabled state,
+         * and reading generation, and the encoding.
+         *
+         * @param devices   The devices.
+         * @param msgpack   Whether the response is MessagePack.
+         * @return The quoted entity tag; empty if any device has no reading generation.
+         */
+        String get_etag(const std::vector<const Device *> &devices, bool msgpack) const;
+
+        /**
+         * @brief Answer a request with 304 if the client's copy is current.
+         *
+         * @param request   Incoming web request.
+         * @param etag      The current entity tag; if empty, the request is never answered.
+         * @return `true` if the request was answered.
+         */
+        bool send_not_modified(AsyncWebServerRequest *request, const String &etag);
+
+        /**
+         * @brief Claim a slot for a streamed response.
+         *
+         * If all slots are in use, the request is answered with status 503.
+         *
+         * @param request   Incoming web request.
+         * @return `true` if a slot was claimed; it must be released with `release_response`.
+         */
+        bool claim_response(AsyncWebServerRequest *request);
+
+        /**
+         * @brief Release a slot claimed by `claim_response`.
+         *
+         */
+        void release_response()
+        {
+            --in_flight_responses;
+        }
+
+        /**
+         * @brief Handle a GET of the state of all devices.
+         *
+         * This handles the URI `/rest/devices/state`. The response contains one member per
+         * enabled device, as for the device-specific GET. The optional query parameters are:
+         * - `device`: the identifiers of the devices to include; the default is all.
+         * - `field`: the names of the fields to include, for example `average` or `last`; the default is all.
+         *
+         * Each parameter may be repeated, or may be a comma-separated list.
+         *
+         * @param request   Incoming web request.
+         * @param devices   The list of devices.
+         */
+        void handle_on_devices_state(AsyncWebServerRequest *request, const std::vector<Device *> &devices);
+
         /**
          * @brief Handle a device-specific GET.
          *
@@ -67,5 +219,14 @@ namespace grmcdorman::device
          * @param device    Device associated with URI.
          */
         void handle_on_device_get(AsyncWebServerRequest *request, const Device *device);
+
+        uint8_t in_flight_responses = 0;    //!< The number of streamed responses in progress.
+        uint32_t boot_id = 0;               //!< A random value chosen at setup, so that entity tags differ across boots.
+
+        const std::vector<Device *> *event_devices = nullptr;  //!< The devices pushed to event clients.
+        std::unique_ptr<AsyncEventSource> events;               //!< The event source; created by `setup_events`.
+        std::vector<uint32_t> pushed_generations;                //!< The reading generation last pushed, for each device.
+        uint32_t event_id = 0;                                  //!< The ID of the last event sent.
+        Scheduler::Task event_task;                             //!< Task for pushing new readings.
     };
 }
\ No newline at end of file
@@ -44,10 +44,21 @@ namespace grmcdorman::device
      * mechanisms to configure the WiFi connection without ever creating a web server.
      *
      * At present, the soft AP is not password protected.
+     *
+     * Connecting does not block: `setup` starts the connection, and `loop` follows it
+     * until it succeeds or times out. The BSSID and channel of the access point, and any
+     * DHCP lease, are cached on `LittleFS` (and kept across deep sleep; see `DutyCycle`), so
+     * that the next connection to the same SSID skips the scan. If that does not connect within
+     * `FAST_CONNECT_TIMEOUT`, a normal connection is made. Optionally, the cached lease
+     * is reused as a static configuration, which also skips DHCP; this risks an address
+     * conflict if the DHCP server has since given the address to another device.
      */
     class WifiSetup: public Device
     {
         public:
+            static constexpr uint32_t FAST_CONNECT_TIMEOUT = 5000;     //!< Milliseconds to wait for a connection to the cached access point.
+            static constexpr uint32_t SOFT_AP_DELAY = 500;             //!< Milliseconds to wait at each step of starting the Soft AP.
+
             WifiSetup();
 
             /**
@@ -58,8 +69,23 @@ namespace grmcdorman::device
             void set_defaults() override;
             void setup() override;
             void loop() override;
+
+            /**
+             * @brief Get the boot phase.
+             *
+             * The connection is started before any other device is set up.
+             *
+             * @return `BootPhase::NETWORK_START`.
+             */
+            BootPhase get_boot_phase() const override
+            {
+                return BootPhase::NETWORK_START;
+            }
+
             bool publish(DynamicJsonDocument &json) const override;
-            DynamicJsonDocument as_json() const override;
+            const __FlashStringHelper *get_publish_key() const override;
+            bool get_definition_value(size_t index, float &value) const override;
+            bool serialize_into(JsonObject json) const override;
             /**
              * @brief Get the local host name.
              *
@@ -83,8 +109,60 @@ namespace grmcdorman::device
             {
                 return false;
             }
+
+            /**
+             * @brief Save the cached access point and lease.
+             *
+             * @param buffer    Receives the state.
+             * @param size      The size of the buffer.
+             * @return The number of bytes used.
+             */
+            size_t save_retained_state(uint8_t *buffer, size_t size) override;
+
+            /**
+             * @brief Restore the cached access point and lease.
+             *
+             * @param buffer        The state.
+             * @param size          The size of the state.
+             * @param elapsed_ms    Not used.
+             */
+            void restore_retained_state(const uint8_t *buffer, size_t size, uint32_t elapsed_ms) override;
         private:
-            void connect_to_ap();                           //!< Try to connect to the configured AP.
+            /**
+             * @brief The connection state.
+             *
+             */
+            enum class State
+            {
+                CONNECTING,                                 //!< Waiting for the station connection.
+                CONNECTED,                                  //!< Connected in station mode.
+                AP_ENABLING,                                //!< Waiting after enabling the Soft AP.
+                AP_STARTING,                                //!< Waiting after starting the Soft AP.
+                SOFT_AP                                     //!< Running the Soft AP.
+            };
+
+            /**
+             * @brief The cached details of the last connection.
+             *
+             */
+            struct ConnectionCache
+            {
+                uint32_t ssid_hash;                         //!< The FNV-1a hash of the SSID the details are for.
+                uint8_t bssid[6];                           //!< The access point BSSID.
+                uint8_t channel;                            //!< The access point channel.
+                uint8_t has_lease;                          //!< Non-zero if the addresses are from a DHCP lease.
+                uint32_t ip;                                //!< The leased address.
+                uint32_t gateway;                           //!< The leased gateway address.
+                uint32_t subnet;                            //!< The leased subnet mask.
+                uint32_t dns_1;                             //!< The leased preferred DNS server.
+                uint32_t dns_2;                             //!< The leased alternative DNS server.
+            };
+
+            void connect_to_ap();                           //!< Start connecting to the configured AP.
+            void start_soft_ap();                           //!< Start the soft AP.
+            uint32_t hash_ssid() const;                     //!< Get the hash of the configured SSID.
+            void update_cache();                            //!< Update the connection cache, and its file, after connecting.
+            void load_cache();                              //!< Load the connection cache from its file.
             StringSetting hostname;                         //!< The local host name configuration.
             StringSetting ssid;                             //!< The SSID to connect to in station mode.
             PasswordSetting password;                       //!< The password for the SSID.
@@ -96,9 +174,15 @@ namespace grmcdorman::device
             StringSetting dns_1;                            //!< DNS server 1; ignored if auto_dns is true.
             StringSetting dns_2;                            //!< DNS server 2; ignored if auto_dns is true.
             UnsignedIntegerSetting connection_timeout;      //!< Station association timeout, in seconds.
+            ToggleSetting reuse_lease;                      //!< If true, reuse a cached DHCP lease as a static configuration.
             ToggleSetting publish_rssi;                     //!< If true, publish RSSI (signal quality) to MQTT.
 
             bool tried_connect_on_setup = false;            //!< If true, `setup` tried to connect to an AP.
+            State state = State::CONNECTING;                //!< The connection state.
+            uint32_t state_start_ms = 0;                    //!< When the current state was entered.
+            ConnectionCache cache{};                        //!< The details of the last connection.
+            bool cache_valid = false;                       //!< Whether `cache` is set.
+            bool fast_connect = false;                      //!< Whether the current connection attempt uses the cache.
 
             std::unique_ptr<DNSServer> dns_server;          //!< The local DNS server for Soft AP mode.
     };
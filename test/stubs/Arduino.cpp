@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+#include "native_allocator.h"
+
+namespace
+{
+    constexpr uint32_t NOMINAL_HEAP = 40 * 1024;
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    template <typename T>
+    char *unsigned_to_string(T value, char *result, int base)
+    {
+        if (base < 2 || base > 36)
+        {
+            *result = '\0';
+            return result;
+        }
+        char *p = result;
+        do
+        {
+            auto digit = static_cast<char>(value % base);
+            *p++ = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            value /= base;
+        } while (value != 0);
+        *p = '\0';
+        std::reverse(result, p);
+        return result;
+    }
+
+    template <typename T>
+    char *signed_to_string(T value, char *result, int base)
+    {
+        if (value < 0 && base == 10)
+        {
+            *result = '-';
+            unsigned_to_string(0 - static_cast<unsigned long>(value), result + 1, base);
+            return result;
+        }
+        return unsigned_to_string(static_cast<unsigned long>(value), result, base);
+    }
+}
+
+EspClass ESP;
+HardwareSerial Serial;
+
+uint32_t millis()
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+uint32_t micros()
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+}
+
+char *itoa(int value, char *result, int base)
+{
+    return signed_to_string(value, result, base);
+}
+
+char *utoa(unsigned int value, char *result, int base)
+{
+    return unsigned_to_string(value, result, base);
+}
+
+char *ltoa(long value, char *result, int base)
+{
+    return signed_to_string(value, result, base);
+}
+
+char *ultoa(unsigned long value, char *result, int base)
+{
+    return unsigned_to_string(value, result, base);
+}
+
+char *dtostrf(double number, signed char width, unsigned char prec, char *s)
+{
+    sprintf(s, "%*.*f", width, prec, number);
+    return s;
+}
+
+uint32_t EspClass::getChipId()
+{
+    return 0x00c0ffee;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    return static_cast<uint32_t>(native::cycle_count());
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    size_t used = native::get_heap_used();
+    return used < NOMINAL_HEAP ? NOMINAL_HEAP - static_cast<uint32_t>(used) : 0;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize()
+{
+    return getFreeHeap();
+}
+
+uint8_t EspClass::getHeapFragmentation()
+{
+    return 0;
+}
+
+void EspClass::restart()
+{
+    exit(0);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the ESP8266 Arduino core, providing what the portable
+ * library sources use: the pgmspace macros, `String`, `Print`/`Stream`,
+ * time, `ESP` and `Serial`. See `platformio.ini`, `[env:native]`.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "pgmspace.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+
+/**
+ * @brief Milliseconds since the program started, from the host's steady clock.
+ */
+uint32_t millis();
+
+/**
+ * @brief Microseconds since the program started, from the host's steady clock.
+ */
+uint32_t micros();
+
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+char *itoa(int value, char *result, int base);
+char *utoa(unsigned int value, char *result, int base);
+char *ltoa(long value, char *result, int base);
+char *ultoa(unsigned long value, char *result, int base);
+char *dtostrf(double number, signed char width, unsigned char prec, char *s);
+
+/**
+ * @brief Host stand-in for the ESP8266 `EspClass`.
+ *
+ * The heap figures are those of a nominal 40 KiB heap, less the bytes
+ * held through the counting allocator (see `native_allocator.h`).
+ */
+class EspClass
+{
+    public:
+        uint32_t getChipId();
+        uint32_t getCycleCount();
+        uint32_t getFreeHeap();
+        uint32_t getMaxFreeBlockSize();
+        uint8_t getHeapFragmentation();
+        void restart();
+};
+
+extern EspClass ESP;
+
+/**
+ * @brief Host stand-in for the ESP8266 UART; output goes to `stdout`, there is no input.
+ */
+class HardwareSerial: public Stream
+{
+    public:
+        void begin(unsigned long baud)
+        {
+        }
+
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t *buffer, size_t size) override;
+        using Print::write;
+
+        int available() override
+        {
+            return 0;
+        }
+
+        int read() override
+        {
+            return -1;
+        }
+
+        int peek() override
+        {
+            return -1;
+        }
+
+        void flush() override;
+};
+
+extern HardwareSerial Serial;
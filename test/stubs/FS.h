@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the ESP8266 core's `FS.h`: an in-memory file system.
+ *
+ * The file system's own storage is not counted by the counting allocator
+ * (see `native::UncountedScope`), since on the device it is in flash.
+ */
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Stream.h"
+
+namespace fs
+{
+    struct FSInfo
+    {
+        size_t totalBytes;
+        size_t usedBytes;
+        size_t blockSize;
+        size_t pageSize;
+        size_t maxOpenFiles;
+        size_t maxPathLength;
+    };
+
+    class File: public Stream
+    {
+        public:
+            typedef std::vector<uint8_t> contents_t;     //!< A file's contents.
+
+            File()
+            {
+            }
+
+            File(std::shared_ptr<contents_t> contents, bool writable, size_t position);
+            File(const File &other);
+            File &operator=(const File &other);
+            ~File();
+
+            size_t write(uint8_t c) override;
+            size_t write(const uint8_t *buffer, size_t size) override;
+            using Print::write;
+
+            int available() override;
+            int read() override;
+            int peek() override;
+            size_t read(uint8_t *buffer, size_t size);
+            size_t readBytes(char *buffer, size_t length) override;
+            using Stream::readBytes;
+
+            bool seek(uint32_t position);
+            size_t position() const;
+            size_t size() const;
+            void close();
+
+            operator bool() const
+            {
+                return contents != nullptr;
+            }
+
+        private:
+            std::shared_ptr<contents_t> contents;   //!< The file's contents; none if not open.
+            bool writable = false;                  //!< If true, opened for writing.
+            size_t offset = 0;                      //!< The read or write position.
+    };
+
+    class FS
+    {
+        public:
+            bool begin();
+            void end();
+            bool format();
+            bool info(FSInfo &info);
+
+            File open(const char *path, const char *mode);
+            File open(const String &path, const char *mode);
+            bool exists(const char *path);
+            bool exists(const String &path);
+            bool remove(const char *path);
+            bool remove(const String &path);
+            bool rename(const char *path_from, const char *path_to);
+            bool rename(const String &path_from, const String &path_to);
+
+        private:
+            typedef std::map<std::string, std::shared_ptr<File::contents_t>> files_t;
+
+            files_t files;          //!< The files, by path.
+            bool mounted = false;   //!< Set by `begin`.
+    };
+}
+
+using fs::File;
+using fs::FS;
+using fs::FSInfo;
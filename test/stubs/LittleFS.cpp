@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "LittleFS.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "native_allocator.h"
+
+fs::FS LittleFS;
+
+namespace fs
+{
+    File::File(std::shared_ptr<contents_t> contents, bool writable, size_t position):
+        contents(std::move(contents)), writable(writable), offset(position)
+    {
+    }
+
+    File::File(const File &other): contents(other.contents), writable(other.writable), offset(other.offset)
+    {
+    }
+
+    File &File::operator=(const File &other)
+    {
+        native::UncountedScope uncounted;
+        contents = other.contents;
+        writable = other.writable;
+        offset = other.offset;
+        return *this;
+    }
+
+    File::~File()
+    {
+        close();
+    }
+
+    size_t File::write(uint8_t c)
+    {
+        return write(&c, 1);
+    }
+
+    size_t File::write(const uint8_t *buffer, size_t size)
+    {
+        if (!contents || !writable)
+        {
+            return 0;
+        }
+        native::UncountedScope uncounted;
+        if (offset + size > contents->size())
+        {
+            contents->resize(offset + size);
+        }
+        memcpy(contents->data() + offset, buffer, size);
+        offset += size;
+        return size;
+    }
+
+    int File::available()
+    {
+        return contents ? static_cast<int>(contents->size() - offset) : 0;
+    }
+
+    int File::read()
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int File::peek()
+    {
+        return contents && offset < contents->size() ? (*contents)[offset] : -1;
+    }
+
+    size_t File::read(uint8_t *buffer, size_t size)
+    {
+        if (!contents)
+        {
+            return 0;
+        }
+        size_t count = std::min(size, contents->size() - offset);
+        memcpy(buffer, contents->data() + offset, count);
+        offset += count;
+        return count;
+    }
+
+    size_t File::readBytes(char *buffer, size_t length)
+    {
+        return read(reinterpret_cast<uint8_t *>(buffer), length);
+    }
+
+    bool File::seek(uint32_t position)
+    {
+        if (!contents || position > contents->size())
+        {
+            return false;
+        }
+        offset = position;
+        return true;
+    }
+
+    size_t File::position() const
+    {
+        return offset;
+    }
+
+    size_t File::size() const
+    {
+        return contents ? contents->size() : 0;
+    }
+
+    void File::close()
+    {
+        native::UncountedScope uncounted;
+        contents.reset();
+    }
+
+    bool FS::begin()
+    {
+        mounted = true;
+        return true;
+    }
+
+    void FS::end()
+    {
+        mounted = false;
+    }
+
+    bool FS::format()
+    {
+        native::UncountedScope uncounted;
+        files.clear();
+        return true;
+    }
+
+    bool FS::info(FSInfo &info)
+    {
+        size_t used = 0;
+        for (const auto &file : files)
+        {
+            used += file.second->size();
+        }
+        info = FSInfo{ 1024 * 1024, used, 8192, 256, 5, 32 };
+        return mounted;
+    }
+
+    File FS::open(const char *path, const char *mode)
+    {
+        if (!mounted)
+        {
+            return File();
+        }
+        native::UncountedScope uncounted;
+        auto existing = files.find(path);
+        switch (mode[0])
+        {
+            case 'r':
+                return existing != files.end() ? File(existing->second, mode[1] == '+', 0) : File();
+
+            case 'w':
+            {
+                auto contents = std::make_shared<File::contents_t>();
+                files[path] = contents;
+                return File(contents, true, 0);
+            }
+
+            case 'a':
+            {
+                auto &contents = files[path];
+                if (!contents)
+                {
+                    contents = std::make_shared<File::contents_t>();
+                }
+                return File(contents, true, contents->size());
+            }
+
+            default:
+                return File();
+        }
+    }
+
+    File FS::open(const String &path, const char *mode)
+    {
+        return open(path.c_str(), mode);
+    }
+
+    bool FS::exists(const char *path)
+    {
+        native::UncountedScope uncounted;
+        return mounted && files.count(path) != 0;
+    }
+
+    bool FS::exists(const String &path)
+    {
+        return exists(path.c_str());
+    }
+
+    bool FS::remove(const char *path)
+    {
+        native::UncountedScope uncounted;
+        return mounted && files.erase(path) != 0;
+    }
+
+    bool FS::remove(const String &path)
+    {
+        return remove(path.c_str());
+    }
+
+    bool FS::rename(const char *path_from, const char *path_to)
+    {
+        native::UncountedScope uncounted;
+        auto from = files.find(path_from);
+        if (!mounted || from == files.end())
+        {
+            return false;
+        }
+        // As LittleFS does, this replaces an existing file.
+        auto contents = from->second;
+        files.erase(from);
+        files[path_to] = contents;
+        return true;
+    }
+
+    bool FS::rename(const String &path_from, const String &path_to)
+    {
+        return rename(path_from.c_str(), path_to.c_str());
+    }
+}
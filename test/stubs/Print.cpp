@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "Print.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (size-- > 0 && write(*buffer++) == 1)
+    {
+        ++written;
+    }
+    return written;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+}
+
+size_t Print::print(const __FlashStringHelper *str)
+{
+    return write(reinterpret_cast<const char *>(str));
+}
+
+size_t Print::print(const String &str)
+{
+    return write(str.c_str(), str.length());
+}
+
+size_t Print::print(const char str[])
+{
+    return write(str);
+}
+
+size_t Print::print(char c)
+{
+    return write(static_cast<uint8_t>(c));
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return print(static_cast<unsigned long long>(value), base);
+}
+
+size_t Print::print(int value, int base)
+{
+    return print(static_cast<long long>(value), base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return print(static_cast<unsigned long long>(value), base);
+}
+
+size_t Print::print(long value, int base)
+{
+    return print(static_cast<long long>(value), base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return print(static_cast<unsigned long long>(value), base);
+}
+
+size_t Print::print(long long value, int base)
+{
+    if (value < 0 && base == DEC)
+    {
+        return print('-') + print(0 - static_cast<unsigned long long>(value), base);
+    }
+    return print(static_cast<unsigned long long>(value), base);
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+    char buffer[8 * sizeof(value) + 1];
+    char *end = &buffer[sizeof(buffer)];
+    char *p = end;
+    if (base < 2)
+    {
+        base = DEC;
+    }
+    do
+    {
+        auto digit = static_cast<char>(value % base);
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value != 0);
+    return write(p, end - p);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buffer[48];
+    int length = snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return length > 0 ? write(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1)) : 0;
+}
+
+size_t Print::println(const __FlashStringHelper *str)
+{
+    return print(str) + println();
+}
+
+size_t Print::println(const String &str)
+{
+    return print(str) + println();
+}
+
+size_t Print::println(const char str[])
+{
+    return print(str) + println();
+}
+
+size_t Print::println(char c)
+{
+    return print(c) + println();
+}
+
+size_t Print::println(unsigned char value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(long long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(double value, int digits)
+{
+    return print(value, digits) + println();
+}
+
+size_t Print::println()
+{
+    return write("\r\n");
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the ESP8266 core's `Print`.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print
+{
+    public:
+        virtual ~Print()
+        {
+        }
+
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size);
+
+        size_t write(const char *str)
+        {
+            return str != nullptr ? write(reinterpret_cast<const uint8_t *>(str), strlen(str)) : 0;
+        }
+
+        size_t write(const char *buffer, size_t size)
+        {
+            return write(reinterpret_cast<const uint8_t *>(buffer), size);
+        }
+
+        virtual int availableForWrite()
+        {
+            return 0;
+        }
+
+        virtual void flush()
+        {
+        }
+
+        size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+        size_t print(const __FlashStringHelper *str);
+        size_t print(const String &str);
+        size_t print(const char str[]);
+        size_t print(char c);
+        size_t print(unsigned char value, int base = DEC);
+        size_t print(int value, int base = DEC);
+        size_t print(unsigned int value, int base = DEC);
+        size_t print(long value, int base = DEC);
+        size_t print(unsigned long value, int base = DEC);
+        size_t print(long long value, int base = DEC);
+        size_t print(unsigned long long value, int base = DEC);
+        size_t print(double value, int digits = 2);
+
+        size_t println(const __FlashStringHelper *str);
+        size_t println(const String &str);
+        size_t println(const char str[]);
+        size_t println(char c);
+        size_t println(unsigned char value, int base = DEC);
+        size_t println(int value, int base = DEC);
+        size_t println(unsigned int value, int base = DEC);
+        size_t println(long value, int base = DEC);
+        size_t println(unsigned long value, int base = DEC);
+        size_t println(long long value, int base = DEC);
+        size_t println(unsigned long long value, int base = DEC);
+        size_t println(double value, int digits = 2);
+        size_t println();
+};
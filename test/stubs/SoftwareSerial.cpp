@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "SoftwareSerial.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    std::vector<SoftwareSerial *> ports;   //!< The ports that have been begun.
+}
+
+SoftwareSerial::~SoftwareSerial()
+{
+    end();
+}
+
+void SoftwareSerial::begin(uint32_t baud, SoftwareSerialConfig config, int8_t rx_pin, int8_t tx_pin, bool invert, int buffer_capacity)
+{
+    end();
+    buffer.assign(std::max(buffer_capacity, 1), 0);
+    head = 0;
+    count = 0;
+    receive_pin = rx_pin;
+    ports.push_back(this);
+}
+
+void SoftwareSerial::end()
+{
+    buffer.clear();
+    head = 0;
+    count = 0;
+    receive_pin = -1;
+    ports.erase(std::remove(ports.begin(), ports.end(), this), ports.end());
+}
+
+int SoftwareSerial::available()
+{
+    return static_cast<int>(count);
+}
+
+int SoftwareSerial::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t SoftwareSerial::read(uint8_t *data, size_t size)
+{
+    size_t read_count = std::min(size, count);
+    for (size_t i = 0; i < read_count; ++i)
+    {
+        data[i] = buffer[head];
+        head = (head + 1) % buffer.size();
+    }
+    count -= read_count;
+    return read_count;
+}
+
+int SoftwareSerial::peek()
+{
+    return count != 0 ? buffer[head] : -1;
+}
+
+size_t SoftwareSerial::write(uint8_t c)
+{
+    return 1;
+}
+
+size_t SoftwareSerial::inject(const uint8_t *data, size_t size)
+{
+    size_t accepted = std::min(size, buffer.size() - count);
+    for (size_t i = 0; i < accepted; ++i)
+    {
+        buffer[(head + count + i) % buffer.size()] = data[i];
+    }
+    count += accepted;
+    if (accepted != 0 && receive_handler)
+    {
+        receive_handler();
+    }
+    return accepted;
+}
+
+SoftwareSerial *SoftwareSerial::on_pin(int8_t rx_pin)
+{
+    auto port = std::find_if(ports.begin(), ports.end(), [rx_pin] (const SoftwareSerial *port)
+    {
+        return port->receive_pin == rx_pin;
+    });
+    return port != ports.end() ? *port : nullptr;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for EspSoftwareSerial.
+ *
+ * There is no line: a benchmark finds the port a device has begun on its
+ * receive pin (`on_pin`), and hands the bytes the sensor would have sent to
+ * `inject`, which queues them and calls the receive handler as the library
+ * does. The queue is sized by `begin`, and bytes that do not fit are
+ * dropped, as they are on the device.
+ */
+
+#include <functional>
+#include <vector>
+
+#include "Stream.h"
+
+enum SoftwareSerialConfig
+{
+    SWSERIAL_5N1 = 0,
+    SWSERIAL_6N1,
+    SWSERIAL_7N1,
+    SWSERIAL_8N1
+};
+
+class SoftwareSerial: public Stream
+{
+    public:
+        typedef std::function<void()> handler_t;    //!< The receive handler.
+
+        SoftwareSerial()
+        {
+        }
+
+        SoftwareSerial(const SoftwareSerial &) = delete;
+        SoftwareSerial &operator=(const SoftwareSerial &) = delete;
+        ~SoftwareSerial();
+
+        void begin(uint32_t baud, SoftwareSerialConfig config, int8_t rx_pin, int8_t tx_pin, bool invert, int buffer_capacity = 64);
+        void end();
+
+        void onReceive(const handler_t &handler)
+        {
+            receive_handler = handler;
+        }
+
+        int available() override;
+        int read() override;
+        size_t read(uint8_t *buffer, size_t size);
+        int peek() override;
+        size_t write(uint8_t c) override;
+        using Print::write;
+
+        /**
+         * @brief Receive bytes from the (imaginary) sensor, and call the receive handler.
+         *
+         * @param data  The bytes.
+         * @param size  The number of bytes.
+         * @return The number of bytes that fit in the receive buffer.
+         */
+        size_t inject(const uint8_t *data, size_t size);
+
+        /**
+         * @brief Find the port begun on a receive pin.
+         *
+         * @param rx_pin    The receive pin.
+         * @return The port, or `nullptr` if none has been begun on `rx_pin`.
+         */
+        static SoftwareSerial *on_pin(int8_t rx_pin);
+
+    private:
+        std::vector<uint8_t> buffer;    //!< The receive ring buffer.
+        size_t head = 0;                //!< The next byte to read.
+        size_t count = 0;               //!< Bytes in the buffer.
+        handler_t receive_handler;      //!< Called by `inject`.
+        int8_t receive_pin = -1;        //!< The receive pin; -1 if not begun.
+};
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the ESP8266 core's `Stream`.
+ */
+
+#include "Print.h"
+
+class Stream: public Print
+{
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+
+        void setTimeout(unsigned long timeout)
+        {
+        }
+
+        /**
+         * @brief Read up to `length` bytes. There is no timeout on the host: this stops when no more data is available.
+         */
+        virtual size_t readBytes(char *buffer, size_t length)
+        {
+            size_t count = 0;
+            while (count < length)
+            {
+                int c = read();
+                if (c < 0)
+                {
+                    break;
+                }
+                buffer[count++] = static_cast<char>(c);
+            }
+            return count;
+        }
+
+        size_t readBytes(uint8_t *buffer, size_t length)
+        {
+            return readBytes(reinterpret_cast<char *>(buffer), length);
+        }
+
+        String readString()
+        {
+            String result;
+            for (int c = read(); c >= 0; c = read())
+            {
+                result += static_cast<char>(c);
+            }
+            return result;
+        }
+};
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the ESP8266 core's `StreamString`: a `String` that can be printed to and read from.
+ */
+
+#include "Stream.h"
+
+class StreamString: public Stream, public String
+{
+    public:
+        size_t write(uint8_t c) override
+        {
+            return concat(static_cast<char>(c)) ? 1 : 0;
+        }
+
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            return concat(reinterpret_cast<const char *>(buffer), static_cast<unsigned int>(size)) ? size : 0;
+        }
+
+        using Print::write;
+
+        int available() override
+        {
+            return static_cast<int>(length());
+        }
+
+        int read() override
+        {
+            if (length() == 0)
+            {
+                return -1;
+            }
+            char c = charAt(0);
+            remove(0, 1);
+            return static_cast<unsigned char>(c);
+        }
+
+        int peek() override
+        {
+            return length() != 0 ? static_cast<unsigned char>(charAt(0)) : -1;
+        }
+};
@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "WString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    template <typename T>
+    String to_string(T value, unsigned char base)
+    {
+        char buffer[8 * sizeof(T) + 2];
+        char *end = &buffer[sizeof(buffer) - 1];
+        char *p = end;
+        *p = '\0';
+        bool negative = value < 0;
+        auto magnitude = negative ? 0 - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+        if (base < 2 || base > 36)
+        {
+            base = 10;
+        }
+        do
+        {
+            auto digit = magnitude % base;
+            *--p = static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+            magnitude /= base;
+        } while (magnitude != 0);
+        if (negative)
+        {
+            *--p = '-';
+        }
+        return String(p, static_cast<unsigned int>(end - p));
+    }
+
+    String to_string(double value, unsigned char decimal_places)
+    {
+        char buffer[48];
+        int length = snprintf(buffer, sizeof(buffer), "%.*f", decimal_places, value);
+        return String(buffer, length < 0 ? 0 : std::min<unsigned int>(length, sizeof(buffer) - 1));
+    }
+}
+
+String::String(const char *cstr)
+{
+    if (cstr != nullptr)
+    {
+        copy(cstr, strlen(cstr));
+    }
+}
+
+String::String(const char *cstr, unsigned int length)
+{
+    if (cstr != nullptr)
+    {
+        copy(cstr, length);
+    }
+}
+
+String::String(const String &str)
+{
+    copy(str.c_str(), str.len);
+}
+
+String::String(String &&rval) noexcept
+{
+    move(rval);
+}
+
+String::String(const __FlashStringHelper *str): String(reinterpret_cast<const char *>(str))
+{
+}
+
+String::String(char c)
+{
+    copy(&c, 1);
+}
+
+String::String(unsigned char value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(int value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(unsigned int value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(long value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(unsigned long value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(long long value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(unsigned long long value, unsigned char base): String(to_string(value, base))
+{
+}
+
+String::String(float value, unsigned char decimal_places): String(to_string(static_cast<double>(value), decimal_places))
+{
+}
+
+String::String(double value, unsigned char decimal_places): String(to_string(value, decimal_places))
+{
+}
+
+String::~String()
+{
+    invalidate();
+}
+
+String &String::operator=(const String &rhs)
+{
+    if (this != &rhs)
+    {
+        copy(rhs.c_str(), rhs.len);
+    }
+    return *this;
+}
+
+String &String::operator=(String &&rval) noexcept
+{
+    if (this != &rval)
+    {
+        move(rval);
+    }
+    return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+    if (cstr == nullptr)
+    {
+        invalidate();
+        return *this;
+    }
+    return copy(cstr, strlen(cstr));
+}
+
+String &String::operator=(const __FlashStringHelper *str)
+{
+    return *this = reinterpret_cast<const char *>(str);
+}
+
+String &String::operator=(char c)
+{
+    return copy(&c, 1);
+}
+
+void String::invalidate()
+{
+    free(heap);
+    heap = nullptr;
+    heap_capacity = 0;
+    len = 0;
+    sso[0] = '\0';
+}
+
+bool String::reserve(unsigned int size)
+{
+    if (capacity() >= size)
+    {
+        return true;
+    }
+    return change_buffer(size);
+}
+
+bool String::change_buffer(unsigned int max_length)
+{
+    if (max_length <= SSO_CAPACITY)
+    {
+        return true;
+    }
+
+    // As in the ESP8266 core: the block is rounded up to 16 bytes.
+    size_t new_size = (max_length + 16) & ~static_cast<size_t>(0xf);
+    char *new_buffer;
+    if (heap != nullptr)
+    {
+        new_buffer = static_cast<char *>(realloc(heap, new_size));
+    }
+    else
+    {
+        new_buffer = static_cast<char *>(malloc(new_size));
+        if (new_buffer != nullptr)
+        {
+            memcpy(new_buffer, sso, len + 1);
+        }
+    }
+    if (new_buffer == nullptr)
+    {
+        return false;
+    }
+    heap = new_buffer;
+    heap_capacity = static_cast<unsigned int>(new_size - 1);
+    return true;
+}
+
+String &String::copy(const char *cstr, unsigned int length)
+{
+    if (!reserve(length))
+    {
+        invalidate();
+        return *this;
+    }
+    memmove(wbuffer(), cstr, length);
+    len = length;
+    wbuffer()[len] = '\0';
+    return *this;
+}
+
+void String::move(String &rhs) noexcept
+{
+    free(heap);
+    heap = rhs.heap;
+    heap_capacity = rhs.heap_capacity;
+    len = rhs.len;
+    memcpy(sso, rhs.sso, sizeof(sso));
+    rhs.heap = nullptr;
+    rhs.heap_capacity = 0;
+    rhs.len = 0;
+    rhs.sso[0] = '\0';
+}
+
+bool String::concat(const String &str)
+{
+    if (&str == this)
+    {
+        unsigned int length = len;
+        if (!reserve(len * 2))
+        {
+            return false;
+        }
+        memcpy(wbuffer() + length, wbuffer(), length);
+        len += length;
+        wbuffer()[len] = '\0';
+        return true;
+    }
+    return concat(str.c_str(), str.len);
+}
+
+bool String::concat(const char *cstr)
+{
+    return cstr != nullptr && concat(cstr, strlen(cstr));
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+    if (cstr == nullptr)
+    {
+        return false;
+    }
+    if (length == 0)
+    {
+        return true;
+    }
+    if (!reserve(len + length))
+    {
+        return false;
+    }
+    memmove(wbuffer() + len, cstr, length);
+    len += length;
+    wbuffer()[len] = '\0';
+    return true;
+}
+
+bool String::concat(const __FlashStringHelper *str)
+{
+    return concat(reinterpret_cast<const char *>(str));
+}
+
+bool String::concat(char c)
+{
+    return concat(&c, 1);
+}
+
+bool String::concat(unsigned char value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(int value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(unsigned int value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(long value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(unsigned long value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(long long value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(unsigned long long value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(float value)
+{
+    return concat(String(value));
+}
+
+bool String::concat(double value)
+{
+    return concat(String(value));
+}
+
+int String::compareTo(const String &s) const
+{
+    return strcmp(c_str(), s.c_str());
+}
+
+bool String::equals(const String &s) const
+{
+    return len == s.len && memcmp(c_str(), s.c_str(), len) == 0;
+}
+
+bool String::equals(const char *cstr) const
+{
+    return strcmp(c_str(), cstr != nullptr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+    return len == s.len && strcasecmp(c_str(), s.c_str()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+    return prefix.len <= len && memcmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    return suffix.len <= len && memcmp(c_str() + len - suffix.len, suffix.c_str(), suffix.len) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+    return index < len ? c_str()[index] : '\0';
+}
+
+void String::setCharAt(unsigned int index, char c)
+{
+    if (index < len)
+    {
+        wbuffer()[index] = c;
+    }
+}
+
+char String::operator[](unsigned int index) const
+{
+    return charAt(index);
+}
+
+char &String::operator[](unsigned int index)
+{
+    static char dummy_writable_char;
+    if (index >= len)
+    {
+        dummy_writable_char = '\0';
+        return dummy_writable_char;
+    }
+    return wbuffer()[index];
+}
+
+int String::indexOf(char ch, unsigned int from_index) const
+{
+    if (from_index >= len)
+    {
+        return -1;
+    }
+    const char *found = static_cast<const char *>(memchr(c_str() + from_index, ch, len - from_index));
+    return found != nullptr ? static_cast<int>(found - c_str()) : -1;
+}
+
+int String::indexOf(const char *str, unsigned int from_index) const
+{
+    if (from_index >= len)
+    {
+        return -1;
+    }
+    const char *found = strstr(c_str() + from_index, str);
+    return found != nullptr ? static_cast<int>(found - c_str()) : -1;
+}
+
+int String::indexOf(const String &str, unsigned int from_index) const
+{
+    return indexOf(str.c_str(), from_index);
+}
+
+int String::lastIndexOf(char ch) const
+{
+    const char *found = strrchr(c_str(), ch);
+    return found != nullptr ? static_cast<int>(found - c_str()) : -1;
+}
+
+String String::substring(unsigned int begin_index) const
+{
+    return substring(begin_index, len);
+}
+
+String String::substring(unsigned int begin_index, unsigned int end_index) const
+{
+    if (begin_index > end_index)
+    {
+        std::swap(begin_index, end_index);
+    }
+    end_index = std::min(end_index, len);
+    if (begin_index >= end_index)
+    {
+        return String();
+    }
+    return String(c_str() + begin_index, end_index - begin_index);
+}
+
+void String::remove(unsigned int index)
+{
+    remove(index, static_cast<unsigned int>(-1));
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index >= len)
+    {
+        return;
+    }
+    count = std::min(count, len - index);
+    memmove(wbuffer() + index, wbuffer() + index + count, len - index - count);
+    len -= count;
+    wbuffer()[len] = '\0';
+}
+
+void String::toLowerCase()
+{
+    for (char &c : *this)
+    {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+}
+
+void String::toUpperCase()
+{
+    for (char &c : *this)
+    {
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    }
+}
+
+void String::trim()
+{
+    unsigned int begin_index = 0;
+    while (begin_index < len && isspace(static_cast<unsigned char>(c_str()[begin_index])))
+    {
+        ++begin_index;
+    }
+    unsigned int end_index = len;
+    while (end_index > begin_index && isspace(static_cast<unsigned char>(c_str()[end_index - 1])))
+    {
+        --end_index;
+    }
+    remove(end_index);
+    remove(0, begin_index);
+}
+
+long String::toInt() const
+{
+    return strtol(c_str(), nullptr, 10);
+}
+
+float String::toFloat() const
+{
+    return strtof(c_str(), nullptr);
+}
+
+double String::toDouble() const
+{
+    return strtod(c_str(), nullptr);
+}
+
+StringSumHelper operator+(const String &lhs, const String &rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const String &lhs, const char *rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const String &lhs, const __FlashStringHelper *rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const String &lhs, char rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const char *lhs, const String &rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const __FlashStringHelper *lhs, const String &rhs)
+{
+    StringSumHelper result(reinterpret_cast<const char *>(lhs));
+    result.concat(rhs);
+    return result;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the ESP8266 core's `String`.
+ *
+ * This follows the core's allocation behaviour, since that is what the
+ * benchmarks measure: strings of up to `SSO_CAPACITY` characters are held
+ * in the object itself, and longer ones in a heap block sized to the length
+ * rounded up to 16 bytes, grown with `realloc` as needed.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pgmspace.h"
+
+class String
+{
+    public:
+        static constexpr unsigned int SSO_CAPACITY = 11;   //!< Characters held without a heap block, as on the ESP8266.
+
+        String()
+        {
+        }
+        String(const char *cstr);
+        String(const char *cstr, unsigned int length);
+        String(const String &str);
+        String(String &&rval) noexcept;
+        String(const __FlashStringHelper *str);
+        explicit String(char c);
+        explicit String(unsigned char value, unsigned char base = 10);
+        explicit String(int value, unsigned char base = 10);
+        explicit String(unsigned int value, unsigned char base = 10);
+        explicit String(long value, unsigned char base = 10);
+        explicit String(unsigned long value, unsigned char base = 10);
+        explicit String(long long value, unsigned char base = 10);
+        explicit String(unsigned long long value, unsigned char base = 10);
+        explicit String(float value, unsigned char decimal_places = 2);
+        explicit String(double value, unsigned char decimal_places = 2);
+        ~String();
+
+        String &operator=(const String &rhs);
+        String &operator=(String &&rval) noexcept;
+        String &operator=(const char *cstr);
+        String &operator=(const __FlashStringHelper *str);
+        String &operator=(char c);
+
+        bool reserve(unsigned int size);
+
+        unsigned int length() const
+        {
+            return len;
+        }
+
+        bool isEmpty() const
+        {
+            return len == 0;
+        }
+
+        const char *c_str() const
+        {
+            return heap != nullptr ? heap : sso;
+        }
+
+        char *begin()
+        {
+            return wbuffer();
+        }
+
+        char *end()
+        {
+            return wbuffer() + len;
+        }
+
+        const char *begin() const
+        {
+            return c_str();
+        }
+
+        const char *end() const
+        {
+            return c_str() + len;
+        }
+
+        bool concat(const String &str);
+        bool concat(const char *cstr);
+        bool concat(const char *cstr, unsigned int length);
+        bool concat(const __FlashStringHelper *str);
+        bool concat(char c);
+        bool concat(unsigned char value);
+        bool concat(int value);
+        bool concat(unsigned int value);
+        bool concat(long value);
+        bool concat(unsigned long value);
+        bool concat(long long value);
+        bool concat(unsigned long long value);
+        bool concat(float value);
+        bool concat(double value);
+
+        template <typename T>
+        String &operator+=(const T &rhs)
+        {
+            concat(rhs);
+            return *this;
+        }
+
+        String &operator+=(const char *cstr)
+        {
+            concat(cstr);
+            return *this;
+        }
+
+        String &operator+=(const __FlashStringHelper *str)
+        {
+            concat(str);
+            return *this;
+        }
+
+        int compareTo(const String &s) const;
+        bool equals(const String &s) const;
+        bool equals(const char *cstr) const;
+        bool equalsIgnoreCase(const String &s) const;
+
+        bool operator==(const String &rhs) const
+        {
+            return equals(rhs);
+        }
+
+        bool operator==(const char *cstr) const
+        {
+            return equals(cstr);
+        }
+
+        bool operator!=(const String &rhs) const
+        {
+            return !equals(rhs);
+        }
+
+        bool operator!=(const char *cstr) const
+        {
+            return !equals(cstr);
+        }
+
+        bool operator<(const String &rhs) const
+        {
+            return compareTo(rhs) < 0;
+        }
+
+        bool operator>(const String &rhs) const
+        {
+            return compareTo(rhs) > 0;
+        }
+
+        bool startsWith(const String &prefix) const;
+        bool endsWith(const String &suffix) const;
+
+        char charAt(unsigned int index) const;
+        void setCharAt(unsigned int index, char c);
+        char operator[](unsigned int index) const;
+        char &operator[](unsigned int index);
+
+        int indexOf(char ch, unsigned int from_index = 0) const;
+        int indexOf(const char *str, unsigned int from_index = 0) const;
+        int indexOf(const String &str, unsigned int from_index = 0) const;
+        int lastIndexOf(char ch) const;
+
+        String substring(unsigned int begin_index) const;
+        String substring(unsigned int begin_index, unsigned int end_index) const;
+
+        void remove(unsigned int index);
+        void remove(unsigned int index, unsigned int count);
+        void toLowerCase();
+        void toUpperCase();
+        void trim();
+
+        long toInt() const;
+        float toFloat() const;
+        double toDouble() const;
+
+    protected:
+        unsigned int capacity() const
+        {
+            return heap != nullptr ? heap_capacity : SSO_CAPACITY;
+        }
+
+        char *wbuffer()
+        {
+            return heap != nullptr ? heap : sso;
+        }
+
+        void invalidate();
+        bool change_buffer(unsigned int max_length);
+        String &copy(const char *cstr, unsigned int length);
+        void move(String &rhs) noexcept;
+
+    private:
+        char sso[SSO_CAPACITY + 1] = {};    //!< The in-object buffer.
+        char *heap = nullptr;               //!< The heap buffer, if the string has outgrown `sso`.
+        unsigned int heap_capacity = 0;     //!< Characters `heap` can hold, excluding the terminator.
+        unsigned int len = 0;               //!< The string length.
+};
+
+/**
+ * @brief The result of `operator+`, as in the core.
+ */
+class StringSumHelper: public String
+{
+    public:
+        StringSumHelper(const String &s): String(s)
+        {
+        }
+
+        StringSumHelper(String &&s): String(static_cast<String &&>(s))
+        {
+        }
+
+        StringSumHelper(const char *p): String(p)
+        {
+        }
+};
+
+StringSumHelper operator+(const String &lhs, const String &rhs);
+StringSumHelper operator+(const String &lhs, const char *rhs);
+StringSumHelper operator+(const String &lhs, const __FlashStringHelper *rhs);
+StringSumHelper operator+(const String &lhs, char rhs);
+StringSumHelper operator+(const char *lhs, const String &rhs);
+StringSumHelper operator+(const __FlashStringHelper *lhs, const String &rhs);
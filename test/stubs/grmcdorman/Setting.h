@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * Host stand-in for the esp8266_web_settings setting classes.
+ *
+ * Only the value-holding part is here - name, persistence, and conversion
+ * to and from strings - since there is no web server on the host. Values
+ * are held in `String`, as the library does, so the allocations match.
+ */
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+namespace grmcdorman
+{
+    class SettingInterface
+    {
+        public:
+            typedef std::vector<SettingInterface *> settings_list_t;    //!< A list of settings.
+
+            SettingInterface(const __FlashStringHelper *description, const __FlashStringHelper *name):
+                setting_description(description), setting_name(name)
+            {
+            }
+
+            virtual ~SettingInterface()
+            {
+            }
+
+            const __FlashStringHelper *description() const
+            {
+                return setting_description;
+            }
+
+            const __FlashStringHelper *name() const
+            {
+                return setting_name;
+            }
+
+            virtual bool is_persistable() const
+            {
+                return true;
+            }
+
+            virtual String as_string() const = 0;
+            virtual bool set_from_string(const String &value) = 0;
+
+        private:
+            const __FlashStringHelper *setting_description;
+            const __FlashStringHelper *setting_name;
+    };
+
+    /**
+     * @brief Display-only settings: not persisted, and not settable from a string.
+     */
+    class DisplaySetting: public SettingInterface
+    {
+        public:
+            using SettingInterface::SettingInterface;
+
+            bool is_persistable() const override
+            {
+                return false;
+            }
+
+            bool set_from_string(const String &value) override
+            {
+                return false;
+            }
+    };
+
+    class NoteSetting: public DisplaySetting
+    {
+        public:
+            explicit NoteSetting(const __FlashStringHelper *text): DisplaySetting(text, F(""))
+            {
+            }
+
+            String as_string() const override
+            {
+                return String(description());
+            }
+    };
+
+    class InfoSettingHtml: public DisplaySetting
+    {
+        public:
+            typedef std::function<void(const InfoSettingHtml &)> request_callback_t;   //!< Called before the value is sent.
+
+            using DisplaySetting::DisplaySetting;
+
+            void set(const String &new_value)
+            {
+                value = new_value;
+            }
+
+            void set(const __FlashStringHelper *new_value)
+            {
+                value = new_value;
+            }
+
+            const String &get() const
+            {
+                return value;
+            }
+
+            void set_request_callback(const request_callback_t &callback)
+            {
+                request_callback = callback;
+            }
+
+            String as_string() const override
+            {
+                if (request_callback)
+                {
+                    request_callback(*this);
+                }
+                return value;
+            }
+
+        private:
+            mutable String value;
+            request_callback_t request_callback;
+    };
+
+    typedef InfoSettingHtml InfoSetting;
+
+    class StringSetting: public SettingInterface
+    {
+        public:
+            using SettingInterface::SettingInterface;
+
+            void set(const String &new_value)
+            {
+                value = new_value;
+            }
+
+            const String &get() const
+            {
+                return value;
+            }
+
+            String as_string() const override
+            {
+                return value;
+            }
+
+            bool set_from_string(const String &new_value) override
+            {
+                value = new_value;
+                return true;
+            }
+
+        private:
+            String value;
+    };
+
+    class PasswordSetting: public StringSetting
+    {
+        public:
+            using StringSetting::StringSetting;
+    };
+
+    class UnsignedIntegerSetting: public SettingInterface
+    {
+        public:
+            using SettingInterface::SettingInterface;
+
+            void set(uint32_t new_value)
+            {
+                value = new_value;
+            }
+
+            uint32_t get() const
+            {
+                return value;
+            }
+
+            String as_string() const override
+            {
+                return String(value);
+            }
+
+            bool set_from_string(const String &new_value) override
+            {
+                value = strtoul(new_value.c_str(), nullptr, 10);
+                return true;
+            }
+
+        private:
+            uint32_t value = 0;
+    };
+
+    class SignedIntegerSetting: public SettingInterface
+    {
+        public:
+            using SettingInterface::SettingInterface;
+
+            void set(int32_t new_value)
+            {
+                value = new_value;
+            }
+
+            int32_t get() const
+            {
+                return value;
+            }
+
+            String as_string() const override
+            {
+                return String(value);
+            }
+
+            bool set_from_string(const String &new_value) override
+            {
+                value = new_value.toInt();
+                return true;
+            }
+
+        private:
+            int32_t value = 0;
+    };
+
+    class FloatSetting: public SettingInterface
+    {
+        public:
+            using SettingInterface::SettingInterface;
+
+            void set(float new_value)
+            {
+                value = new_value;
+            }
+
+            float get() const
+            {
+                return value;
+            }
+
+            String as_string() const override
+            {
+                return String(value, 6);
+            }
+
+            bool set_from_string(const String &new_value) override
+            {
+                value = new_value.toFloat();
+                return true;
+            }
+
+        private:
+            float value = 0;
+    };
+
+    class ToggleSetting: public SettingInterface
+    {
+        public:
+            using SettingInterface::SettingInterface;
+
+            void set(bool new_value)
+            {
+                value = new_value;
+            }
+
+            bool get() const
+            {
+                return value;
+            }
+
+            String as_string() const override
+            {
+                return value ? String(F("true")) : String(F("false"));
+            }
+
+            bool set_from_string(const String &new_value) override
+            {
+                value = new_value == "true" || new_value == "1" || new_value == "on";
+                return true;
+            }
+
+        private:
+            bool value = false;
+    };
+
+    class ExclusiveOptionSetting: public SettingInterface
+    {
+        public:
+            typedef std::vector<const __FlashStringHelper *> names_list_t;    //!< The option names.
+
+            ExclusiveOptionSetting(const __FlashStringHelper *description, const __FlashStringHelper *name, const names_list_t &names):
+                SettingInterface(description, name), names(names)
+            {
+            }
+
+            void set(int new_value)
+            {
+                value = new_value;
+            }
+
+            int get() const
+            {
+                return value;
+            }
+
+            String as_string() const override
+            {
+                return String(value);
+            }
+
+            bool set_from_string(const String &new_value) override
+            {
+                for (size_t i = 0; i < names.size(); ++i)
+                {
+                    if (strcmp_P(new_value.c_str(), reinterpret_cast<const char *>(names[i])) == 0)
+                    {
+                        value = static_cast<int>(i);
+                        return true;
+                    }
+                }
+                value = new_value.toInt();
+                return true;
+            }
+
+        private:
+            const names_list_t &names;
+            int value = 0;
+    };
+}
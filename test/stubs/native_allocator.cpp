@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "native_allocator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *pointer, size_t size);
+    void __real_free(void *pointer);
+}
+
+namespace
+{
+    constexpr uint32_t BLOCK_MAGIC = 0x4e41544bu;
+
+    /**
+     * @brief Precedes each block; 16 bytes, so that the caller's pointer keeps `malloc`'s alignment.
+     */
+    struct alignas(16) BlockHeader
+    {
+        size_t size;        //!< The caller's size.
+        uint32_t magic;     //!< `BLOCK_MAGIC`; anything else is a block from the unwrapped C library.
+        uint32_t counted;   //!< Nonzero if the block is in `live_bytes`.
+    };
+
+    static_assert(sizeof(BlockHeader) == 16, "The block header must preserve 16-byte alignment");
+
+    native::AllocationStats stats;
+    size_t base_bytes = 0;      //!< `live_bytes` at the last reset.
+    size_t heap_used = 0;
+    int uncounted_depth = 0;
+
+    BlockHeader *header_of(void *pointer)
+    {
+        return reinterpret_cast<BlockHeader *>(static_cast<char *>(pointer) - sizeof(BlockHeader));
+    }
+
+    void *allocate(size_t size)
+    {
+        auto header = static_cast<BlockHeader *>(__real_malloc(sizeof(BlockHeader) + size));
+        if (header == nullptr)
+        {
+            return nullptr;
+        }
+        header->size = size;
+        header->magic = BLOCK_MAGIC;
+        header->counted = uncounted_depth == 0;
+        heap_used += size;
+        if (header->counted)
+        {
+            ++stats.allocations;
+            stats.live_bytes += size;
+            if (stats.live_bytes > base_bytes)
+            {
+                stats.peak_bytes = std::max(stats.peak_bytes, stats.live_bytes - base_bytes);
+            }
+        }
+        return header + 1;
+    }
+
+    void release(void *pointer)
+    {
+        if (pointer == nullptr)
+        {
+            return;
+        }
+        BlockHeader *header = header_of(pointer);
+        if (header->magic != BLOCK_MAGIC)
+        {
+            __real_free(pointer);
+            return;
+        }
+        heap_used -= header->size;
+        if (header->counted)
+        {
+            ++stats.frees;
+            stats.live_bytes -= header->size;
+        }
+        header->magic = 0;
+        __real_free(header);
+    }
+
+    void *reallocate(void *pointer, size_t size)
+    {
+        if (pointer == nullptr)
+        {
+            return allocate(size);
+        }
+        if (size == 0)
+        {
+            release(pointer);
+            return nullptr;
+        }
+        BlockHeader *header = header_of(pointer);
+        if (header->magic != BLOCK_MAGIC)
+        {
+            return __real_realloc(pointer, size);
+        }
+        void *new_pointer = allocate(size);
+        if (new_pointer != nullptr)
+        {
+            memcpy(new_pointer, pointer, std::min(size, header->size));
+            release(pointer);
+        }
+        return new_pointer;
+    }
+}
+
+extern "C"
+{
+    void *__wrap_malloc(size_t size)
+    {
+        return allocate(size);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        void *pointer = allocate(count * size);
+        if (pointer != nullptr)
+        {
+            memset(pointer, 0, count * size);
+        }
+        return pointer;
+    }
+
+    void *__wrap_realloc(void *pointer, size_t size)
+    {
+        return reallocate(pointer, size);
+    }
+
+    void __wrap_free(void *pointer)
+    {
+        release(pointer);
+    }
+}
+
+void *operator new(size_t size)
+{
+    void *pointer = allocate(size);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    release(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    release(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    release(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    release(pointer);
+}
+
+namespace native
+{
+    void reset_allocation_stats()
+    {
+        stats.allocations = 0;
+        stats.frees = 0;
+        stats.peak_bytes = 0;
+        base_bytes = stats.live_bytes;
+    }
+
+    AllocationStats get_allocation_stats()
+    {
+        return stats;
+    }
+
+    size_t get_heap_used()
+    {
+        return heap_used;
+    }
+
+    UncountedScope::UncountedScope()
+    {
+        ++uncounted_depth;
+    }
+
+    UncountedScope::~UncountedScope()
+    {
+        --uncounted_depth;
+    }
+
+    uint64_t cycle_count()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t value;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+        return value;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/*
+ * The counting allocator used by the host benchmarks.
+ *
+ * `malloc`, `calloc`, `realloc` and `free` are wrapped at link time
+ * (`-Wl,--wrap=...` in `[env:native]`) and the global `operator new` and
+ * `operator delete` are replaced, so that every heap block the library
+ * makes - `String`, `std::vector`, `std::function`, ArduinoJson documents -
+ * is counted. Each block carries a small header recording its size.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace native
+{
+    /**
+     * @brief Heap activity since the last `reset_allocation_stats`.
+     */
+    struct AllocationStats
+    {
+        size_t allocations = 0;     //!< Blocks allocated, including by `realloc`.
+        size_t frees = 0;           //!< Blocks released.
+        size_t live_bytes = 0;      //!< Bytes held now, in counted blocks.
+        size_t peak_bytes = 0;      //!< Largest number of bytes held above the level at the reset.
+    };
+
+    /**
+     * @brief Start a new measurement: zero the counts, and take the bytes held now as the peak's base.
+     */
+    void reset_allocation_stats();
+
+    /**
+     * @brief Get the heap activity since the last `reset_allocation_stats`.
+     */
+    AllocationStats get_allocation_stats();
+
+    /**
+     * @brief Get the bytes held in all blocks, counted or not.
+     */
+    size_t get_heap_used();
+
+    /**
+     * @brief Excludes the allocations made while it exists from the counts.
+     *
+     * The host stubs use this for their own bookkeeping - the in-memory file
+     * system, the serial receive queue - which has no equivalent on the device.
+     * Blocks made in scope are also not counted when they are released.
+     */
+    class UncountedScope
+    {
+        public:
+            UncountedScope();
+            ~UncountedScope();
+            UncountedScope(const UncountedScope &) = delete;
+            UncountedScope &operator=(const UncountedScope &) = delete;
+    };
+
+    /**
+     * @brief Read the host's cycle counter (`rdtsc`, `cntvct_el0`, or the steady clock in nanoseconds).
+     */
+    uint64_t cycle_count();
+}
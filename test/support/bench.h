@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "native_allocator.h"
+
+/**
+ * @brief The host benchmark harness.
+ *
+ * A benchmark runs an operation a number of times and reports, per operation,
+ * the host cycles and heap allocations, and over the whole run the peak bytes
+ * held above the level at the start. Each figure is checked against the
+ * threshold for the operation in `bench_thresholds.h`; the test fails if any
+ * is exceeded.
+ *
+ * Cycles are host cycles, not ESP8266 cycles. They catch a change in the
+ * amount of work; the allocation figures are the same as on the device.
+ */
+namespace bench
+{
+    /**
+     * @brief What a benchmark measured, or the most it may measure.
+     */
+    struct Result
+    {
+        uint32_t cycles;        //!< Host cycles per operation.
+        uint32_t allocations;   //!< Heap allocations per operation, rounded up.
+        uint32_t peak_bytes;    //!< Peak heap bytes over the run.
+    };
+
+    typedef Result Threshold;   //!< The most a benchmark may measure.
+
+    /**
+     * @brief Keep the compiler from discarding a value that is computed only to be measured.
+     *
+     * @param value The value.
+     */
+    template <typename T>
+    inline void keep(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    /**
+     * @brief Run an operation and measure it.
+     *
+     * @param iterations    The number of times to run `operation`.
+     * @param operation     The operation; called with the iteration number.
+     * @return The measurements.
+     */
+    template <typename Operation>
+    Result measure(uint32_t iterations, Operation &&operation)
+    {
+        native::reset_allocation_stats();
+        uint64_t start = native::cycle_count();
+        for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+        {
+            operation(iteration);
+        }
+        uint64_t elapsed = native::cycle_count() - start;
+        auto stats = native::get_allocation_stats();
+
+        return Result
+        {
+            static_cast<uint32_t>(elapsed / iterations),
+            static_cast<uint32_t>((stats.allocations + iterations - 1) / iterations),
+            static_cast<uint32_t>(stats.peak_bytes)
+        };
+    }
+
+    /**
+     * @brief Print a benchmark's measurements, and fail the test if they exceed its threshold.
+     *
+     * @param name      The benchmark name.
+     * @param result    The measurements.
+     * @param threshold The threshold.
+     */
+    inline void check(const char *name, const Result &result, const Threshold &threshold)
+    {
+        printf("%-36s %10" PRIu32 " cycles/op %6" PRIu32 " allocs/op %8" PRIu32 " peak bytes\n",
+            name, result.cycles, result.allocations, result.peak_bytes);
+
+        char message[80];
+        snprintf(message, sizeof(message), "%s: cycles", name);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(threshold.cycles, result.cycles, message);
+        snprintf(message, sizeof(message), "%s: allocations", name);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(threshold.allocations, result.allocations, message);
+        snprintf(message, sizeof(message), "%s: peak bytes", name);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(threshold.peak_bytes, result.peak_bytes, message);
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "grmcdorman/device/Accumulator.h"
+#include "grmcdorman/device/Device.h"
+
+namespace bench
+{
+    /**
+     * @brief A temperature and humidity device, for the configuration and publishing benchmarks.
+     *
+     * Its settings are a typical mix: a title and status, which are not saved,
+     * and strings of both short and long values, numbers, a toggle and a pin choice.
+     */
+    class BenchDevice: public ::grmcdorman::device::Device
+    {
+        public:
+            BenchDevice(const __FlashStringHelper *name, const __FlashStringHelper *identifier):
+                Device(name, identifier),
+                title(F("<h2>Benchmark device</h2>")),
+                server(F("Server address"), F("server")),
+                port(F("Server port"), F("port")),
+                username(F("User name"), F("username")),
+                offset(F("Temperature offset"), F("offset")),
+                fahrenheit(F("Report in Fahrenheit"), F("fahrenheit")),
+                data_pin(F("Data pin"), F("data_pin"), data_line_names),
+                device_status(F("Status"), F("device_status"))
+            {
+                initialize({&temperature_definition, &humidity_definition},
+                    {&title, &server, &port, &username, &offset, &fahrenheit, &data_pin, &device_status, &enabled});
+
+                server.set(F("sensors.home.example.net"));
+                port.set(1883);
+                username.set(F("sensor"));
+                offset.set(-0.5f);
+                data_pin.set(dataline_to_index(D3));
+            }
+
+            void setup() override
+            {
+            }
+
+            void loop() override
+            {
+            }
+
+            bool publish(DynamicJsonDocument &json) const override
+            {
+                if (!is_enabled())
+                {
+                    return false;
+                }
+
+                return serialize_into(json.createNestedObject(get_publish_key()));
+            }
+
+            bool serialize_into(JsonObject json) const override
+            {
+                json[F("enabled")] = is_enabled();
+                temperature.serialize_into(json.createNestedObject(F("temperature")));
+                humidity.serialize_into(json.createNestedObject(F("humidity")));
+                return true;
+            }
+
+            /**
+             * @brief Record a reading, as a sensor's `loop` would.
+             *
+             * @param new_temperature   The temperature.
+             * @param new_humidity      The humidity.
+             */
+            void record(float new_temperature, float new_humidity)
+            {
+                temperature.new_reading(new_temperature);
+                humidity.new_reading(new_humidity);
+                clear_is_published();
+            }
+
+            /**
+             * @brief Change a saved setting, so that the next save writes the file.
+             *
+             * @param new_port  The new port.
+             */
+            void set_port(uint32_t new_port)
+            {
+                port.set(new_port);
+            }
+
+        private:
+            static constexpr Definition temperature_definition
+            {
+                " Temperature", "_temperature", "°C", "mdi:thermometer",
+                "temperature", Definition::Layout::ACCUMULATOR, nullptr, 1.0f
+            };
+            static constexpr Definition humidity_definition
+            {
+                " Humidity", "_humidity", "%", "mdi:water-percent",
+                "humidity", Definition::Layout::ACCUMULATOR, nullptr, 1.0f
+            };
+
+            ::grmcdorman::NoteSetting title;
+            ::grmcdorman::StringSetting server;
+            ::grmcdorman::UnsignedIntegerSetting port;
+            ::grmcdorman::StringSetting username;
+            ::grmcdorman::FloatSetting offset;
+            ::grmcdorman::ToggleSetting fahrenheit;
+            ::grmcdorman::ExclusiveOptionSetting data_pin;
+            ::grmcdorman::InfoSettingHtml device_status;
+            ::grmcdorman::device::Accumulator<float, 5> temperature;
+            ::grmcdorman::device::Accumulator<float, 5> humidity;
+    };
+}
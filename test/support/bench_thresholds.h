@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "bench.h"
+
+/**
+ * @brief The checked-in limits for the host benchmarks; see `bench.h`.
+ *
+ * Each is `{ cycles per operation, allocations per operation, peak bytes }`.
+ *
+ * Where the code measured does not depend on ArduinoJson - the accumulators, the
+ * Vindriktning parser and `ConfigFile`'s binary file - the allocation and peak figures
+ * are those of a run of these suites built with g++ against the stubs, so that a new
+ * allocation on those paths fails. Lower them when an allocation is removed. The host
+ * has 8-byte pointers, so the peak for a container of pointers is about twice that on
+ * the ESP8266. The cycle limits for those paths are several times that run's cycles,
+ * so that a slower runner does not fail.
+ *
+ * The state document limits have not yet been measured with the ArduinoJson library:
+ * the one allocation of `StateDocument::get_capacity` bytes is how `DynamicJsonDocument`
+ * allocates, and the cycle limits are estimates of the library's cost. Set them from the
+ * first `pio test -e native` run.
+ */
+namespace bench::thresholds
+{
+    // Accumulator: no allocation.
+    constexpr Threshold FLOAT_NEW_READING{ 2000, 0, 0 };
+    constexpr Threshold FLOAT_GET_CURRENT_AVERAGE{ 2000, 0, 0 };
+    constexpr Threshold COMPACT_NEW_READING{ 2000, 0, 0 };
+    constexpr Threshold COMPACT_GET_CURRENT_AVERAGE{ 2000, 0, 0 };
+
+    // Vindriktning, per 20-byte message including the serial receive callback: no allocation.
+    constexpr Threshold CLEAN_FRAME{ 10000, 0, 0 };
+    constexpr Threshold SPLIT_FRAME{ 12000, 0, 0 };
+    constexpr Threshold RESYNCHRONIZED_FRAME{ 12000, 0, 0 };
+    constexpr Threshold BAD_CHECKSUM_FRAME{ 10000, 0, 0 };
+
+    // ConfigFile, for four devices of seven saved settings each. Values of more than
+    // `String::SSO_CAPACITY` characters, and the temporary file name, are heap blocks.
+    constexpr Threshold SAVE_CHANGED{ 250000, 9, 48 };
+    constexpr Threshold SAVE_UNCHANGED{ 100000, 4, 32 };
+    constexpr Threshold LOAD{ 250000, 16, 1536 };
+
+    // The MQTT state document, built by `StateDocument` and written to a stand-in for the client:
+    // one block, of `Device::JSON_DOCUMENT_CAPACITY` per device. The cycles include `measureJson`
+    // (or `measureMsgPack`), which serializes the document a second time.
+    constexpr Threshold STATE_DOCUMENT{ 250000, 1, 4096 };
+    constexpr Threshold STATE_DOCUMENT_MSGPACK{ 200000, 1, 4096 };
+    constexpr Threshold STATE_DOCUMENT_ONE{ 80000, 1, 4096 };
+}
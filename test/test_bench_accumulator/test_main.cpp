@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <unity.h>
+
+#include "bench.h"
+#include "bench_thresholds.h"
+#include "grmcdorman/device/Accumulator.h"
+
+using grmcdorman::device::Accumulator;
+using grmcdorman::device::CompactIntegerAccumulatorPolicy;
+
+namespace
+{
+    constexpr uint32_t ITERATIONS = 100000;
+
+    // As AbstractTemperaturePressureSensor and VindriktningAirQuality use them.
+    typedef Accumulator<float, 5> FloatAccumulator;
+    typedef Accumulator<uint16_t, 5, 0, 0, CompactIntegerAccumulatorPolicy<uint16_t>> CompactAccumulator;
+
+    void test_float_new_reading()
+    {
+        FloatAccumulator accumulator;
+        auto result = bench::measure(ITERATIONS, [&accumulator] (uint32_t iteration)
+        {
+            accumulator.new_reading(20.0f + (iteration % 64) * 0.125f);
+        });
+        bench::keep(accumulator.get_current_average());
+        bench::check("float new_reading", result, bench::thresholds::FLOAT_NEW_READING);
+    }
+
+    void test_float_get_current_average()
+    {
+        FloatAccumulator accumulator;
+        auto result = bench::measure(ITERATIONS, [&accumulator] (uint32_t iteration)
+        {
+            accumulator.new_reading(20.0f + (iteration % 64) * 0.125f);
+            bench::keep(accumulator.get_current_average());
+        });
+        bench::check("float new_reading + average", result, bench::thresholds::FLOAT_GET_CURRENT_AVERAGE);
+    }
+
+    void test_compact_new_reading()
+    {
+        CompactAccumulator accumulator;
+        auto result = bench::measure(ITERATIONS, [&accumulator] (uint32_t iteration)
+        {
+            accumulator.new_reading(static_cast<uint16_t>(iteration % 500));
+        });
+        bench::keep(accumulator.get_current_average());
+        bench::check("compact new_reading", result, bench::thresholds::COMPACT_NEW_READING);
+    }
+
+    void test_compact_get_current_average()
+    {
+        CompactAccumulator accumulator;
+        auto result = bench::measure(ITERATIONS, [&accumulator] (uint32_t iteration)
+        {
+            accumulator.new_reading(static_cast<uint16_t>(iteration % 500));
+            bench::keep(accumulator.get_current_average());
+        });
+        bench::check("compact new_reading + average", result, bench::thresholds::COMPACT_GET_CURRENT_AVERAGE);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_float_new_reading);
+    RUN_TEST(test_float_get_current_average);
+    RUN_TEST(test_compact_new_reading);
+    RUN_TEST(test_compact_get_current_average);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <unity.h>
+
+#include <LittleFS.h>
+
+#include <vector>
+
+#include "bench.h"
+#include "bench_device.h"
+#include "bench_thresholds.h"
+#include "grmcdorman/device/ConfigFile.h"
+
+using grmcdorman::device::ConfigFile;
+using grmcdorman::device::Device;
+
+namespace
+{
+    constexpr uint32_t ITERATIONS = 1000;
+
+    /**
+     * @brief The devices whose settings are saved and loaded: as many as a typical sketch has.
+     */
+    struct Fixture
+    {
+        Fixture():
+            first(F("First"), F("first")),
+            second(F("Second"), F("second")),
+            third(F("Third"), F("third")),
+            fourth(F("Fourth"), F("fourth")),
+            devices{ &first, &second, &third, &fourth }
+        {
+            LittleFS.format();
+            TEST_ASSERT_TRUE(ConfigFile::mount());
+        }
+
+        bench::BenchDevice first;
+        bench::BenchDevice second;
+        bench::BenchDevice third;
+        bench::BenchDevice fourth;
+        std::vector<Device *> devices;
+    };
+
+    void test_save_changed()
+    {
+        Fixture fixture;
+        ConfigFile config;
+
+        auto result = bench::measure(ITERATIONS, [&fixture, &config] (uint32_t iteration)
+        {
+            fixture.first.set_port(1000 + iteration);
+            config.save(fixture.devices);
+        });
+
+        TEST_ASSERT_TRUE(LittleFS.exists(config.get_binary_path()));
+        bench::check("save, changed", result, bench::thresholds::SAVE_CHANGED);
+    }
+
+    void test_save_unchanged()
+    {
+        Fixture fixture;
+        ConfigFile config;
+        config.save(fixture.devices);
+
+        auto result = bench::measure(ITERATIONS, [&fixture, &config] (uint32_t)
+        {
+            config.save(fixture.devices);
+        });
+
+        bench::check("save, unchanged", result, bench::thresholds::SAVE_UNCHANGED);
+    }
+
+    void test_load()
+    {
+        Fixture fixture;
+        ConfigFile config;
+        fixture.third.set_port(8883);
+        config.save(fixture.devices);
+        fixture.third.set_port(0);
+
+        auto result = bench::measure(ITERATIONS, [&fixture, &config] (uint32_t)
+        {
+            TEST_ASSERT_TRUE(config.load(fixture.devices));
+        });
+
+        TEST_ASSERT_EQUAL_STRING("8883", fixture.third.get(String(F("port"))).c_str());
+        bench::check("load", result, bench::thresholds::LOAD);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_save_changed);
+    RUN_TEST(test_save_unchanged);
+    RUN_TEST(test_load);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <unity.h>
+
+#include <vector>
+
+#include "bench.h"
+#include "bench_device.h"
+#include "bench_thresholds.h"
+#include "grmcdorman/device/StateDocument.h"
+
+using grmcdorman::device::Device;
+using grmcdorman::device::StateDocument;
+
+namespace
+{
+    constexpr uint32_t ITERATIONS = 1000;
+
+    /**
+     * @brief Stands in for the MQTT client: accepts and counts the payload bytes.
+     */
+    class ClientPrint: public Print
+    {
+        public:
+            size_t write(uint8_t c) override
+            {
+                return write(&c, 1);
+            }
+
+            size_t write(const uint8_t *data, size_t size) override
+            {
+                bench::keep(data);
+                written += size;
+                return size;
+            }
+
+            size_t get_written() const
+            {
+                return written;
+            }
+
+        private:
+            size_t written = 0;
+    };
+
+    /**
+     * @brief Build and send the state document, as `MqttPublisher::publish` and `publish_json`
+     * or `publish_msgpack` do.
+     *
+     * @param devices   The devices.
+     * @param msgpack   If true, send MessagePack; otherwise JSON.
+     * @return The payload length, if the devices were all added, the document did not overflow,
+     *         and the bytes sent match the measured length; otherwise zero.
+     */
+    size_t publish(const std::vector<Device *> &devices, bool msgpack = false)
+    {
+        DynamicJsonDocument state_json(StateDocument::get_capacity(devices));
+        auto built = StateDocument::build(devices, state_json);
+
+        ClientPrint client;
+        size_t length = msgpack ? measureMsgPack(state_json) : measureJson(state_json);
+        size_t written = msgpack ? StateDocument::write_msgpack(state_json, client) : StateDocument::write_json(state_json, client);
+        bool sent = built.complete && !state_json.overflowed() && written == length && client.get_written() == length;
+        return sent ? length : 0;
+    }
+
+    struct Fixture
+    {
+        Fixture():
+            first(F("First"), F("first")),
+            second(F("Second"), F("second")),
+            third(F("Third"), F("third")),
+            fourth(F("Fourth"), F("fourth")),
+            devices{ &first, &second, &third, &fourth }
+        {
+        }
+
+        /**
+         * @brief Give every device a new reading, so that each is published.
+         *
+         * @param iteration The iteration; varies the readings.
+         */
+        void record(uint32_t iteration)
+        {
+            float step = (iteration % 16) * 0.25f;
+            first.record(20.0f + step, 40.0f + step);
+            second.record(21.0f + step, 45.0f - step);
+            third.record(-4.0f - step, 80.0f + step);
+            fourth.record(18.5f + step, 55.0f);
+        }
+
+        bench::BenchDevice first;
+        bench::BenchDevice second;
+        bench::BenchDevice third;
+        bench::BenchDevice fourth;
+        std::vector<Device *> devices;
+    };
+
+    void test_publish_all()
+    {
+        Fixture fixture;
+
+        size_t length = 0;
+        auto result = bench::measure(ITERATIONS, [&fixture, &length] (uint32_t iteration)
+        {
+            fixture.record(iteration);
+            length = publish(fixture.devices);
+        });
+
+        TEST_ASSERT_NOT_EQUAL(0, length);
+        bench::check("state document, 4 devices", result, bench::thresholds::STATE_DOCUMENT);
+    }
+
+    void test_publish_all_msgpack()
+    {
+        Fixture fixture;
+
+        size_t length = 0;
+        auto result = bench::measure(ITERATIONS, [&fixture, &length] (uint32_t iteration)
+        {
+            fixture.record(iteration);
+            length = publish(fixture.devices, true);
+        });
+
+        TEST_ASSERT_NOT_EQUAL(0, length);
+        bench::check("state MessagePack, 4 devices", result, bench::thresholds::STATE_DOCUMENT_MSGPACK);
+    }
+
+    void test_publish_one()
+    {
+        // Usually only one device has a new reading when the publish interval ends.
+        Fixture fixture;
+        fixture.record(0);
+        publish(fixture.devices);
+
+        size_t length = 0;
+        auto result = bench::measure(ITERATIONS, [&fixture, &length] (uint32_t iteration)
+        {
+            fixture.second.record(21.0f + (iteration % 16) * 0.25f, 45.0f);
+            length = publish(fixture.devices);
+        });
+
+        TEST_ASSERT_NOT_EQUAL(0, length);
+        bench::check("state document, 1 of 4 devices", result, bench::thresholds::STATE_DOCUMENT_ONE);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_publish_all);
+    RUN_TEST(test_publish_all_msgpack);
+    RUN_TEST(test_publish_one);
+    return UNITY_END();
+}
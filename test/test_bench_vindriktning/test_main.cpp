@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2021, 2022 G. R. McDorman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <unity.h>
+
+#include <SoftwareSerial.h>
+
+#include <vector>
+
+#include "bench.h"
+#include "bench_thresholds.h"
+#include "grmcdorman/device/VindriktningAirQuality.h"
+
+using grmcdorman::device::Device;
+using grmcdorman::device::VindriktningAirQuality;
+
+namespace
+{
+    constexpr uint32_t ITERATIONS = 10000;
+    constexpr size_t FRAME_SIZE = 20;
+
+    /**
+     * @brief Make a sensor message.
+     *
+     * @param pm25          The PM 2.5 reading.
+     * @param good_checksum If false, the bytes do not sum to zero.
+     * @return The message.
+     */
+    std::vector<uint8_t> make_frame(uint16_t pm25, bool good_checksum = true)
+    {
+        std::vector<uint8_t> frame(FRAME_SIZE, 0);
+        frame[0] = 0x16;
+        frame[1] = 0x11;
+        frame[2] = 0x0B;
+        frame[5] = static_cast<uint8_t>(pm25 >> 8);
+        frame[6] = static_cast<uint8_t>(pm25 & 0xff);
+        frame[12] = 0x03;
+        frame[15] = 0x10;
+        uint8_t sum = 0;
+        for (size_t index = 0; index < FRAME_SIZE - 1; ++index)
+        {
+            sum += frame[index];
+        }
+        frame[FRAME_SIZE - 1] = static_cast<uint8_t>(0x100 - sum + (good_checksum ? 0 : 1));
+        return frame;
+    }
+
+    /**
+     * @brief Set up a sensor, and find the port it reads.
+     *
+     * @param sensor    The sensor.
+     * @return The port; the benchmark sends the sensor's messages to it.
+     */
+    SoftwareSerial &begin(VindriktningAirQuality &sensor)
+    {
+        sensor.set_enabled(true);
+        sensor.setup();
+        SoftwareSerial *port = SoftwareSerial::on_pin(Device::D2);
+        TEST_ASSERT_NOT_NULL(port);
+        return *port;
+    }
+
+    void test_clean_frames()
+    {
+        VindriktningAirQuality sensor;
+        SoftwareSerial &port = begin(sensor);
+        auto frame = make_frame(42);
+
+        auto result = bench::measure(ITERATIONS, [&port, &frame] (uint32_t)
+        {
+            port.inject(frame.data(), frame.size());
+        });
+
+        TEST_ASSERT_EQUAL_UINT32(ITERATIONS, sensor.get_reading_generation());
+        TEST_ASSERT_EQUAL_UINT16(42, sensor.get_pm25());
+        bench::check("clean frame", result, bench::thresholds::CLEAN_FRAME);
+    }
+
+    void test_split_frames()
+    {
+        // The serial library delivers bytes as they arrive; a message is often split.
+        VindriktningAirQuality sensor;
+        SoftwareSerial &port = begin(sensor);
+        auto frame = make_frame(137);
+
+        auto result = bench::measure(ITERATIONS, [&port, &frame] (uint32_t)
+        {
+            port.inject(frame.data(), 7);
+            port.inject(frame.data() + 7, 6);
+            port.inject(frame.data() + 13, frame.size() - 13);
+        });
+
+        TEST_ASSERT_EQUAL_UINT32(ITERATIONS, sensor.get_reading_generation());
+        TEST_ASSERT_EQUAL_UINT16(137, sensor.get_pm25());
+        bench::check("split frame", result, bench::thresholds::SPLIT_FRAME);
+    }
+
+    void test_resynchronized_frames()
+    {
+        // Line noise before each message: the parser slides past it.
+        VindriktningAirQuality sensor;
+        SoftwareSerial &port = begin(sensor);
+        std::vector<uint8_t> stream{ 0x00, 0xff, 0x16, 0x11, 0x42, 0x0B, 0x16 };
+        auto frame = make_frame(9);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+
+        auto result = bench::measure(ITERATIONS, [&port, &stream] (uint32_t)
+        {
+            port.inject(stream.data(), stream.size());
+        });
+
+        TEST_ASSERT_EQUAL_UINT32(ITERATIONS, sensor.get_reading_generation());
+        TEST_ASSERT_EQUAL_UINT16(9, sensor.get_pm25());
+        bench::check("resynchronized frame", result, bench::thresholds::RESYNCHRONIZED_FRAME);
+    }
+
+    void test_bad_checksums()
+    {
+        VindriktningAirQuality sensor;
+        SoftwareSerial &port = begin(sensor);
+        auto frame = make_frame(500, false);
+
+        auto result = bench::measure(ITERATIONS, [&port, &frame] (uint32_t)
+        {
+            port.inject(frame.data(), frame.size());
+        });
+
+        TEST_ASSERT_EQUAL_UINT32(0, sensor.get_reading_generation());
+        bench::check("bad checksum frame", result, bench::thresholds::BAD_CHECKSUM_FRAME);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_frames);
+    RUN_TEST(test_split_frames);
+    RUN_TEST(test_resynchronized_frames);
+    RUN_TEST(test_bad_checksums);
+    return UNITY_END();
+}